@@ -28,29 +28,7 @@
 
 namespace Duel
 {
-    static unsigned leavesTested;
-
-    static bool intersects( const Vector2<>& center, float r, const Vector2<>& min, const Vector2<>& max )
-    {
-        // http://stackoverflow.com/questions/401847/circle-rectangle-collision-detection-intersection
-
-        const Vector2<> halfRect = ( max - min ) / 2.0f;
-        const Vector2<> circleDistance = ( min + halfRect - center ).fabs();
-
-        if ( circleDistance.x > halfRect.x + r )
-            return false;
-
-        if ( circleDistance.y > halfRect.y + r )
-            return false;
-
-        if ( circleDistance.x <= halfRect.x )
-            return true;
-
-        if ( circleDistance.y <= halfRect.y )
-            return true;
-
-        return pow( ( circleDistance.x - halfRect.x ), 2 ) + pow( ( circleDistance.y - halfRect.y ), 2 ) <= pow( r, 2 );
-    }
+    static unsigned segmentsHit;
 
     GameScene::GameScene( IEngine* sg, Map* map, IGameServer* server, TcpSocket* socket )
             : sg( sg ), playerSpawned( false ), player( nullptr ), map( map ), server( server ), socket( socket )
@@ -108,36 +86,28 @@ namespace Duel
     {
     }
 
-    void GameScene::collideNode( const Ct2Node* node, Movement& movement )
+    void GameScene::collide( Movement& movement )
     {
-        if ( !node->lines.isEmpty() )
-            leavesTested++;
-
-        iterate2 ( i, node->lines )
-        {
-            const Ct2Line& line = i;
+        Ct2Tree::Query query;
+        query.centre = movement.newPos;
+        query.radius = movement.r;
 
-            const Vector2<> posProj = ( movement.newPos - line.a )  * line.normalize;
+        uint32_t firstHit, numHits;
 
-            float t = line.dir.dot( posProj );
+        collisionHits.clear();
+        segmentsHit += ctree2->queryCircles( &query, 1, collisionHits, &firstHit, &numHits );
 
-            if ( t < 0.0f )
-                t = 0.0f;
-            else if ( t > 1.0f )
-                t = 1.0f;
+        // Each slide moves the circle, so re-check the remaining candidates against the new position
+        for ( uint32_t i = firstHit; i < firstHit + numHits; i++ )
+        {
+            const Ct2Line& line = ctree2->lines[collisionHits[i]];
 
-            if ( ( line.a + line.length * t - movement.newPos ).getLength() < movement.r )
+            if ( Ct2Tree::touches( line, movement.newPos, movement.r ) )
             {
                 movement.vec = line.dir * movement.vec.dot( line.dir );
                 movement.recalc();
             }
         }
-
-        for ( int i = 0; i < 2; i++ )
-        {
-            if ( node->children[i] != nullptr && intersects( movement.newPos, movement.r, node->children[i]->bounds[0], node->children[i]->bounds[1] ) )
-                collideNode( node->children[i], movement );
-        }
     }
 
     void GameScene::onFrameBegin()
@@ -179,7 +149,7 @@ namespace Duel
         if ( drawCollisions )
         {
             graphicsDriver->setRenderFlag( RenderFlag::depthTest, false );
-            renderCtree2Node( ctree2, 1, maxDepth, numLeaves );
+            renderCtree2( maxDepth, numLeaves );
             graphicsDriver->setRenderFlag( RenderFlag::depthTest, true );
         }
 
@@ -191,10 +161,10 @@ namespace Duel
             if ( osdFont == nullptr )
                 osdFont = resMgr->getFont( "Common/Fonts/DejaVuSans.ttf", 14, IFont::bold );
 
-            osdFont->drawString( viewport.getXy().convert<float>() - Vector2<>( 20.0f, 20.0f ), ( String ) "ctree depth = " + maxDepth + "; " + numLeaves + " leaves (" + leavesTested + " tested)",
+            osdFont->drawString( viewport.getXy().convert<float>() - Vector2<>( 20.0f, 20.0f ), ( String ) "ctree depth = " + maxDepth + "; " + numLeaves + " leaves (" + segmentsHit + " segments hit)",
                     Colour::green(), IFont::right | IFont::bottom );
 
-            leavesTested = 0;
+            segmentsHit = 0;
         }
     }
 
@@ -230,7 +200,7 @@ namespace Duel
         movement.recalc();
 
         if ( ctree2 != nullptr && !noclip )
-            collideNode( ctree2, movement );
+            collide( movement );
 
         vec = movement.vec * movement.speed;
 
@@ -411,33 +381,44 @@ namespace Duel
         }
     }
 
-    void GameScene::renderCtree2Node( const Ct2Node* node, unsigned depth, unsigned& maxDepth, size_t& numLeaves )
+    void GameScene::renderCtree2( unsigned& maxDepth, size_t& numLeaves )
     {
-        if ( depth > maxDepth )
-            maxDepth = depth;
-
-        graphicsDriver->drawRectangleOutline( node->bounds[0], node->bounds[1] - node->bounds[0], Colour( 0.0f, 1.0f, 0.0f, 0.2f ), nullptr );
-
-        if ( !node->lines.isEmpty() )
-            numLeaves++;
+        // ends of the subtrees enclosing the current node, innermost last
+        List<uint32_t> enclosing;
 
         Vector<> mouseProj;
+        const bool haveMouse = graphicsDriver->unproject( mouse, mouseProj );
 
-        if ( graphicsDriver->unproject( mouse, mouseProj ) && !( mouseProj.getXy() < node->bounds[0] || mouseProj.getXy() > node->bounds[1] ) )
+        for ( size_t i = 0; i < ctree2->nodes.getLength(); i++ )
         {
-            Colour colour = node->lines.isEmpty() ? Colour::white( 0.05f ) : Colour( 0.0f, 0.0f, 1.0f, 0.25f );
+            const Ct2Tree::Node& node = ctree2->nodes[i];
 
-            graphicsDriver->drawRectangle( node->bounds[0], node->bounds[1] - node->bounds[0], colour, nullptr );
-        }
+            while ( !enclosing.isEmpty() && enclosing[enclosing.getLength() - 1] <= i )
+                enclosing.remove( enclosing.getLength() - 1 );
+
+            const unsigned depth = enclosing.getLength() + 1;
+
+            if ( depth > maxDepth )
+                maxDepth = depth;
 
-        iterate2 ( i, node->lines )
-            graphicsDriver->drawLine( (*i).a, (*i).b, Colour( 1.0f, 0.0f, 0.0f, 0.5f ) );
+            graphicsDriver->drawRectangleOutline( node.bounds[0], node.bounds[1] - node.bounds[0], Colour( 0.0f, 1.0f, 0.0f, 0.2f ), nullptr );
 
-        if ( node->children[0] )
-            renderCtree2Node( node->children[0], depth + 1, maxDepth, numLeaves );
+            if ( node.numLines > 0 )
+                numLeaves++;
 
-        if ( node->children[1] )
-            renderCtree2Node( node->children[1], depth + 1, maxDepth, numLeaves );
+            if ( haveMouse && !( mouseProj.getXy() < node.bounds[0] || mouseProj.getXy() > node.bounds[1] ) )
+            {
+                Colour colour = ( node.numLines == 0 ) ? Colour::white( 0.05f ) : Colour( 0.0f, 0.0f, 1.0f, 0.25f );
+
+                graphicsDriver->drawRectangle( node.bounds[0], node.bounds[1] - node.bounds[0], colour, nullptr );
+            }
+
+            for ( uint32_t j = node.firstLine; j < node.firstLine + node.numLines; j++ )
+                graphicsDriver->drawLine( ctree2->lines[j].a, ctree2->lines[j].b, Colour( 1.0f, 0.0f, 0.0f, 0.5f ) );
+
+            if ( ctree2->hasChildren( i ) )
+                enclosing.add( node.next );
+        }
     }
 
     void GameScene::spawnEntity( bool localplayer, uint16_t entId, String name, const Vector<>& pos )
@@ -102,7 +102,8 @@ namespace Duel
         Vector<unsigned> viewport;
 
         // World
-        Object<Ct2Node> ctree2;
+        Object<Ct2Tree> ctree2;
+        List<uint32_t> collisionHits;
 
         // MP
         bool playerSpawned;
@@ -126,9 +127,9 @@ namespace Duel
         bool drawCollisions, noclip;
         Vector2<float> mouse;
 
-        void collideNode( const Ct2Node* node, Movement& movement );
+        void collide( Movement& movement );
         void playerMove( Vector2<> vec, float delta );
-        void renderCtree2Node( const Ct2Node* node, unsigned depth, unsigned& maxDepth, size_t& numLeaves );
+        void renderCtree2( unsigned& maxDepth, size_t& numLeaves );
         void spawnEntity( bool localplayer, uint16_t entId, String name, const Vector<>& pos );
 
         void processIncoming();
@@ -27,6 +27,15 @@
 
 #include <littl/Console.hpp>
 
+#ifdef Duel_epoll_server
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace Duel
 {
     BotEnt::BotEnt( GameServerThread* thread, EntId entId )
@@ -115,8 +124,195 @@ namespace Duel
         return q;
     }
 
+#ifdef Duel_epoll_server
+    // Clients that can't keep up with this much pending output get dropped
+    static const size_t maxPendingOutput = 0x100000;
+
+    static const size_t receiveChunkSize = 0x1000;
+    static const int maxEventsPerWait = 256;
+
+    RemotePlayerEnt::RemotePlayerEnt( GameServerThread* thread, EntId entId, int fd )
+            : entId( entId ), spawned( false ), thread( thread ), hasSaidHello( false ), fd( fd ),
+            inLength( 0 ), outBegin( 0 ), outLength( 0 ),
+            waitingForWrite( false ), queuedForFlush( false ), disconnected( false )
+    {
+    }
+
+    RemotePlayerEnt::~RemotePlayerEnt()
+    {
+        close( fd );
+    }
+
+    void RemotePlayerEnt::bufferRaw( const void* data, size_t length )
+    {
+        if ( disconnected )
+            return;
+
+        if ( outLength - outBegin + length > maxPendingOutput )
+        {
+            printf( "%s: too much pending output, dropping.\n", name.c_str() );
+            disconnected = true;
+            return;
+        }
+
+        // Reclaim the already sent part of the buffer
+        if ( outBegin > 0 )
+        {
+            memmove( outBuffer.getPtr(), outBuffer.getPtr() + outBegin, outLength - outBegin );
+            outLength -= outBegin;
+            outBegin = 0;
+        }
+
+        if ( outLength + length > outBuffer.getCapacity() )
+            outBuffer.resize( outLength + length, true );
+
+        memcpy( outBuffer.getPtr() + outLength, data, length );
+        outLength += length;
+
+        thread->queueFlush( this );
+    }
+
+    void RemotePlayerEnt::flush()
+    {
+        while ( outBegin < outLength && !disconnected )
+        {
+            ssize_t sent = send( fd, outBuffer.getPtr() + outBegin, outLength - outBegin, MSG_NOSIGNAL );
+
+            if ( sent > 0 )
+                outBegin += sent;
+            else if ( sent < 0 && errno == EINTR )
+                continue;
+            else if ( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            {
+                // Resume once the socket becomes writable again
+                if ( !waitingForWrite )
+                    thread->setWriteInterest( this, true );
+
+                return;
+            }
+            else
+                disconnected = true;
+        }
+
+        outBegin = 0;
+        outLength = 0;
+
+        if ( waitingForWrite )
+            thread->setWriteInterest( this, false );
+    }
+
+    void RemotePlayerEnt::init()
+    {
+        ArrayIOStream prewelcome;
+
+        prewelcome.writeString( "Storm.Sandbox" );
+        prewelcome.writeString( thread->engine->getVariableValue( "map_name", true ) );
+        prewelcome.write<int16_t>( 0 );
+        prewelcome.write<int16_t>( 8 );
+
+        // Same packet framing as TcpSocket::send(), the client picks this up with TcpSocket::receive()
+        const uint32_t length = ( uint32_t ) prewelcome.getSize();
+
+        bufferRaw( &length, sizeof( length ) );
+        bufferRaw( prewelcome.getPtr(), prewelcome.getSize() );
+    }
+
+    bool RemotePlayerEnt::receive()
+    {
+        // Drain the socket
+        for ( ; ; )
+        {
+            if ( inLength + receiveChunkSize > inBuffer.getCapacity() )
+                inBuffer.resize( inLength + receiveChunkSize, true );
+
+            ssize_t count = recv( fd, inBuffer.getPtr() + inLength, inBuffer.getCapacity() - inLength, 0 );
+
+            if ( count > 0 )
+                inLength += count;
+            else if ( count == 0 )
+                return false;
+            else if ( errno == EINTR )
+                continue;
+            else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                break;
+            else
+                return false;
+        }
+
+        // Parse all complete messages
+        const uint8_t* data = inBuffer.getPtr();
+        size_t pos = 0;
+
+        for ( ; ; )
+        {
+            const size_t available = inLength - pos;
+
+            if ( !hasSaidHello )
+            {
+                JoinHeader message;
+
+                if ( available < sizeof( message ) )
+                    break;
+
+                memcpy( &message, data + pos, sizeof( message ) );
+
+                if ( message.type != MSG_JOIN )
+                    return false;
+
+                if ( available < sizeof( message ) + message.nameLength )
+                    break;
+
+                onJoin( ( const char* ) data + pos + sizeof( message ), message.nameLength );
+                pos += sizeof( message ) + message.nameLength;
+            }
+            else
+            {
+                MsgType msgType;
+
+                if ( available < sizeof( msgType ) )
+                    break;
+
+                memcpy( &msgType, data + pos, sizeof( msgType ) );
+
+                if ( msgType == MSG_PLAYER_MOVE )
+                {
+                    PlayerMoveMessage message;
+
+                    if ( available < sizeof( message ) )
+                        break;
+
+                    memcpy( &message, data + pos, sizeof( message ) );
+                    onPlayerMove( message );
+                    pos += sizeof( message );
+                }
+                else
+                    return false;
+            }
+        }
+
+        // Keep the incomplete tail
+        memmove( inBuffer.getPtr(), inBuffer.getPtr() + pos, inLength - pos );
+        inLength -= pos;
+
+        return !disconnected;
+    }
+
+    void RemotePlayerEnt::spawnAt( const Vector<>& pos )
+    {
+        this->pos = pos;
+        spawned = true;
+
+        PlayerSpawnMessage message = { MSG_PLAYER_SPAWN, entId, pos.x, pos.y, pos.z };
+        bufferMessage( message );
+    }
+
+    void RemotePlayerEnt::update()
+    {
+        // Incoming data is processed by receive() as soon as it arrives
+    }
+#else
     RemotePlayerEnt::RemotePlayerEnt( GameServerThread* thread, EntId entId, TcpSocket* socket )
-            : entId( entId ), spawned( false ), thread( thread ), socket( socket ), hasSaidHello( false )
+            : entId( entId ), spawned( false ), thread( thread ), hasSaidHello( false ), socket( socket )
     {
     }
 
@@ -176,15 +372,7 @@ namespace Duel
                     receiveBuffer.resize( totalLength, true );
 
                     if ( socket->read( *receiveBuffer, totalLength, 0, false ) )
-                    {
-                        name.set( ( const char* ) receiveBuffer.getPtr( sizeof( message ) ), message.nameLength );
-
-                        printf( "%s connected.\n", name.c_str() );
-
-                        hasSaidHello = true;
-
-                        thread->readyToSpawn( this );
-                    }
+                        onJoin( ( const char* ) receiveBuffer.getPtr( sizeof( message ) ), message.nameLength );
                 }
                 else
                 {
@@ -208,23 +396,7 @@ namespace Duel
                         if ( !socket->read( &message, sizeof( message ), 0, false ) )
                             break;
 
-                        // Broadcast locally
-                        LocalEvent ev;
-                        ev.type = EventType::entMovement;
-                        ev.data.entMovement.entId = entId;
-                        ev.data.entMovement.x = message.x;
-                        ev.data.entMovement.y = message.y;
-                        ev.data.entMovement.z = message.z;
-                        thread->broadcastLocal( nullptr, ev );
-
-                        // Broadcast remote
-                        EntMoveMessage movement = { MSG_ENT_MOVE, entId, message.x, message.y, message.z };
-                        thread->broadcastRemote( this, &movement, sizeof( movement ) );
-
-                        // Update self
-                        pos.x += message.x;
-                        pos.y += message.y;
-                        pos.z += message.z;
+                        onPlayerMove( message );
                         break;
                     }
 
@@ -234,6 +406,39 @@ namespace Duel
             }
         }
     }
+#endif
+
+    void RemotePlayerEnt::onJoin( const char* name, size_t nameLength )
+    {
+        this->name.set( name, nameLength );
+
+        printf( "%s connected.\n", this->name.c_str() );
+
+        hasSaidHello = true;
+
+        thread->readyToSpawn( this );
+    }
+
+    void RemotePlayerEnt::onPlayerMove( const PlayerMoveMessage& message )
+    {
+        // Broadcast locally
+        LocalEvent ev;
+        ev.type = EventType::entMovement;
+        ev.data.entMovement.entId = entId;
+        ev.data.entMovement.x = message.x;
+        ev.data.entMovement.y = message.y;
+        ev.data.entMovement.z = message.z;
+        thread->broadcastLocal( nullptr, ev );
+
+        // Broadcast remote
+        EntMoveMessage movement = { MSG_ENT_MOVE, entId, message.x, message.y, message.z };
+        thread->broadcastRemote( this, &movement, sizeof( movement ) );
+
+        // Update self
+        pos.x += message.x;
+        pos.y += message.y;
+        pos.z += message.z;
+    }
 
     IGameServer* IGameServer::create( IEngine* engine )
     {
@@ -257,6 +462,7 @@ namespace Duel
     {
         engine->setVariable( "host_max",        engine->createIntVariable( -1 ),                true );
         engine->setVariable( "host_port",       engine->createIntVariable( 0xD0E1 ),            true );
+        engine->setVariable( "host_tickrate",   engine->createIntVariable( 60 ),                true );
         //engine->setVariable( "map_name",        engine->createStringVariable( "uc_0" ),         true );
 
         thread = new GameServerThread( engine );
@@ -299,8 +505,14 @@ namespace Duel
     }
 
     GameServerThread::GameServerThread( IEngine* engine )
-            : engine( engine ), nextEntId( 0 )
+            : engine( engine ), nextEntId( 0 ), hostPort( 0 )
     {
+#ifdef Duel_epoll_server
+        listenFd = -1;
+        epollFd = epoll_create1( EPOLL_CLOEXEC );
+
+        SG_assert( epollFd >= 0 )
+#endif
     }
 
     GameServerThread::~GameServerThread()
@@ -330,8 +542,118 @@ namespace Duel
         iterate2 ( i, remotePlayers )
             delete i;
             */
+
+#ifdef Duel_epoll_server
+        if ( listenFd >= 0 )
+            close( listenFd );
+
+        close( epollFd );
+#endif
+    }
+
+#ifdef Duel_epoll_server
+    void GameServerThread::acceptConnections()
+    {
+        for ( ; ; )
+        {
+            int fd = accept4( listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+            if ( fd < 0 )
+            {
+                if ( errno == EINTR )
+                    continue;
+
+                // EAGAIN - backlog drained; anything else (e.g. out of descriptors) we'll retry on the next wakeup
+                break;
+            }
+
+            int noDelay = 1;
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+
+            RemotePlayerEnt* ent = new RemotePlayerEnt( this, nextEntId++, fd );
+
+            epoll_event ev;
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = ent;
+
+            if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+            {
+                delete ent;
+                continue;
+            }
+
+            addRemotePlayer( ent );
+        }
     }
 
+    void GameServerThread::disconnect( RemotePlayerEnt* ent )
+    {
+        printf( "%s disconnected.\n", ent->getName() );
+
+        {
+            CriticalSection cs( spawnQueueMtx );
+            spawnQueue.removeItem( ent );
+        }
+
+        {
+            CriticalSection cs( remotePlayersMtx );
+            remotePlayers.removeItem( ent );
+
+            CriticalSection cs2( flushQueueMtx );
+            flushQueue.removeItem( ent );
+        }
+
+        epoll_ctl( epollFd, EPOLL_CTL_DEL, ent->getFd(), nullptr );
+        delete ent;
+    }
+
+    void GameServerThread::flushQueued()
+    {
+        // Keeps the players alive; disconnect() takes this one before deleting them
+        CriticalSection cs( remotePlayersMtx );
+
+        {
+            CriticalSection cs2( flushQueueMtx );
+
+            iterate2 ( i, flushQueue )
+            {
+                i->queuedForFlush = false;
+                flushing.add( i );
+            }
+
+            flushQueue.clear();
+        }
+
+        // Writers blocked on a full socket get flushed on EPOLLOUT instead
+        iterate2 ( i, flushing )
+            if ( !i->waitingForWrite )
+                i->flush();
+
+        flushing.clear();
+    }
+
+    void GameServerThread::queueFlush( RemotePlayerEnt* ent )
+    {
+        CriticalSection cs( flushQueueMtx );
+
+        if ( !ent->queuedForFlush )
+        {
+            ent->queuedForFlush = true;
+            flushQueue.add( ent );
+        }
+    }
+
+    void GameServerThread::setWriteInterest( RemotePlayerEnt* ent, bool enabled )
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | ( enabled ? EPOLLOUT : 0 );
+        ev.data.ptr = ent;
+
+        epoll_ctl( epollFd, EPOLL_CTL_MOD, ent->getFd(), &ev );
+        ent->waitingForWrite = enabled;
+    }
+#endif
+
     void GameServerThread::addBot( BotEnt* ent )
     {
         CriticalSection cs( botsMtx );
@@ -400,13 +722,12 @@ namespace Duel
         return ent;
     }
 
-    void GameServerThread::addRemotePlayer( TcpSocket* socket )
+    void GameServerThread::addRemotePlayer( RemotePlayerEnt* newEnt )
     {
-        Object<RemotePlayerEnt> ent;
+        Object<RemotePlayerEnt> ent = newEnt;
 
         try
         {
-            ent = new RemotePlayerEnt( this, nextEntId++, socket );
             ent->init();
 
             if ( !localPlayers.isEmpty() )
@@ -546,13 +867,148 @@ namespace Duel
         int host_max = String::toInt( engine->getVariableValue( "host_max", true ) );
         int host_port = String::toInt( engine->getVariableValue( "host_port", true ) );
 
+#ifdef Duel_epoll_server
+        // Port 0 lets the system pick a free one
+        SG_assert ( host_port >= 0 )
+
+        listenFd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        SG_assert( listenFd >= 0 )
+
+        int reuseAddr = 1;
+        setsockopt( listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddr, sizeof( reuseAddr ) );
+
+        sockaddr_in address;
+        memset( &address, 0, sizeof( address ) );
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl( INADDR_ANY );
+        address.sin_port = htons( host_port );
+
+        int result = bind( listenFd, ( sockaddr* ) &address, sizeof( address ) );
+        SG_assert( result == 0 )
+
+        socklen_t addressLength = sizeof( address );
+        result = getsockname( listenFd, ( sockaddr* ) &address, &addressLength );
+        SG_assert( result == 0 )
+
+        hostPort = ntohs( address.sin_port );
+
+        result = listen( listenFd, SOMAXCONN );
+        SG_assert( result == 0 )
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+
+        result = epoll_ctl( epollFd, EPOLL_CTL_ADD, listenFd, &ev );
+        SG_assert( result == 0 )
+#else
         SG_assert ( host_port > 0 )
 
         listenSocket = TcpSocket::create( false );
 
         SG_assert ( listenSocket->listen( host_port ) )
+
+        hostPort = host_port;
+#endif
     }
 
+#ifdef Duel_epoll_server
+    void GameServerThread::run()
+    {
+        const int tickRate = maximum( String::toInt( engine->getVariableValue( "host_tickrate", true ) ), 1 );
+        const uint64_t tickInterval = 1000000 / tickRate;
+
+        epoll_event events[maxEventsPerWait];
+
+        List<RemotePlayerEnt*> dropped;
+
+        Timer loopTimer;
+        loopTimer.start();
+
+        uint64_t lastTick = 0, nextTick = 0;
+
+        while ( !shouldEnd )
+        {
+            // Sleep until there's traffic or the next tick is due
+            const uint64_t now = loopTimer.getMicros();
+            const int timeout = ( nextTick > now ) ? ( int )( ( nextTick - now + 999 ) / 1000 ) : 0;
+
+            int numEvents = epoll_wait( epollFd, events, maxEventsPerWait, timeout );
+
+            if ( numEvents < 0 && errno != EINTR )
+            {
+                printf( "GameServerThread: epoll_wait failed (errno %i)\n", errno );
+                break;
+            }
+
+            {
+                CriticalSection cs3( localPlayersMtx );
+                CriticalSection cs( remotePlayersMtx );
+                CriticalSection cs2( botsMtx );
+
+                for ( int i = 0; i < numEvents; i++ )
+                {
+                    RemotePlayerEnt* ent = ( RemotePlayerEnt* ) events[i].data.ptr;
+
+                    // The listening socket is registered with a null pointer
+                    if ( ent == nullptr || ent->disconnected )
+                        continue;
+
+                    if ( events[i].events & EPOLLOUT )
+                        ent->flush();
+
+                    if ( events[i].events & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) )
+                    {
+                        if ( !ent->receive() )
+                            ent->disconnected = true;
+                    }
+                }
+            }
+
+            for ( int i = 0; i < numEvents; i++ )
+                if ( events[i].data.ptr == nullptr )
+                    acceptConnections();
+
+            const uint64_t time = loopTimer.getMicros();
+
+            if ( time >= nextTick )
+            {
+                const double delta = ( time - lastTick ) / 1000000.0;
+                lastTick = time;
+
+                {
+                    CriticalSection cs3( localPlayersMtx );
+                    CriticalSection cs( remotePlayersMtx );
+                    CriticalSection cs2( botsMtx );
+
+                    iterate2 ( i, bots )
+                        i->update( delta );
+                }
+
+                spawnQueued();
+
+                // Don't try to catch up on missed ticks
+                nextTick = maximum( nextTick + tickInterval, time );
+            }
+
+            flushQueued();
+
+            // Drop dead connections
+            {
+                CriticalSection cs( remotePlayersMtx );
+
+                iterate2 ( i, remotePlayers )
+                    if ( i->disconnected )
+                        dropped.add( i );
+            }
+
+            iterate2 ( i, dropped )
+                disconnect( i );
+
+            dropped.clear();
+        }
+    }
+#else
     void GameServerThread::run()
     {
         unsigned counter = 0, interval = 0;
@@ -577,7 +1033,7 @@ namespace Duel
                 Reference<TcpSocket> incoming = listenSocket->accept( false );
 
                 if ( incoming != nullptr )
-                    addRemotePlayer( incoming.detach() );
+                    addRemotePlayer( new RemotePlayerEnt( this, nextEntId++, incoming.detach() ) );
             }
 
             double delta = deltaTimer.getMicros() / 1000000.0;
@@ -600,18 +1056,7 @@ namespace Duel
                     i->flush();
             }
 
-            if ( !spawnQueue.isEmpty() )
-            {
-                CriticalSection cs( spawnQueueMtx );
-
-                iterate2 ( ent, spawnQueue )
-                {
-                    ent->spawnAt( Vector<>( rand() % 16 - 8, rand() % 16 - 8, rand() % 2 ) );
-                    broadcastEntSpawn( ent );
-                }
-
-                spawnQueue.clear();
-            }
+            spawnQueued();
 
             if ( counter == 0 )
                 printf( "Update Time: %u us\n", ( unsigned int ) timer.getMicros() );
@@ -622,6 +1067,7 @@ namespace Duel
             pauseThread( 1 );
         }
     }
+#endif
 
     void GameServerThread::readyToSpawn( IEnt* ent )
     {
@@ -630,6 +1076,22 @@ namespace Duel
         spawnQueue.add( ent );
     }
 
+    void GameServerThread::spawnQueued()
+    {
+        if ( !spawnQueue.isEmpty() )
+        {
+            CriticalSection cs( spawnQueueMtx );
+
+            iterate2 ( ent, spawnQueue )
+            {
+                ent->spawnAt( Vector<>( rand() % 16 - 8, rand() % 16 - 8, rand() % 2 ) );
+                broadcastEntSpawn( ent );
+            }
+
+            spawnQueue.clear();
+        }
+    }
+
     void GameServerThread::spawnBot1()
     {
         Object<BotEnt> ent = new BotEnt( this, nextEntId++ );
@@ -28,6 +28,11 @@
 #include <littl/TcpSocket.hpp>
 #include <littl/Thread.hpp>
 
+// Readiness-based networking; elsewhere the server polls every socket each iteration
+#ifdef __linux__
+#define Duel_epoll_server
+#endif
+
 namespace Duel
 {
     class GameServerThread;
@@ -98,15 +103,43 @@ namespace Duel
             bool spawned;
 
             GameServerThread* thread;
-            Reference<TcpSocket> socket;
 
             bool hasSaidHello;
 
+#ifdef Duel_epoll_server
+            int fd;
+
+            // Received bytes not yet parsed into messages; [0, inLength)
+            Array<uint8_t> inBuffer;
+            size_t inLength;
+
+            // Buffered messages not yet accepted by the socket; [outBegin, outLength)
+            Array<uint8_t> outBuffer;
+            size_t outBegin, outLength;
+#else
+            Reference<TcpSocket> socket;
+
             ArrayIOStream messageBuffer, receiveBuffer;
+#endif
+
+            void onJoin( const char* name, size_t nameLength );
+            void onPlayerMove( const PlayerMoveMessage& message );
 
         public:
+#ifdef Duel_epoll_server
+            // Set by the server thread; true while the socket buffer is full and EPOLLOUT is being waited for
+            bool waitingForWrite, queuedForFlush, disconnected;
+
+            RemotePlayerEnt( GameServerThread* thread, EntId entId, int fd );
+            virtual ~RemotePlayerEnt();
+
+            int getFd() const { return fd; }
+            bool hasPendingOutput() const { return outBegin < outLength; }
+            bool receive();
+#else
             RemotePlayerEnt( GameServerThread* thread, EntId entId, TcpSocket* socket );
             //virtual ~RemotePlayerEnt();
+#endif
 
             template <typename T> void bufferMessage( const T& message ) { bufferRaw( &message, sizeof( message ) ); }
             void bufferRaw( const void* data, size_t length );
@@ -119,7 +152,7 @@ namespace Duel
 
             virtual void flush();
             virtual void init();
-            virtual void update();            
+            virtual void update();
     };
 
     class GameServer : public ICommandListener, public IGameServer
@@ -149,7 +182,20 @@ namespace Duel
 
             volatile uint16_t nextEntId;
 
+            // The port actually listened on after initTcpHost
+            int hostPort;
+
+#ifdef Duel_epoll_server
+            int epollFd, listenFd;
+
+            // Remote players with buffered output, flushed once per loop iteration
+            // Guarded by flushQueueMtx (together with RemotePlayerEnt::queuedForFlush); always taken after remotePlayersMtx,
+            // because output gets buffered while broadcasting to remotePlayers
+            List<RemotePlayerEnt*> flushQueue, flushing;
+            Mutex flushQueueMtx;
+#else
             Reference<TcpSocket> listenSocket;
+#endif
 
             List<BotEnt*> bots;
             List<LocalPlayerEnt*> localPlayers;
@@ -171,14 +217,23 @@ namespace Duel
 
             void addBot( BotEnt* ent );
             LocalPlayerEnt* addLocalPlayer( const char* name );
-            void addRemotePlayer( TcpSocket* socket );
+            void addRemotePlayer( RemotePlayerEnt* ent );
             void broadcastEntSpawn( IEnt* ent );
             void init();
             void initTcpHost();
             void readyToSpawn( IEnt* ent );
             void spawnBot1();
+            void spawnQueued();
             void uninit();
 
+#ifdef Duel_epoll_server
+            void acceptConnections();
+            void disconnect( RemotePlayerEnt* ent );
+            void flushQueued();
+            void queueFlush( RemotePlayerEnt* ent );
+            void setWriteInterest( RemotePlayerEnt* ent, bool enabled );
+#endif
+
             virtual void run() override;
     };
 
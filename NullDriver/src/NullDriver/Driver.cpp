@@ -0,0 +1,41 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "NullDriver.hpp"
+
+extern "C" StormGraph_Library_Export StormGraph::IGraphicsDriver* createGraphicsDriver( const char* driverName, StormGraph::IEngine* engine )
+{
+    if ( strcmp( driverName, "Null" ) == 0 )
+        return new NullDriver::NullDriver( engine, false );
+    else if ( strcmp( driverName, "Recording" ) == 0 )
+        return new NullDriver::NullDriver( engine, true );
+    else
+        return 0;
+}
+
+#ifdef __li_MSW
+extern "C" BOOL WINAPI DllMain( HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved )
+{
+    return TRUE;
+}
+#endif
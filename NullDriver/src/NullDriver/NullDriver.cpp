@@ -0,0 +1,812 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "NullDriver.hpp"
+
+#include <StormGraph/Engine.hpp>
+#include <StormGraph/GeometryFactory.hpp>
+#include <StormGraph/HeightMap.hpp>
+#include <StormGraph/Image.hpp>
+
+#include <littl/File.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace NullDriver
+{
+    static const char* version = "TRUNK";
+
+    static const char* blendModeNames[] = { "normal", "additive", "subtractive", "invert" };
+    static const char* renderFlagNames[] = { "culling", "depthTest", "wireframe" };
+
+    class IntRefVariable : public IVariable
+    {
+        protected:
+            int& value;
+
+            virtual ~IntRefVariable() {}
+
+        public:
+            IntRefVariable( int& value ) : value( value ) {}
+
+            virtual String getValue() { return String::formatInt( value ); }
+            virtual bool setValue( const String& value ) { this->value = String::toInt( value ); return true; }
+    };
+
+    const char* getCommandName( CommandType type )
+    {
+        static const char* names[] =
+        {
+            "drawMesh", "drawLine", "drawRectangle", "drawText",
+
+            "addLight", "clear", "clearLights", "popState", "pushState", "setBlendMode", "setCamera", "setClearColour", "setClippingRect", "setMaterial",
+            "setProjection", "setRenderBuffer", "setRenderFlag", "setSceneAmbient", "setShadowMap", "setViewport", "beginPass", "endPass",
+
+            "uploadFont", "uploadInstances", "uploadMesh", "uploadTexture"
+        };
+
+        return names[( int ) type];
+    }
+
+    NullDriver::NullDriver( IEngine* engine, bool recording )
+            : engine( engine ), recording( recording ), maxFrames( 0 ), eventListener( nullptr ), currentBlendMode( normal ),
+            currentRenderBuffer( nullptr ), currentMaterial( nullptr ), numDirectionalLights( 0 ), numPointLights( 0 )
+    {
+        memset( &stats, 0, sizeof( stats ) );
+
+        engine->setVariable( "driver.recordCommands",                       engine->createBoolRefVariable( this->recording ),                           true );
+        engine->setVariable( "driver.maxFrames",                            new IntRefVariable( maxFrames ),                                            true );
+
+        engine->registerCommandListener( this );
+    }
+
+    NullDriver::~NullDriver()
+    {
+    }
+
+    int NullDriver::addDirectionalLight( const DirectionalLightProperties& properties, bool inWorldSpace )
+    {
+        onStateChange( CommandType::addLight, "directional", numDirectionalLights );
+
+        return numDirectionalLights++;
+    }
+
+    int NullDriver::addPointLight( const PointLightProperties& properties, bool inWorldSpace )
+    {
+        onStateChange( CommandType::addLight, "point", numPointLights );
+
+        return numPointLights++;
+    }
+
+    void NullDriver::beginDepthRendering()
+    {
+        onStateChange( CommandType::beginPass, "depth" );
+    }
+
+    void NullDriver::beginPicking()
+    {
+        onStateChange( CommandType::beginPass, "picking" );
+    }
+
+    void NullDriver::beginShadowMapping( ITexture* shadowTexture, const glm::mat4& textureMatrix )
+    {
+        onStateChange( CommandType::beginPass, "shadowMapping" );
+    }
+
+    void NullDriver::changeDisplayMode( DisplayMode* displayMode )
+    {
+    }
+
+    void NullDriver::clear()
+    {
+        onStateChange( CommandType::clear, String() );
+    }
+
+    void NullDriver::clearLights()
+    {
+        numDirectionalLights = 0;
+        numPointLights = 0;
+
+        onStateChange( CommandType::clearLights, String() );
+    }
+
+    IModel* NullDriver::createCuboid( const char* name, CuboidCreationInfo* cuboid )
+    {
+        CuboidCreationInfo2 creationInfo( Vector<>(), cuboid->dimensions, cuboid->origin, cuboid->withNormals, cuboid->withUvs ? 1 : 0, cuboid->wireframe,
+                cuboid->visibleFromInside ? ShapeVisibility::inside : ShapeVisibility::outside );
+
+        return createCuboid( name, creationInfo, cuboid->material, IModel::fullStatic );
+    }
+
+    IModel* NullDriver::createCuboid( const char* name, const CuboidCreationInfo2& creationInfo, IMaterial* material, unsigned flags )
+    {
+        Reference<IMaterial> materialGuard( material );
+
+        List<Vertex> vertices;
+        List<uint32_t> indices;
+
+        GeometryFactory::createCuboidTriangles( creationInfo, vertices, indices );
+
+        MeshCreationInfo2 meshCreationInfo = { String(), MeshFormat::triangleList, MeshLayout::indexed, materialGuard.detach(),
+                vertices.getLength(), indices.getLength(), vertices.getPtr(), indices.getPtr() };
+
+        return createModelFromMemory( name, &meshCreationInfo, 1, flags );
+    }
+
+    ITexture* NullDriver::createDepthTexture( const char* name, const Vector2<unsigned>& resolution )
+    {
+        Reference<Texture> texture = new Texture( this, name, Vector<unsigned>( resolution.x, resolution.y, 1 ), resolution.x * resolution.y * 4 );
+        texture->upload();
+
+        return texture.detach();
+    }
+
+    ILight* NullDriver::createDirectionalLight( const Vector<float>& direction, const Colour& ambient, const Colour& diffuse, const Colour& specular )
+    {
+        return new Light( this, direction, ambient, diffuse, specular );
+    }
+
+    IFont* NullDriver::createFontFromStream( const char* name, SeekableInputStream* input, unsigned size, unsigned style )
+    {
+        Reference<> inputGuard( input );
+
+        return new Font( this, name, size, style );
+    }
+
+    IMaterial* NullDriver::createMaterial( const char* name, const MaterialProperties2* material, bool finalized )
+    {
+        return new Material( this, name, material->colour, material->numTextures );
+    }
+
+    IModel* NullDriver::createModelFromMemory( const char* name, MeshCreationInfo2* meshes, size_t count, unsigned flags )
+    {
+        Reference<IModelPreload> preload = preloadModelFromMemory( name, meshes, count, flags );
+
+        return preload->getFinalized();
+    }
+
+    IModel* NullDriver::createModelFromMemory( const char* name, MeshCreationInfo2** meshes, size_t count, unsigned flags )
+    {
+        Reference<IModelPreload> preload = preloadModelFromMemory( name, meshes, count, flags );
+
+        return preload->getFinalized();
+    }
+
+    IModel* NullDriver::createModelFromMemory( const char* name, MeshCreationInfo3* meshes, size_t count, unsigned flags )
+    {
+        List<MeshCreationInfo3*> meshPtrs;
+
+        for ( size_t i = 0; i < count; i++ )
+            meshPtrs.add( &meshes[i] );
+
+        return createModelFromMemory( name, meshPtrs.getPtr(), count, flags );
+    }
+
+    IModel* NullDriver::createModelFromMemory( const char* name, MeshCreationInfo3** meshes, size_t count, unsigned flags )
+    {
+        Reference<Model> model = new Model( this, name, meshes, count );
+        model->upload();
+
+        return model.detach();
+    }
+
+    IModel* NullDriver::createPlane( const char* name, PlaneCreationInfo* plane )
+    {
+        static const unsigned indices[] = { 0, 1, 2, 0, 2, 3 };
+
+        Vertex vertices[4];
+        memset( vertices, 0, sizeof( vertices ) );
+
+        for ( unsigned i = 0; i < 4; i++ )
+        {
+            vertices[i].pos.x = -plane->origin.x + ( ( i == 1 || i == 2 ) ? plane->dimensions.x : 0.0f );
+            vertices[i].pos.y = -plane->origin.y + ( ( i >= 2 ) ? plane->dimensions.y : 0.0f );
+            vertices[i].pos.z = -plane->origin.z;
+        }
+
+        MeshCreationInfo2 meshCreationInfo = { String(), MeshFormat::triangleList, MeshLayout::indexed, plane->material,
+                4, lengthof( indices ), vertices, indices };
+
+        return createModelFromMemory( name, &meshCreationInfo, 1, IModel::fullStatic );
+    }
+
+    ILight* NullDriver::createPointLight( float range, const Colour& ambient, const Colour& diffuse, const Colour& specular )
+    {
+        return new Light( this, range, ambient, diffuse, specular );
+    }
+
+    IRenderBuffer* NullDriver::createRenderBuffer( const Vector<unsigned>& dimensions, bool withDepthBuffer )
+    {
+        Reference<Texture> texture = new Texture( this, "NullDriver.RenderBuffer", dimensions, dimensions.x * dimensions.y * 4 );
+        texture->upload();
+
+        return new RenderBuffer( texture.detach(), dimensions );
+    }
+
+    IRenderBuffer* NullDriver::createRenderBuffer( ITexture* depthTexture )
+    {
+        if ( depthTexture == nullptr )
+            return nullptr;
+
+        return new RenderBuffer( static_cast<Texture*>( depthTexture->reference() ), depthTexture->getDimensions() );
+    }
+
+    IMaterial* NullDriver::createSolidMaterial( const char* name, const Colour& colour, ITexture* texture )
+    {
+        return new Material( this, name, colour, ( texture != nullptr ) ? 1 : 0 );
+    }
+
+    ITexture* NullDriver::createSolidTexture( const char* name, const Colour& colour )
+    {
+        Reference<Texture> texture = new Texture( this, name, Vector<unsigned>( 1, 1, 1 ), 4 );
+        texture->upload();
+
+        return texture.detach();
+    }
+
+    IStaticModel* NullDriver::createStaticModelFromBsp( const char* name, BspTree* bsp, IResourceManager* resMgr, bool finalized )
+    {
+        Reference<StaticModel> model = new StaticModel( this, name, bsp );
+
+        if ( finalized )
+            model->finalize();
+
+        return model.detach();
+    }
+
+    IModel* NullDriver::createTerrain( const char* name, TerrainCreationInfo* terrain, unsigned modelFlags )
+    {
+        const Vector2<unsigned>& resolution = terrain->resolution;
+
+        SG_assert( resolution.x > 1 && resolution.y > 1 )
+
+        List<Vertex> vertices;
+        List<unsigned> indices;
+
+        for ( unsigned y = 0; y < resolution.y; y++ )
+            for ( unsigned x = 0; x < resolution.x; x++ )
+            {
+                Vertex vertex;
+                memset( &vertex, 0, sizeof( vertex ) );
+
+                const Vector2<float> uv( ( float ) x / ( resolution.x - 1 ), ( float ) y / ( resolution.y - 1 ) );
+                const float height = ( terrain->heightMap != nullptr ) ? terrain->heightMap->get( uv ) : 0.0f;
+
+                vertex.pos = Vector<>( uv.x * terrain->dimensions.x, uv.y * terrain->dimensions.y, height * terrain->dimensions.z ) - terrain->origin;
+                vertices.add( vertex );
+            }
+
+        for ( unsigned y = 0; y + 1 < resolution.y; y++ )
+            for ( unsigned x = 0; x + 1 < resolution.x; x++ )
+            {
+                const unsigned i = y * resolution.x + x;
+
+                indices.add( i );
+                indices.add( i + 1 );
+                indices.add( i + resolution.x + 1 );
+                indices.add( i );
+                indices.add( i + resolution.x + 1 );
+                indices.add( i + resolution.x );
+            }
+
+        MeshCreationInfo2 meshCreationInfo = { String(), terrain->wireframe ? MeshFormat::lineList : MeshFormat::triangleList, MeshLayout::indexed,
+                terrain->material, vertices.getLength(), indices.getLength(), vertices.getPtr(), indices.getPtr() };
+
+        return createModelFromMemory( name, &meshCreationInfo, 1, modelFlags );
+    }
+
+    ITexture* NullDriver::createTextureFromStream( SeekableInputStream* input, const char* name, ILodFunction* lodFunction )
+    {
+        Reference<ITexturePreload> preload = preloadTextureFromStream( input, name, lodFunction );
+
+        return preload->getFinalized();
+    }
+
+    void NullDriver::draw2dCenteredRotated( ITexture* texture, float scale, float angle, const Colour& blend )
+    {
+        onDraw( CommandType::drawRectangle, ( texture != nullptr ) ? texture->getName() : "", 2 );
+    }
+
+    void NullDriver::drawLine( const Vector<float>& a, const Vector<float>& b, const Colour& blend )
+    {
+        onDraw( CommandType::drawLine, String(), 1 );
+    }
+
+    void NullDriver::drawRectangle( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture )
+    {
+        onDraw( CommandType::drawRectangle, ( texture != nullptr ) ? texture->getName() : "", 2 );
+    }
+
+    void NullDriver::drawRectangleOutline( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture )
+    {
+        onDraw( CommandType::drawLine, ( texture != nullptr ) ? texture->getName() : "", 4 );
+    }
+
+    void NullDriver::endDepthRendering()
+    {
+        onStateChange( CommandType::endPass, "depth" );
+    }
+
+    unsigned NullDriver::endPicking( const Vector2<unsigned>& samplePos )
+    {
+        onStateChange( CommandType::endPass, "picking" );
+
+        // Nothing is ever rasterized, so nothing can be picked
+        return 0;
+    }
+
+    void NullDriver::endShadowMapping()
+    {
+        onStateChange( CommandType::endPass, "shadowMapping" );
+    }
+
+    void NullDriver::getDriverInfo( Info* info )
+    {
+        info->release = ( String ) "NullDriver " + version + " " StormGraph_Target;
+        info->renderer = recording ? "Recording (headless)" : "Null (headless)";
+    }
+
+    int16_t NullDriver::getKey( const char* name )
+    {
+        if ( !name )
+            return 0;
+
+        return tolower( *name );
+    }
+
+    String NullDriver::getKeyName( int16_t code )
+    {
+        return ( char ) toupper( code );
+    }
+
+    void NullDriver::getProjectionInfo( IProjectionInfoBuffer* projectionInfoBuffer )
+    {
+        auto buffer = static_cast<ProjectionInfoBuffer*>( projectionInfoBuffer );
+
+        buffer->modelView = modelView;
+        buffer->projection = projection;
+        buffer->viewport = viewport;
+    }
+
+    IMaterial* NullDriver::getSolidMaterial()
+    {
+        if ( solidMaterial == nullptr )
+            solidMaterial = new Material( this, "NullDriver.solidMaterial", Colour(), 0 );
+
+        return solidMaterial->reference();
+    }
+
+    bool NullDriver::isRunning()
+    {
+        return eventListener != nullptr && eventListener->isRunning();
+    }
+
+    void NullDriver::onCloseButton()
+    {
+        if ( eventListener )
+            eventListener->onCloseButton();
+    }
+
+    bool NullDriver::onCommand( const List<String>& tokens )
+    {
+        if ( tokens[0] == "driver.dumpCommands" )
+        {
+            Reference<File> file = File::open( tokens.getLength() > 1 ? tokens[1] : "NullDriver Commands.txt", "wb" );
+
+            if ( file == nullptr )
+                throw Exception( "NullDriver.NullDriver.onCommand", "FileOpenError", "Failed to open the command log for writing." );
+
+            printCommandLog( file.detach() );
+            return true;
+        }
+
+        return false;
+    }
+
+    void NullDriver::onDraw( CommandType type, const String& subject, size_t primitives, size_t instances )
+    {
+        stats.numDrawCalls++;
+        stats.numPrimitives += primitives * instances;
+
+        if ( recording )
+        {
+            Command command = { type, subject, primitives, instances, 0 };
+            commands.add( ( Command&& ) command );
+        }
+    }
+
+    void NullDriver::onFrameBegin()
+    {
+        const unsigned frame = stats.frame + 1;
+
+        memset( &stats, 0, sizeof( stats ) );
+        stats.frame = frame;
+
+        commands.clear();
+
+        numDirectionalLights = 0;
+        numPointLights = 0;
+        currentMaterial = nullptr;
+
+        setRenderBuffer( nullptr );
+        clear();
+
+        if ( eventListener )
+            eventListener->onFrameBegin();
+    }
+
+    void NullDriver::onFrameEnd()
+    {
+        if ( eventListener )
+            eventListener->onFrameEnd();
+    }
+
+    void NullDriver::onKeyState( int16_t key, Key::State state, Unicode::Char character )
+    {
+        if ( eventListener )
+            eventListener->onKeyState( key, state, character );
+    }
+
+    void NullDriver::onMouseMoveTo( const Vector2<int>& mouse )
+    {
+        if ( eventListener )
+            eventListener->onMouseMoveTo( mouse );
+    }
+
+    void NullDriver::onRender()
+    {
+        if ( eventListener )
+            eventListener->onRender();
+    }
+
+    void NullDriver::onStateChange( CommandType type, const String& subject, size_t value )
+    {
+        stats.numStateChanges++;
+
+        if ( recording )
+        {
+            Command command = { type, subject, value, 0, 0 };
+            commands.add( ( Command&& ) command );
+        }
+    }
+
+    void NullDriver::onUpload( CommandType type, const String& subject, size_t bytes )
+    {
+        stats.numUploads++;
+        stats.bytesUploaded += bytes;
+
+        if ( recording )
+        {
+            Command command = { type, subject, 0, 0, bytes };
+            commands.add( ( Command&& ) command );
+        }
+    }
+
+    void NullDriver::onViewportResize( const Vector2<unsigned>& dimensions )
+    {
+        viewport = dimensions;
+
+        if ( eventListener )
+            eventListener->onViewportResize( dimensions );
+    }
+
+    void NullDriver::popBlendMode()
+    {
+        currentBlendMode = blendModes.pop();
+
+        onStateChange( CommandType::setBlendMode, blendModeNames[currentBlendMode] );
+    }
+
+    void NullDriver::popClippingRect()
+    {
+        clippingRects.pop();
+
+        if ( !clippingRects.isEmpty() )
+            onStateChange( CommandType::setClippingRect, "enable" );
+        else
+            onStateChange( CommandType::setClippingRect, "disable" );
+    }
+
+    void NullDriver::popProjection()
+    {
+        const Projection& saved = projections.top();
+
+        projection = saved.projection;
+        modelView = saved.modelView;
+        projections.pop();
+
+        onStateChange( CommandType::popState, "projection" );
+    }
+
+    void NullDriver::popRenderBuffer()
+    {
+        setRenderBuffer( renderBuffers.pop() );
+    }
+
+    ITexturePreload* NullDriver::preloadTextureFromStream( SeekableInputStream* input, const char* name, ILodFunction* lodFunction )
+    {
+        Object<ILodFunction> lodFunctionGuard( lodFunction );
+        Reference<> inputGuard( input );
+
+        // The image is still decoded so that loading costs and format errors match the real drivers
+        Object<Image> image = engine->getImageLoader()->load( input, false );
+
+        if ( image == nullptr )
+            throw StormGraph::Exception( "NullDriver.NullDriver.preloadTextureFromStream", "GraphicsLoadError",
+                    ( String ) "Failed to load texture " + File::formatFileName( name ) + ". File format was not recognized." );
+
+        return new TexturePreload( new Texture( this, name, Vector<unsigned>( image->size.x, image->size.y, 1 ), image->data.getCapacity() ) );
+    }
+
+    IModelPreload* NullDriver::preloadModelFromMemory( const char* name, MeshCreationInfo2* meshes, size_t count, unsigned flags )
+    {
+        List<MeshCreationInfo2*> meshPtrs;
+
+        for ( size_t i = 0; i < count; i++ )
+            meshPtrs.add( &meshes[i] );
+
+        return preloadModelFromMemory( name, meshPtrs.getPtr(), count, flags );
+    }
+
+    IModelPreload* NullDriver::preloadModelFromMemory( const char* name, MeshCreationInfo2** meshes, size_t count, unsigned flags )
+    {
+        return new ModelPreload( new Model( this, name, meshes, count ) );
+    }
+
+    void NullDriver::printCommandLog( OutputStream* output )
+    {
+        Reference<> outputGuard( output );
+
+        output->writeLine( ( String ) "; frame " + String::formatInt( stats.frame ) + ": "
+                + String::formatInt( stats.numDrawCalls ) + " draw calls, "
+                + String::formatInt( stats.numPrimitives ) + " primitives, "
+                + String::formatInt( stats.numStateChanges ) + " state changes, "
+                + String::formatInt( stats.numUploads ) + " uploads ("
+                + String::formatInt( stats.bytesUploaded ) + " B)" );
+
+        for each_in_list ( commands, i )
+        {
+            const Command& command = commands[i];
+
+            output->writeLine( ( String ) getCommandName( command.type ) + "\t" + command.subject + "\t"
+                    + String::formatInt( command.count ) + "\t" + String::formatInt( command.instances ) + "\t" + String::formatInt( command.bytes ) );
+        }
+    }
+
+    void NullDriver::pushBlendMode( BlendMode blendMode )
+    {
+        blendModes.push( currentBlendMode );
+        currentBlendMode = blendMode;
+
+        onStateChange( CommandType::setBlendMode, blendModeNames[blendMode] );
+    }
+
+    void NullDriver::pushClippingRect( const ScreenRect& clippingRect )
+    {
+        clippingRects.push( clippingRect );
+
+        onStateChange( CommandType::setClippingRect, "enable" );
+    }
+
+    void NullDriver::pushProjection()
+    {
+        Projection saved = { projection, modelView };
+        projections.push( saved );
+
+        onStateChange( CommandType::pushState, "projection" );
+    }
+
+    void NullDriver::pushRenderBuffer( IRenderBuffer* renderBuffer )
+    {
+        renderBuffers.push( currentRenderBuffer );
+
+        setRenderBuffer( static_cast<RenderBuffer*>( renderBuffer ) );
+    }
+
+    void NullDriver::runMainLoop( IEventListener* eventListener )
+    {
+        this->eventListener = eventListener;
+
+        if ( eventSource != nullptr )
+        {
+            while ( eventListener->isRunning() )
+                eventSource->processEvents( this );
+        }
+        else
+        {
+            // No window, no events: just keep the frames coming (optionally only up to driver.maxFrames)
+            while ( eventListener->isRunning() && ( maxFrames <= 0 || stats.frame < ( unsigned ) maxFrames ) )
+            {
+                onFrameBegin();
+                onRender();
+                onFrameEnd();
+            }
+        }
+
+        this->eventListener = 0;
+    }
+
+    void NullDriver::selectMaterial( Material* material )
+    {
+        if ( currentMaterial == material )
+            return;
+
+        currentMaterial = material;
+
+        if ( material != nullptr )
+            onStateChange( CommandType::setMaterial, material->getName() );
+    }
+
+    void NullDriver::set2dMode( float nearZ, float farZ )
+    {
+        if ( !currentRenderBuffer )
+            projection = glm::ortho( 0.0f, ( float ) viewport.x, ( float ) viewport.y, 0.0f, nearZ, farZ );
+        else
+            projection = glm::ortho( 0.0f, ( float ) currentRenderBuffer->dimensions.x, ( float ) currentRenderBuffer->dimensions.y, 0.0f, nearZ, farZ );
+
+        modelView = glm::mat4();
+
+        onStateChange( CommandType::setProjection, "2d" );
+    }
+
+    void NullDriver::set3dMode( float nearZ, float farZ )
+    {
+        setPerspectiveProjection( nearZ, farZ, 45.0f );
+    }
+
+    void NullDriver::setCamera( const Camera* camera )
+    {
+        setCamera( camera->eye, camera->center, camera->up );
+    }
+
+    void NullDriver::setCamera( const Vector<float>& eye, const Vector<float>& center, const Vector<float>& up )
+    {
+        // Same D3D-like flip as the OpenGL driver, so that getModelView() and the frustum agree between the two
+        modelView = glm::lookAt( glm::vec3( eye.x, -eye.y, eye.z ), glm::vec3( center.x, -center.y, center.z ), glm::vec3( up.x, -up.y, up.z ) );
+        modelView = glm::scale( modelView, glm::vec3( 1.0f, -1.0f, 1.0f ) );
+
+        this->eye = eye;
+        frustum.setView( eye, center, up );
+
+        onStateChange( CommandType::setCamera, String() );
+    }
+
+    void NullDriver::setClearColour( const Colour& colour )
+    {
+        onStateChange( CommandType::setClearColour, String() );
+    }
+
+    void NullDriver::setDisplayMode( DisplayMode* displayMode )
+    {
+        SG_assert( displayMode->width > 0 )
+        SG_assert( displayMode->height > 0 )
+
+        windowSize = Vector2<unsigned>( displayMode->width, displayMode->height );
+
+        setViewport( Vector2<int>(), windowSize, windowSize );
+    }
+
+    void NullDriver::setEventSource( IEventSource* eventSource )
+    {
+        this->eventSource = eventSource;
+    }
+
+    void NullDriver::setOrthoProjection( const Vector2<float>& leftRight, const Vector2<float>& topBottom, const Vector2<float>& nearFar )
+    {
+        projection = glm::ortho( leftRight.x, leftRight.y, topBottom.x, topBottom.y, nearFar.x, nearFar.y );
+        modelView = glm::mat4();
+
+        onStateChange( CommandType::setProjection, "ortho" );
+    }
+
+    void NullDriver::setPerspectiveProjection( float nearZ, float farZ, float fov )
+    {
+        const float viewportRatio = ( currentRenderBuffer == nullptr )
+                ? ( float )( viewport.x ) / ( float )( viewport.y )
+                : ( float )( currentRenderBuffer->dimensions.x ) / ( float )( currentRenderBuffer->dimensions.y );
+
+        projection = glm::perspective( fov, viewportRatio, nearZ, farZ );
+        frustum.setProjection( fov, viewportRatio, nearZ, farZ );
+
+        modelView = glm::mat4();
+
+        onStateChange( CommandType::setProjection, "perspective" );
+    }
+
+    void NullDriver::setPointLightShadowMap( unsigned index, ITexture* depthMap, const glm::mat4& shadowMapMatrix )
+    {
+        onStateChange( CommandType::setShadowMap, ( depthMap != nullptr ) ? depthMap->getName() : "", index );
+    }
+
+    void NullDriver::setProjection( const glm::mat4& projection )
+    {
+        this->projection = projection;
+
+        onStateChange( CommandType::setProjection, "matrix" );
+    }
+
+    void NullDriver::setRenderBuffer( RenderBuffer* renderBuffer )
+    {
+        if ( currentRenderBuffer == renderBuffer )
+            return;
+
+        currentRenderBuffer = renderBuffer;
+
+        onStateChange( CommandType::setRenderBuffer, ( renderBuffer != nullptr ) ? renderBuffer->texture->getName() : "" );
+    }
+
+    void NullDriver::setRenderFlag( RenderFlag flag, bool value )
+    {
+        onStateChange( CommandType::setRenderFlag, renderFlagNames[( int ) flag], value ? 1 : 0 );
+    }
+
+    void NullDriver::setSceneAmbient( const Colour& colour )
+    {
+        onStateChange( CommandType::setSceneAmbient, String() );
+    }
+
+    void NullDriver::setViewport( const Vector2<int>& pos, const Vector2<unsigned>& size, const Vector2<unsigned>& windowSize )
+    {
+        viewportPos = pos;
+        this->windowSize = windowSize;
+
+        onStateChange( CommandType::setViewport, String() );
+
+        onViewportResize( size );
+    }
+
+    void NullDriver::setViewTransform( const glm::mat4& viewTransform )
+    {
+        modelView = viewTransform;
+
+        onStateChange( CommandType::setCamera, "matrix" );
+    }
+
+    void NullDriver::unload()
+    {
+        engine->unregisterCommandListener( this );
+
+        solidMaterial.release();
+        commands.clear();
+    }
+
+    bool NullDriver::unproject( const Vector2<float>& windowSpace, Vector<float>& worldSpace, IProjectionInfoBuffer* projectionInfoBuffer )
+    {
+        worldSpace = unproject( Vector<>( windowSpace.x, windowSpace.y, 0.0f ), projectionInfoBuffer );
+        return true;
+    }
+
+    Vector<float> NullDriver::unproject( const Vector<>& windowSpace, IProjectionInfoBuffer* projectionInfoBuffer )
+    {
+        const ProjectionInfoBuffer* buffer = static_cast<const ProjectionInfoBuffer*>( projectionInfoBuffer );
+
+        const glm::mat4& mv = ( buffer != nullptr ) ? buffer->modelView : modelView;
+        const glm::mat4& proj = ( buffer != nullptr ) ? buffer->projection : projection;
+        const Vector2<unsigned> size = ( buffer != nullptr ) ? buffer->viewport : viewport;
+
+        const glm::vec3 pos = glm::unProject( glm::vec3( windowSpace.x, ( float ) size.y - windowSpace.y, windowSpace.z ), mv, proj,
+                glm::vec4( 0.0f, 0.0f, ( float ) size.x, ( float ) size.y ) );
+
+        return Vector<float>( pos.x, pos.y, pos.z );
+    }
+}
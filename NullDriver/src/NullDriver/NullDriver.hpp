@@ -0,0 +1,526 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/RenderBatcher.hpp>
+#include <StormGraph/IO/Bsp.hpp>
+
+#include <StormGraph/ViewFrustum.hpp>
+#include <StormGraph/VisualInterface.hpp>
+
+#include <glm/glm.hpp>
+
+#include <littl/Stack.hpp>
+#include <littl/Thread.hpp>
+
+/*
+ *  NullDriver: a headless implementation of IGraphicsDriver.
+ *
+ *  No window or GPU context is ever created. Resources keep only the metadata needed to answer queries
+ *  (dimensions, bounds, primitive counts) and every draw call, state change and upload is counted
+ *  in FrameStats and - when recording is enabled - appended to the command log of the current frame.
+ */
+
+namespace NullDriver
+{
+    using namespace StormGraph;
+    using namespace StormRender;
+
+    class NullDriver;
+
+    li_enum_class( CommandType )
+    {
+        // Draw calls
+        drawMesh, drawLine, drawRectangle, drawText,
+
+        // State changes
+        addLight, clear, clearLights, popState, pushState, setBlendMode, setCamera, setClearColour, setClippingRect, setMaterial,
+        setProjection, setRenderBuffer, setRenderFlag, setSceneAmbient, setShadowMap, setViewport, beginPass, endPass,
+
+        // Uploads
+        uploadFont, uploadInstances, uploadMesh, uploadTexture
+    };
+
+    struct Command
+    {
+        CommandType type;
+
+        // resource or state name (model, texture, blend mode, render pass...)
+        String subject;
+
+        // primitives for draw calls, instances for drawMesh, characters for drawText, value for state changes
+        size_t count, instances;
+
+        // bytes for uploads
+        size_t bytes;
+    };
+
+    struct FrameStats
+    {
+        unsigned frame;
+        size_t numDrawCalls, numPrimitives, numStateChanges, numUploads, bytesUploaded;
+    };
+
+    class Font : public IFont
+    {
+        struct Layout
+        {
+            String string;
+            Colour colour;
+            unsigned short align;
+
+            Vector2<float> dimensions;
+        };
+
+        NullDriver* driver;
+        String name;
+
+        unsigned size, style;
+        float advance, lineSkip;
+
+        public:
+            Font( NullDriver* driver, const char* name, unsigned size, unsigned style );
+            virtual ~Font();
+
+            Vector2<float> measure( const String& string );
+
+            virtual void drawString( const Vector2<>& pos, const String& string, const Colour& colour, unsigned short align ) override;
+            virtual void drawText( const Vector2<>& pos, const Text* text, float alpha ) override;
+            virtual const char* getClassName() const override { return "NullDriver.Font"; }
+            virtual float getLineSkip() override { return lineSkip; }
+            virtual const char* getName() const override { return name; }
+            virtual unsigned getSize() override { return size; }
+            virtual unsigned getStyle() override { return style; }
+            virtual Vector2<float> getTextDimensions( Text* text ) override;
+            virtual Text* layoutText( const String& text, const Colour& colour, unsigned short align ) override;
+            virtual void releaseText( Text* text ) override;
+            virtual void renderString( float x, float y, const String& string, const Colour& colour, unsigned short align ) override;
+            virtual void renderText( float x, float y, const Text* text ) override;
+    };
+
+    class Light : public ILight
+    {
+        NullDriver* driver;
+
+        Type type;
+        DirectionalLightProperties directional;
+        PointLightProperties point;
+
+        public:
+            li_ReferencedClass_override( Light )
+
+            Light( NullDriver* driver, const Vector<float>& direction, const Colour& ambient, const Colour& diffuse, const Colour& specular );
+            Light( NullDriver* driver, float range, const Colour& ambient, const Colour& diffuse, const Colour& specular );
+            virtual ~Light() {}
+
+            virtual void render( const Transform* transforms, size_t numTransforms, bool inWorldSpace ) override;
+    };
+
+    class Material : public IMaterial
+    {
+        NullDriver* driver;
+        String name;
+
+        public:
+            unsigned id;
+            Colour colour;
+            size_t numTextures;
+
+        public:
+            li_ReferencedClass_override( Material )
+
+            Material( NullDriver* driver, const char* name, const Colour& colour, size_t numTextures );
+            virtual ~Material() {}
+
+            void apply();
+            bool isBlended() const { return colour.a < 1.0f; }
+
+            virtual const char* getClassName() const override { return "NullDriver.Material"; }
+            virtual const char* getName() const override { return name; }
+            virtual void setColour( const Colour& colour ) override;
+    };
+
+    class Model : public IModel
+    {
+        struct Mesh
+        {
+            MeshFormat format;
+            MeshLayout layout;
+            Reference<Material> material;
+
+            size_t numVertices, numIndices, numPrimitives;
+        };
+
+        NullDriver* driver;
+        String name;
+
+        List<Mesh> meshes;
+
+        bool bounded, uploaded;
+        Vector<float> bounds[2];
+
+        void addMesh( MeshFormat format, MeshLayout layout, IMaterial* material, size_t numVertices, size_t numIndices );
+        void addBounds( const Vector<float>& pos );
+
+        public:
+            li_ReferencedClass_override( Model )
+
+            Model( NullDriver* driver, const char* name, MeshCreationInfo2** meshes, size_t count );
+            Model( NullDriver* driver, const char* name, MeshCreationInfo3** meshes, size_t count );
+            virtual ~Model();
+
+            size_t getNumMeshes() const { return meshes.getLength(); }
+            Material* getMeshMaterial( size_t index ) { return meshes[index].material; }
+            const void* getMeshKey( size_t index ) { return &meshes[index]; }
+            size_t getSizeInBytes() const;
+            void renderMesh( size_t index, bool applyMaterial = true );
+            void renderMeshInstanced( size_t index, size_t numInstances );
+            void upload();
+
+            virtual IStaticModel* finalize() override { upload(); return this; }
+            virtual bool getBounds( Vector<float> bounds[2] ) override;
+            virtual const char* getClassName() const override { return "NullDriver.Model"; }
+            virtual const char* getName() const override { return name; }
+
+            virtual unsigned pick( const List<Transform>& transforms ) override { return 0; }
+            virtual unsigned pick( const Transform* transforms, size_t numTransforms ) override { return 0; }
+
+            virtual void render() override { render( nullptr, 0, true ); }
+            virtual void render( const List<Transform>& transforms ) override;
+            virtual void render( const List<Transform>** transforms, size_t count ) override;
+            virtual void render( const Transform* transforms, size_t numTransforms, bool inWorldSpace ) override;
+            virtual void render( const Transform* transforms, size_t numTransforms, const Colour& blend ) override;
+            virtual void renderInstanced( const glm::mat4* localToWorld, size_t numInstances ) override;
+            virtual void renderRange( size_t mesh, size_t offset, size_t count ) override;
+            virtual bool updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count ) override;
+    };
+
+    class ModelPreload : public IModelPreload
+    {
+        Reference<Model> model;
+
+        public:
+            li_ReferencedClass_override( ModelPreload )
+
+            ModelPreload( Model* model ) : model( model ) {}
+            virtual ~ModelPreload() {}
+
+            virtual const char* getClassName() const override { return "NullDriver.ModelPreload"; }
+            virtual IModel* getFinalized() override;
+            virtual const char* getName() const override { return model->getName(); }
+    };
+
+    class ProjectionInfoBuffer : public IProjectionInfoBuffer
+    {
+        public:
+            glm::mat4 modelView, projection;
+            Vector2<unsigned> viewport;
+    };
+
+    // Same batching as the OpenGL render queue (both are built on RenderBatcher), recorded per mesh
+    class RenderQueue : public IRenderQueue
+    {
+        struct Entry
+        {
+            Model* model;
+            size_t mesh;
+        };
+
+        NullDriver* driver;
+
+        Mutex mutex;
+
+        // Indexed the same as the batcher's items
+        List<Entry> entries;
+        RenderBatcher batcher;
+
+        // One reference per add() until the next flush
+        List<Model*> models;
+
+        bool instancing;
+
+        public:
+            RenderQueue( NullDriver* driver ) : driver( driver ), instancing( true ) {}
+            virtual ~RenderQueue();
+
+            virtual void add( IModel* model, const Transform* transforms, size_t numTransforms ) override;
+            virtual void getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws ) override;
+            virtual void render() override;
+            virtual void setInstancing( bool enabled ) override { instancing = enabled; }
+    };
+
+    class StaticModel : public IStaticModel
+    {
+        struct Batch
+        {
+            String material;
+            size_t numVertices, numTriangles;
+        };
+
+        NullDriver* driver;
+        String name;
+
+        List<Batch> batches;
+
+        bool bounded, uploaded;
+        Vector<float> bounds[2];
+
+        public:
+            li_ReferencedClass_override( StaticModel )
+
+            StaticModel( NullDriver* driver, const char* name, BspTree* bsp );
+            virtual ~StaticModel() {}
+
+            virtual IStaticModel* finalize() override;
+            virtual bool getBounds( Vector<float> bounds[2] ) override;
+            virtual const char* getClassName() const override { return "NullDriver.StaticModel"; }
+            virtual const char* getName() const override { return name; }
+            virtual void render() override;
+    };
+
+    class Texture : public ITexture
+    {
+        NullDriver* driver;
+        String name;
+
+        Vector<unsigned> dimensions;
+        size_t sizeInBytes;
+
+        bool uploaded;
+
+        public:
+            li_ReferencedClass_override( Texture )
+
+            Texture( NullDriver* driver, const char* name, const Vector<unsigned>& dimensions, size_t sizeInBytes );
+            virtual ~Texture() {}
+
+            void upload();
+
+            virtual const char* getClassName() const override { return "NullDriver.Texture"; }
+            virtual Vector<unsigned> getDimensions() override { return dimensions; }
+            virtual const char* getName() const override { return name; }
+    };
+
+    class TexturePreload : public ITexturePreload
+    {
+        Reference<Texture> texture;
+
+        public:
+            li_ReferencedClass_override( TexturePreload )
+
+            TexturePreload( Texture* texture ) : texture( texture ) {}
+            virtual ~TexturePreload() {}
+
+            virtual const char* getClassName() const override { return "NullDriver.TexturePreload"; }
+            virtual ITexture* getFinalized() override;
+            virtual const char* getName() const override { return texture->getName(); }
+    };
+
+    class RenderBuffer : public IRenderBuffer
+    {
+        public:
+            Reference<Texture> texture;
+            Vector<unsigned> dimensions;
+
+        public:
+            li_ReferencedClass_override( RenderBuffer )
+
+            RenderBuffer( Texture* texture, const Vector<unsigned>& dimensions ) : texture( texture ), dimensions( dimensions ) {}
+            virtual ~RenderBuffer() {}
+
+            virtual ITexture* getTexture() override { return texture; }
+    };
+
+    class NullDriver : public ICommandListener, public IEventListener, public IGraphicsDriver, public IR
+    {
+        struct Projection
+        {
+            glm::mat4 projection, modelView;
+        };
+
+        IEngine* engine;
+
+        // Configuration
+        bool recording;
+        int maxFrames;
+
+        // Window Management
+        Object<IEventSource> eventSource;
+        IEventListener* eventListener;
+
+        Vector2<unsigned> viewport, windowSize;
+        Vector2<int> viewportPos;
+
+        // State
+        BlendMode currentBlendMode;
+        Stack<BlendMode> blendModes;
+        Stack<ScreenRect> clippingRects;
+        Stack<Projection> projections;
+
+        RenderBuffer* currentRenderBuffer;
+        Stack<RenderBuffer*> renderBuffers;
+
+        Material* currentMaterial;
+        unsigned numDirectionalLights, numPointLights;
+
+        // Camera
+        Vector<float> eye;
+        ViewFrustum frustum;
+        glm::mat4 modelView, projection;
+
+        // Command Log
+        FrameStats stats;
+        List<Command> commands;
+
+        Reference<Material> solidMaterial;
+
+        void setRenderBuffer( RenderBuffer* renderBuffer );
+
+        public:
+            NullDriver( IEngine* engine, bool recording );
+            virtual ~NullDriver();
+
+            // NullDriver.NullDriver - Command Log
+            const List<Command>& getCommandLog() const { return commands; }
+            const Vector<float>& getEye() const { return eye; }
+            const FrameStats& getFrameStats() const { return stats; }
+            bool isRecording() const { return recording; }
+            void setRecording( bool enable ) { recording = enable; }
+
+            void onDraw( CommandType type, const String& subject, size_t primitives, size_t instances = 1 );
+            void onStateChange( CommandType type, const String& subject, size_t value = 0 );
+            void onUpload( CommandType type, const String& subject, size_t bytes );
+
+            void printCommandLog( OutputStream* output );
+
+            void selectMaterial( Material* material );
+
+            // StormGraph.ICommandListener
+            virtual bool onCommand( const List<String>& tokens ) override;
+
+            // StormGraph.IEventListener
+            virtual bool isRunning() override;
+            virtual void onCloseButton() override;
+            virtual void onFrameBegin() override;
+            virtual void onFrameEnd() override;
+            virtual void onKeyState( int16_t key, Key::State state, Unicode::Char character ) override;
+            virtual void onMouseMoveTo( const Vector2<int>& mouse ) override;
+            virtual void onRender() override;
+            virtual void onViewportResize( const Vector2<unsigned>& dimensions ) override;
+
+            // StormGraph.IGraphicsDriver
+            virtual void setPointLightShadowMap( unsigned index, ITexture* depthMap, const glm::mat4& shadowMapMatrix ) override;
+
+            virtual int addDirectionalLight( const DirectionalLightProperties& properties, bool inWorldSpace ) override;
+            virtual int addPointLight( const PointLightProperties& properties, bool inWorldSpace ) override;
+            virtual void beginDepthRendering() override;
+            virtual void beginPicking() override;
+            virtual void beginShadowMapping( ITexture* shadowTexture, const glm::mat4& textureMatrix ) override;
+            virtual void changeDisplayMode( DisplayMode* displayMode ) override;
+            virtual void clear() override;
+            virtual void clearLights() override;
+            virtual IModel* createCuboid( const char* name, CuboidCreationInfo* cuboid ) override;
+            virtual IModel* createCuboid( const char* name, const CuboidCreationInfo2& creationInfo, IMaterial* material, unsigned flags ) override;
+            virtual ITexture* createDepthTexture( const char* name, const Vector2<unsigned>& resolution ) override;
+            virtual ILight* createDirectionalLight( const Vector<float>& direction, const Colour& ambient, const Colour& diffuse, const Colour& specular ) override;
+            virtual IMaterial* createCustomMaterial( const char* name, IShaderProgram* shader ) override { return nullptr; }
+            virtual IShaderProgram* createCustomShader( const char* base, const char* name ) override { return nullptr; }
+            virtual IFont* createFontFromStream( const char* name, SeekableInputStream* input, unsigned size, unsigned style ) override;
+            virtual IMaterial* createMaterial( const char* name, const MaterialProperties2* material, bool finalized ) override;
+            virtual IModel* createModelFromMemory( const char* name, MeshCreationInfo2* meshes, size_t count, unsigned flags ) override;
+            virtual IModel* createModelFromMemory( const char* name, MeshCreationInfo2** meshes, size_t count, unsigned flags ) override;
+            virtual IModel* createModelFromMemory( const char* name, MeshCreationInfo3* meshes, size_t count, unsigned flags ) override;
+            virtual IModel* createModelFromMemory( const char* name, MeshCreationInfo3** meshes, size_t count, unsigned flags ) override;
+            virtual IModel* createPlane( const char* name, PlaneCreationInfo* plane ) override;
+            virtual ILight* createPointLight( float range, const Colour& ambient, const Colour& diffuse, const Colour& specular ) override;
+            virtual IProjectionInfoBuffer* createProjectionInfoBuffer() override { return new ProjectionInfoBuffer; }
+            virtual IRenderBuffer* createRenderBuffer( const Vector<unsigned>& dimensions, bool withDepthBuffer ) override;
+            virtual IRenderBuffer* createRenderBuffer( ITexture* depthTexture ) override;
+            virtual IRenderQueue* createRenderQueue() override { return new RenderQueue( this ); }
+            virtual IMaterial* createSolidMaterial( const char* name, const Colour& colour, ITexture* texture ) override;
+            virtual ITexture* createSolidTexture( const char* name, const Colour& colour ) override;
+            virtual IStaticModel* createStaticModelFromBsp( const char* name, BspTree* bsp, IResourceManager* resMgr, bool finalized ) override;
+            virtual IModel* createTerrain( const char* name, TerrainCreationInfo* terrain, unsigned modelFlags ) override;
+            virtual ITexture* createTextureFromStream( SeekableInputStream* input, const char* name, ILodFunction* lodFunction ) override;
+            virtual void drawLine( const Vector<float>& a, const Vector<float>& b, const Colour& blend ) override;
+            virtual void drawRectangle( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture ) override;
+            virtual void drawRectangleOutline( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture ) override;
+            virtual void drawStats() override {}
+            virtual void endDepthRendering() override;
+            virtual unsigned endPicking( const Vector2<unsigned>& samplePos ) override;
+            virtual void endShadowMapping() override;
+            virtual void getDriverInfo( Info* info ) override;
+            virtual IEventListener* getEventListener() override { return this; }
+            virtual int16_t getKey( const char* name ) override;
+            virtual String getKeyName( int16_t code ) override;
+            virtual const glm::mat4& getModelView() override { return modelView; }
+            virtual void getProjectionInfo( IProjectionInfoBuffer* projectionInfoBuffer ) override;
+            virtual IMaterial* getSolidMaterial() override;
+            virtual const ViewFrustum* getViewFrustum() override { return &frustum; }
+            virtual Vector2<unsigned> getViewportSize() override { return viewport; }
+            virtual Vector2<unsigned> getWindowSize() override { return windowSize; }
+            virtual ITexturePreload* preloadTextureFromStream( SeekableInputStream* input, const char* name, ILodFunction* lodFunction ) override;
+            virtual IModelPreload* preloadModelFromMemory( const char* name, MeshCreationInfo2* meshes, size_t count, unsigned flags ) override;
+            virtual IModelPreload* preloadModelFromMemory( const char* name, MeshCreationInfo2** meshes, size_t count, unsigned flags ) override;
+            virtual void runMainLoop( IEventListener* eventListener ) override;
+            virtual void popBlendMode() override;
+            virtual void popClippingRect() override;
+            virtual void popProjection() override;
+            virtual void popRenderBuffer() override;
+            virtual void pushBlendMode( BlendMode blendMode ) override;
+            virtual void pushClippingRect( const ScreenRect& clippingRect ) override;
+            virtual void pushProjection() override;
+            virtual void pushRenderBuffer( IRenderBuffer* renderBuffer ) override;
+            virtual void set2dMode( float nearZ, float farZ ) override;
+            virtual void set3dMode( float nearZ, float farZ ) override;
+            virtual void setCamera( const Camera* camera ) override;
+            virtual void setCamera( const Vector<float>& eye, const Vector<float>& center, const Vector<float>& up ) override;
+            virtual void setClearColour( const Colour& colour ) override;
+            virtual void setDisplayMode( DisplayMode* displayMode ) override;
+            virtual void setEventSource( IEventSource* eventSource ) override;
+            virtual void setLevelOfDetail( LevelOfDetail* lod ) override {}
+            virtual void setOrthoProjection( const Vector2<float>& leftRight, const Vector2<float>& topBottom, const Vector2<float>& nearFar ) override;
+            virtual void setPerspectiveProjection( float nearZ, float farZ, float fov ) override;
+            virtual void setProjection( const glm::mat4& projection ) override;
+            virtual void setRenderFlag( RenderFlag flag, bool value ) override;
+            virtual void setSceneAmbient( const Colour& colour ) override;
+            virtual void setViewport( const Vector2<int>& pos, const Vector2<unsigned>& size, const Vector2<unsigned>& windowSize ) override;
+            virtual void setViewTransform( const glm::mat4& viewTransform ) override;
+            virtual void startup() override {}
+            virtual void unload() override;
+            virtual bool unproject( const Vector2<float>& windowSpace, Vector<float>& worldSpace, IProjectionInfoBuffer* projectionInfoBuffer ) override;
+            virtual Vector<float> unproject( const Vector<>& windowSpace, IProjectionInfoBuffer* projectionInfoBuffer ) override;
+
+            // 2012 new stuff
+            virtual void draw2dCenteredRotated( ITexture* texture, float scale, float angle, const Colour& blend ) override;
+            virtual StormRender::IR* getR() override { return this; }
+
+            virtual void beginFrame() override { onFrameBegin(); }
+            virtual void endFrame() override { onFrameEnd(); }
+            virtual Event_t* getEvent() override { return nullptr; }
+    };
+
+    const char* getCommandName( CommandType type );
+}
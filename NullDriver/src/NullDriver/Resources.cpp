@@ -0,0 +1,504 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "NullDriver.hpp"
+
+namespace NullDriver
+{
+    static size_t getPrimitiveCount( MeshFormat format, size_t count )
+    {
+        switch ( format )
+        {
+            case MeshFormat::lineList: return count / 2;
+            case MeshFormat::lineStrip: return ( count > 0 ) ? count - 1 : 0;
+            case MeshFormat::pointList: return count;
+            case MeshFormat::triangleList: return count / 3;
+        }
+
+        return 0;
+    }
+
+    Font::Font( NullDriver* driver, const char* name, unsigned size, unsigned style )
+            : driver( driver ), name( name ), size( size ), style( style )
+    {
+        // Fixed-pitch metrics; good enough for layout code that only needs consistent, non-zero dimensions
+        advance = size * 0.6f;
+        lineSkip = ( float ) ( size + size / 5 );
+
+        driver->onUpload( CommandType::uploadFont, name, 0 );
+    }
+
+    Font::~Font()
+    {
+    }
+
+    void Font::drawString( const Vector2<>& pos, const String& string, const Colour& colour, unsigned short align )
+    {
+        driver->onDraw( CommandType::drawText, name, string.getNumBytes() * 2 );
+    }
+
+    void Font::drawText( const Vector2<>& pos, const Text* text, float alpha )
+    {
+        SG_assert3( text != nullptr, "NullDriver.Font.drawText" )
+
+        const Layout* layout = ( const Layout* ) text;
+
+        driver->onDraw( CommandType::drawText, name, layout->string.getNumBytes() * 2 );
+    }
+
+    Vector2<float> Font::getTextDimensions( Text* text )
+    {
+        return ( ( Layout* ) text )->dimensions;
+    }
+
+    Text* Font::layoutText( const String& text, const Colour& colour, unsigned short align )
+    {
+        Layout* layout = new Layout;
+        layout->string = text;
+        layout->colour = colour;
+        layout->align = align;
+        layout->dimensions = measure( text );
+
+        return ( Text* ) layout;
+    }
+
+    Vector2<float> Font::measure( const String& string )
+    {
+        const size_t length = string.getNumBytes();
+
+        unsigned numLines = 1, lineLength = 0, maxLineLength = 0;
+
+        for ( size_t i = 0; i < length; i++ )
+        {
+            if ( string[i] == '\n' )
+            {
+                numLines++;
+                lineLength = 0;
+            }
+            else
+                maxLineLength = maximum( maxLineLength, ++lineLength );
+        }
+
+        return Vector2<float>( maxLineLength * advance, numLines * lineSkip );
+    }
+
+    void Font::releaseText( Text* text )
+    {
+        delete ( Layout* ) text;
+    }
+
+    void Font::renderString( float x, float y, const String& string, const Colour& colour, unsigned short align )
+    {
+        drawString( Vector2<>( x, y ), string, colour, align );
+    }
+
+    void Font::renderText( float x, float y, const Text* text )
+    {
+        drawText( Vector2<>( x, y ), text );
+    }
+
+    Light::Light( NullDriver* driver, const Vector<float>& direction, const Colour& ambient, const Colour& diffuse, const Colour& specular )
+            : driver( driver ), type( directional )
+    {
+        directional.ambient = ambient;
+        directional.diffuse = diffuse;
+        directional.direction = direction;
+        directional.specular = specular;
+    }
+
+    Light::Light( NullDriver* driver, float range, const Colour& ambient, const Colour& diffuse, const Colour& specular )
+            : driver( driver ), type( point )
+    {
+        point.ambient = ambient;
+        point.diffuse = diffuse;
+        point.range = range;
+        point.specular = specular;
+    }
+
+    void Light::render( const Transform* transforms, size_t numTransforms, bool inWorldSpace )
+    {
+        if ( type == directional )
+            driver->addDirectionalLight( directional, inWorldSpace );
+        else
+            driver->addPointLight( point, inWorldSpace );
+    }
+
+    static unsigned nextMaterialId = 0;
+
+    Material::Material( NullDriver* driver, const char* name, const Colour& colour, size_t numTextures )
+            : driver( driver ), name( name ), colour( colour ), numTextures( numTextures )
+    {
+        id = nextMaterialId++;
+    }
+
+    void Material::apply()
+    {
+        driver->selectMaterial( this );
+    }
+
+    void Material::setColour( const Colour& colour )
+    {
+        this->colour = colour;
+    }
+
+    Model::Model( NullDriver* driver, const char* name, MeshCreationInfo2** meshes, size_t count )
+            : driver( driver ), name( name ), bounded( false ), uploaded( false )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const MeshCreationInfo2* mesh = meshes[i];
+
+            addMesh( mesh->format, mesh->layout, mesh->material, mesh->numVertices, mesh->numIndices );
+
+            for ( size_t j = 0; j < mesh->numVertices; j++ )
+                addBounds( mesh->vertices[j].pos );
+        }
+    }
+
+    Model::Model( NullDriver* driver, const char* name, MeshCreationInfo3** meshes, size_t count )
+            : driver( driver ), name( name ), bounded( false ), uploaded( false )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const MeshCreationInfo3* mesh = meshes[i];
+
+            addMesh( mesh->format, mesh->layout, mesh->material, mesh->numVertices, mesh->numIndices );
+
+            for ( size_t j = 0; j < mesh->numVertices; j++ )
+                addBounds( Vector<float>( mesh->coords[j * 3], mesh->coords[j * 3 + 1], mesh->coords[j * 3 + 2] ) );
+        }
+    }
+
+    Model::~Model()
+    {
+    }
+
+    void Model::addBounds( const Vector<float>& pos )
+    {
+        if ( !bounded )
+        {
+            bounds[0] = pos;
+            bounds[1] = pos;
+            bounded = true;
+            return;
+        }
+
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            bounds[0].set( axis, minimum( bounds[0].get( axis ), pos.get( axis ) ) );
+            bounds[1].set( axis, maximum( bounds[1].get( axis ), pos.get( axis ) ) );
+        }
+    }
+
+    void Model::addMesh( MeshFormat format, MeshLayout layout, IMaterial* material, size_t numVertices, size_t numIndices )
+    {
+        Mesh mesh;
+
+        mesh.format = format;
+        mesh.layout = layout;
+        mesh.material = static_cast<Material*>( material );
+        mesh.numVertices = numVertices;
+        mesh.numIndices = ( layout == MeshLayout::indexed ) ? numIndices : 0;
+        mesh.numPrimitives = getPrimitiveCount( format, ( layout == MeshLayout::indexed ) ? numIndices : numVertices );
+
+        meshes.add( ( Mesh&& ) mesh );
+    }
+
+    bool Model::getBounds( Vector<float> bounds[2] )
+    {
+        if ( !bounded )
+            return false;
+
+        bounds[0] = this->bounds[0];
+        bounds[1] = this->bounds[1];
+        return true;
+    }
+
+    size_t Model::getSizeInBytes() const
+    {
+        size_t size = 0;
+
+        for each_in_list ( meshes, i )
+            size += meshes[i].numVertices * sizeof( Vertex ) + meshes[i].numIndices * sizeof( unsigned );
+
+        return size;
+    }
+
+    void Model::render( const List<Transform>& transforms )
+    {
+        render( transforms.getPtrUnsafe(), transforms.getLength(), true );
+    }
+
+    void Model::render( const List<Transform>** transforms, size_t count )
+    {
+        for ( size_t i = 0; i < count; i++ )
+            render( *transforms[i] );
+    }
+
+    void Model::render( const Transform* transforms, size_t numTransforms, bool inWorldSpace )
+    {
+        for each_in_list ( meshes, i )
+        {
+            const Mesh& mesh = meshes[i];
+
+            if ( mesh.material != nullptr )
+                mesh.material->apply();
+
+            driver->onDraw( CommandType::drawMesh, name, mesh.numPrimitives );
+        }
+    }
+
+    void Model::render( const Transform* transforms, size_t numTransforms, const Colour& blend )
+    {
+        render( transforms, numTransforms, true );
+    }
+
+    void Model::renderInstanced( const glm::mat4* localToWorld, size_t numInstances )
+    {
+        if ( numInstances == 0 )
+            return;
+
+        // One per-instance transform buffer shared by all meshes, then one instanced draw per mesh
+        driver->onUpload( CommandType::uploadInstances, name, numInstances * sizeof( glm::mat4 ) );
+
+        for each_in_list ( meshes, i )
+        {
+            const Mesh& mesh = meshes[i];
+
+            if ( mesh.material != nullptr )
+                mesh.material->apply();
+
+            driver->onDraw( CommandType::drawMesh, name, mesh.numPrimitives, numInstances );
+        }
+    }
+
+    void Model::renderMesh( size_t index, bool applyMaterial )
+    {
+        const Mesh& mesh = meshes[index];
+
+        if ( applyMaterial && mesh.material != nullptr )
+            mesh.material->apply();
+
+        driver->onDraw( CommandType::drawMesh, name, mesh.numPrimitives );
+    }
+
+    void Model::renderMeshInstanced( size_t index, size_t numInstances )
+    {
+        const Mesh& mesh = meshes[index];
+
+        driver->onUpload( CommandType::uploadInstances, name, numInstances * sizeof( glm::mat4 ) );
+
+        if ( mesh.material != nullptr )
+            mesh.material->apply();
+
+        driver->onDraw( CommandType::drawMesh, name, mesh.numPrimitives, numInstances );
+    }
+
+    void Model::renderRange( size_t mesh, size_t offset, size_t count )
+    {
+        SG_assert( mesh < meshes.getLength() )
+
+        const Mesh& renderedMesh = meshes[mesh];
+
+        if ( renderedMesh.material != nullptr )
+            renderedMesh.material->apply();
+
+        driver->onDraw( CommandType::drawMesh, name, getPrimitiveCount( renderedMesh.format, count ) );
+    }
+
+    bool Model::updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count )
+    {
+        SG_assert( mesh < meshes.getLength() )
+
+        if ( offset + count > meshes[mesh].numVertices )
+            return false;
+
+        driver->onUpload( CommandType::uploadMesh, name, count * sizeof( Vertex ) );
+        return true;
+    }
+
+    void Model::upload()
+    {
+        if ( uploaded )
+            return;
+
+        driver->onUpload( CommandType::uploadMesh, name, getSizeInBytes() );
+        uploaded = true;
+    }
+
+    IModel* ModelPreload::getFinalized()
+    {
+        // Uploads are only ever recorded on the main thread; preloads may be created elsewhere
+        model->upload();
+
+        return model->reference();
+    }
+
+    RenderQueue::~RenderQueue()
+    {
+        iterate ( models )
+            models.current()->release();
+    }
+
+    void RenderQueue::add( IModel* model, const Transform* transforms, size_t numTransforms )
+    {
+        Model* nullModel = static_cast<Model*>( model );
+
+        Entry entry;
+        entry.model = nullModel;
+
+        RenderBatcher::Item item;
+        item.program = 0;
+        item.texture = 0;
+        item.localToWorld = Transform::compose( transforms, numTransforms );
+
+        CriticalSection cs( mutex );
+
+        models.add( nullModel->reference() );
+
+        for ( size_t i = 0; i < nullModel->getNumMeshes(); i++ )
+        {
+            Material* material = nullModel->getMeshMaterial( i );
+
+            // There are no programs or textures here, so the material is the only state to group by
+            item.mesh = nullModel->getMeshKey( i );
+            item.material = ( material != nullptr ) ? material->id + 1 : 0;
+            item.blended = ( material != nullptr && material->isBlended() );
+
+            entry.mesh = i;
+            entries.add( entry );
+            batcher.add( item );
+        }
+    }
+
+    void RenderQueue::getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws )
+    {
+        CriticalSection cs( mutex );
+
+        batcher.getInstancingStats( numInstanced, numInstancedDraws );
+    }
+
+    void RenderQueue::render()
+    {
+        CriticalSection cs( mutex );
+
+        batcher.build( driver->getEye(), instancing );
+
+        const List<RenderBatcher::Run>& runs = batcher.getRuns();
+
+        for ( size_t i = 0; i < runs.getLength(); i++ )
+        {
+            const RenderBatcher::Run& run = runs[i];
+            const Entry& entry = entries[batcher.getItemIndex( run.first )];
+
+            if ( run.count > 1 )
+                entry.model->renderMeshInstanced( entry.mesh, run.count );
+            else
+                entry.model->renderMesh( entry.mesh, run.applyMaterial );
+        }
+
+        entries.clear();
+        batcher.clear();
+
+        iterate ( models )
+            models.current()->release();
+
+        models.clear();
+    }
+
+    StaticModel::StaticModel( NullDriver* driver, const char* name, BspTree* bsp )
+            : driver( driver ), name( name ), bounded( false ), uploaded( false )
+    {
+        for ( size_t i = 0; i < bsp->materials.getLength(); i++ )
+        {
+            Batch batch = { bsp->materials[i].name, bsp->vertices[i].getLength(), bsp->totalTriangles[i] };
+            batches.add( ( Batch&& ) batch );
+        }
+
+        if ( bsp->root != nullptr )
+        {
+            bounds[0] = bsp->root->bounds[0];
+            bounds[1] = bsp->root->bounds[1];
+            bounded = true;
+        }
+    }
+
+    IStaticModel* StaticModel::finalize()
+    {
+        if ( !uploaded )
+        {
+            size_t size = 0;
+
+            for each_in_list ( batches, i )
+                size += batches[i].numVertices * sizeof( Vertex ) + batches[i].numTriangles * 3 * sizeof( unsigned );
+
+            driver->onUpload( CommandType::uploadMesh, name, size );
+            uploaded = true;
+        }
+
+        return this;
+    }
+
+    bool StaticModel::getBounds( Vector<float> bounds[2] )
+    {
+        if ( !bounded )
+            return false;
+
+        bounds[0] = this->bounds[0];
+        bounds[1] = this->bounds[1];
+        return true;
+    }
+
+    void StaticModel::render()
+    {
+        // Batches only know their material by name; forget the cached one so that the next Model re-applies its own
+        driver->selectMaterial( nullptr );
+
+        for each_in_list ( batches, i )
+        {
+            driver->onStateChange( CommandType::setMaterial, batches[i].material );
+            driver->onDraw( CommandType::drawMesh, name, batches[i].numTriangles );
+        }
+    }
+
+    Texture::Texture( NullDriver* driver, const char* name, const Vector<unsigned>& dimensions, size_t sizeInBytes )
+            : driver( driver ), name( name ), dimensions( dimensions ), sizeInBytes( sizeInBytes ), uploaded( false )
+    {
+    }
+
+    void Texture::upload()
+    {
+        if ( uploaded )
+            return;
+
+        driver->onUpload( CommandType::uploadTexture, name, sizeInBytes );
+        uploaded = true;
+    }
+
+    ITexture* TexturePreload::getFinalized()
+    {
+        texture->upload();
+
+        return texture->reference();
+    }
+}
@@ -149,34 +149,36 @@ namespace OpenGlDriver
 
         iterate ( node->meshes )
         {
-            unsigned materialIndex = node->meshes.current()->material;
+            BspMesh* bspMesh = node->meshes.current();
+            unsigned materialIndex = bspMesh->material;
 
             SG_assert( materialIndex < materialGroups.getLength() )
 
             Object<BspRenderMesh> mesh = new BspRenderMesh;
             mesh->material = materialIndex;
 
+            const unsigned* bspIndices = bspMesh->getIndices();
+            const size_t numIndices = bspMesh->getNumIndices();
+
             if ( !wireframe )
             {
                 mesh->indexOffset = currentOffset[materialIndex];
-                mesh->indexCount = node->meshes.current()->indices.getLength();
+                mesh->indexCount = numIndices;
 
-                materialGroups[materialIndex]->updateIndices( mesh->indexOffset, node->meshes.current()->indices.getPtr(), mesh->indexCount );
+                materialGroups[materialIndex]->updateIndices( mesh->indexOffset, bspIndices, mesh->indexCount );
             }
             else
             {
-                size_t numIndices = node->meshes.current()->indices.getLength();
-
                 Array<unsigned> indices( numIndices * 2 );
 
-                for ( size_t i = 0; i < node->meshes.current()->indices.getLength() / 3; i++ )
+                for ( size_t i = 0; i < numIndices / 3; i++ )
                 {
-                    indices[i * 6] = node->meshes.current()->indices[i * 3];
-                    indices[i * 6 + 1] = node->meshes.current()->indices[i * 3 + 1];
-                    indices[i * 6 + 2] = node->meshes.current()->indices[i * 3 + 1];
-                    indices[i * 6 + 3] = node->meshes.current()->indices[i * 3 + 2];
-                    indices[i * 6 + 4] = node->meshes.current()->indices[i * 3 + 2];
-                    indices[i * 6 + 5] = node->meshes.current()->indices[i * 3];
+                    indices[i * 6] = bspIndices[i * 3];
+                    indices[i * 6 + 1] = bspIndices[i * 3 + 1];
+                    indices[i * 6 + 2] = bspIndices[i * 3 + 1];
+                    indices[i * 6 + 3] = bspIndices[i * 3 + 2];
+                    indices[i * 6 + 4] = bspIndices[i * 3 + 2];
+                    indices[i * 6 + 5] = bspIndices[i * 3];
                 }
 
                 mesh->indexOffset = currentOffset[materialIndex];
@@ -204,6 +206,16 @@ namespace OpenGlDriver
         return this;
     }
 
+    bool BspModel::getBounds( Vector<float> bounds[2] )
+    {
+        if ( root == nullptr )
+            return false;
+
+        bounds[0] = root->bounds[0];
+        bounds[1] = root->bounds[1];
+        return true;
+    }
+
     size_t BspModel::getMeshCount()
     {
         return 0;
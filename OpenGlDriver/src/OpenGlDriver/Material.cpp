@@ -25,8 +25,10 @@
 
 namespace OpenGlDriver
 {
+    static unsigned nextMaterialId = 0;
+
     Material::Material( OpenGlDriver* driver, const char* name, const MaterialProperties2* properties, bool finalized )
-            : driver( driver ), name( name ), dynamicLighting( false ), lightMapping( false ), receivesShadows( false ), queueEntry( nullptr )
+            : driver( driver ), name( name ), id( nextMaterialId++ ), dynamicLighting( false ), lightMapping( false ), receivesShadows( false )
     {
         SG_assert( properties != nullptr )
 
@@ -72,7 +74,7 @@ namespace OpenGlDriver
         Resource::remove( this );
     }
 
-    void Material::apply()
+    void Material::apply( bool instanced )
     {
         ShaderProgram* shaderProgram = nullptr;
 
@@ -81,7 +83,7 @@ namespace OpenGlDriver
             if ( shaderProgramSet == nullptr )
                 getShaderSet();
 
-            shaderProgram = shaderProgramSet->getShaderProgram( dynamicLighting );
+            shaderProgram = shaderProgramSet->getShaderProgram( dynamicLighting, instanced );
 
             if ( driver->renderState.currentMaterialColour != this )
             {
@@ -58,13 +58,15 @@ namespace OpenGlDriver
     }
 
     Mesh::Mesh( OpenGlDriver* driver, MeshPreload* preload, bool finalized )
-            : driver( driver ), nextQueued( nullptr )
+            : driver( driver ), nextQueued( nullptr ), hasBounds( false )
     {
         SG_assert( preload != nullptr )
 
         localData = preload;
         fixLocalUvs();
 
+        computeBounds( localData->coords.getPtr(), localData->coords.getLength() / 3 );
+
         if ( finalized )
             finalize();
     }
@@ -101,10 +103,12 @@ namespace OpenGlDriver
     }*/
 
     Mesh::Mesh( OpenGlDriver* driver, MeshCreationInfo3* creationInfo, unsigned flags, bool finalize )
-            : driver( driver ), nextQueued( nullptr )
+            : driver( driver ), nextQueued( nullptr ), hasBounds( false )
     {
         SG_assert( creationInfo != nullptr )
 
+        computeBounds( creationInfo->coords, creationInfo->numVertices );
+
         if ( finalize )
         {
             initStructs( getRenderMode( creationInfo->format ), creationInfo->layout, static_cast<Material*>( creationInfo->material ) );
@@ -166,6 +170,29 @@ namespace OpenGlDriver
         }
     }
 
+    void Mesh::computeBounds( const float* coords, size_t numVertices )
+    {
+        if ( coords == nullptr || numVertices == 0 )
+            return;
+
+        bounds[0] = Vector<float>( coords[0], coords[1], coords[2] );
+        bounds[1] = bounds[0];
+
+        for ( size_t i = 1; i < numVertices; i++ )
+        {
+            const float* pos = coords + i * 3;
+
+            bounds[0].x = minimum( bounds[0].x, pos[0] );
+            bounds[0].y = minimum( bounds[0].y, pos[1] );
+            bounds[0].z = minimum( bounds[0].z, pos[2] );
+            bounds[1].x = maximum( bounds[1].x, pos[0] );
+            bounds[1].y = maximum( bounds[1].y, pos[1] );
+            bounds[1].z = maximum( bounds[1].z, pos[2] );
+        }
+
+        hasBounds = true;
+    }
+
     void Mesh::beginRender( bool flat )
     {
         // General Mesh Render Setup
@@ -605,6 +632,28 @@ namespace OpenGlDriver
         }
     }
 
+    void Mesh::doRenderInstanced( size_t numInstances )
+    {
+        SG_assert( driverShared.useVertexBuffers )
+
+        if ( remoteData->layout == MeshLayout::indexed )
+        {
+            glApi.functions.glDrawElementsInstanced( remoteData->renderMode, remoteData->numIndices, remoteData->indexFormat, offsetToPtr( 0 ), numInstances );
+            stats.numRenderCalls++;
+
+            if ( remoteData->renderMode == GL_TRIANGLES )
+                stats.numPolys += remoteData->numIndices / 3 * numInstances;
+        }
+        else
+        {
+            glApi.functions.glDrawArraysInstanced( remoteData->renderMode, 0, remoteData->numVertices, numInstances );
+            stats.numRenderCalls++;
+
+            if ( remoteData->renderMode == GL_TRIANGLES )
+                stats.numPolys += remoteData->numVertices / 3 * numInstances;
+        }
+    }
+
     void Mesh::doRenderRange( size_t offset, size_t count )
     {
         if ( driverShared.useVertexBuffers )
@@ -736,6 +785,16 @@ namespace OpenGlDriver
                 localData->uvs[i][j] = 1.0f - localData->uvs[i][j];
     }
 
+    bool Mesh::getBounds( Vector<float> bounds[2] )
+    {
+        if ( !hasBounds )
+            return false;
+
+        bounds[0] = this->bounds[0];
+        bounds[1] = this->bounds[1];
+        return true;
+    }
+
     size_t Mesh::getNumVertices()
     {
         if ( driverShared.useVertexBuffers )
@@ -1093,6 +1152,77 @@ namespace OpenGlDriver
         endRender( false );
     }
 
+    void Mesh::renderInstanced( const glm::mat4* localToWorld, size_t numInstances, Material* material )
+    {
+        // With instancing available, localToWorld must have been uploaded by OpenGlDriver::uploadInstances
+
+        if ( material == nullptr )
+        {
+            if ( driverShared.useVertexBuffers )
+                material = remoteData->material;
+            else
+                material = localData->material;
+        }
+
+        SG_assert3( material != nullptr, "OpenGlDriver.Mesh.renderInstanced" )
+
+        if ( driverShared.haveInstancing && driver->globalState.shadersEnabled )
+        {
+            material->apply( true );
+
+            const GLint instanceToWorld = driver->renderState.currentShaderProgram->getInstanceToWorld();
+
+            beginRender( false );
+
+            // A mat4 attribute takes 4 consecutive locations, one per column
+            if ( instanceToWorld >= 0 )
+            {
+                glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, driver->instanceBuffer );
+
+                for ( GLint column = 0; column < 4; column++ )
+                {
+                    glApi.functions.glEnableVertexAttribArray( instanceToWorld + column );
+                    glApi.functions.glVertexAttribPointer( instanceToWorld + column, 4, GL_FLOAT, GL_FALSE, sizeof( glm::mat4 ), offsetToPtr( column * sizeof( glm::vec4 ) ) );
+                    glApi.functions.glVertexAttribDivisor( instanceToWorld + column, 1 );
+                }
+
+                glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, remoteData->vbo );
+            }
+
+            doRenderInstanced( numInstances );
+
+            if ( instanceToWorld >= 0 )
+            {
+                for ( GLint column = 0; column < 4; column++ )
+                    glApi.functions.glDisableVertexAttribArray( instanceToWorld + column );
+            }
+
+            endRender( false );
+        }
+        else
+        {
+            // No instancing; still set up the material and vertex arrays only once for all the instances
+            material->apply();
+
+            beginRender( false );
+
+            for ( size_t i = 0; i < numInstances; i++ )
+            {
+                if ( driver->globalState.shadersEnabled )
+                    driver->renderState.currentShaderProgram->setLocalToWorld( localToWorld[i] );
+
+                glPushMatrix();
+                glMultMatrixf( &localToWorld[i][0][0] );
+
+                doRenderAll();
+
+                glPopMatrix();
+            }
+
+            endRender( false );
+        }
+    }
+
     void Mesh::renderRange( size_t offset, size_t count, Material* material )
     {
         if ( material == nullptr )
@@ -1214,27 +1344,85 @@ namespace OpenGlDriver
         return false;
     }*/
 
-    /*bool Mesh::updateVertices( unsigned offset, const Vertex* vertices, unsigned count )
+    bool Mesh::updateVertices( size_t offset, const Vertex* vertices, size_t count )
     {
-        if ( vbo != 0 )
+        if ( offset + count > getNumVertices() )
+            return false;
+
+        if ( driverShared.useVertexBuffers )
         {
-            SG_assert( ( offset + count ) * sizeof( Vertex ) <= vboCapacity );
+            // Repack into the interleaved layout chosen in loadVertices; UVs are flipped the same way
+            const VertexProperties& properties = remoteData->vertexProperties;
 
-            glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, vbo );
+            Array<float> packed( count * remoteData->vertexSize / sizeof( float ) );
+            float* vertexBuffer = packed.getPtr();
 
-            if ( !isSimple )
+            for ( size_t i = 0; i < count; i++ )
             {
-                //printf( "Simple updateVertexCoords: updating %u vertices from %u (byte ranges %u to %u)\n", count, offset, offset * sizeof( float ), ( offset + count ) * sizeof( float ) );
-                glApi.functions.glBufferSubData( GL_ARRAY_BUFFER, offset * sizeof( Vertex ), count * sizeof( Vertex ), vertices );
+                const Vertex& v = vertices[i];
+
+                *( vertexBuffer++ ) = v.pos.x;
+                *( vertexBuffer++ ) = v.pos.y;
+                *( vertexBuffer++ ) = v.pos.z;
+
+                if ( properties.hasNormals )
+                {
+                    *( vertexBuffer++ ) = v.normal.x;
+                    *( vertexBuffer++ ) = v.normal.y;
+                    *( vertexBuffer++ ) = v.normal.z;
+                }
+
+                for ( size_t j = 0; j < properties.numTextures; j++ )
+                {
+                    *( vertexBuffer++ ) = v.uv[j].x;
+                    *( vertexBuffer++ ) = 1.0f - v.uv[j].y;
+                }
+
+                if ( properties.hasLightUvs )
+                {
+                    *( vertexBuffer++ ) = v.lightUv.x;
+                    *( vertexBuffer++ ) = 1.0f - v.lightUv.y;
+                }
             }
 
+            glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, remoteData->vbo );
+            glApi.functions.glBufferSubData( GL_ARRAY_BUFFER, offset * remoteData->vertexSize, count * remoteData->vertexSize, packed.getPtr() );
             glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, 0 );
         }
-        //else
-            //glApi.functions.glBufferData( GL_ARRAY_BUFFER, numVertices * sizeof( Vertex ), nullptr, usage );
-        //else
-//            data->vertices
+        else
+        {
+            const bool hasNormals = !localData->normals.isEmpty();
 
-        return false;
-    }*/
+            for ( size_t i = 0; i < count; i++ )
+            {
+                const Vertex& v = vertices[i];
+                const size_t index = offset + i;
+
+                localData->coords.getUnsafe( index * 3 ) = v.pos.x;
+                localData->coords.getUnsafe( index * 3 + 1 ) = v.pos.y;
+                localData->coords.getUnsafe( index * 3 + 2 ) = v.pos.z;
+
+                if ( hasNormals )
+                {
+                    localData->normals.getUnsafe( index * 3 ) = v.normal.x;
+                    localData->normals.getUnsafe( index * 3 + 1 ) = v.normal.y;
+                    localData->normals.getUnsafe( index * 3 + 2 ) = v.normal.z;
+                }
+
+                for ( size_t j = 0; j < TEXTURES_PER_VERTEX && !localData->uvs[j].isEmpty(); j++ )
+                {
+                    localData->uvs[j].getUnsafe( index * 2 ) = v.uv[j].x;
+                    localData->uvs[j].getUnsafe( index * 2 + 1 ) = 1.0f - v.uv[j].y;
+                }
+
+                if ( !localData->lightUvs.isEmpty() )
+                {
+                    localData->lightUvs.getUnsafe( index * 2 ) = v.lightUv.x;
+                    localData->lightUvs.getUnsafe( index * 2 + 1 ) = 1.0f - v.lightUv.y;
+                }
+            }
+        }
+
+        return true;
+    }
 }
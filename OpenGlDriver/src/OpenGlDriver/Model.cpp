@@ -171,6 +171,37 @@ namespace OpenGlDriver
         return this;
     }
 
+    bool Model::getBounds( Vector<float> bounds[2] )
+    {
+        bool haveAny = false;
+
+        iterate2 ( mesh, meshes )
+        {
+            Vector<float> meshBounds[2];
+
+            if ( !mesh->getBounds( meshBounds ) )
+                return false;
+
+            if ( !haveAny )
+            {
+                bounds[0] = meshBounds[0];
+                bounds[1] = meshBounds[1];
+                haveAny = true;
+            }
+            else
+            {
+                bounds[0].x = minimum( bounds[0].x, meshBounds[0].x );
+                bounds[0].y = minimum( bounds[0].y, meshBounds[0].y );
+                bounds[0].z = minimum( bounds[0].z, meshBounds[0].z );
+                bounds[1].x = maximum( bounds[1].x, meshBounds[1].x );
+                bounds[1].y = maximum( bounds[1].y, meshBounds[1].y );
+                bounds[1].z = maximum( bounds[1].z, meshBounds[1].z );
+            }
+        }
+
+        return haveAny;
+    }
+
     size_t Model::getMeshCount()
     {
         return meshes.getLength();
@@ -262,6 +293,26 @@ namespace OpenGlDriver
         glPopMatrix();
     }
 
+    void Model::renderInstanced( const glm::mat4* localToWorld, size_t numInstances )
+    {
+        if ( numInstances == 0 )
+            return;
+
+        // All meshes share the instance buffer, so it is only uploaded once
+        if ( driverShared.haveInstancing && driver->globalState.shadersEnabled )
+            driver->uploadInstances( localToWorld, numInstances );
+
+        iterate ( meshes )
+            meshes.current()->renderInstanced( localToWorld, numInstances );
+    }
+
+    void Model::renderRange( size_t mesh, size_t offset, size_t count )
+    {
+        SG_assert( mesh < meshes.getLength() )
+
+        meshes[mesh]->renderRange( offset, count );
+    }
+
     /*bool Model::retrieveVertices( size_t mesh, size_t offset, Vertex* vertices, size_t count )
     {
         SG_assert( mesh < meshes.getLength() )
@@ -276,10 +327,10 @@ namespace OpenGlDriver
         return meshes[mesh]->updateVertexCoords( vertex, coords, count );
     }*/
 
-   /* bool Model::updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count )
+    bool Model::updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count )
     {
         SG_assert( mesh < meshes.getLength() )
 
         return meshes[mesh]->updateVertices( offset, vertices, count );
-    }*/
+    }
 }
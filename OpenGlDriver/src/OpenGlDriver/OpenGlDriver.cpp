@@ -91,7 +91,8 @@ namespace OpenGlDriver
         Gl_vbos = 4,
         Gl_shaders = 8,
         Gl_renderbuffers = 16,
-        Gl_vaos = 32
+        Gl_vaos = 32,
+        Gl_instancing = 64
     };
 
     struct GlFunction
@@ -129,6 +130,10 @@ namespace OpenGlDriver
         { "glDeleteProgram",                Gl_shaders },
         { "glDeleteShader",                 Gl_shaders },
         { "glDetachShader",                 Gl_shaders },
+        { "glDisableVertexAttribArray",     Gl_instancing },
+        { "glDrawArraysInstancedARB",       Gl_instancing },
+        { "glDrawElementsInstancedARB",     Gl_instancing },
+        { "glEnableVertexAttribArray",      Gl_instancing },
         { "glFramebufferRenderbufferEXT",   Gl_renderbuffers },
         { "glFramebufferTexture2DEXT",      Gl_renderbuffers },
         { "glGenBuffers",                   Gl_vbos },
@@ -154,7 +159,9 @@ namespace OpenGlDriver
         { "glUniformMatrix4fv",             Gl_shaders },
         { "glUnmapBuffer",                  Gl_vbos },
         { "glUseProgram",                   Gl_shaders },
-        { "glVertexAttrib4f",               Gl_shaders }
+        { "glVertexAttrib4f",               Gl_shaders },
+        { "glVertexAttribDivisorARB",       Gl_instancing },
+        { "glVertexAttribPointer",          Gl_instancing }
     };
 
     static const Key keys[] =
@@ -206,7 +213,7 @@ namespace OpenGlDriver
     }
 
     OpenGlDriver::OpenGlDriver( IEngine* engine )
-            : engine( engine ), eventListener( nullptr )
+            : engine( engine ), eventListener( nullptr ), instanceBuffer( 0 ), instanceBufferCapacity( 0 )
     {
         forceNoShaders = false;
         forceNoVbo = false;
@@ -390,43 +397,17 @@ namespace OpenGlDriver
 
     glm::mat4 OpenGlDriver::applyTransforms( const Transform* transforms, unsigned numTransforms )
     {
-        // OpenGL does it the reverse way
-        // reversed reverse = correct! yay!
-
-        glm::mat4 matrix;
-
-        for ( int i = numTransforms - 1; i >= 0; i-- )
-        {
-            const Transform& current = transforms[i];
-
-            switch ( current.operation )
-            {
-                case Transform::translate:
-                    //glTranslatef( current.vector.x, current.vector.y, current.vector.z );
-                    matrix = glm::translate( matrix, current.vector.operator glm::vec3() );
-                    break;
-
-                case Transform::rotate:
-                    //glRotatef( ( GLfloat )( -current.angle * 180.0f / M_PI ), current.vector.x, current.vector.y, current.vector.z );
-                    matrix = glm::rotate( matrix, ( float )( -current.angle * 180.0f / M_PI ), ( glm::vec3 ) current.vector.operator glm::vec3() );
-                    break;
-
-                case Transform::scale:
-                    //glScalef( current.vector.x, current.vector.y, current.vector.z );
-                    matrix = glm::scale( matrix, current.vector.operator glm::vec3() );
-                    break;
-
-                case Transform::matrix:
-                    //glMultMatrixf( &current.transformation[0][0] );
-                    matrix = matrix * current.transformation;
-                    break;
-            }
-        }
+        glm::mat4 matrix = composeTransforms( transforms, numTransforms );
 
         glMultMatrixf( &matrix[0][0] );
         return matrix;
     }
 
+    glm::mat4 OpenGlDriver::composeTransforms( const Transform* transforms, unsigned numTransforms )
+    {
+        return Transform::compose( transforms, numTransforms );
+    }
+
     void OpenGlDriver::beginDepthRendering()
     {
         // TODO: ;;;
@@ -698,6 +679,15 @@ namespace OpenGlDriver
         return new Texture( this, name, image, lodFunction );
     }
 
+    // Same as composing a scale and a translation, without any calls into glm
+    static glm::mat4 scaleAndTranslate( const Vector<float>& scale, const Vector<float>& translation )
+    {
+        return glm::mat4( scale.x, 0.0f, 0.0f, 0.0f,
+                0.0f, scale.y, 0.0f, 0.0f,
+                0.0f, 0.0f, scale.z, 0.0f,
+                translation.x, translation.y, translation.z, 1.0f );
+    }
+
     void OpenGlDriver::draw2dCenteredRotated( ITexture* texture, float scale, float angle, const Colour& blend )
     {
         Transform transforms[4];
@@ -723,14 +713,10 @@ namespace OpenGlDriver
 
     void OpenGlDriver::drawLine( const Vector<float>& a, const Vector<float>& b, const Colour& blend )
     {
-        Transform transforms[2];
-
-        transforms[0] = Transform( Transform::scale, b - a );
-        transforms[1] = Transform( Transform::translate, a );
+        const glm::mat4 matrix = scaleAndTranslate( b - a, a );
 
         glPushMatrix();
-
-        applyTransforms( transforms, 2 );
+        glMultMatrixf( &matrix[0][0] );
 
         line->render( solidMaterial, blend );
 
@@ -739,14 +725,10 @@ namespace OpenGlDriver
 
     void OpenGlDriver::drawRectangle( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture )
     {
-        Transform transforms[2];
-
-        transforms[0] = Transform( Transform::scale, size );
-        transforms[1] = Transform( Transform::translate, pos );
+        const glm::mat4 matrix = scaleAndTranslate( size, pos );
 
         glPushMatrix();
-
-        applyTransforms( transforms, 2 );
+        glMultMatrixf( &matrix[0][0] );
 
         if ( texture == nullptr )
             plane1x1uv->render( solidMaterial, blend );
@@ -758,14 +740,10 @@ namespace OpenGlDriver
 
     void OpenGlDriver::drawRectangleOutline( const Vector<float>& pos, const Vector2<float>& size, const Colour& blend, ITexture* texture )
     {
-        Transform transforms[2];
-
-        transforms[0] = Transform( Transform::scale, size );
-        transforms[1] = Transform( Transform::translate, pos );
+        const glm::mat4 matrix = scaleAndTranslate( size, pos );
 
         glPushMatrix();
-
-        applyTransforms( transforms, 2 );
+        glMultMatrixf( &matrix[0][0] );
 
         if ( texture == nullptr )
             rect1x1->render( solidMaterial, blend );
@@ -933,6 +911,7 @@ namespace OpenGlDriver
 #endif
 
         Reference<ShaderProgramSet> set = new ShaderProgramSet( this, properties );
+        set->id = shaderProgramSets.getLength();
         set->init();
 
 #ifdef li_MSW
@@ -1023,6 +1002,10 @@ namespace OpenGlDriver
             driverShared.requirePo2Textures = true;     // pretends to support NPOT, but horribly destroys those
         }
 
+        // Instanced drawing feeds the instance matrices to the stock shaders through a vertex buffer
+        driverShared.haveInstancing = driverShared.useShaders && driverShared.useVertexBuffers
+                && haveExtension( "GL_ARB_draw_instanced" ) && haveExtension( "GL_ARB_instanced_arrays" );
+
         for ( unsigned i = 0; i < sizeof( glLinkTable ) / sizeof( *glLinkTable ); i++ )
         {
             glApi.pointers[i] = 0;
@@ -1031,7 +1014,8 @@ namespace OpenGlDriver
                     || ( driverShared.useShaders && ( glLinkTable[i].flags & Gl_shaders ) )
                     || ( driverShared.useVaos && ( glLinkTable[i].flags & Gl_vaos ) )
                     || ( driverShared.useVertexBuffers && ( glLinkTable[i].flags & Gl_vbos ) )
-                    || ( driverShared.haveRenderBuffers && ( glLinkTable[i].flags & Gl_renderbuffers ) );
+                    || ( driverShared.haveRenderBuffers && ( glLinkTable[i].flags & Gl_renderbuffers ) )
+                    || ( driverShared.haveInstancing && ( glLinkTable[i].flags & Gl_instancing ) );
 
             if ( !wanted )
                 continue;
@@ -1059,6 +1043,8 @@ namespace OpenGlDriver
                     printf( "OpenGlDriver Warning: '%s' not available.\n", glLinkTable[i].name );
                     continue;
                 }
+                else if ( glLinkTable[i].flags & Gl_instancing )
+                    driverShared.haveInstancing = false;
                 else if ( glLinkTable[i].flags & Gl_vbos )
                     driverShared.useVertexBuffers = false;
                 else if ( glLinkTable[i].flags & Gl_renderbuffers )
@@ -1084,6 +1070,9 @@ namespace OpenGlDriver
         if ( glApi.functions.glCompressedTexImage2DARB == nullptr )
             driverShared.haveS3tc = false;
 
+        if ( !driverShared.useShaders || !driverShared.useVertexBuffers )
+            driverShared.haveInstancing = false;
+
         #define test( value_ ) ( ( value_ ) ? "<span style=\"color: #080\">yes</span>" : "<b style=\"color: #f00\">no</b>" )
 
         Common::logEvent( "OpenGlDriver.OpenGlDriver", ( String ) "Initializing OpenGlDriver!\n"
@@ -1095,6 +1084,7 @@ namespace OpenGlDriver
                 + "&nbsp;&nbsp;<b>Have Render Buffers</b>: " + test( driverShared.haveRenderBuffers ) + "\n"
                 + "&nbsp;&nbsp;<b>Have S3 Texture Compression</b>: " + test( driverShared.haveS3tc ) + "\n"
                 + "&nbsp;&nbsp;<b>Have GL_ATI_meminfo</b>: " + test( driverShared.haveAtiMeminfo ) + "\n"
+                + "&nbsp;&nbsp;<b>Have Instanced Drawing</b>: " + test( driverShared.haveInstancing ) + "\n"
                 + "&nbsp;&nbsp;<b>Have Vertex Array Objects</b>: " + test( driverShared.useVaos ) + "\n"
                 + "&nbsp;&nbsp;<b>Have Vertex Buffers</b>: " + test( driverShared.useVertexBuffers ) + "\n"
                 + "&nbsp;&nbsp;<b>NPOT textures supported</b>: " + test( !driverShared.requirePo2Textures ) + "\n"
@@ -1777,6 +1767,14 @@ namespace OpenGlDriver
     {
         assets.pickingShaderProgram.release();
 
+        if ( instanceBuffer != 0 )
+        {
+            glApi.functions.glDeleteBuffers( 1, &instanceBuffer );
+
+            instanceBuffer = 0;
+            instanceBufferCapacity = 0;
+        }
+
         plane1x1uv.release();
         line.release();
         rect1x1.release();
@@ -1859,6 +1857,28 @@ namespace OpenGlDriver
         return pos;
     }
 
+    void OpenGlDriver::uploadInstances( const glm::mat4* localToWorld, size_t numInstances )
+    {
+        SG_assert( driverShared.haveInstancing )
+
+        const size_t size = numInstances * sizeof( glm::mat4 );
+
+        if ( instanceBuffer == 0 )
+            glApi.functions.glGenBuffers( 1, &instanceBuffer );
+
+        glApi.functions.glBindBuffer( GL_ARRAY_BUFFER, instanceBuffer );
+
+        // Re-specifying the storage orphans the data still used by the previous draw instead of waiting for it
+        if ( size > instanceBufferCapacity )
+            instanceBufferCapacity = maximum<size_t>( size, instanceBufferCapacity * 2 );
+
+        glApi.functions.glBufferData( GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW );
+        glApi.functions.glBufferSubData( GL_ARRAY_BUFFER, 0, size, localToWorld );
+
+        // Mesh::beginRender binds its own buffer only when switching meshes
+        renderState.currentMesh = nullptr;
+    }
+
     SdlEventSource::SdlEventSource( SDL_Surface* display, OpenGlDriver::Profiling& profiling ) : display( display ), profiling( profiling )
     {
     }
@@ -25,8 +25,10 @@
 
 #include <StormGraph/GraphicsDriver.hpp>
 #include <StormGraph/Profiler.hpp>
+#include <StormGraph/RenderBatcher.hpp>
 #include <StormGraph/IO/Bsp.hpp>
 
+#include <StormGraph/ViewFrustum.hpp>
 #include <StormGraph/VisualInterface.hpp>
 
 #include <SDL.h>
@@ -44,6 +46,7 @@ struct FtFont;
 #include <glm/glm.hpp>
 
 #include <littl/Stack.hpp>
+#include <littl/Thread.hpp>
 
 #ifdef _MSC_VER
 #pragma warning ( disable : 4200 )
@@ -88,6 +91,10 @@ namespace OpenGlDriver
             PFNGLDELETEPROGRAMPROC glDeleteProgram;
             PFNGLDELETESHADERPROC glDeleteShader;
             PFNGLDETACHSHADERPROC glDetachShader;
+            PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
+            PFNGLDRAWARRAYSINSTANCEDARBPROC glDrawArraysInstanced;
+            PFNGLDRAWELEMENTSINSTANCEDARBPROC glDrawElementsInstanced;
+            PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
             PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC glFramebufferRenderbuffer;
             PFNGLFRAMEBUFFERTEXTURE2DEXTPROC glFramebufferTexture2D;
             PFNGLGENBUFFERSPROC glGenBuffers;
@@ -114,6 +121,8 @@ namespace OpenGlDriver
             PFNGLUNMAPBUFFERPROC glUnmapBuffer;
             PFNGLUSEPROGRAMPROC glUseProgram;
             PFNGLVERTEXATTRIB4FPROC glVertexAttrib4f;
+            PFNGLVERTEXATTRIBDIVISORARBPROC glVertexAttribDivisor;
+            PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
         }
         functions;
 
@@ -141,12 +150,6 @@ namespace OpenGlDriver
         size_t bytesInTextures, bytesInMeshes;
     };
 
-    struct MatEntry
-    {
-        IMaterial* material;
-        Mesh* first, * last;
-    };
-
     class Queueable
     {
         public:
@@ -164,11 +167,14 @@ namespace OpenGlDriver
         ShaderProgramSetProperties common;
 
         unsigned numDirectionalLights, numPointLights;
+
+        // Take the local-to-world matrix from the per-instance attribute `instanceToWorld` instead of the modelview matrix
+        bool instanced;
     };
 
     struct Shared
     {
-        bool haveAtiMeminfo, haveRenderBuffers, haveS3tc, isGlInit, requirePo2Textures, useShaders, useVaos, useVertexBuffers;
+        bool haveAtiMeminfo, haveInstancing, haveRenderBuffers, haveS3tc, isGlInit, requirePo2Textures, useShaders, useVaos, useVertexBuffers;
         int maxFixedLights;
         unsigned textureLod, maxPo2Upscale, maxTextureSize;
     };
@@ -253,6 +259,9 @@ namespace OpenGlDriver
                     pointShadowMap[MAX_POINT_LIGHTS], pointShadowMatrix[MAX_POINT_LIGHTS], localToWorld,
                     textures[TEXTURES_PER_VERTEX];
 
+            // First of the 4 attribute locations taken by the instance matrix; -1 if not instanced
+            GLint instanceToWorld;
+
         private:
             void init( PixelShader* pixel, VertexShader* vertex );
 
@@ -261,6 +270,7 @@ namespace OpenGlDriver
             virtual ~ShaderProgram();
 
             //virtual int getParamId( const char* name );
+            GLint getInstanceToWorld() const { return instanceToWorld; }
             virtual void select();
             /*virtual void setColourParam( int id, const Colour& colour );
             virtual void setTexture( ITexture* texture );
@@ -284,15 +294,21 @@ namespace OpenGlDriver
         ShaderProgramSetProperties properties;
 
         unsigned dirLightVars, pointLightVars;
+
+        // The instanced variants follow the regular ones and are only compiled on first use
         ShaderProgram** programs;
 
+        public:
+            // Index in OpenGlDriver::shaderProgramSets; used for render queue sorting
+            unsigned id;
+
         public:
             li_ReferencedClass_override( ShaderProgramSet )
 
             ShaderProgramSet( OpenGlDriver* driver, ShaderProgramSetProperties* properties );
             virtual ~ShaderProgramSet();
 
-            ShaderProgram* getShaderProgram( bool dynamicLighting );
+            ShaderProgram* getShaderProgram( bool dynamicLighting, bool instanced = false );
             void init();
             bool matches( const ShaderProgramSetProperties* properties );
     };
@@ -354,6 +370,9 @@ namespace OpenGlDriver
             OpenGlDriver* driver;
             String name;
 
+            // Unique per material; used for render queue sorting
+            unsigned id;
+
             Reference<ShaderProgramSet> shaderProgramSet;
 
             Colour colour;
@@ -375,8 +394,6 @@ namespace OpenGlDriver
             // Shadow Mapping
             bool castsShadows, receivesShadows;
 
-            MatEntry* queueEntry;
-
             void getShaderSet();
 
         public:
@@ -385,12 +402,13 @@ namespace OpenGlDriver
             Material( OpenGlDriver* driver, const char* name, const MaterialProperties2* properties, bool finalized );
             virtual ~Material();
 
-            void apply();
+            void apply( bool instanced = false );
             void apply( const Colour& blend );
             void apply( const Colour& blend, Texture* texture0 );
             Material* finalize();
             virtual const char* getClassName() const { return "OpenGlDriver.Material"; }
             virtual const char* getName() const { return name; }
+            bool isBlended() const { return colour.a < 1.0f; }
             virtual void query( unsigned flags, MaterialProperties2* properties );
             void setColour( const Colour& colour ) override;
     };
@@ -441,6 +459,12 @@ namespace OpenGlDriver
             Queueable* nextQueued;
             unsigned queuedOffset, queuedCount;
 
+            // Model-space bounding box, valid if hasBounds
+            bool hasBounds;
+            Vector<float> bounds[2];
+
+            void computeBounds( const float* coords, size_t numVertices );
+
             //void createVBO( unsigned flags, unsigned numVertices, const float* coords, const float* normals, const float* uvs );
             //void createIBO( unsigned flags, unsigned numIndices, const unsigned* indices );
 
@@ -473,11 +497,13 @@ namespace OpenGlDriver
             // Rendering
             void beginRender( bool flat );
             void doRenderAll();
+            void doRenderInstanced( size_t numInstances );
             void doRenderRange( size_t offset, size_t count );
             void endRender( bool flat );
 
             Mesh* finalize();
 
+            bool getBounds( Vector<float> bounds[2] );
             size_t getNumVertices();
             static GLenum getRenderMode( MeshFormat format );
 
@@ -485,6 +511,7 @@ namespace OpenGlDriver
             void render( const glm::mat4& localToWorld, Material* material = nullptr );
             void render( Material* material, const Colour& blend );
             void render( Material* material, const Colour& blend, Texture* texture0 );
+            void renderInstanced( const glm::mat4* localToWorld, size_t numInstances, Material* material = nullptr );
             void renderRange( size_t offset, size_t count, Material* material = nullptr );
 
             // TODO: wat
@@ -495,8 +522,8 @@ namespace OpenGlDriver
             void setMaterial( Material* material );
 
             bool updateIndices( size_t offset, const unsigned* indices, size_t count );
-            /*bool updateVertexCoords( unsigned offset, float* coords, unsigned count );
-            bool updateVertices( unsigned offset, const Vertex* vertices, unsigned count );*/
+            //bool updateVertexCoords( unsigned offset, float* coords, unsigned count );
+            bool updateVertices( size_t offset, const Vertex* vertices, size_t count );
     };
 
     class ModelPreload : public IModelPreload
@@ -523,6 +550,8 @@ namespace OpenGlDriver
 
     class Model : public IModel
     {
+        friend class RenderQueue;
+
         OpenGlDriver* driver;
         String name;
 
@@ -539,6 +568,7 @@ namespace OpenGlDriver
 
             virtual Model* finalize();
 
+            virtual bool getBounds( Vector<float> bounds[2] ) override;
             virtual const char* getClassName() const override { return "OpenGlDriver.Model"; }
             virtual size_t getMeshCount();
             virtual size_t getMeshVertexCount( size_t mesh );
@@ -552,11 +582,13 @@ namespace OpenGlDriver
 
             virtual void render( const Transform* transforms, size_t numTransforms, bool inWorldSpace ) override;
             virtual void render( const Transform* transforms, size_t numTransforms, const Colour& blend ) override;
+            virtual void renderInstanced( const glm::mat4* localToWorld, size_t numInstances ) override;
+            virtual void renderRange( size_t mesh, size_t offset, size_t count ) override;
 
             //virtual bool retrieveVertices( size_t mesh, size_t offset, Vertex* vertices, size_t count ) override;
 
             //virtual bool updateVertexCoords( unsigned mesh, unsigned offset, float* coords, unsigned count ) override;
-            //virtual bool updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count ) override;
+            virtual bool updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count ) override;
     };
 
     class BspModel : public IStaticModel
@@ -596,6 +628,7 @@ namespace OpenGlDriver
 
             virtual BspModel* finalize() override;
 
+            virtual bool getBounds( Vector<float> bounds[2] ) override;
             virtual const char* getClassName() const override { return "OpenGlDriver.BspModel"; }
             virtual size_t getMeshCount();
             virtual size_t getMeshVertexCount( size_t mesh );
@@ -759,12 +792,22 @@ namespace OpenGlDriver
             bool isSetUp();
     };
 
-    class RenderQueue : public IRenderQueue
+    class RenderQueue : public IRenderQueue, public Mutex
     {
+        struct QueueItem
+        {
+            Mesh* mesh;
+            Material* material;
+        };
+
         public:
             OpenGlDriver* driver;
 
-            List<MatEntry> materials;
+            // Indexed the same as the batcher's items
+            List<QueueItem> items;
+            RenderBatcher batcher;
+
+            bool instancing;
 
         public:
             RenderQueue( OpenGlDriver* driver );
@@ -775,30 +818,9 @@ namespace OpenGlDriver
             virtual void add( IModel* model, const Transform* transforms, size_t numTransforms ) override;
             /*virtual void addLight( ILight* light, const Transform* transforms, size_t numTransforms ) override;*/
 
+            virtual void getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws ) override;
             virtual void render() override;
-    };
-
-    class ViewFrustum
-    {
-    	enum { top = 0, bottom, left, right, nearClip, farClip, numPlanes };
-
-        public:
-            enum TestResult { outside, intersect, inside };
-
-        	Plane planes[numPlanes];
-
-        	Vector<float> ntl, ntr, nbl, nbr, ftl, ftr, fbl, fbr;
-        	float nearD, farD, ratio, angle,tang;
-        	float nw, nh, fw, fh;
-
-        	ViewFrustum();
-        	~ViewFrustum();
-
-            void setProjection( float angle, float ratio, float nearD, float farD );
-            void setView( const Vector<float>& eye, const Vector<float>& center, const Vector<float>& up );
-            TestResult pointInFrustum( const Vector<float>& point );
-            TestResult sphereInFrustum( const Vector<float>& center, float radius );
-            TestResult boxInFrustum( const Vector<float>& min, const Vector<float>& max );
+            virtual void setInstancing( bool enabled ) override { instancing = enabled; }
     };
 
     int gluInvertMatrixd( const GLdouble m[16], GLdouble invOut[16] );
@@ -896,6 +918,10 @@ namespace OpenGlDriver
             ReferenceList<ShaderProgramSet> shaderProgramSets;
             Stack<ScreenRect> clippingRects;
 
+            // Per-instance matrices of the current instanced draw; streamed anew for every model
+            GLuint instanceBuffer;
+            size_t instanceBufferCapacity;
+
             // RenderBuffers
             RenderBuffer* currentRenderBuffer;
             Stack<RenderBuffer*> renderBuffers;
@@ -930,6 +956,7 @@ namespace OpenGlDriver
             void checkErrors( const char* caller );
             virtual Image* createImageFromStream( SeekableInputStream* input );
             ShaderProgramSet* getShaderProgramSet( ShaderProgramSetProperties* properties );
+            void uploadInstances( const glm::mat4* localToWorld, size_t numInstances );
 
             // OpenGlDriver.OpenGlDriver - Picking
             Colour getPickingColour( unsigned id );
@@ -939,6 +966,7 @@ namespace OpenGlDriver
             // OpenGlDriver.OpenGlDriver - Transformation
             void applyTransforms( const List<Transform>& transforms );
             static glm::mat4 applyTransforms( const Transform* transforms, unsigned numTransforms );
+            static glm::mat4 composeTransforms( const Transform* transforms, unsigned numTransforms );
 
             // TEMPORARY
             virtual void setPointLightShadowMap( unsigned index, ITexture* depthMap, const glm::mat4& shadowMapMatrix ) override;
@@ -1002,6 +1030,7 @@ namespace OpenGlDriver
             virtual void getProjectionInfo( IProjectionInfoBuffer* projectionInfoBuffer ) override;
             virtual IMaterial* getSolidMaterial();
             //virtual Texture* getSolidTexture();
+            virtual const ViewFrustum* getViewFrustum() override { return &frustum; }
             virtual Vector2<unsigned> getViewportSize() override;
             virtual Vector2<unsigned> getWindowSize() override { return windowSize; }
             virtual void popBlendMode();
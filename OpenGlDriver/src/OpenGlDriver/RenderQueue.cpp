@@ -26,47 +26,109 @@
 namespace OpenGlDriver
 {
     RenderQueue::RenderQueue( OpenGlDriver* driver )
-            : driver( driver )
+            : driver( driver ), instancing( true )
     {
     }
 
     void RenderQueue::add( IModel* model, const Transform* transforms, size_t numTransforms )
     {
-        //iterate2 ( i, model->me
+        Model* glModel = static_cast<Model*>( model );
+
+        glm::mat4 localToWorld = OpenGlDriver::composeTransforms( transforms, numTransforms );
+
+        iterate ( glModel->meshes )
+            enqueue( glModel->meshes.current(), localToWorld );
     }
 
     void RenderQueue::enqueue( Mesh* mesh, const glm::mat4& transform )
     {
-        /*Material* material;
+        Material* material;
 
         if ( driverShared.useVertexBuffers )
             material = mesh->remoteData->material;
         else
             material = mesh->localData->material;
 
-        if ( material->queueEntry != nullptr )
-        {
-            material->queueEntry->last->nextQueued = mesh;
-            material->queueEntry->last = mesh;
-        }
-        else
-        {
-            MatEntry entry = { material, mesh, mesh };
+        SG_assert3( material != nullptr, "OpenGlDriver.RenderQueue.enqueue" )
 
-            materials.add( entry );
-        }*/
-    }
+        RenderBatcher::Item batchItem;
+        batchItem.mesh = mesh;
+        batchItem.program = 0;
+        batchItem.texture = 0;
+        batchItem.material = material->id;
+        batchItem.blended = material->isBlended();
+        batchItem.localToWorld = transform;
 
-    void RenderQueue::render()
-    {
+        if ( material->shaderProgramSet != nullptr )
+            batchItem.program = ( material->shaderProgramSet->id << 1 ) | ( material->dynamicLighting ? 1 : 0 );
+
+        if ( material->numTextures > 0 && material->textures[0] != nullptr )
+            batchItem.texture = material->textures[0]->texture;
+
+        QueueItem item = { mesh, material };
+
+        CriticalSection lock( this );
+        items.add( item );
+        batcher.add( batchItem );
     }
 
-    /*void RenderQueue::addLight( ILight* light, const Transform* transforms, size_t numTransforms )
+    void RenderQueue::getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws )
     {
-        light->render( transforms, numTransforms );
+        CriticalSection lock( this );
+
+        batcher.getInstancingStats( numInstanced, numInstancedDraws );
     }
 
-    void RenderQueue::run()
+    void RenderQueue::render()
     {
-    }*/
+        CriticalSection lock( this );
+
+        // The instance matrices come from a vertex attribute, which only the shader path has
+        batcher.build( driver->currentCamera, instancing && driverShared.haveInstancing && driver->globalState.shadersEnabled );
+
+        const List<RenderBatcher::Run>& runs = batcher.getRuns();
+
+        for ( size_t i = 0; i < runs.getLength(); i++ )
+        {
+            const RenderBatcher::Run& run = runs[i];
+            const QueueItem& item = items[batcher.getItemIndex( run.first )];
+
+            if ( run.count > 1 )
+            {
+                const glm::mat4* matrices = batcher.getInstanceMatrices( run );
+
+                driver->uploadInstances( matrices, run.count );
+                item.mesh->renderInstanced( matrices, run.count, item.material );
+                continue;
+            }
+
+            if ( run.applyMaterial )
+                item.material->apply();
+
+            const glm::mat4& transform = batcher.getItem( batcher.getItemIndex( run.first ) ).localToWorld;
+
+            if ( driver->globalState.shadersEnabled )
+            {
+                driver->renderState.currentShaderProgram->setLocalToWorld( transform );
+
+                item.mesh->beginRender( false );
+                item.mesh->doRenderAll();
+                item.mesh->endRender( false );
+            }
+            else
+            {
+                glPushMatrix();
+                glMultMatrixf( &transform[0][0] );
+
+                item.mesh->beginRender( false );
+                item.mesh->doRenderAll();
+                item.mesh->endRender( false );
+
+                glPopMatrix();
+            }
+        }
+
+        items.clear();
+        batcher.clear();
+    }
 }
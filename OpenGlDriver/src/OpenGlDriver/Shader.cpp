@@ -102,9 +102,21 @@ namespace OpenGlDriver
 
         name += String::formatInt( properties->common.lightMapping ) + "L" + String::formatInt( properties->common.receivesShadows ) + "S";
 
+        if ( properties->instanced )
+            name += "I";
+
+        // Instanced programs are drawn with only the view matrix on the modelview stack
+        // and transform the vertices into world space themselves
+        const String vertex = properties->instanced ? "vertex" : "gl_Vertex";
+        const String normal = properties->instanced ? "vec3( instanceToWorld * vec4( gl_Normal, 0.0 ) )" : "gl_Normal";
+
         // **** VERTEX SHADER ****
 
         vertexShaderSource += "attribute vec4 blendColour;\n";
+
+        if ( properties->instanced )
+            vertexShaderSource += "attribute mat4 instanceToWorld;\n";
+
         vertexShaderSource += "varying vec4 colour;\n";
 
         if ( numTextures > 0 )
@@ -125,10 +137,16 @@ namespace OpenGlDriver
 
             vertexShaderSource += "varying vec4 pointShadowUv" + index + ";\n";
             vertexShaderSource += "uniform mat4 pointShadowMatrix" + index + ";\n";
-            vertexShaderSource += "uniform mat4 localToWorld;\n";
+
+            if ( !properties->instanced )
+                vertexShaderSource += "uniform mat4 localToWorld;\n";
         }
 
         vertexShaderSource += "void main() {\n";
+
+        if ( properties->instanced )
+            vertexShaderSource += "    vec4 vertex = instanceToWorld * gl_Vertex;\n";
+
         vertexShaderSource += "    colour = blendColour;\n";
 
         for ( unsigned i = 0; i < numTextures; i++ )
@@ -137,8 +155,8 @@ namespace OpenGlDriver
         // Dynamic Directional & Point Lighting
         if ( properties->numDirectionalLights > 0 || properties->numPointLights > 0 )
         {
-            vertexShaderSource += "    N = normalize( gl_NormalMatrix * gl_Normal );\n";
-            vertexShaderSource += "    V = vec3( gl_ModelViewMatrix * gl_Vertex );\n";
+            vertexShaderSource += "    N = normalize( gl_NormalMatrix * " + normal + " );\n";
+            vertexShaderSource += "    V = vec3( gl_ModelViewMatrix * " + vertex + " );\n";
         }
 
         // Light Mapping
@@ -150,10 +168,13 @@ namespace OpenGlDriver
         {
             String index = "[" + String::formatInt( i ) + "]";
 
-            vertexShaderSource += "    pointShadowUv" + index + " = pointShadowMatrix" + index + " * ( localToWorld * gl_Vertex );\n";
+            if ( properties->instanced )
+                vertexShaderSource += "    pointShadowUv" + index + " = pointShadowMatrix" + index + " * vertex;\n";
+            else
+                vertexShaderSource += "    pointShadowUv" + index + " = pointShadowMatrix" + index + " * ( localToWorld * gl_Vertex );\n";
         }
 
-        vertexShaderSource += "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n";
+        vertexShaderSource += "    gl_Position = gl_ModelViewProjectionMatrix * " + vertex + ";\n";
         vertexShaderSource += "}\n";
 
         vertexShader = new VertexShader( name + "vertex", vertexShaderSource );
@@ -410,6 +431,11 @@ namespace OpenGlDriver
 
         localToWorld = glApi.functions.glGetUniformLocation( program, "localToWorld" );
 
+        if ( properties->instanced )
+            instanceToWorld = glApi.functions.glGetAttribLocation( program, "instanceToWorld" );
+        else
+            instanceToWorld = -1;
+
         // ASSIGN TEXTURE INDICES
         unsigned nextTextureIndex = 0;
 
@@ -650,7 +676,7 @@ namespace OpenGlDriver
     }*/
 
     ShaderProgramSet::ShaderProgramSet( OpenGlDriver* driver, ShaderProgramSetProperties* properties )
-            : driver( driver ), properties( *properties ), programs( nullptr )
+            : driver( driver ), properties( *properties ), programs( nullptr ), id( 0 )
     {
         if ( properties->dynamicLighting )
         {
@@ -666,10 +692,15 @@ namespace OpenGlDriver
 
     void ShaderProgramSet::init()
     {
-        programs = Allocator<ShaderProgram*>::allocate( dirLightVars * pointLightVars );
+        const unsigned numVariants = dirLightVars * pointLightVars;
+
+        programs = Allocator<ShaderProgram*>::allocate( numVariants * 2 );
 
         SG_assert( programs != nullptr )
 
+        for ( unsigned i = 0; i < numVariants; i++ )
+            programs[numVariants + i] = nullptr;
+
         for ( unsigned dirLights = 0; dirLights < dirLightVars; dirLights++ )
             for ( unsigned pointLights = 0; pointLights < pointLightVars; pointLights++ )
             {
@@ -678,6 +709,7 @@ namespace OpenGlDriver
                 programProperties.common = this->properties;
                 programProperties.numDirectionalLights = dirLights;
                 programProperties.numPointLights = pointLights;
+                programProperties.instanced = false;
 
                 programs[pointLightVars * dirLights + pointLights] = new ShaderProgram( driver, &programProperties );
             }
@@ -689,18 +721,15 @@ namespace OpenGlDriver
 
     ShaderProgramSet::~ShaderProgramSet()
     {
-        for ( unsigned dirLights = 0; dirLights < dirLightVars; dirLights++ )
-            for ( unsigned pointLights = 0; pointLights < pointLightVars; pointLights++ )
-                delete programs[pointLightVars * dirLights + pointLights];
+        for ( unsigned i = 0; i < dirLightVars * pointLightVars * 2; i++ )
+            delete programs[i];
 
         Allocator<ShaderProgram*>::release( programs );
     }
 
-    ShaderProgram* ShaderProgramSet::getShaderProgram( bool dynamicLighting )
+    ShaderProgram* ShaderProgramSet::getShaderProgram( bool dynamicLighting, bool instanced )
     {
-        ShaderProgram* program;
-
-        unsigned numDirectionalLights = 0, numPointLights = 0;
+        unsigned numDirectionalLights = 0, numPointLights = 0, index = 0;
 
         if ( dynamicLighting && driver->globalState.dynamicLightingEnabled )
         {
@@ -710,10 +739,29 @@ namespace OpenGlDriver
             SG_assert( numDirectionalLights < dirLightVars )
             SG_assert( numPointLights < pointLightVars )
 
-            program = programs[pointLightVars * numDirectionalLights + numPointLights];
+            index = pointLightVars * numDirectionalLights + numPointLights;
         }
-        else
-            program = programs[0];
+
+        if ( instanced )
+        {
+            SG_assert( driverShared.haveInstancing )
+
+            index += dirLightVars * pointLightVars;
+
+            if ( programs[index] == nullptr )
+            {
+                ShaderProgramProperties programProperties;
+
+                programProperties.common = this->properties;
+                programProperties.numDirectionalLights = numDirectionalLights;
+                programProperties.numPointLights = numPointLights;
+                programProperties.instanced = true;
+
+                programs[index] = new ShaderProgram( driver, &programProperties );
+            }
+        }
+
+        ShaderProgram* program = programs[index];
 
         if ( driver->renderState.currentShaderProgram != program )
         {
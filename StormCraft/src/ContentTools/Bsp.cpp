@@ -24,10 +24,43 @@
 #include <StormGraph/IO/BspGenerator.hpp>
 #include <StormGraph/GraphicsDriver.hpp>
 
+#include <littl/Thread.hpp>
+
+#include <atomic>
+#include <cfloat>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 //#define Bsp_print_stuff
 
 namespace StormGraph
 {
+    // Subtrees with at least this many polygons are handed out to the build threads
+    static const size_t parallelBuildThreshold = 2048;
+
+    // Centroid bins per axis evaluated by the surface area heuristic
+    static const int sahNumBins = 16;
+
+    // Vertices closer than this in every attribute get merged
+    static const float weldTolerance = 0.001f;
+
+    // Wide enough that any vertex within weldTolerance of a position falls at most one cell away on each axis
+    static const float weldCellSize = 4.0f * weldTolerance;
+
+    static const unsigned endOfChain = ~0u;
+
+    static uint64_t getWeldCellKey( unsigned materialIndex, int64_t x, int64_t y, int64_t z )
+    {
+        uint64_t key = materialIndex * 0x9E3779B97F4A7C15ULL;
+
+        key = ( key ^ ( uint64_t ) x ) * 0xBF58476D1CE4E5B9ULL;
+        key = ( key ^ ( uint64_t ) y ) * 0x94D049BB133111EBULL;
+        key = ( key ^ ( uint64_t ) z ) * 0x9E3779B97F4A7C15ULL;
+
+        return key ^ ( key >> 31 );
+    }
+
     // assumes that the points are on opposite sides of the plane!
     // Get the point where the line between 2 points crosses the plane
     // Took me some time to figure that out :P
@@ -143,9 +176,564 @@ namespace StormGraph
         }
     }
 
-    BspGenerator::BspGenerator( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit )
-            : nodePolyLimit( nodePolyLimit ), nodeVolumeLimit( nodeVolumeLimit )
+    static void expandBounds( Vector<float> bounds[2], const Vector<float>& point )
+    {
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            if ( point.get( axis ) < bounds[0].get( axis ) )
+                bounds[0].set( axis, point.get( axis ) );
+
+            if ( point.get( axis ) > bounds[1].get( axis ) )
+                bounds[1].set( axis, point.get( axis ) );
+        }
+    }
+
+    static float getSurfaceArea( const Vector<float> bounds[2] )
+    {
+        const Vector<float> size = bounds[1] - bounds[0];
+
+        return 2.0f * ( size.x * size.y + size.y * size.z + size.z * size.x );
+    }
+
+    // Find the "most offending" axis with respect to the shape of the maximal node volume
+    static int getSplitAxis( const Vector<float>& boundsSize, const Vector<float>& nodeVolumeLimit )
+    {
+        const Vector<float> overflow = boundsSize / nodeVolumeLimit;
+
+        if ( overflow.y >= overflow.x && overflow.y >= overflow.z )
+            return 1;
+        else if ( overflow.z >= overflow.x && overflow.z >= overflow.y )
+            return 2;
+        else
+            return 0;
+    }
+
+    static double findSweepSplit( const BspPolygon* polygons, size_t count, const Vector<float> bounds[2], int axis, unsigned bestCounts[2] )
+    {
+        // size of the node boundary
+        const Vector<float> boundsSize = bounds[1] - bounds[0];
+
+        // center of the node volume (in world space!!)
+        const Vector<float> boundsCenter = bounds[0] + boundsSize / 2;
+
+        // A polygon reaches below (above) a plane exactly when its lowest (highest) vertex does,
+        // so the extents are gathered once and every candidate plane then costs 2 comparisons per polygon
+        Array<float> extents( count * 2 );
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            extents[i * 2] = FLT_MAX;
+            extents[i * 2 + 1] = -FLT_MAX;
+
+            for ( unsigned j = 0; j < polygons[i].numVertices; j++ )
+            {
+                extents[i * 2] = minimum( extents[i * 2], polygons[i].v[j].pos.get( axis ) );
+                extents[i * 2 + 1] = maximum( extents[i * 2 + 1], polygons[i].v[j].pos.get( axis ) );
+            }
+        }
+
+        // We'll loop through the possible partitionings until the polygon count ratio
+        // of the 2 new partitions starts to get worse.
+
+        // With these settings the loop will iterate 11 times
+        // Smaller steps would be most likely unreasonable because big nodes will be split further anyway
+        double limit = boundsSize.get( axis ) / 3.0f;
+        double step = ( boundsSize.get( axis ) - 2 * limit ) / 10.0f;
+
+        double bestPolygonRatio = 0.0f, bestCoord = 0.0f;
+
+        SG_assert( step > 0.01 )
+
+        for ( double c = bounds[0].get( axis ) + limit; c <= bounds[1].get( axis ) - limit; c += step )
+        {
+            // Count the polygons on each side of the splitting plane
+            unsigned counts[2] = { 0, 0 };
+
+            for ( size_t i = 0; i < count; i++ )
+            {
+                int side[2] = { 0, 0 };
+
+                if ( extents[i * 2] < c - 0.001f )
+                    side[0] = 1;
+
+                if ( extents[i * 2 + 1] > c + 0.001f )
+                    side[1] = 1;
+
+                if ( !side[0] && !side[1] )
+                    side[0] = 1;
+
+                counts[0] += side[0];
+                counts[1] += side[1];
+            }
+
+            // No polygons on one of the sides? Such partitioning would be, of course, meaningless
+            if ( counts[0] == 0 || counts[1] == 0 )
+                continue;
+
+            // Calculate the polygon count ratio for this partitioning (always >= 1.0)
+            double ratio = ( counts[0] > counts[1] ) ? ( double ) counts[0] / counts[1] : ( double ) counts[1] / counts[0];
+
+            // Only test the polygon ratio if we've already had a successful iteration
+            if ( bestCounts[0] != 0 )
+            {
+                // The polygon ratio just got worse
+                // And it's not going to get better.
+                if ( ratio > bestPolygonRatio )
+                    break;
+
+                // The polygon ratio is exactly the same? Well, test the volume ratio then
+                // (this should only happen for very low resolution meshes)
+                if ( ratio == bestPolygonRatio && fabs( boundsCenter.get( axis ) - c ) > fabs( boundsCenter.get( axis ) - bestCoord ) )
+                    break;
+            }
+
+            // We've got a new candidate
+            bestPolygonRatio = ratio;
+            bestCoord = c;
+
+            // Cache these values to allocate a big enough array later
+            bestCounts[0] = counts[0];
+            bestCounts[1] = counts[1];
+        }
+
+        // WHAT THE-
+        SG_assert( bestPolygonRatio >= 1.0f )
+
+#ifdef Bsp_print_stuff
+        printf( "BSP ## Best poly ratio %g (@ %g)\n", bestPolygonRatio, bestCoord );
+#endif
+
+        return bestCoord;
+    }
+
+    // Binned surface area heuristic: the polygons are sorted into bins by their centroids on each axis
+    // and the boundaries between the bins are evaluated with one sweep from each side.
+    // Ties go to the lower axis and the lower boundary, so the choice doesn't depend on anything but the input.
+    static bool findSahSplit( const BspPolygon* polygons, size_t count, int& axis, double& coord )
+    {
+        struct Bin
+        {
+            size_t count;
+            Vector<float> bounds[2];
+        };
+
+        Array<Vector<float>> boxes( count * 2 ), centres( count );
+        Vector<float> centreBounds[2];
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            getBounds( &polygons[i], 1, &boxes[i * 2] );
+            centres[i] = ( boxes[i * 2] + boxes[i * 2 + 1] ) / 2;
+
+            if ( i == 0 )
+                centreBounds[0] = centreBounds[1] = centres[i];
+            else
+                expandBounds( centreBounds, centres[i] );
+        }
+
+        bool found = false;
+        double bestCost = 0.0;
+
+        for ( int a = 0; a < 3; a++ )
+        {
+            const double low = centreBounds[0].get( a );
+            const double extent = centreBounds[1].get( a ) - low;
+
+            // All the centroids lie in one plane; nothing to separate along this axis
+            if ( extent < 0.01 )
+                continue;
+
+            Bin bins[sahNumBins];
+
+            for ( int b = 0; b < sahNumBins; b++ )
+                bins[b].count = 0;
+
+            for ( size_t i = 0; i < count; i++ )
+            {
+                Bin& bin = bins[minimum( ( int )( ( centres[i].get( a ) - low ) / extent * sahNumBins ), sahNumBins - 1 )];
+
+                if ( bin.count++ == 0 )
+                {
+                    bin.bounds[0] = boxes[i * 2];
+                    bin.bounds[1] = boxes[i * 2 + 1];
+                }
+                else
+                {
+                    expandBounds( bin.bounds, boxes[i * 2] );
+                    expandBounds( bin.bounds, boxes[i * 2 + 1] );
+                }
+            }
+
+            // Right-to-left sweep: area and polygon count of bins [b, sahNumBins)
+            double rightArea[sahNumBins];
+            size_t rightCount[sahNumBins];
+
+            Vector<float> sweep[2];
+            size_t numSwept = 0;
+
+            for ( int b = sahNumBins - 1; b > 0; b-- )
+            {
+                if ( bins[b].count > 0 )
+                {
+                    if ( numSwept == 0 )
+                    {
+                        sweep[0] = bins[b].bounds[0];
+                        sweep[1] = bins[b].bounds[1];
+                    }
+                    else
+                    {
+                        expandBounds( sweep, bins[b].bounds[0] );
+                        expandBounds( sweep, bins[b].bounds[1] );
+                    }
+
+                    numSwept += bins[b].count;
+                }
+
+                rightCount[b] = numSwept;
+                rightArea[b] = ( numSwept > 0 ) ? getSurfaceArea( sweep ) : 0.0;
+            }
+
+            // Left-to-right sweep, evaluating the boundary between bins b and b + 1
+            numSwept = 0;
+
+            for ( int b = 0; b < sahNumBins - 1; b++ )
+            {
+                if ( bins[b].count > 0 )
+                {
+                    if ( numSwept == 0 )
+                    {
+                        sweep[0] = bins[b].bounds[0];
+                        sweep[1] = bins[b].bounds[1];
+                    }
+                    else
+                    {
+                        expandBounds( sweep, bins[b].bounds[0] );
+                        expandBounds( sweep, bins[b].bounds[1] );
+                    }
+
+                    numSwept += bins[b].count;
+                }
+
+                if ( numSwept == 0 || rightCount[b + 1] == 0 )
+                    continue;
+
+                const double cost = getSurfaceArea( sweep ) * numSwept + rightArea[b + 1] * rightCount[b + 1];
+
+                if ( !found || cost < bestCost )
+                {
+                    found = true;
+                    bestCost = cost;
+                    axis = a;
+                    coord = low + extent * ( b + 1 ) / sahNumBins;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    static void splitPolygons( const BspPolygon* polygons, size_t count, const Vector<float> bounds[2], int axis, double coord,
+            List<BspPolygon>* partitions[2] )
+    {
+        // This is going to be useful later on...
+        const Vector<float> axisMask( axis == 0 ? 1.0f : 0.0f, axis == 1 ? 1.0f : 0.0f, axis == 2 ? 1.0f : 0.0f );
+
+        Plane plane;
+        plane.setNormalAndPoint( -axisMask, Vector<float>( axis == 0 ? coord : bounds[0].x, axis == 1 ? coord : bounds[0].y, axis == 2 ? coord : bounds[0].z ) );
+
+        // Add the polygons to their respective partitions
+        for ( size_t i = 0; i < count; i++ )
+        {
+            BspPolygon front, back;
+
+            front.numVertices = 0;
+            back.numVertices = 0;
+
+            splitPolygon( polygons[i], plane, front, back );
+
+            if ( front.numVertices > 0 )
+            {
+                front.materialIndex = polygons[i].materialIndex;
+                partitions[0]->add( front );
+            }
+
+            if ( back.numVertices > 0 )
+            {
+                back.materialIndex = polygons[i].materialIndex;
+                partitions[1]->add( back );
+            }
+        }
+
+#ifdef Bsp_print_stuff
+        printf( "Left child: %" PRIuPTR " tris\n", partitions[0]->getLength() );
+        printf( "Right child: %" PRIuPTR " tris\n", partitions[1]->getLength() );
+#endif
+    }
+
+    // Intermediate tree produced by the (possibly parallel) partitioning;
+    // the leaves keep their polygons until Bsp::emit turns them into meshes
+    struct BspBuildNode
+    {
+        Vector<float> bounds[2];
+        List<BspPolygon> polygons;
+        BspBuildNode* children[2];
+
+        BspBuildNode()
+        {
+            children[0] = nullptr;
+            children[1] = nullptr;
+        }
+
+        ~BspBuildNode()
+        {
+            delete children[0];
+            delete children[1];
+        }
+    };
+
+    // Shared state of a single partitioning
+    // Subtrees above parallelBuildThreshold are queued as tasks and picked up by whichever thread is free
+    class BspBuilder
+    {
+        struct Task
+        {
+            BspBuildNode* node;
+            List<BspPolygon>* polygons;
+        };
+
+        unsigned nodePolyLimit;
+        Vector<float> nodeVolumeLimit;
+        BspSplitMode splitMode;
+        bool parallel;
+
+        // Guards tasks and the error; idle workers wait on taskCondition until a task is queued or pending reaches 0
+        std::mutex taskMutex;
+        std::condition_variable taskCondition;
+        List<Task> tasks;
+
+        // Tasks queued or in progress (plus the root until it's done)
+        std::atomic<size_t> pending;
+
+        std::atomic<bool> failed;
+        String errorName, errorDesc;
+
+        void build( BspBuildNode* node, const BspPolygon* polygons, size_t count );
+        void execute( BspBuildNode* node, const BspPolygon* polygons, size_t count );
+        void split( BspBuildNode* node, const BspPolygon* polygons, size_t count, const Vector<float>& boundsSize );
+
+        public:
+            BspBuilder( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit, BspSplitMode splitMode, bool parallel );
+            ~BspBuilder();
+
+            void run( BspBuildNode* root, const BspPolygon* polygons, size_t count );
+            void work();
+    };
+
+    class BspBuildThread : public Thread
+    {
+        BspBuilder* builder;
+
+        public:
+            BspBuildThread( BspBuilder* builder ) : builder( builder )
+            {
+            }
+
+        protected:
+            virtual void run()
+            {
+                builder->work();
+            }
+    };
+
+    BspBuilder::BspBuilder( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit, BspSplitMode splitMode, bool parallel )
+            : nodePolyLimit( nodePolyLimit ), nodeVolumeLimit( nodeVolumeLimit ), splitMode( splitMode ), parallel( parallel ),
+            pending( 1 ), failed( false )
+    {
+    }
+
+    BspBuilder::~BspBuilder()
+    {
+        // Only non-empty if the build has failed
+        iterate ( tasks )
+            delete tasks.current().polygons;
+    }
+
+    void BspBuilder::build( BspBuildNode* node, const BspPolygon* polygons, size_t count )
+    {
+        // Somebody else has already failed; no point in going on
+        if ( failed )
+            return;
+
+        getBounds( polygons, count, node->bounds );
+
+#ifdef Bsp_print_stuff
+        printf( "BOUNDS: [%s] to [%s]\n", node->bounds[0].toString().c_str(), node->bounds[1].toString().c_str() );
+#endif
+
+        // size of the node boundary
+        const Vector<float> boundsSize = node->bounds[1] - node->bounds[0];
+
+        // Could the given polygons form a single acceptable node?
+        // Damn those unprecise floating points
+        if ( count > nodePolyLimit || boundsSize > nodeVolumeLimit * 1.001f )
+            split( node, polygons, count, boundsSize );
+        else
+        {
+            // Yeah, no prob
+            node->polygons.resize( count );
+
+            for ( size_t i = 0; i < count; i++ )
+                node->polygons.add( polygons[i] );
+        }
+    }
+
+    void BspBuilder::execute( BspBuildNode* node, const BspPolygon* polygons, size_t count )
+    {
+        try
+        {
+            build( node, polygons, count );
+        }
+        catch ( Exception& ex )
+        {
+            std::lock_guard<std::mutex> lock( taskMutex );
+
+            if ( !failed )
+            {
+                errorName = ex.getName();
+                errorDesc = ex.getDesc();
+                failed = true;
+            }
+
+            taskCondition.notify_all();
+        }
+
+        if ( --pending == 0 )
+        {
+            // Taking the lock makes sure that no worker is between checking `pending` and going to sleep
+            std::lock_guard<std::mutex> lock( taskMutex );
+            taskCondition.notify_all();
+        }
+    }
+
+    void BspBuilder::run( BspBuildNode* root, const BspPolygon* polygons, size_t count )
+    {
+        execute( root, polygons, count );
+
+        // Help with whatever has been queued in the meantime
+        work();
+
+        if ( failed )
+            throw Exception( "StormGraph.Bsp.partition", errorName, errorDesc );
+    }
+
+    void BspBuilder::split( BspBuildNode* node, const BspPolygon* polygons, size_t count, const Vector<float>& boundsSize )
+    {
+        // LOLNO, splitting time
+        List<BspPolygon>* partitions[2] = { nullptr, nullptr };
+
+        int axis;
+        double coord;
+
+        // The heuristic is only consulted for nodes with too many polygons; nodes that are just too big have to be cut along the offending axis
+        if ( splitMode == BspSplitMode::surfaceAreaHeuristic && count > nodePolyLimit && findSahSplit( polygons, count, axis, coord ) )
+        {
+            partitions[0] = new List<BspPolygon>( count / 2 );
+            partitions[1] = new List<BspPolygon>( count / 2 );
+
+            splitPolygons( polygons, count, node->bounds, axis, coord, partitions );
+
+            // Every single polygon straddles the plane; this would never end
+            if ( partitions[0]->getLength() >= count && partitions[1]->getLength() >= count )
+            {
+                delete partitions[0];
+                delete partitions[1];
+
+                partitions[0] = nullptr;
+                partitions[1] = nullptr;
+            }
+        }
+
+        if ( partitions[0] == nullptr )
+        {
+            axis = getSplitAxis( boundsSize, nodeVolumeLimit );
+
+#ifdef Bsp_print_stuff
+            printf( "Splitting along %i axis...\n", axis );
+#endif
+
+            unsigned bestCounts[2] = { 0, 0 };
+            coord = findSweepSplit( polygons, count, node->bounds, axis, bestCounts );
+
+            // Pre-allocate the space
+            // It won't most likely be enough because of the splits
+            // But it's better than starting from 0, amirite?
+            partitions[0] = new List<BspPolygon>( bestCounts[0] );
+            partitions[1] = new List<BspPolygon>( bestCounts[1] );
+
+            splitPolygons( polygons, count, node->bounds, axis, coord, partitions );
+        }
+
+        // but 2 children
+        for ( int i = 0; i < 2; i++ )
+        {
+            node->children[i] = new BspBuildNode;
+
+            if ( parallel && partitions[i]->getLength() >= parallelBuildThreshold )
+            {
+                {
+                    std::lock_guard<std::mutex> lock( taskMutex );
+
+                    pending++;
+                    tasks.add( Task { node->children[i], partitions[i] } );
+                }
+
+                taskCondition.notify_one();
+            }
+            else
+            {
+                Object<List<BspPolygon>> guard( partitions[i] );
+
+                build( node->children[i], partitions[i]->getPtr(), partitions[i]->getLength() );
+            }
+        }
+    }
+
+    void BspBuilder::work()
+    {
+        while ( true )
+        {
+            Task task;
+
+            {
+                std::unique_lock<std::mutex> lock( taskMutex );
+
+                // Nothing queued doesn't mean we're done; the subtrees still being built might hand out more
+                taskCondition.wait( lock, [this] { return !tasks.isEmpty() || pending == 0 || failed; } );
+
+                if ( tasks.isEmpty() || failed )
+                    return;
+
+                // Take the most recent task; it's the deepest one and its polygons are still warm
+                task = tasks[tasks.getLength() - 1];
+                tasks.remove( tasks.getLength() - 1 );
+            }
+
+            execute( task.node, task.polygons->getPtr(), task.polygons->getLength() );
+            delete task.polygons;
+        }
+    }
+
+    BspGenerator::BspGenerator( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit, BspSplitMode splitMode, unsigned numThreads )
+            : nodePolyLimit( nodePolyLimit ), nodeVolumeLimit( nodeVolumeLimit ), splitMode( splitMode ), numThreads( numThreads )
     {
+        if ( this->numThreads == 0 )
+            this->numThreads = maximum( std::thread::hardware_concurrency(), 1u );
+
+        stats.numNodes = 0;
+        stats.numLeaves = 0;
+        stats.numPolygons = 0;
+        stats.maxDepth = 0;
+        stats.seconds = 0.0;
     }
 
     BspGenerator::~BspGenerator()
@@ -203,6 +791,8 @@ namespace StormGraph
     {
         tree = new BspTree;
 
+        welder.clear();
+
         tree->root = partition( polygons, count );
         //printf( "## BSP GENERATION COMPLETE | %u Triangles total\n", totalTriangles );
 
@@ -225,19 +815,79 @@ namespace StormGraph
 
     unsigned Bsp::getVertexIndex( unsigned materialIndex, const Vertex& vertex )
     {
-        iterate ( tree->vertices[materialIndex] )
+        return welder.getIndex( materialIndex, tree->vertices[materialIndex], vertex );
+    }
+
+    void BspVertexWelder::clear()
+    {
+        cells.clear();
+        chains.resize( 0 );
+    }
+
+    unsigned BspVertexWelder::getIndex( unsigned materialIndex, List<Vertex>& vertices, const Vertex& vertex )
+    {
+        List<unsigned>& chain = chains[materialIndex];
+
+        // Any vertex that could be welded with this one lies in the cells overlapping [pos - tolerance, pos + tolerance]
+        // (the window is slightly enlarged to stay on the safe side of rounding)
+        int64_t lo[3], hi[3];
+
+        for ( int axis = 0; axis < 3; axis++ )
         {
-            const Vertex& current = tree->vertices[materialIndex].current();
+            lo[axis] = ( int64_t ) floor( ( vertex.pos.get( axis ) - 1.5f * weldTolerance ) / weldCellSize );
+            hi[axis] = ( int64_t ) floor( ( vertex.pos.get( axis ) + 1.5f * weldTolerance ) / weldCellSize );
+        }
+
+        // Return the lowest matching index, just like a linear scan would
+        unsigned match = endOfChain;
+
+        for ( int64_t x = lo[0]; x <= hi[0]; x++ )
+            for ( int64_t y = lo[1]; y <= hi[1]; y++ )
+                for ( int64_t z = lo[2]; z <= hi[2]; z++ )
+                {
+                    const unsigned* head = cells.find( getWeldCellKey( materialIndex, x, y, z ) );
+
+                    for ( unsigned i = ( head != nullptr ) ? *head : endOfChain; i != endOfChain; i = chain[i] )
+                    {
+                        if ( i >= match )
+                            continue;
+
+                        const Vertex& current = vertices[i];
+
+                        if ( current.pos.equals( vertex.pos, weldTolerance ) && current.normal.equals( vertex.normal, weldTolerance )
+                                && current.uv[0].equals( vertex.uv[0], weldTolerance )
+                                && current.uv[1].equals( vertex.uv[1], weldTolerance )
+                                && current.uv[2].equals( vertex.uv[2], weldTolerance )
+                                && current.lightUv.equals( vertex.lightUv, weldTolerance ) )
+                            match = i;
+                    }
+                }
+
+        if ( match != endOfChain )
+            return match;
+
+        // New vertex; push it to the front of its cell's chain
+        unsigned index = vertices.add( vertex );
 
-            if ( current.pos.equals( vertex.pos, 0.001f ) && current.normal.equals( vertex.normal, 0.001f )
-                    && current.uv[0].equals( vertex.uv[0], 0.001f )
-                    && current.uv[1].equals( vertex.uv[1], 0.001f )
-                    && current.uv[2].equals( vertex.uv[2], 0.001f )
-                    && current.lightUv.equals( vertex.lightUv, 0.001f ) )
-                return tree->vertices[materialIndex].iter();
+        uint64_t key = getWeldCellKey( materialIndex,
+                ( int64_t ) floor( vertex.pos.x / weldCellSize ),
+                ( int64_t ) floor( vertex.pos.y / weldCellSize ),
+                ( int64_t ) floor( vertex.pos.z / weldCellSize ) );
+
+        unsigned* head = cells.find( key );
+
+        if ( head != nullptr )
+        {
+            chain.add( *head );
+            *head = index;
+        }
+        else
+        {
+            chain.add( endOfChain );
+            cells.set( ( uint64_t&& ) key, ( unsigned&& ) index );
         }
 
-        return tree->vertices[materialIndex].add( vertex );
+        return index;
     }
 /*
     BspNode* Bsp::partition( BspTri* triangles, const unsigned count )
@@ -456,189 +1106,98 @@ namespace StormGraph
         }
     }
 */
-    BspNode* Bsp::partition( const BspPolygon* polygons, size_t count )
+    BspNode* Bsp::emit( const BspBuildNode* buildNode, unsigned depth )
     {
-        Object<BspNode> node = new BspNode;
-        getBounds( polygons, count, node->bounds );
-
-#ifdef Bsp_print_stuff
-        printf( "BOUNDS: [%s] to [%s]\n", node->bounds[0].toString().c_str(), node->bounds[1].toString().c_str() );
-#endif
-
-        // size of the node boundary
-        const Vector<float> boundsSize = node->bounds[1] - node->bounds[0];
+        BspNodeGuard node( new BspNode );
 
-        // center of the node volume (in world space!!)
-        const Vector<float> boundsCenter = node->bounds[0] + boundsSize / 2;
+        node->bounds[0] = buildNode->bounds[0];
+        node->bounds[1] = buildNode->bounds[1];
 
-#ifdef Bsp_print_stuff
-        printf( "%"PRIuPTR" VS %u polys; %s vs %s bounds\n", count, nodePolyLimit, boundsSize.toString().c_str(), nodeVolumeLimit.toString().c_str() );
-#endif
+        stats.numNodes++;
+        stats.maxDepth = maximum( stats.maxDepth, depth );
 
-        // Could the given polygons form a single acceptable node?
-        // Damn those unprecise floating points
-        if ( count > nodePolyLimit || boundsSize > nodeVolumeLimit * 1.001f )
+        if ( buildNode->children[0] != nullptr )
         {
-            // LOLNO, splitting time
-            // Ok, let's do this!
-
-            // Find the "most offending" axis with respect to the shape of the maximal node volume
-            const Vector<float> overflow = boundsSize / nodeVolumeLimit;
-
-            int axis;
-
-            if ( overflow.y >= overflow.x && overflow.y >= overflow.z )
-                axis = 1;
-            else if ( overflow.z >= overflow.x && overflow.z >= overflow.y )
-                axis = 2;
-            else
-                axis = 0;
+            node->children[0] = emit( buildNode->children[0], depth + 1 );
+            node->children[1] = emit( buildNode->children[1], depth + 1 );
 
-            // The axis is now determined. Let's find some reasonable splitting plane
-#ifdef Bsp_print_stuff
-            printf( "Splitting along %i axis...\n", axis );
-#endif
+            return node.detach();
+        }
 
-            // We'll loop through the possible partitionings until the polygon count ratio
-            // of the 2 new partitions starts to get worse.
+        stats.numLeaves++;
+        stats.numPolygons += buildNode->polygons.getLength();
 
-            // With these settings the loop will iterate 11 times
-            // Smaller steps would be most likely unreasonable because big nodes will be split further anyway
-            double limit = boundsSize.get( axis ) / 3.0f;
-            double step = ( boundsSize.get( axis ) - 2 * limit ) / 10.0f;
+        // Build the material groups
+        iterate ( buildNode->polygons )
+        {
+            const BspPolygon& polygon = buildNode->polygons.current();
+            size_t group;
 
-            double bestPolygonRatio = 0.0f, bestCoord = 0.0f;
-            unsigned bestCounts[2] = { 0, 0 };
+            for ( group = 0; group < node->meshes.getLength(); group++ )
+                if ( node->meshes[group]->material == polygon.materialIndex )
+                    break;
 
-            SG_assert( step > 0.01 )
+            if ( group >= node->meshes.getLength() )
+                group = node->meshes.add( new BspMesh( polygon.materialIndex ) );
 
-            for ( double c = node->bounds[0].get( axis ) + limit; c <= node->bounds[1].get( axis ) - limit; c += step )
-            {
-                // Count the polygons on each side of the splitting plane
-                //printf( "c = [%g: %g :%g] (+ %g)\n", c, node->bounds[0].get( axis ) + limit, node->bounds[1].get( axis ) - limit, step );
+            tree->totalTriangles[polygon.materialIndex] += breakPoly( polygon, node->meshes[group]->indices );
+        }
 
-                unsigned counts[2] = { 0, 0 };
+        return node.detach();
+    }
 
-                for ( unsigned i = 0; i < count; i++ )
-                {
-                    int side[2] = { 0, 0 };
+    BspNode* Bsp::partition( const BspPolygon* polygons, size_t count )
+    {
+        const uint64_t start = Timer::getRelativeMicroseconds();
 
-                    for ( unsigned j = 0; j < polygons[i].numVertices; j++ )
-                        if ( polygons[i].v[j].pos.get( axis ) < c - 0.001f )
-                            side[0] = 1;
-                        else if ( polygons[i].v[j].pos.get( axis ) > c + 0.001f )
-                            side[1] = 1;
+        stats.numNodes = 0;
+        stats.numLeaves = 0;
+        stats.numPolygons = 0;
+        stats.maxDepth = 0;
 
-                    if ( !side[0] && !side[1] )
-                        side[0] = 1;
+        Object<BspBuildNode> root = new BspBuildNode;
 
-                    counts[0] += side[0];
-                    counts[1] += side[1];
-                }
+        {
+            BspBuilder builder( nodePolyLimit, nodeVolumeLimit, splitMode, numThreads > 1 );
 
-                // No polygons on one of the sides? Such partitioning would be, of course, meaningless
-                if ( counts[0] == 0 || counts[1] == 0 )
-                    continue;
+            List<BspBuildThread*> threads;
 
-                // Calculate the polygon count ratio for this partitioning (always >= 1.0)
-                double ratio = ( counts[0] > counts[1] ) ? ( double ) counts[0] / counts[1] : ( double ) counts[1] / counts[0];
+            for ( unsigned i = 1; i < numThreads; i++ )
+                threads.add( new BspBuildThread( &builder ) );
 
-                // Only test the polygon ratio if we've already had a successful iteration
-                if ( bestCounts[0] != 0 )
-                {
-                    // The polygon ratio just got worse
-                    // And it's not going to get better.
-                    if ( ratio > bestPolygonRatio )
-                        break;
+            for each_in_list ( threads, i )
+                threads[i]->start();
 
-                    // The polygon ratio is exactly the same? Well, test the volume ratio then
-                    // (this should only happen for very low resolution meshes)
-                    if ( ratio == bestPolygonRatio && fabs( boundsCenter.get( axis ) - c ) > fabs( boundsCenter.get( axis ) - bestCoord ) )
-                        break;
-                }
-
-                // We've got a new candidate
-                bestPolygonRatio = ratio;
-                bestCoord = c;
-
-                // Cache these values to allocate a big enough array later
-                bestCounts[0] = counts[0];
-                bestCounts[1] = counts[1];
+            // The calling thread splits the root (and everything under the threshold) and then joins the pool
+            try
+            {
+                builder.run( root, polygons, count );
             }
-
-            // WHAT THE-
-            SG_assert( bestPolygonRatio >= 1.0f )
-
-#ifdef Bsp_print_stuff
-            printf( "BSP ## Best poly ratio %g (@ %g)\n", bestPolygonRatio, bestCoord );
-#endif
-
-            // Pre-allocate the space
-            // It won't most likely be enough because of the splits
-            // But it's better than starting from 0, amirite?
-            List<BspPolygon> partitions[2] = { bestCounts[0], bestCounts[1] };
-
-            // This is going to be useful later on...
-            const Vector<float> axisMask( axis == 0 ? 1.0f : 0.0f, axis == 1 ? 1.0f : 0.0f, axis == 2 ? 1.0f : 0.0f );
-
-            Plane plane;
-            plane.setNormalAndPoint( -axisMask, Vector<float>( axis == 0 ? bestCoord : node->bounds[0].x, axis == 1 ? bestCoord : node->bounds[0].y, axis == 2 ? bestCoord : node->bounds[0].z ) );
-
-            // Add the polygons to their respective partitions
-            for ( size_t i = 0; i < count; i++ )
+            catch ( ... )
             {
-                BspPolygon front, back;
-
-                front.numVertices = 0;
-                back.numVertices = 0;
-
-                splitPolygon( polygons[i], plane, front, back );
-
-                if ( front.numVertices > 0 )
+                for each_in_list ( threads, i )
                 {
-                    front.materialIndex = polygons[i].materialIndex;
-                    partitions[0].add( front );
+                    threads[i]->waitFor();
+                    delete threads[i];
                 }
 
-                if ( back.numVertices > 0 )
-                {
-                    back.materialIndex = polygons[i].materialIndex;
-                    partitions[1].add( back );
-                }
+                throw;
             }
 
-#ifdef Bsp_print_stuff
-            printf( "Left child: %" PRIuPTR " tris\n", partitions[0].getLength() );
-            printf( "Right child: %" PRIuPTR " tris\n", partitions[1].getLength() );
-#endif
-
-            // but 2 children
-            node->children[0] = partition( partitions[0].getPtr(), partitions[0].getLength() );
-            node->children[1] = partition( partitions[1].getPtr(), partitions[1].getLength() );
-
-            return node.detach();
-        }
-        else
-        {
-            // Yeah, no prob
-
-            // Build the material groups
-            for ( size_t i = 0; i < count; i++ )
+            for each_in_list ( threads, i )
             {
-                size_t group;
-
-                for ( group = 0; group < node->meshes.getLength(); group++ )
-                    if ( node->meshes[group]->material == polygons[i].materialIndex )
-                        break;
+                threads[i]->waitFor();
+                delete threads[i];
+            }
+        }
 
-                if ( group >= node->meshes.getLength() )
-                    group = node->meshes.add( new BspMesh( polygons[i].materialIndex ) );
+        // Meshes are emitted serially in depth-first order, so vertex welding (and therefore the whole tree)
+        // comes out exactly the same no matter how many threads took part
+        BspNode* node = emit( root, 1 );
 
-                tree->totalTriangles[polygons[i].materialIndex] += breakPoly( polygons[i], node->meshes[group]->indices );
-            }
+        stats.seconds = ( Timer::getRelativeMicroseconds() - start ) / 1000000.0;
 
-            return node.detach();
-        }
+        return node;
     }
 
     unsigned Bsp::registerMaterial( const char* name, MaterialStaticProperties* material )
@@ -704,18 +1263,21 @@ namespace StormGraph
         {
             BspMesh* mesh = node->meshes.current();
 
-            output->write<uint32_t>( mesh->indices.getLength() / 3 );
+            const unsigned* meshIndices = mesh->getIndices();
+            const size_t numIndices = mesh->getNumIndices();
+
+            output->write<uint32_t>( numIndices / 3 );
             output->write<uint32_t>( mesh->material );
 
             if ( indexSize == 2 )
             {
-                for each_in_list( mesh->indices, i )
-                    output->write<uint16_t>( mesh->indices[i] );
+                for ( size_t i = 0; i < numIndices; i++ )
+                    output->write<uint16_t>( meshIndices[i] );
             }
             else
             {
-                for each_in_list( mesh->indices, i )
-                    output->write<uint32_t>( mesh->indices[i] );
+                for ( size_t i = 0; i < numIndices; i++ )
+                    output->write<uint32_t>( meshIndices[i] );
             }
         }
 
@@ -730,14 +1292,139 @@ namespace StormGraph
             output->write<uint8_t>( 0 );
     }
 
-    void BspWriter::save( BspTree* tree, OutputStream* output )
+    uint32_t BspWriter::flatten( BspNode* node, List<BspBlockNode>& nodes, List<BspBlockMesh>& meshes, List<unsigned>& indices )
+    {
+        const uint32_t index = nodes.getLength();
+
+        BspBlockNode blockNode;
+
+        for ( int i = 0; i < 2; i++ )
+        {
+            blockNode.bounds[i][0] = node->bounds[i].x;
+            blockNode.bounds[i][1] = node->bounds[i].y;
+            blockNode.bounds[i][2] = node->bounds[i].z;
+        }
+
+        blockNode.firstMesh = meshes.getLength();
+        blockNode.numMeshes = node->meshes.getLength();
+        blockNode.children[0] = 0;
+        blockNode.children[1] = 0;
+
+        iterate ( node->meshes )
+        {
+            BspMesh* mesh = node->meshes.current();
+
+            const unsigned* meshIndices = mesh->getIndices();
+
+            BspBlockMesh blockMesh = { mesh->material, ( uint32_t ) indices.getLength(), ( uint32_t ) mesh->getNumIndices() };
+            meshes.add( blockMesh );
+
+            for ( size_t i = 0; i < mesh->getNumIndices(); i++ )
+                indices.add( meshIndices[i] );
+        }
+
+        nodes.add( blockNode );
+
+        // Pre-order: the node itself, then the whole first subtree, then the second one
+        if ( node->children[0] != nullptr || node->children[1] != nullptr )
+        {
+            const uint32_t first = flatten( node->children[0], nodes, meshes, indices );
+            const uint32_t second = flatten( node->children[1], nodes, meshes, indices );
+
+            nodes[index].children[0] = first;
+            nodes[index].children[1] = second;
+        }
+
+        return index;
+    }
+
+    static inline uint32_t alignBlock( uint64_t offset )
+    {
+        return ( uint32_t )( ( offset + bspBlockAlignment - 1 ) & ~( uint64_t )( bspBlockAlignment - 1 ) );
+    }
+
+    static void padTo( OutputStream* output, uint64_t& pos, uint32_t offset )
+    {
+        for ( ; pos < offset; pos++ )
+            output->write<uint8_t>( 0 );
+    }
+
+    void BspWriter::saveBlocks( BspTree* tree, OutputStream* output )
+    {
+        List<BspBlockNode> nodes;
+        List<BspBlockMesh> meshes;
+        List<unsigned> indices;
+
+        if ( tree->root != nullptr )
+            flatten( tree->root, nodes, meshes, indices );
+
+        BspBlockHeader header;
+        header.numVertices = 0;
+
+        for ( size_t i = 0; i < tree->materials.getLength(); i++ )
+            header.numVertices += tree->vertices[i].getLength();
+
+        header.numNodes = nodes.getLength();
+        header.numMeshes = meshes.getLength();
+        header.numIndices = indices.getLength();
+
+        header.vertexOffset = alignBlock( sizeof( BspBlockHeader ) );
+        header.nodeOffset = alignBlock( header.vertexOffset + ( uint64_t ) header.numVertices * sizeof( BspBlockVertex ) );
+        header.meshOffset = alignBlock( header.nodeOffset + ( uint64_t ) header.numNodes * sizeof( BspBlockNode ) );
+        header.indexOffset = alignBlock( header.meshOffset + ( uint64_t ) header.numMeshes * sizeof( BspBlockMesh ) );
+
+        output->write( &header, sizeof( header ) );
+        uint64_t pos = sizeof( header );
+
+        padTo( output, pos, header.vertexOffset );
+
+        for ( size_t i = 0; i < tree->materials.getLength(); i++ )
+            iterate ( tree->vertices[i] )
+            {
+                const Vertex& vertex = tree->vertices[i].current();
+
+                BspBlockVertex blockVertex = {
+                    { vertex.pos.x, vertex.pos.y, vertex.pos.z },
+                    { vertex.normal.x, vertex.normal.y, vertex.normal.z },
+                    { vertex.uv[0].x, vertex.uv[0].y },
+                    { vertex.lightUv.x, vertex.lightUv.y }
+                };
+
+                output->write( &blockVertex, sizeof( blockVertex ) );
+                pos += sizeof( blockVertex );
+            }
+
+        padTo( output, pos, header.nodeOffset );
+        output->write( nodes.getPtr(), nodes.getLength() * sizeof( BspBlockNode ) );
+        pos += nodes.getLength() * sizeof( BspBlockNode );
+
+        padTo( output, pos, header.meshOffset );
+        output->write( meshes.getPtr(), meshes.getLength() * sizeof( BspBlockMesh ) );
+        pos += meshes.getLength() * sizeof( BspBlockMesh );
+
+        padTo( output, pos, header.indexOffset );
+
+        if ( indexSize == 2 )
+        {
+            for each_in_list( indices, i )
+                output->write<uint16_t>( indices[i] );
+        }
+        else
+        {
+            for each_in_list( indices, i )
+                output->write<uint32_t>( indices[i] );
+        }
+    }
+
+    void BspWriter::save( BspTree* tree, OutputStream* output, unsigned revision )
     {
         Reference<> outputGuard( output );
 
         SG_assert( tree != nullptr )
         SG_assert( output != nullptr )
+        SG_assert( revision <= 1 )
 
-        output->writeString( "Sg_Bsp#0" );
+        output->writeString( revision == 0 ? "Sg_Bsp#0" : "Sg_Bsp#1" );
 
         indexSize = 2;
 
@@ -791,17 +1478,21 @@ namespace StormGraph
             output->write<uint32_t>( tree->vertices[i].getLength() );
             output->write<uint32_t>( tree->totalTriangles[i] );
 
-            iterate ( tree->vertices[i] )
-            {
-                const Vertex& vertex = tree->vertices[i].current();
+            if ( revision == 0 )
+                iterate ( tree->vertices[i] )
+                {
+                    const Vertex& vertex = tree->vertices[i].current();
 
-                output->write<Vector<float>>( vertex.pos );
-                output->write<Vector<float>>( vertex.normal );
-                output->write<Vector2<float>>( vertex.uv[0] );
-                output->write<Vector2<float>>( vertex.lightUv );
-            }
+                    output->write<Vector<float>>( vertex.pos );
+                    output->write<Vector<float>>( vertex.normal );
+                    output->write<Vector2<float>>( vertex.uv[0] );
+                    output->write<Vector2<float>>( vertex.lightUv );
+                }
         }
 
-        save( tree->root, output );
+        if ( revision == 0 )
+            save( tree->root, output );
+        else
+            saveBlocks( tree, output );
     }
 }
@@ -0,0 +1,356 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include <StormGraph/IO/LightBaker.hpp>
+
+#include <littl/Thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <thread>
+
+namespace StormGraph
+{
+    // Offset of shadow ray origins from the lit surface, to avoid self-shadowing
+    static const float shadowBias = 0.01f;
+
+    static const unsigned bvhLeafSize = 4;
+    static const size_t luxelBatchSize = 256;
+
+    class LightBakerThread : public Thread
+    {
+        const LightBaker* baker;
+        const LightBaker::Luxel* luxels;
+        size_t count;
+
+        Colour* results;
+        std::atomic<size_t>& next;
+
+        public:
+            LightBakerThread( const LightBaker* baker, const LightBaker::Luxel* luxels, size_t count, Colour* results, std::atomic<size_t>& next )
+                    : baker( baker ), luxels( luxels ), count( count ), results( results ), next( next )
+            {
+            }
+
+        protected:
+            virtual void run()
+            {
+                // Every luxel is computed independently, so the order in which threads pick up batches doesn't matter
+                for ( ; ; )
+                {
+                    const size_t begin = next.fetch_add( luxelBatchSize );
+
+                    if ( begin >= count )
+                        break;
+
+                    const size_t end = minimum( begin + luxelBatchSize, count );
+
+                    for ( size_t i = begin; i < end; i++ )
+                        results[i] = baker->calculateAt( luxels[i].pos, luxels[i].normal, luxels[i].castShadows );
+                }
+            }
+    };
+
+    static bool rayHitsBox( const Vector<>& origin, const Vector<>& invDirection, const Vector<> bounds[2], float maxDistance )
+    {
+        float tMin = 0.0f, tMax = maxDistance;
+
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            const float t0 = ( bounds[0].get( axis ) - origin.get( axis ) ) * invDirection.get( axis );
+            const float t1 = ( bounds[1].get( axis ) - origin.get( axis ) ) * invDirection.get( axis );
+
+            tMin = maximum( tMin, minimum( t0, t1 ) );
+            tMax = minimum( tMax, maximum( t0, t1 ) );
+
+            if ( tMin > tMax )
+                return false;
+        }
+
+        return true;
+    }
+
+    LightBaker::LightBaker( const Colour& sceneAmbient )
+            : sceneAmbient( sceneAmbient )
+    {
+    }
+
+    void LightBaker::addLight( const Light& light )
+    {
+        if ( light.type == point || light.type == directional )
+            lights.add( light );
+    }
+
+    void LightBaker::addLuxel( Image* image, size_t offset, const Vector<>& pos, const Vector<>& normal, bool castShadows )
+    {
+        luxels.add( Luxel { image, offset, pos, normal, castShadows } );
+    }
+
+    void LightBaker::bake( const List<BspPolygon>& polygons, unsigned numThreads )
+    {
+        buildTriangles( polygons );
+
+        if ( numThreads == 0 )
+            numThreads = maximum( std::thread::hardware_concurrency(), 1u );
+
+        Array<Colour> results;
+        results.resize( luxels.getLength(), false );
+
+        std::atomic<size_t> next( 0 );
+        List<LightBakerThread*> threads;
+
+        for ( unsigned i = 0; i < numThreads; i++ )
+            threads.add( new LightBakerThread( this, luxels.getPtrUnsafe(), luxels.getLength(), results.getPtr(), next ) );
+
+        for each_in_list ( threads, i )
+            threads[i]->start();
+
+        for each_in_list ( threads, i )
+        {
+            threads[i]->waitFor();
+            delete threads[i];
+        }
+
+        // Write in queue order, so that luxels shared by several faces (borders) end up the same as with a serial bake
+        for each_in_list ( luxels, i )
+        {
+            const Luxel& luxel = luxels[i];
+
+            luxel.image->data[luxel.offset] = results[i].getR();
+            luxel.image->data[luxel.offset + 1] = results[i].getG();
+            luxel.image->data[luxel.offset + 2] = results[i].getB();
+        }
+
+        luxels.clear();
+    }
+
+    unsigned LightBaker::buildBvh( const Vector<>* centres, unsigned* order, unsigned first, unsigned count )
+    {
+        const unsigned index = nodes.getLength();
+
+        BvhNode node;
+        node.bounds[0] = node.bounds[1] = triangles[order[first]].v0;
+        node.first = first;
+        node.count = count;
+        node.secondChild = 0;
+
+        Vector<> centreMin = centres[order[first]], centreMax = centreMin;
+
+        for ( unsigned i = first; i < first + count; i++ )
+        {
+            const Triangle& triangle = triangles[order[i]];
+            const Vector<> corners[3] = { triangle.v0, triangle.v0 + triangle.edge1, triangle.v0 + triangle.edge2 };
+
+            for ( int axis = 0; axis < 3; axis++ )
+            {
+                for ( int j = 0; j < 3; j++ )
+                {
+                    node.bounds[0].set( axis, minimum( node.bounds[0].get( axis ), corners[j].get( axis ) ) );
+                    node.bounds[1].set( axis, maximum( node.bounds[1].get( axis ), corners[j].get( axis ) ) );
+                }
+
+                centreMin.set( axis, minimum( centreMin.get( axis ), centres[order[i]].get( axis ) ) );
+                centreMax.set( axis, maximum( centreMax.get( axis ), centres[order[i]].get( axis ) ) );
+            }
+        }
+
+        if ( count <= bvhLeafSize )
+        {
+            nodes.add( node );
+            return index;
+        }
+
+        // Median split along the longest axis of the centroid bounds
+        const Vector<> extent = centreMax - centreMin;
+        const int axis = ( extent.x >= extent.y && extent.x >= extent.z ) ? 0 : ( extent.y >= extent.z ? 1 : 2 );
+
+        std::nth_element( order + first, order + first + count / 2, order + first + count, [centres, axis]( unsigned a, unsigned b )
+        {
+            return centres[a].get( axis ) < centres[b].get( axis );
+        } );
+
+        node.count = 0;
+        nodes.add( node );
+
+        buildBvh( centres, order, first, count / 2 );
+        const unsigned secondChild = buildBvh( centres, order, first + count / 2, count - count / 2 );
+
+        nodes[index].secondChild = secondChild;
+        return index;
+    }
+
+    void LightBaker::buildTriangles( const List<BspPolygon>& polygons )
+    {
+        triangles.clear();
+        nodes.clear();
+
+        for each_in_list ( polygons, i )
+        {
+            const BspPolygon& polygon = polygons[i];
+
+            for ( unsigned j = 1; j + 1 < polygon.numVertices; j++ )
+            {
+                const Triangle triangle { polygon.v[0].pos, polygon.v[j].pos - polygon.v[0].pos, polygon.v[j + 1].pos - polygon.v[0].pos };
+
+                // Skip degenerate triangles
+                if ( triangle.edge1.crossProduct( triangle.edge2 ).getLength() > 1.0e-8f )
+                    triangles.add( triangle );
+            }
+        }
+
+        if ( triangles.isEmpty() )
+            return;
+
+        Array<Vector<>> centres;
+        Array<unsigned> order;
+
+        centres.resize( triangles.getLength(), false );
+        order.resize( triangles.getLength(), false );
+
+        for each_in_list ( triangles, i )
+        {
+            centres[i] = triangles[i].v0 + ( triangles[i].edge1 + triangles[i].edge2 ) / 3.0f;
+            order[i] = i;
+        }
+
+        buildBvh( centres.getPtr(), order.getPtr(), 0, triangles.getLength() );
+
+        // Store the triangles in leaf order
+        List<Triangle> sorted;
+
+        for each_in_list ( triangles, i )
+            sorted.add( triangles[order[i]] );
+
+        triangles = ( List<Triangle>&& ) sorted;
+    }
+
+    Colour LightBaker::calculateAt( const Vector<>& pos, const Vector<>& normal, bool castShadows ) const
+    {
+        Colour sum = sceneAmbient;
+
+        const Vector<> origin = pos + normal * shadowBias;
+
+        for each_in_list ( lights, i )
+        {
+            const Light& light = lights[i];
+
+            if ( light.type == point )
+            {
+                const Vector<> ray( light.position - pos );
+                float diffuseAmount = maximum( 0.0f, ray.normalize().dotProduct( normal ) );
+
+                float attenuation =  light.range / ( 2.0f * ray.getLength() + 0.001f );
+
+                if ( castShadows && diffuseAmount > 0.0f )
+                {
+                    const Vector<> shadowRay( light.position - origin );
+
+                    if ( isOccluded( origin, shadowRay.normalize(), shadowRay.getLength() ) )
+                        diffuseAmount = 0.0f;
+                }
+
+                sum += ( light.ambient + diffuseAmount * light.diffuse ) * attenuation;
+            }
+            else if ( light.type == directional )
+            {
+                float diffuseAmount = maximum( 0.0f, ( -light.direction ).dotProduct( normal ) );
+
+                if ( castShadows && diffuseAmount > 0.0f && isOccluded( origin, ( -light.direction ).normalize(), FLT_MAX ) )
+                    diffuseAmount = 0.0f;
+
+                sum += light.ambient + diffuseAmount * light.diffuse;
+            }
+        }
+
+        sum.a = 1.0f;
+
+        return sum;
+    }
+
+    bool LightBaker::isOccluded( const Vector<>& origin, const Vector<>& direction, float maxDistance ) const
+    {
+        if ( nodes.isEmpty() )
+            return false;
+
+        Vector<> invDirection;
+
+        for ( int axis = 0; axis < 3; axis++ )
+            invDirection.set( axis, 1.0f / ( direction.get( axis ) != 0.0f ? direction.get( axis ) : 1.0e-30f ) );
+
+        // The tree is balanced, so this is plenty
+        unsigned stack[64];
+        unsigned depth = 0;
+
+        stack[depth++] = 0;
+
+        while ( depth > 0 )
+        {
+            const unsigned index = stack[--depth];
+            const BvhNode& node = nodes[index];
+
+            if ( !rayHitsBox( origin, invDirection, node.bounds, maxDistance ) )
+                continue;
+
+            if ( node.count == 0 )
+            {
+                stack[depth++] = index + 1;
+                stack[depth++] = node.secondChild;
+                continue;
+            }
+
+            // Moller-Trumbore; any hit will do
+            for ( unsigned i = node.first; i < node.first + node.count; i++ )
+            {
+                const Triangle& triangle = triangles[i];
+
+                const Vector<> p = direction.crossProduct( triangle.edge2 );
+                const float det = triangle.edge1.dotProduct( p );
+
+                if ( fabs( det ) < 1.0e-8f )
+                    continue;
+
+                const float invDet = 1.0f / det;
+                const Vector<> s = origin - triangle.v0;
+
+                const float u = s.dotProduct( p ) * invDet;
+
+                if ( u < 0.0f || u > 1.0f )
+                    continue;
+
+                const Vector<> q = s.crossProduct( triangle.edge1 );
+                const float v = direction.dotProduct( q ) * invDet;
+
+                if ( v < 0.0f || u + v > 1.0f )
+                    continue;
+
+                const float t = triangle.edge2.dotProduct( q ) * invDet;
+
+                if ( t > 1.0e-4f && t < maxDistance )
+                    return true;
+            }
+        }
+
+        return false;
+    }
+}
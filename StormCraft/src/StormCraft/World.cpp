@@ -27,6 +27,7 @@
 
 #include <StormGraph/IO/Bsp.hpp>
 #include <StormGraph/IO/ImageWriter.hpp>
+#include <StormGraph/IO/LightBaker.hpp>
 #include <StormGraph/GeometryFactory.hpp>
 
 #define LIGHTMAP_BORDER 1
@@ -46,51 +47,31 @@
 
 static const Colour selectionBlend { 1.0f, 0.75f, 0.75f, 1.0f };
 
-class Lighting
+// Collect the lights up front instead of walking the world tree for every luxel
+static void addLights( LightBaker& lightBaker, GroupWorldNode* group )
 {
-    protected:
-        static void calculateInNode( Colour& sum, const Vector<>& pos, const Vector<>& normal, GroupWorldNode* group )
-        {
-            iterate2 ( child, group->children )
-            {
-                LightWorldNode* light = dynamic_cast<LightWorldNode*>( *child );
-
-                if ( light != nullptr && light->enabled )
-                {
-                    if ( light->type == 0 )
-                    {
-                        const Vector<> ray( light->position - pos );
-                        float diffuseAmount = maximum( 0.0f, ray.normalize().dotProduct( normal ) );
+    iterate2 ( child, group->children )
+    {
+        LightWorldNode* light = dynamic_cast<LightWorldNode*>( *child );
 
-                        float attenuation =  light->range / ( 2.0f * ray.getLength() + 0.001f );
+        if ( light != nullptr && light->enabled )
+            lightBaker.addLight( LightBaker::Light { light->type, light->position, light->direction, light->ambient, light->diffuse, light->range } );
 
-                        sum += ( light->ambient + diffuseAmount * light->diffuse ) * attenuation;
-                    }
-                    else if ( light->type == 1 )
-                    {
-                        float diffuseAmount = maximum( 0.0f, ( -light->direction ).dotProduct( normal ) );
+        GroupWorldNode* group = dynamic_cast<GroupWorldNode*>( *child );
 
-                        sum += light->ambient + diffuseAmount * light->diffuse;
-                    }
-                }
-
-                GroupWorldNode* group = dynamic_cast<GroupWorldNode*>( *child );
+        if ( group != nullptr )
+            addLights( lightBaker, group );
+    }
+}
 
-                if ( group != nullptr )
-                    calculateInNode( sum, pos, normal, group );
-            }
-        }
+// Publishes a light baker through World::lightBaker for as long as it is in scope, even if building the geometry throws
+class LightBakerScope
+{
+    World* world;
 
     public:
-        static Colour calculateAt( const Vector<>& pos, const Vector<>& normal, World* world )
-        {
-            Colour sum = world->rootNode->sceneAmbient;
-
-            calculateInNode( sum, pos, normal, world->rootNode );
-            sum.a = 1.0f;
-
-            return sum;
-        }
+        LightBakerScope( World* world, LightBaker* lightBaker ) : world( world ) { world->lightBaker = lightBaker; }
+        ~LightBakerScope() { world->lightBaker = nullptr; }
 };
 
 /*static IMaterial* getMaterial( World* world, const String& name, const String& materialName )
@@ -701,8 +682,18 @@ BspTree* RootWorldNode::buildGeometry()
 
     Object<BspGenerator> bsp = new BspGenerator( maximum( world->exportSettings.bspPolygonLimit, 1 ), world->exportSettings.bspVolumeLimit );
 
-    iterate2 ( child, children )
-        child->buildGeometry( bsp, polygons );
+    // Light maps can only be baked once all the geometry (and therefore all potential occluders) is known
+    LightBaker lightBaker( world->rootNode->sceneAmbient );
+    addLights( lightBaker, world->rootNode );
+
+    {
+        LightBakerScope scope( world, &lightBaker );
+
+        iterate2 ( child, children )
+            child->buildGeometry( bsp, polygons );
+    }
+
+    lightBaker.bake( polygons );
 
     return bsp->generate( polygons.getPtr(), polygons.getLength() );
 }
@@ -1135,11 +1126,8 @@ void FaceWorldNode::buildGeometry( Bsp* bsp, List<BspPolygon>& polygons )
                 const Vector<> normal = sample( normalSamples, Vector2<>( u, v ) );
                 const Vector<> pos = sample( posSamples, Vector2<>( u, v ) );
 
-                Colour luxel = Lighting::calculateAt( pos, normal, world );
-
-                lightMapImage->data[index++] = luxel.getR();
-                lightMapImage->data[index++] = luxel.getG();
-                lightMapImage->data[index++] = luxel.getB();
+                world->lightBaker->addLuxel( lightMapImage, index, pos, normal );
+                index += 3;
             }
         }
     }
@@ -1904,11 +1892,9 @@ void TerrainWorldNode::buildGeometry( Bsp* bsp, List<BspPolygon>& polygons )
                     const Vector<> normal = sample( normalSamples, tuInPoly );
                     const Vector<> pos;
 
-                    Colour luxel = Lighting::calculateAt( pos, normal, world );
-
-                    lightMapImage->data[index++] = luxel.getR();
-                    lightMapImage->data[index++] = luxel.getG();
-                    lightMapImage->data[index++] = luxel.getB();
+                    // Luxel positions aren't known for terrain, so it can't receive shadows
+                    world->lightBaker->addLuxel( lightMapImage, index, pos, normal, false );
+                    index += 3;
                 }
             }
         }
@@ -25,6 +25,7 @@
 
 #include <StormGraph/IO/BspGenerator.hpp>
 #include <StormGraph/IO/Ctree2Generator.hpp>
+#include <StormGraph/IO/LightBaker.hpp>
 #include <StormGraph/Engine.hpp>
 #include <StormGraph/GuiDriver.hpp>
 #include <StormGraph/HeightMap.hpp>
@@ -472,6 +473,7 @@ class World
         // Light Maps
         List<LightMapDesc> lightMapDescs;
         List<LightMap> lightMaps;       // used during export
+        LightBaker* lightBaker = nullptr;   // used during export
 
         // Dynamic Resources - Base
         Reference<IUnionFileSystem> vfs;
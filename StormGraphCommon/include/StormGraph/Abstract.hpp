@@ -183,7 +183,7 @@ namespace StormGraph
         	void print();
     };
 
-    struct Transform
+    SgStruct Transform
     {
         enum Operation { translate, rotate, scale, matrix } operation;
         Vector<float> vector;   // translation, rotation, scaling
@@ -196,6 +196,13 @@ namespace StormGraph
                 : operation( operation ), vector( vector ), angle( angle )
         {
         }
+
+        Transform( const glm::mat4& transformation ) : operation( matrix ), angle( 0.0f ), transformation( transformation )
+        {
+        }
+
+        // Transforms are applied in order (transforms[0] first); a single matrix transform is returned as-is
+        static glm::mat4 compose( const Transform* transforms, unsigned numTransforms );
     };
 
     struct Vertex
@@ -44,6 +44,7 @@ namespace StormGraph
     class IResourceManager;
     class ITexture;
     class ITexturePreload;
+    class ViewFrustum;
 
     typedef IGraphicsDriver* ( *GraphicsDriverProvider )( const char* driverName, IEngine* engine );
 
@@ -274,6 +275,15 @@ namespace StormGraph
             virtual ~IStaticModel() {}
 
             virtual IStaticModel* finalize() = 0;
+
+            /**
+             *  @brief Get the model-space axis-aligned bounding box.
+             *
+             *  @param bounds receives the minimum and maximum corner
+             *  @return false if the bounds are not known (the model must then never be culled)
+             */
+            virtual bool getBounds( Vector<float> bounds[2] ) { return false; }
+
             virtual void render() = 0;
     };
 
@@ -304,11 +314,44 @@ namespace StormGraph
             virtual void render( const Transform* transforms, size_t numTransforms, bool inWorldSpace = true ) = 0;
             virtual void render( const Transform* transforms, size_t numTransforms, const Colour& blend ) = 0;
 
+            /**
+             *  @brief Render the model once for every transformation in localToWorld.
+             *
+             *  Drivers supporting hardware instancing draw all instances of each mesh in a single call.
+             *
+             *  @param localToWorld world-space transformation of each instance
+             *  @param numInstances number of items in localToWorld
+             */
+            virtual void renderInstanced( const glm::mat4* localToWorld, size_t numInstances )
+            {
+                for ( size_t i = 0; i < numInstances; i++ )
+                {
+                    Transform transform( localToWorld[i] );
+                    render( &transform, 1 );
+                }
+            }
+
+            /**
+             *  @brief Draw a part of one mesh, in world space.
+             *
+             *  @param offset first vertex (or index, for indexed meshes) to draw
+             *  @param count number of vertices (or indices) to draw
+             */
+            virtual void renderRange( size_t mesh, size_t offset, size_t count ) = 0;
+
             //virtual bool retrieveVertices( size_t mesh, size_t offset, Vertex* vertices, size_t count ) = 0;
 
             // `count` specifies the number of full 3-float vertices
             //virtual bool updateVertexCoords( unsigned mesh, unsigned offset, float* coords, unsigned count ) = 0;
-            //virtual bool updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count ) = 0;
+
+            /**
+             *  @brief Overwrite vertices of a mesh in place; meant for models created with dynamicVertices or streamedVertices.
+             *
+             *  Only the attributes the mesh was created with are updated.
+             *
+             *  @return false if the range lies outside of the mesh
+             */
+            virtual bool updateVertices( size_t mesh, size_t offset, const Vertex* vertices, size_t count ) = 0;
     };
 
     /*
@@ -431,10 +474,22 @@ namespace StormGraph
              */
             //virtual void addLight( ILight* light, const Transform* transforms, size_t numTransforms ) = 0;
 
+            /**
+             *  @brief Get the number of meshes drawn as instances by the last render() and the number of instanced draws used for them.
+             */
+            virtual void getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws ) = 0;
+
             /**
              *  @brief Start the rendering.
              */
             virtual void render() = 0;
+
+            /**
+             *  @brief Enable or disable instanced drawing (enabled by default).
+             *
+             *  When enabled, the opaque items with the same mesh and material are sorted next to each other and drawn with a single instanced call.
+             */
+            virtual void setInstancing( bool enabled ) = 0;
     };
 
     SgStruct CuboidCreationInfo
@@ -565,6 +620,7 @@ namespace StormGraph
             virtual const glm::mat4& getModelView() = 0;
             virtual void getProjectionInfo( IProjectionInfoBuffer* projectionInfoBuffer ) = 0;
             virtual IMaterial* getSolidMaterial() = 0;
+            virtual const ViewFrustum* getViewFrustum() = 0;
             virtual Vector2<unsigned> getViewportSize() = 0;
             virtual Vector2<unsigned> getWindowSize() = 0;
             virtual ITexturePreload* preloadTextureFromStream( SeekableInputStream* input, const char* name, ILodFunction* lodFunction ) = 0;
@@ -0,0 +1,113 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/RenderSortKey.hpp>
+
+namespace StormGraph
+{
+    /**
+     *  The driver-independent part of a render queue.
+     *
+     *  Drivers add one item per queued mesh and call build() when flushing. That sorts the items by RenderSortKey
+     *  (with the mesh ranked between the material and the depth, so that instances of a mesh end up next to each other),
+     *  splits them into runs of the same mesh and material (drawn as one instanced call when instancing is enabled)
+     *  and works out which draws have to apply their material. The driver then walks getRuns() in order.
+     */
+    SgClass RenderBatcher
+    {
+        public:
+            struct Item
+            {
+                // Identity of the mesh; items with the same mesh and material may share an instanced draw
+                const void* mesh;
+
+                // Raw state names, ranked at every build (see RenderSortKey::makeDense); 0 for none
+                uint32_t program, texture, material;
+
+                bool blended;
+                glm::mat4 localToWorld;
+            };
+
+            struct Run
+            {
+                // Range of getItemIndex positions
+                size_t first, count;
+
+                // Instanced runs always apply their material; single draws only when it differs from the previous draw's
+                bool applyMaterial;
+            };
+
+        private:
+            struct SortEntry
+            {
+                uint64_t key;
+                size_t item;
+            };
+
+            List<Item> items;
+            List<SortEntry> sortEntries;
+            List<Run> runs;
+
+            // Per-item dense state ids for the current build
+            List<uint32_t> programIds, textureIds, materialIds, meshIds, distinctIds;
+            List<uintptr_t> distinctMeshes;
+
+            List<glm::mat4> instanceMatrices;
+            unsigned numInstanced, numInstancedDraws;
+
+        public:
+            RenderBatcher() : numInstanced( 0 ), numInstancedDraws( 0 ) {}
+
+            // Returns the index of the item, in submission order
+            size_t add( const Item& item ) { return items.add( item ); }
+
+            /**
+             *  @brief Sort the items added since the last clear() and group them into runs.
+             *
+             *  @param eye camera position the depth order is based on
+             *  @param instancing whether runs may contain more than one item
+             */
+            void build( const Vector<float>& eye, bool instancing );
+
+            // Forget the items, but keep the allocations for the next flush
+            void clear();
+
+            /**
+             *  @brief Get the model matrices of all items in a run, in draw order.
+             *
+             *  The array stays valid until the next call.
+             */
+            const glm::mat4* getInstanceMatrices( const Run& run );
+
+            void getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws ) const;
+            const Item& getItem( size_t index ) const { return items[index]; }
+
+            // Submission index of the item drawn at a position
+            size_t getItemIndex( size_t position ) const { return sortEntries[position].item; }
+
+            size_t getNumItems() const { return items.getLength(); }
+            const List<Run>& getRuns() const { return runs; }
+    };
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/Abstract.hpp>
+
+namespace StormGraph
+{
+    /**
+     *  Sort keys for render queues: opaque draws first, grouped by state and mesh and front to back within those,
+     *  then blended draws strictly back to front. Grouping by mesh keeps the instances of a mesh together for RenderBatcher.
+     *
+     *  Key layout (most significant first):
+     *      opaque:  0 | 8 bits program | 12 bits first texture | 12 bits material | 12 bits mesh | 19 bits view distance
+     *      blended: 1 | 32 bits inverted view distance | 15 bits material | 16 bits unused
+     *
+     *  The state ids must be dense (see makeDense). Ids that still don't fit are clamped, which only weakens the grouping;
+     *  the buckets and the depth order are never affected.
+     */
+    SgClass RenderSortKey
+    {
+        public:
+            static uint64_t getBlended( uint32_t material, float distanceSquared );
+            static uint64_t getOpaque( uint32_t program, uint32_t texture, uint32_t material, uint32_t mesh, float distanceSquared );
+            static bool isBlended( uint64_t key ) { return ( key >> 63 ) != 0; }
+
+            /**
+             *  @brief Replace every value by its rank among the distinct values.
+             *
+             *  Raw state names (GL object names, ever-growing material ids) can be arbitrarily large; their ranks fit the key fields.
+             *
+             *  @param distinct scratch list, kept by the caller to avoid reallocating it every flush
+             */
+            static void makeDense( uint32_t* values, size_t count, List<uint32_t>& distinct );
+    };
+}
@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/Abstract.hpp>
+
+namespace StormGraph
+{
+    /**
+     *  Batch versions of the Vector and Plane operations found in hot loops.
+     *
+     *  The kernels use SSE (x86) or NEON (AArch64) when the compiler targets them, and plain scalar code otherwise.
+     *  Define StormGraph_No_SIMD to force the scalar code.
+     *  Each kernel has a ...Scalar twin built on the regular Vector/Plane methods; it serves as the reference for the SIMD code,
+     *  which matches it up to float rounding.
+     */
+    SgClass VectorBatch
+    {
+        public:
+            /**
+             *  @brief Transform points by a matrix, computing matrix * ( x, y, z, 1 ).
+             *
+             *  The w component of the points is passed through unchanged. in and out may point to the same array.
+             */
+            static void transformPoints( const glm::mat4& matrix, const Vector<float>* in, Vector<float>* out, size_t count );
+            static void transformPointsScalar( const glm::mat4& matrix, const Vector<float>* in, Vector<float>* out, size_t count );
+
+            /**
+             *  @brief Normalize vectors the same way as Vector::normalize.
+             *
+             *  The w component is kept and zero vectors come out as all zeros. in and out may point to the same array.
+             */
+            static void normalize( const Vector<float>* in, Vector<float>* out, size_t count );
+            static void normalizeScalar( const Vector<float>* in, Vector<float>* out, size_t count );
+
+            /**
+             *  @brief Classify spheres against a set of planes the same way as ViewFrustum::sphereInFrustum.
+             *
+             *  The spheres are given in structure-of-arrays form. The plane that rejected the previous spheres is tested first,
+             *  so spatially coherent batches are usually rejected after a single plane.
+             *
+             *  planeMasks enables hierarchical culling (at most 8 planes). On input, bit i means plane i has to be tested;
+             *  a sphere whose mask is 0 is accepted without any test. On output, the mask holds the planes the sphere intersects.
+             *
+             *  @param results receives ViewFrustum::TestResult for every sphere (0 outside, 1 intersect, 2 inside)
+             *  @param planeMasks optional per-sphere plane masks (may be nullptr)
+             *  @return number of spheres not outside the planes
+             */
+            static size_t spheresInPlanes( const Plane* planes, size_t numPlanes, const float* x, const float* y, const float* z, const float* radius,
+                    size_t count, uint8_t* results, uint8_t* planeMasks = nullptr );
+            static void spheresInPlanesScalar( const Plane* planes, size_t numPlanes, const float* x, const float* y, const float* z, const float* radius,
+                    size_t count, uint8_t* results );
+    };
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+
+#pragma once
+
+#include <StormGraph/Abstract.hpp>
+
+namespace StormGraph
+{
+    SgClass ViewFrustum
+    {
+    	enum { top = 0, bottom, left, right, nearClip, farClip, numPlanes };
+
+        public:
+            enum TestResult { outside, intersect, inside };
+            enum { allPlanes = ( 1 << numPlanes ) - 1 };
+
+        	Plane planes[numPlanes];
+
+        	Vector<float> ntl, ntr, nbl, nbr, ftl, ftr, fbl, fbr;
+        	float nearD, farD, ratio, angle,tang;
+        	float nw, nh, fw, fh;
+
+        	ViewFrustum();
+        	~ViewFrustum();
+
+            void setProjection( float angle, float ratio, float nearD, float farD );
+            void setView( const Vector<float>& eye, const Vector<float>& center, const Vector<float>& up );
+
+            /**
+             *  @brief Extract the clipping planes from a combined projection * view matrix.
+             *
+             *  Used for views not set up through setProjection/setView (e.g. shadow map passes).
+             */
+            void setViewProjection( const glm::mat4& viewProjection );
+
+            TestResult pointInFrustum( const Vector<float>& point ) const;
+            TestResult sphereInFrustum( const Vector<float>& center, float radius ) const;
+            TestResult boxInFrustum( const Vector<float>& min, const Vector<float>& max ) const;
+
+            /**
+             *  @brief Batch versions of sphereInFrustum and boxInFrustum for volumes in structure-of-arrays form.
+             *
+             *  Four volumes are tested at a time with SSE/NEON where available. The plane that rejected the previous
+             *  volumes is tested first, so spatially coherent batches are usually rejected after a single plane.
+             *  spheresInFrustum is VectorBatch::spheresInPlanes applied to the frustum planes.
+             *
+             *  planeMasks enables hierarchical culling. On input, bit i means plane i has to be tested; pass allPlanes for
+             *  the root volumes. A volume whose mask is 0 lies inside its parent's planes and is accepted without any test.
+             *  On output, the mask holds the planes the volume intersects, to be passed on to its children.
+             *
+             *  @param results receives a TestResult for every volume; with all planes tested, identical to the single-volume functions
+             *  @param planeMasks optional per-volume plane masks (may be nullptr)
+             *  @return number of volumes not outside the frustum
+             */
+            size_t spheresInFrustum( const float* x, const float* y, const float* z, const float* radius, size_t count,
+                    uint8_t* results, uint8_t* planeMasks = nullptr ) const;
+            size_t boxesInFrustum( const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ,
+                    size_t count, uint8_t* results, uint8_t* planeMasks = nullptr ) const;
+    };
+}
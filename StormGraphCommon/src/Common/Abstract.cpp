@@ -23,6 +23,8 @@
 
 #include <StormGraph/Abstract.hpp>
 
+#include <glm/gtc/matrix_transform.hpp>
+
 namespace StormGraph
 {
     static float hue2rgb( float p, float q, float t )
@@ -152,6 +154,44 @@ namespace StormGraph
     	printf( "Plane( %f, %f, %f # %f )\n", normal.x, normal.y, normal.z, d );
     }
 
+    glm::mat4 Transform::compose( const Transform* transforms, unsigned numTransforms )
+    {
+        // Cached node matrices end up here; no need to multiply them by identity
+        if ( numTransforms == 1 && transforms[0].operation == matrix )
+            return transforms[0].transformation;
+
+        // OpenGL does it the reverse way
+        // reversed reverse = correct! yay!
+
+        glm::mat4 result;
+
+        for ( int i = numTransforms - 1; i >= 0; i-- )
+        {
+            const Transform& current = transforms[i];
+
+            switch ( current.operation )
+            {
+                case translate:
+                    result = glm::translate( result, current.vector.operator glm::vec3() );
+                    break;
+
+                case rotate:
+                    result = glm::rotate( result, ( float )( -current.angle * 180.0f / M_PI ), current.vector.operator glm::vec3() );
+                    break;
+
+                case scale:
+                    result = glm::scale( result, current.vector.operator glm::vec3() );
+                    break;
+
+                case matrix:
+                    result = result * current.transformation;
+                    break;
+            }
+        }
+
+        return result;
+    }
+
     unsigned Polygon::breakIntoTriangles( List<unsigned>& indices )
     {
         if ( numVertices < 3 )
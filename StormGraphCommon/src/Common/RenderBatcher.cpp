@@ -0,0 +1,157 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include <StormGraph/RenderBatcher.hpp>
+
+#include <algorithm>
+
+namespace StormGraph
+{
+    void RenderBatcher::build( const Vector<float>& eye, bool instancing )
+    {
+        const size_t numItems = items.getLength();
+
+        runs.clear();
+        sortEntries.clear();
+
+        numInstanced = 0;
+        numInstancedDraws = 0;
+
+        if ( numItems == 0 )
+            return;
+
+        // Raw state names are GL object names and ever-growing material ids; rank them instead
+        programIds.clear();
+        textureIds.clear();
+        materialIds.clear();
+        meshIds.clear();
+        distinctMeshes.clear();
+
+        for ( size_t i = 0; i < numItems; i++ )
+        {
+            programIds.add( items[i].program );
+            textureIds.add( items[i].texture );
+            materialIds.add( items[i].material );
+            distinctMeshes.add( ( uintptr_t ) items[i].mesh );
+        }
+
+        RenderSortKey::makeDense( programIds.getPtrUnsafe(), numItems, distinctIds );
+        RenderSortKey::makeDense( textureIds.getPtrUnsafe(), numItems, distinctIds );
+        RenderSortKey::makeDense( materialIds.getPtrUnsafe(), numItems, distinctIds );
+
+        // Meshes are identified by address; rank them the same way as makeDense
+        uintptr_t* begin = distinctMeshes.getPtrUnsafe();
+        std::sort( begin, begin + numItems );
+
+        uintptr_t* end = std::unique( begin, begin + numItems );
+
+        for ( size_t i = 0; i < numItems; i++ )
+            meshIds.add( ( uint32_t )( std::lower_bound( begin, end, ( uintptr_t ) items[i].mesh ) - begin ) );
+
+        for ( size_t i = 0; i < numItems; i++ )
+        {
+            const glm::mat4& transform = items[i].localToWorld;
+
+            const float dx = transform[3][0] - eye.x, dy = transform[3][1] - eye.y, dz = transform[3][2] - eye.z;
+            const float distanceSq = dx * dx + dy * dy + dz * dz;
+
+            SortEntry entry;
+            entry.item = i;
+
+            if ( items[i].blended )
+                entry.key = RenderSortKey::getBlended( materialIds[i], distanceSq );
+            else
+                entry.key = RenderSortKey::getOpaque( programIds[i], textureIds[i], materialIds[i], meshIds[i], distanceSq );
+
+            sortEntries.add( entry );
+        }
+
+        // Ties are broken by submission order to keep the output deterministic
+        std::sort( sortEntries.getPtrUnsafe(), sortEntries.getPtrUnsafe() + numItems, []( const SortEntry& a, const SortEntry& b )
+        {
+            return a.key < b.key || ( a.key == b.key && a.item < b.item );
+        } );
+
+        // Material of the previous single draw; instanced draws select a program of their own, so after one nothing is current
+        bool haveMaterial = false;
+        uint32_t currentMaterial = 0;
+
+        for ( size_t i = 0, last; i < numItems; i = last )
+        {
+            const Item& item = items[sortEntries[i].item];
+
+            last = i + 1;
+
+            if ( instancing )
+            {
+                while ( last < numItems && items[sortEntries[last].item].mesh == item.mesh && items[sortEntries[last].item].material == item.material )
+                    last++;
+            }
+
+            Run run;
+            run.first = i;
+            run.count = last - i;
+
+            if ( run.count > 1 )
+            {
+                run.applyMaterial = true;
+                haveMaterial = false;
+
+                numInstanced += ( unsigned ) run.count;
+                numInstancedDraws++;
+            }
+            else
+            {
+                run.applyMaterial = !haveMaterial || item.material != currentMaterial;
+
+                haveMaterial = true;
+                currentMaterial = item.material;
+            }
+
+            runs.add( run );
+        }
+    }
+
+    void RenderBatcher::clear()
+    {
+        items.clear();
+        sortEntries.clear();
+        runs.clear();
+    }
+
+    const glm::mat4* RenderBatcher::getInstanceMatrices( const Run& run )
+    {
+        instanceMatrices.clear();
+
+        for ( size_t i = 0; i < run.count; i++ )
+            instanceMatrices.add( items[getItemIndex( run.first + i )].localToWorld );
+
+        return instanceMatrices.getPtrUnsafe();
+    }
+
+    void RenderBatcher::getInstancingStats( unsigned* numInstanced, unsigned* numInstancedDraws ) const
+    {
+        *numInstanced = this->numInstanced;
+        *numInstancedDraws = this->numInstancedDraws;
+    }
+}
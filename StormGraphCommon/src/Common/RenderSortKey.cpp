@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include <StormGraph/RenderSortKey.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace StormGraph
+{
+    // Non-negative IEEE floats compare the same way as their bit patterns
+    static uint32_t getDepthBits( float distanceSquared )
+    {
+        uint32_t depth;
+        memcpy( &depth, &distanceSquared, sizeof( depth ) );
+
+        return depth;
+    }
+
+    uint64_t RenderSortKey::getBlended( uint32_t material, float distanceSquared )
+    {
+        const uint64_t depth = ~getDepthBits( distanceSquared );
+
+        return ( 1ull << 63 ) | ( depth << 31 ) | ( ( uint64_t ) minimum<uint32_t>( material, 0x7FFF ) << 16 );
+    }
+
+    uint64_t RenderSortKey::getOpaque( uint32_t program, uint32_t texture, uint32_t material, uint32_t mesh, float distanceSquared )
+    {
+        return ( ( uint64_t ) minimum<uint32_t>( program, 0xFF ) << 55 ) | ( ( uint64_t ) minimum<uint32_t>( texture, 0xFFF ) << 43 )
+                | ( ( uint64_t ) minimum<uint32_t>( material, 0xFFF ) << 31 ) | ( ( uint64_t ) minimum<uint32_t>( mesh, 0xFFF ) << 19 )
+                | ( getDepthBits( distanceSquared ) >> 13 );
+    }
+
+    void RenderSortKey::makeDense( uint32_t* values, size_t count, List<uint32_t>& distinct )
+    {
+        distinct.clear();
+
+        for ( size_t i = 0; i < count; i++ )
+            distinct.add( values[i] );
+
+        uint32_t* begin = distinct.getPtrUnsafe();
+        std::sort( begin, begin + count );
+
+        uint32_t* end = std::unique( begin, begin + count );
+
+        for ( size_t i = 0; i < count; i++ )
+            values[i] = ( uint32_t )( std::lower_bound( begin, end, values[i] ) - begin );
+    }
+}
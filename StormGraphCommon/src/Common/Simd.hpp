@@ -0,0 +1,182 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/Abstract.hpp>
+
+#include <cstring>
+
+// Internal: a minimal set of 4-wide float operations shared by the batch kernels
+// StormGraph_SIMD is defined when one of the implementations is available; define StormGraph_No_SIMD to disable them
+
+#if !defined( StormGraph_No_SIMD ) && ( defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 ) )
+#define StormGraph_SSE
+#include <xmmintrin.h>
+#elif !defined( StormGraph_No_SIMD ) && defined( __aarch64__ ) && defined( __ARM_NEON )
+#define StormGraph_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined( StormGraph_SSE ) || defined( StormGraph_NEON )
+#define StormGraph_SIMD
+#endif
+
+namespace StormGraph
+{
+#ifdef StormGraph_SIMD
+    // The kernels are written once against these wrappers
+    // Comparisons return all-ones/all-zeros lane masks stored in a Float4
+
+#ifdef StormGraph_SSE
+    typedef __m128 Float4;
+
+    static inline Float4 load4( const float* p ) { return _mm_loadu_ps( p ); }
+    static inline void store4( float* p, Float4 v ) { _mm_storeu_ps( p, v ); }
+    static inline Float4 splat( float value ) { return _mm_set1_ps( value ); }
+    template <int lane> static inline Float4 broadcast( Float4 v ) { return _mm_shuffle_ps( v, v, _MM_SHUFFLE( lane, lane, lane, lane ) ); }
+
+    static inline Float4 add( Float4 a, Float4 b ) { return _mm_add_ps( a, b ); }
+    static inline Float4 sub( Float4 a, Float4 b ) { return _mm_sub_ps( a, b ); }
+    static inline Float4 mul( Float4 a, Float4 b ) { return _mm_mul_ps( a, b ); }
+    static inline Float4 div( Float4 a, Float4 b ) { return _mm_div_ps( a, b ); }
+    static inline Float4 sqrt4( Float4 v ) { return _mm_sqrt_ps( v ); }
+
+    static inline Float4 lessThan( Float4 a, Float4 b ) { return _mm_cmplt_ps( a, b ); }
+    static inline Float4 notEqual( Float4 a, Float4 b ) { return _mm_cmpneq_ps( a, b ); }
+    static inline Float4 and4( Float4 mask, Float4 v ) { return _mm_and_ps( mask, v ); }
+    static inline Float4 or4( Float4 a, Float4 b ) { return _mm_or_ps( a, b ); }
+    static inline Float4 select( Float4 mask, Float4 a, Float4 b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }
+
+    // Bit i set if lane i of the mask is set
+    static inline int getMask( Float4 mask ) { return _mm_movemask_ps( mask ); }
+
+    static inline void transpose( Float4& a, Float4& b, Float4& c, Float4& d ) { _MM_TRANSPOSE4_PS( a, b, c, d ); }
+#else
+    typedef float32x4_t Float4;
+
+    static inline Float4 load4( const float* p ) { return vld1q_f32( p ); }
+    static inline void store4( float* p, Float4 v ) { vst1q_f32( p, v ); }
+    static inline Float4 splat( float value ) { return vdupq_n_f32( value ); }
+    template <int lane> static inline Float4 broadcast( Float4 v ) { return vdupq_laneq_f32( v, lane ); }
+
+    static inline Float4 add( Float4 a, Float4 b ) { return vaddq_f32( a, b ); }
+    static inline Float4 sub( Float4 a, Float4 b ) { return vsubq_f32( a, b ); }
+    static inline Float4 mul( Float4 a, Float4 b ) { return vmulq_f32( a, b ); }
+    static inline Float4 div( Float4 a, Float4 b ) { return vdivq_f32( a, b ); }
+    static inline Float4 sqrt4( Float4 v ) { return vsqrtq_f32( v ); }
+
+    static inline Float4 lessThan( Float4 a, Float4 b ) { return vreinterpretq_f32_u32( vcltq_f32( a, b ) ); }
+    static inline Float4 notEqual( Float4 a, Float4 b ) { return vreinterpretq_f32_u32( vmvnq_u32( vceqq_f32( a, b ) ) ); }
+    static inline Float4 and4( Float4 mask, Float4 v ) { return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( mask ), vreinterpretq_u32_f32( v ) ) ); }
+    static inline Float4 or4( Float4 a, Float4 b ) { return vreinterpretq_f32_u32( vorrq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ) ) ); }
+    static inline Float4 select( Float4 mask, Float4 a, Float4 b ) { return vbslq_f32( vreinterpretq_u32_f32( mask ), a, b ); }
+
+    static inline int getMask( Float4 mask )
+    {
+        static const uint32_t weights[4] = { 1, 2, 4, 8 };
+
+        return ( int ) vaddvq_u32( vandq_u32( vreinterpretq_u32_f32( mask ), vld1q_u32( weights ) ) );
+    }
+
+    static inline void transpose( Float4& a, Float4& b, Float4& c, Float4& d )
+    {
+        // ( a0 b0 a2 b2 ) ( a1 b1 a3 b3 ), same for c & d
+        const float32x4x2_t ab = vtrnq_f32( a, b ), cd = vtrnq_f32( c, d );
+
+        a = vcombine_f32( vget_low_f32( ab.val[0] ), vget_low_f32( cd.val[0] ) );
+        b = vcombine_f32( vget_low_f32( ab.val[1] ), vget_low_f32( cd.val[1] ) );
+        c = vcombine_f32( vget_high_f32( ab.val[0] ), vget_high_f32( cd.val[0] ) );
+        d = vcombine_f32( vget_high_f32( ab.val[1] ), vget_high_f32( cd.val[1] ) );
+    }
+#endif
+
+    // Lane i is set if bit i of bits is set
+    static inline Float4 getLaneMask( int bits )
+    {
+        static const uint32_t masks[16][4] =
+        {
+            { 0u, 0u, 0u, 0u }, { ~0u, 0u, 0u, 0u }, { 0u, ~0u, 0u, 0u }, { ~0u, ~0u, 0u, 0u },
+            { 0u, 0u, ~0u, 0u }, { ~0u, 0u, ~0u, 0u }, { 0u, ~0u, ~0u, 0u }, { ~0u, ~0u, ~0u, 0u },
+            { 0u, 0u, 0u, ~0u }, { ~0u, 0u, 0u, ~0u }, { 0u, ~0u, 0u, ~0u }, { ~0u, ~0u, 0u, ~0u },
+            { 0u, 0u, ~0u, ~0u }, { ~0u, 0u, ~0u, ~0u }, { 0u, ~0u, ~0u, ~0u }, { ~0u, ~0u, ~0u, ~0u }
+        };
+
+        float lanes[4];
+        memcpy( lanes, masks[bits & 0xF], sizeof( lanes ) );
+
+        return load4( lanes );
+    }
+
+    // Shared by the batch culling kernels (VectorBatch::spheresInPlanes, ViewFrustum::boxesInFrustum)
+
+    // Bit j set if volume j of the four needs the plane tested
+    static inline int getPlaneLanes( const uint8_t* planeMasks, int plane )
+    {
+        int lanes = 0;
+
+        for ( int lane = 0; lane < 4; lane++ )
+            if ( planeMasks[lane] & ( 1 << plane ) )
+                lanes |= 1 << lane;
+
+        return lanes;
+    }
+
+    static inline void addPlane( int planeMasks[4], int lanes, int plane )
+    {
+        for ( int lane = 0; lane < 4; lane++ )
+            if ( lanes & ( 1 << lane ) )
+                planeMasks[lane] |= 1 << plane;
+    }
+
+    static inline size_t storeResults( uint8_t* results, uint8_t* planeMasks, int outsideLanes, int intersectLanes, const int intersectedPlanes[4] )
+    {
+        size_t numVisible = 0;
+
+        // Branchless, since the visibility of neighbouring volumes is hard to predict (ViewFrustum::TestResult: outside = 0, intersect = 1, inside = 2)
+        for ( int lane = 0; lane < 4; lane++ )
+        {
+            const int visible = ( ~outsideLanes >> lane ) & 1;
+
+            results[lane] = ( uint8_t )( visible * ( 2 - ( ( intersectLanes >> lane ) & 1 ) ) );
+            numVisible += visible;
+        }
+
+        if ( planeMasks != nullptr )
+            for ( int lane = 0; lane < 4; lane++ )
+                planeMasks[lane] = ( results[lane] == 1 ) ? intersectedPlanes[lane] : 0;
+
+        return numVisible;
+    }
+
+    // Same order of operations as Plane::pointDistance
+    static inline Float4 getDistance( const Plane& plane, Float4 x, Float4 y, Float4 z )
+    {
+        Float4 distance = mul( splat( plane.normal.x ), x );
+        distance = add( distance, mul( splat( plane.normal.y ), y ) );
+        distance = add( distance, mul( splat( plane.normal.z ), z ) );
+
+        return add( splat( plane.d ), distance );
+    }
+#endif
+}
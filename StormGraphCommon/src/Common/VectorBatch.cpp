@@ -0,0 +1,230 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Simd.hpp"
+
+#include <StormGraph/VectorBatch.hpp>
+#include <StormGraph/ViewFrustum.hpp>
+
+namespace StormGraph
+{
+    void VectorBatch::transformPoints( const glm::mat4& matrix, const Vector<float>* in, Vector<float>* out, size_t count )
+    {
+#ifdef StormGraph_SIMD
+        const Float4 c0 = load4( &matrix[0][0] ), c1 = load4( &matrix[1][0] ), c2 = load4( &matrix[2][0] ), c3 = load4( &matrix[3][0] );
+        const Float4 xyz = getLaneMask( 0x7 );
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const Float4 point = load4( &in[i].x );
+
+            Float4 result = mul( c0, broadcast<0>( point ) );
+            result = add( result, mul( c1, broadcast<1>( point ) ) );
+            result = add( result, mul( c2, broadcast<2>( point ) ) );
+            result = add( result, c3 );
+
+            store4( &out[i].x, select( xyz, result, point ) );
+        }
+#else
+        transformPointsScalar( matrix, in, out, count );
+#endif
+    }
+
+    void VectorBatch::transformPointsScalar( const glm::mat4& matrix, const Vector<float>* in, Vector<float>* out, size_t count )
+    {
+        // Same order of operations as the SIMD code
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const Vector<float> point = in[i];
+
+            out[i] = Vector<float>( matrix[0][0] * point.x + matrix[1][0] * point.y + matrix[2][0] * point.z + matrix[3][0],
+                    matrix[0][1] * point.x + matrix[1][1] * point.y + matrix[2][1] * point.z + matrix[3][1],
+                    matrix[0][2] * point.x + matrix[1][2] * point.y + matrix[2][2] * point.z + matrix[3][2],
+                    point.w );
+        }
+    }
+
+    void VectorBatch::normalize( const Vector<float>* in, Vector<float>* out, size_t count )
+    {
+        size_t i = 0;
+
+#ifdef StormGraph_SIMD
+        const Float4 zero = splat( 0.0f );
+
+        // Four vectors at a time, transposed to x/y/z/w rows
+        for ( ; i + 4 <= count; i += 4 )
+        {
+            Float4 x = load4( &in[i].x ), y = load4( &in[i + 1].x ), z = load4( &in[i + 2].x ), w = load4( &in[i + 3].x );
+            transpose( x, y, z, w );
+
+            const Float4 length = sqrt4( add( add( mul( x, x ), mul( y, y ) ), mul( z, z ) ) );
+            const Float4 nonZero = notEqual( length, zero );
+
+            // Zero-length lanes divide by zero, but get masked out
+            x = and4( nonZero, div( x, length ) );
+            y = and4( nonZero, div( y, length ) );
+            z = and4( nonZero, div( z, length ) );
+            w = and4( nonZero, w );
+
+            transpose( x, y, z, w );
+            store4( &out[i].x, x );
+            store4( &out[i + 1].x, y );
+            store4( &out[i + 2].x, z );
+            store4( &out[i + 3].x, w );
+        }
+#endif
+
+        normalizeScalar( in + i, out + i, count - i );
+    }
+
+    void VectorBatch::normalizeScalar( const Vector<float>* in, Vector<float>* out, size_t count )
+    {
+        for ( size_t i = 0; i < count; i++ )
+            out[i] = in[i].normalize();
+    }
+
+    size_t VectorBatch::spheresInPlanes( const Plane* planes, size_t numPlanes, const float* x, const float* y, const float* z, const float* radius,
+            size_t count, uint8_t* results, uint8_t* planeMasks )
+    {
+        SG_assert( planeMasks == nullptr || numPlanes <= 8 )
+
+        // The plane that rejected the last spheres
+        size_t firstPlane = 0;
+
+        size_t i = 0, numVisible = 0;
+
+#ifdef StormGraph_SIMD
+        const Float4 zero = splat( 0.0f );
+
+        for ( ; i + 4 <= count; i += 4 )
+        {
+            const Float4 cx = load4( x + i ), cy = load4( y + i ), cz = load4( z + i ), r = load4( radius + i ), negR = sub( zero, r );
+
+            Float4 outsideLanes = zero, intersectLanes = zero;
+            int intersectedPlanes[4] = { 0, 0, 0, 0 };
+
+            for ( size_t j = 0; j < numPlanes; j++ )
+            {
+                const size_t plane = ( firstPlane + j < numPlanes ) ? firstPlane + j : firstPlane + j - numPlanes;
+
+                int lanes = 0xF;
+
+                if ( planeMasks != nullptr && ( lanes = getPlaneLanes( planeMasks + i, ( int ) plane ) ) == 0 )
+                    continue;
+
+                const Float4 distance = getDistance( planes[plane], cx, cy, cz );
+                Float4 out = lessThan( distance, negR ), in = lessThan( distance, r );
+
+                if ( lanes != 0xF )
+                {
+                    out = and4( getLaneMask( lanes ), out );
+                    in = and4( getLaneMask( lanes ), in );
+                }
+
+                outsideLanes = or4( outsideLanes, out );
+                intersectLanes = or4( intersectLanes, in );
+
+                if ( planeMasks != nullptr )
+                    addPlane( intersectedPlanes, getMask( in ), ( int ) plane );
+
+                // The remaining planes can't change anything once all four are out
+                if ( getMask( outsideLanes ) == 0xF )
+                {
+                    firstPlane = plane;
+                    break;
+                }
+            }
+
+            numVisible += storeResults( results + i, ( planeMasks != nullptr ) ? planeMasks + i : nullptr, getMask( outsideLanes ), getMask( intersectLanes ),
+                    intersectedPlanes );
+        }
+#endif
+
+        for ( ; i < count; i++ )
+        {
+            const Vector<float> center( x[i], y[i], z[i] );
+            const int mask = ( planeMasks != nullptr ) ? planeMasks[i] : ~0;
+
+            uint8_t result = ViewFrustum::inside;
+            int intersectedPlanes = 0;
+
+            for ( size_t j = 0; j < numPlanes; j++ )
+            {
+                const size_t plane = ( firstPlane + j < numPlanes ) ? firstPlane + j : firstPlane + j - numPlanes;
+
+                if ( !( mask & ( 1 << plane ) ) )
+                    continue;
+
+                const float distance = planes[plane].pointDistance( center );
+
+                if ( distance < -radius[i] )
+                {
+                    result = ViewFrustum::outside;
+                    firstPlane = plane;
+                    break;
+                }
+                else if ( distance < radius[i] )
+                {
+                    result = ViewFrustum::intersect;
+                    intersectedPlanes |= 1 << plane;
+                }
+            }
+
+            results[i] = result;
+
+            if ( planeMasks != nullptr )
+                planeMasks[i] = ( result == ViewFrustum::intersect ) ? intersectedPlanes : 0;
+
+            if ( result != ViewFrustum::outside )
+                numVisible++;
+        }
+
+        return numVisible;
+    }
+
+    void VectorBatch::spheresInPlanesScalar( const Plane* planes, size_t numPlanes, const float* x, const float* y, const float* z, const float* radius,
+            size_t count, uint8_t* results )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const Vector<float> center( x[i], y[i], z[i] );
+            uint8_t result = ViewFrustum::inside;
+
+            for ( size_t j = 0; j < numPlanes; j++ )
+            {
+                const float distance = planes[j].pointDistance( center );
+
+                if ( distance < -radius[i] )
+                {
+                    result = ViewFrustum::outside;
+                    break;
+                }
+                else if ( distance < radius[i] )
+                    result = ViewFrustum::intersect;
+            }
+
+            results[i] = result;
+        }
+    }
+
+}
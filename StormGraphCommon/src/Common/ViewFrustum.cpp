@@ -0,0 +1,283 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#define _USE_MATH_DEFINES
+
+#include "Simd.hpp"
+
+#include <StormGraph/VectorBatch.hpp>
+#include <StormGraph/ViewFrustum.hpp>
+
+namespace StormGraph
+{
+    static Vector<float> getPositiveVertex( const Vector<float>& min, const Vector<float>& max, const Vector<float>& normal )
+    {
+        Vector<float> result = min;
+
+        if ( normal.x > 0 )
+            result.x = max.x;
+
+        if ( normal.y > 0 )
+            result.y = max.y;
+
+        if ( normal.z > 0 )
+            result.z = max.z;
+
+        return result;
+    }
+
+    static Vector<float> getNegativeVertex( const Vector<float>& min, const Vector<float>& max, const Vector<float>& normal )
+    {
+        Vector<float> result = min;
+
+        if ( normal.x < 0 )
+            result.x = max.x;
+
+        if ( normal.y < 0 )
+            result.y = max.y;
+
+        if ( normal.z < 0 )
+            result.z = max.z;
+
+        return result;
+    }
+
+    ViewFrustum::ViewFrustum()
+    {
+        // Until set up, every plane passes everything
+        for ( int i = 0; i < numPlanes; i++ )
+        {
+            planes[i].normal = Vector<float>();
+            planes[i].d = 0.0f;
+        }
+    }
+
+    ViewFrustum::~ViewFrustum()
+    {
+    }
+
+    void ViewFrustum::setProjection( float angle, float ratio, float nearD, float farD )
+    {
+    	this->ratio = ratio;
+    	this->angle = angle;
+    	this->nearD = nearD;
+    	this->farD = farD;
+
+    	tang = ( float ) tan( angle * 0.5 * M_PI / 180.f );
+    	nh = nearD * tang;
+    	nw = nh * ratio;
+    	fh = farD  * tang;
+    	fw = fh * ratio;
+    }
+
+    void ViewFrustum::setView( const Vector<float>& p, const Vector<float>& l, const Vector<float>& up )
+    {
+    	Vector<float> dir, nc, fc, X, Y, Z;
+
+    	Z = ( p - l ).normalize();
+    	X = up.crossProduct( Z ).normalize();
+    	Y = Z.crossProduct( X );
+
+    	nc = p - Z * nearD;
+    	fc = p - Z * farD;
+
+    	ntl = nc + Y * nh - X * nw;
+    	ntr = nc + Y * nh + X * nw;
+    	nbl = nc - Y * nh - X * nw;
+    	nbr = nc - Y * nh + X * nw;
+
+    	ftl = fc + Y * fh - X * fw;
+    	ftr = fc + Y * fh + X * fw;
+    	fbl = fc - Y * fh - X * fw;
+    	fbr = fc - Y * fh + X * fw;
+
+    	planes[top].set3Points( ntr, ntl, ftl );
+    	planes[bottom].set3Points( nbl, nbr, fbr );
+    	planes[left].set3Points( ntl, nbl, fbl );
+    	planes[right].set3Points( nbr, ntr, fbr );
+    	planes[nearClip].set3Points( ntl, ntr, nbr );
+    	planes[farClip].set3Points( ftr, ftl, fbl );
+    }
+
+    void ViewFrustum::setViewProjection( const glm::mat4& m )
+    {
+        // Gribb & Hartmann: each plane is the sum/difference of the fourth row and one of the other rows
+        // (glm is column-major, hence m[column][row])
+
+        planes[left].setCoefficients( m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0] );
+        planes[right].setCoefficients( m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0] );
+        planes[bottom].setCoefficients( m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1] );
+        planes[top].setCoefficients( m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1] );
+        planes[nearClip].setCoefficients( m[0][3] + m[0][2], m[1][3] + m[1][2], m[2][3] + m[2][2], m[3][3] + m[3][2] );
+        planes[farClip].setCoefficients( m[0][3] - m[0][2], m[1][3] - m[1][2], m[2][3] - m[2][2], m[3][3] - m[3][2] );
+    }
+
+    ViewFrustum::TestResult ViewFrustum::pointInFrustum( const Vector<float>& point ) const
+    {
+        // For the sake of speed, near & far are ignored
+        // Applies also to sphereInFrustum()
+
+    	for ( int i = 0; i < 6; i++ )
+    		if ( planes[i].pointDistance( point ) < 0 )
+    			return outside;
+
+    	return inside;
+    }
+
+    ViewFrustum::TestResult ViewFrustum::sphereInFrustum( const Vector<float>& center, float radius ) const
+    {
+        TestResult result = inside;
+    	float distance;
+
+    	for ( int i = 0; i < 6; i++ )
+        {
+    		distance = planes[i].pointDistance( center );
+
+    		if ( distance < -radius )
+    			return outside;
+    		else if ( distance < radius )
+    			result = intersect;
+    	}
+
+    	return result;
+    }
+
+    ViewFrustum::TestResult ViewFrustum::boxInFrustum( const Vector<float>& min, const Vector<float>& max ) const
+    {
+    	TestResult result = inside;
+
+    	for ( int i = 0; i < 6; i++ )
+    	{
+    		if ( planes[i].pointDistance( getPositiveVertex( min, max, planes[i].normal ) ) < 0 )
+    			return outside;
+    		else if ( planes[i].pointDistance( getNegativeVertex( min, max, planes[i].normal ) ) < 0 )
+    			result = intersect;
+    	}
+
+    	return result;
+    }
+
+    size_t ViewFrustum::spheresInFrustum( const float* x, const float* y, const float* z, const float* radius, size_t count,
+            uint8_t* results, uint8_t* planeMasks ) const
+    {
+        return VectorBatch::spheresInPlanes( planes, numPlanes, x, y, z, radius, count, results, planeMasks );
+    }
+
+    size_t ViewFrustum::boxesInFrustum( const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ,
+            size_t count, uint8_t* results, uint8_t* planeMasks ) const
+    {
+        // The plane that rejected the last volumes
+        int firstPlane = 0;
+
+        size_t i = 0, numVisible = 0;
+
+#ifdef StormGraph_SIMD
+        const Float4 zero = splat( 0.0f );
+
+        for ( ; i + 4 <= count; i += 4 )
+        {
+            const Float4 x0 = load4( minX + i ), y0 = load4( minY + i ), z0 = load4( minZ + i );
+            const Float4 x1 = load4( maxX + i ), y1 = load4( maxY + i ), z1 = load4( maxZ + i );
+
+            Float4 outsideLanes = zero, intersectLanes = zero;
+            int intersectedPlanes[4] = { 0, 0, 0, 0 };
+
+            for ( int j = 0; j < numPlanes; j++ )
+            {
+                const int plane = ( firstPlane + j < numPlanes ) ? firstPlane + j : firstPlane + j - numPlanes;
+                const Vector<float>& normal = planes[plane].normal;
+
+                int lanes = 0xF;
+
+                if ( planeMasks != nullptr && ( lanes = getPlaneLanes( planeMasks + i, plane ) ) == 0 )
+                    continue;
+
+                // The plane is shared by all four boxes, so the choice of corners is too (see getPositiveVertex/getNegativeVertex)
+                const Float4 positive = getDistance( planes[plane], normal.x > 0 ? x1 : x0, normal.y > 0 ? y1 : y0, normal.z > 0 ? z1 : z0 );
+                const Float4 negative = getDistance( planes[plane], normal.x < 0 ? x1 : x0, normal.y < 0 ? y1 : y0, normal.z < 0 ? z1 : z0 );
+                Float4 out = lessThan( positive, zero ), in = lessThan( negative, zero );
+
+                if ( lanes != 0xF )
+                {
+                    out = and4( getLaneMask( lanes ), out );
+                    in = and4( getLaneMask( lanes ), in );
+                }
+
+                outsideLanes = or4( outsideLanes, out );
+                intersectLanes = or4( intersectLanes, in );
+
+                if ( planeMasks != nullptr )
+                    addPlane( intersectedPlanes, getMask( in ), plane );
+
+                if ( getMask( outsideLanes ) == 0xF )
+                {
+                    firstPlane = plane;
+                    break;
+                }
+            }
+
+            numVisible += storeResults( results + i, ( planeMasks != nullptr ) ? planeMasks + i : nullptr, getMask( outsideLanes ), getMask( intersectLanes ),
+                    intersectedPlanes );
+        }
+#endif
+
+        for ( ; i < count; i++ )
+        {
+            const Vector<float> min( minX[i], minY[i], minZ[i] ), max( maxX[i], maxY[i], maxZ[i] );
+            const int mask = ( planeMasks != nullptr ) ? planeMasks[i] : allPlanes;
+
+            TestResult result = inside;
+            int intersectedPlanes = 0;
+
+            for ( int j = 0; j < numPlanes; j++ )
+            {
+                const int plane = ( firstPlane + j < numPlanes ) ? firstPlane + j : firstPlane + j - numPlanes;
+
+                if ( !( mask & ( 1 << plane ) ) )
+                    continue;
+
+                if ( planes[plane].pointDistance( getPositiveVertex( min, max, planes[plane].normal ) ) < 0 )
+                {
+                    result = outside;
+                    firstPlane = plane;
+                    break;
+                }
+                else if ( planes[plane].pointDistance( getNegativeVertex( min, max, planes[plane].normal ) ) < 0 )
+                {
+                    result = intersect;
+                    intersectedPlanes |= 1 << plane;
+                }
+            }
+
+            results[i] = result;
+
+            if ( planeMasks != nullptr )
+                planeMasks[i] = ( result == intersect ) ? intersectedPlanes : 0;
+
+            if ( result != outside )
+                numVisible++;
+        }
+
+        return numVisible;
+    }
+}
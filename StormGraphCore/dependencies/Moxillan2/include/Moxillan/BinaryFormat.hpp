@@ -27,7 +27,7 @@
 
 namespace Moxillan
 {
-    static const uint8_t node_file = 0x01, node_dir = 0x02, node_sys = 0x04, node_compressed = 0x08;
+    static const uint8_t node_file = 0x01, node_dir = 0x02, node_sys = 0x04, node_compressed = 0x08, node_chunked = 0x10;
 
     static const char headerMagic[6] = "\xCCMox1";
 
@@ -55,4 +55,45 @@ namespace Moxillan
 
         uint32_t flags;
     };
+
+    // 12 bytes
+    // Same layout as 0x0111; file entries may additionally be chunked (node_chunked)
+    struct Header_0x0112
+    {
+        uint32_t fileTableBegin;
+        uint32_t fileTableEnd;
+
+        uint32_t flags;
+    };
+
+    // 24 bytes
+    // Offsets and sizes are 64-bit from this version on, in the header, the file table and the chunk tables alike
+    struct Header_0x0113
+    {
+        uint64_t fileTableBegin;
+        uint64_t fileTableEnd;
+
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    // 12 bytes
+    // Stored at the beginning of a chunked entry. The data is split into chunkSize-byte chunks (the last one may be shorter),
+    // each of them deflated independently, or stored as-is if deflating didn't make it any smaller.
+    // At chunkTableOffset follow numChunks + 1 uint32 offsets, all relative to the beginning of the entry; chunk i spans [offset i, offset i + 1).
+    struct ChunkedEntryHeader
+    {
+        uint32_t chunkSize;
+        uint32_t numChunks;
+        uint32_t chunkTableOffset;
+    };
+
+    // 16 bytes
+    // Chunked entry header in 0x0113; followed by numChunks + 1 uint64 offsets
+    struct ChunkedEntryHeader_0x0113
+    {
+        uint32_t chunkSize;
+        uint32_t numChunks;
+        uint64_t chunkTableOffset;
+    };
 }
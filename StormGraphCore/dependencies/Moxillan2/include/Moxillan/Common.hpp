@@ -23,9 +23,14 @@
 
 #pragma once
 
+#include <stddef.h>
+
 namespace Moxillan
 {
     static const char versionString[] = "0.3.2";
 
     static const int inherit = -1;
+
+    // Uncompressed size of one chunk of a chunked package entry
+    static const size_t defaultChunkSize = 0x10000;
 }
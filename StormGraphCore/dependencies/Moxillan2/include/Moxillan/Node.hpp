@@ -52,12 +52,13 @@ namespace Moxillan
     {
         friend class PackageBuilder;
 
-        bool compressed;
+        bool compressed, chunked;
         uint64_t offset, compressedSize, size;
 
         public:
             virtual ~IFileNode() {}
 
+            // May be called more than once (and from a build thread); each stream starts at the beginning of the file
             virtual InputStream* getInputStream() = 0;
     };
 
@@ -34,11 +34,12 @@ namespace Moxillan
     using namespace li;
 
     class Node;
+    class PackageMapping;
 
     struct DirEntry
     {
         String name;
-        bool isDirectory, isCompressed;
+        bool isDirectory, isCompressed, isChunked;
         uint64_t size, compressedSize;
 
         Node* node;
@@ -57,8 +58,10 @@ namespace Moxillan
 
         protected:
             Reference<SeekableInputStream> input;
+            Object<PackageMapping> mapping;
             Object<Node> rootNode;
 
+            uint16_t formatVersion;
             uint64_t fileTableLength, dataLength;
             bool fileTableCompressed;
 
@@ -68,10 +71,18 @@ namespace Moxillan
             Node* readNode( InputStream* input );
 
         public:
-            Package( SeekableInputStream* input );
+            /**
+             *  If nativeFileName is given, file data is read directly from the native file instead of the shared input stream,
+             *  which lets multiple threads read from the package at once.
+             *  With memoryMap set, the whole package is mapped into memory, otherwise positional reads are used.
+             *  Falls back to the (serialized) input stream if the native file can't be opened.
+             */
+            Package( SeekableInputStream* input, const char* nativeFileName = nullptr, bool memoryMap = true );
             ~Package();
 
             // I/O
+            bool isConcurrent() const;
+            bool isMapped() const;
             void setIoBufferCapacity( size_t capacity );
 
             // Package
@@ -86,7 +97,12 @@ namespace Moxillan
             void listDirectory( Node* directory, List<DirEntry>& contents );
 
             // Files
+            // Chunked entries are always opened for random access, as seeking only costs the decompression of one chunk
             SeekableInputStream* openFile( Node* node, AccessStrategy strategy );
             SeekableInputStream* openFile( const char* path, AccessStrategy strategy );
+
+            // Zero-copy access to a stored (uncompressed) file; nullptr if the package isn't mapped or the file is compressed
+            // The returned pointer stays valid for the lifetime of the Package
+            const uint8_t* getFileView( Node* node );
     };
 }
@@ -27,13 +27,31 @@
 
 namespace Moxillan
 {
+    class PackageBuildState;
+
     class PackageBuilder
     {
+        friend class PackageBuildThread;
+
+        static void collectFiles( INode* node, int compression, PackageBuildState* state );
+        static void prepareEntry( PackageBuildState* state, size_t index );
+        static void writeEntries( PackageBuildState* state, SeekableOutputStream* output, unsigned numThreads );
         static void writeNode( INode* node, OutputStream* output );
-        static void writeNodeData( INode* node, SeekableOutputStream* output, int compression );
+        static uint64_t writeChunkedStream( InputStream* input, SeekableOutputStream* output, int compression, size_t chunkSize );
         static uint64_t writeStream( InputStream* input, OutputStream* output, int compression );
 
         public:
-            static void buildPackage( IDirectoryNode* rootDir, SeekableOutputStream* output, int compression = 0, int tableCompression = 0 );
+            /**
+             *  Files are compressed on several threads, but the output doesn't depend on the number of threads.
+             *  Compressed data waiting to be written is kept within a fixed memory budget; large files are compressed
+             *  straight into the output instead.
+             *  Files with identical content and compression settings are stored only once.
+             *
+             *  @param chunkSize if non-zero, compressed files are split into independently deflated chunks of this size,
+             *      which makes them seekable without inflating the whole file. 0 deflates every file as a single stream.
+             *  @param numThreads number of compression threads (0 to use all hardware threads)
+             */
+            static void buildPackage( IDirectoryNode* rootDir, SeekableOutputStream* output, int compression = 0, int tableCompression = 0,
+                    size_t chunkSize = defaultChunkSize, unsigned numThreads = 0 );
     };
 }
@@ -3,6 +3,7 @@
 #include <Moxillan/PackageBuilder.hpp>
 
 #include <littl.hpp>
+#include <littl/File.hpp>
 #include <littl/Main.hpp>
 
 using namespace li;
@@ -16,16 +17,19 @@ namespace Moxillan
             Object<Moxillan::IDirectoryNode> rootDir;
 
             int compression = 0;
+            size_t chunkSize = defaultChunkSize;
 
             for ( unsigned i = 2; i < args.getLength(); i++ )
             {
                 if ( args[i].beginsWith( '!' ) )
                     compression = args[i].dropLeftPart( 1 ).toInt();
+                else if ( args[i].beginsWith( '#' ) )
+                    chunkSize = args[i].dropLeftPart( 1 ).toInt() * 1024;       // in KiB; 0 to deflate whole files (seekable only by re-inflating)
                 else if ( args[i].beginsWith( '@' ) )
                     rootDir = new Moxillan::NativeDirectoryNode( args[i].dropLeftPart( 1 ), nullptr, compression );
             }
 
-            Moxillan::PackageBuilder::buildPackage( rootDir, File::open( args[1], true ), 0 );
+            Moxillan::PackageBuilder::buildPackage( rootDir, File::open( args[1], true ), 0, 0, chunkSize );
 
             //uint64_t written = pkg->build();
             //printf( "%llu bytes written.\n", written );
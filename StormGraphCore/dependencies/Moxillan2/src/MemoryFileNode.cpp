@@ -50,6 +50,8 @@ namespace Moxillan
 
     InputStream* MemoryFileNode::getInputStream()
     {
+        // Every stream starts at the beginning; the builder may read a file more than once
+        data->setPos( 0 );
         return data->reference();
     }
 
@@ -30,18 +30,42 @@
 #include <littl/ZlibDecompressor.hpp>
 #endif
 
+#ifdef __li_MSW
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 //static const size_t ioBufferCapacity = 0x10000;
 //static uint8_t ioBuffer[ioBufferCapacity];
 
 namespace Moxillan
 {
+    // FNV-1a over the raw bytes of a name; names are compared case-sensitively, so no folding here
+    static inline uint32_t hashName( const char* name, size_t length )
+    {
+        uint32_t hash = 0x811C9DC5;
+
+        for ( size_t i = 0; i < length; i++ )
+            hash = ( hash ^ ( uint8_t ) name[i] ) * 0x01000193;
+
+        return hash;
+    }
+
     class Node : public DirEntry
     {
         public:
             uint64_t offset;
+            uint32_t nameHash;
 
             List<Node*> contents;
 
+            // Open-addressed table of the children, keyed by nameHash (power-of-two length, linear probing)
+            Array<Node*> index;
+
         public:
             Node( const String& name, bool isDirectory, size_t contentsLength = 0 ) : contents( contentsLength )
             {
@@ -49,6 +73,10 @@ namespace Moxillan
 
                 this->name = name;
                 this->isDirectory = isDirectory;
+                this->isCompressed = false;
+                this->isChunked = false;
+
+                nameHash = hashName( name.c_str(), name.getNumBytes() );
             }
 
             ~Node()
@@ -57,23 +85,55 @@ namespace Moxillan
                     delete contents.current();
             }
 
-            Node* find( const char* name, bool wantDirectory )
+            void buildIndex()
             {
-                if ( name == nullptr || *name == 0 )
-                    return wantDirectory ? this : nullptr;
+                size_t capacity = 4;
+
+                while ( capacity < contents.getLength() * 2 )
+                    capacity <<= 1;
+
+                index.resize( capacity, false );
+                memset( index.getPtr(), 0, capacity * sizeof( Node* ) );
 
+                // Children are inserted in order, so the first of any duplicate names is the one found
                 iterate ( contents )
-                    if ( contents.current()->name == name )
-                    {
-                        if ( contents.current()->isDirectory == wantDirectory )
-                            return contents.current();
-                        else
-                            return nullptr;
-                    }
+                {
+                    size_t slot = contents.current()->nameHash & ( capacity - 1 );
+
+                    while ( index[slot] != nullptr )
+                        slot = ( slot + 1 ) & ( capacity - 1 );
+
+                    index[slot] = contents.current();
+                }
+            }
+
+            Node* find( const char* name, size_t length, bool wantDirectory )
+            {
+                if ( length == 0 )
+                    return wantDirectory ? this : nullptr;
+
+                if ( index.getCapacity() == 0 )
+                    return nullptr;
+
+                const size_t mask = index.getCapacity() - 1;
+                const uint32_t hash = hashName( name, length );
+
+                for ( size_t slot = hash & mask; index[slot] != nullptr; slot = ( slot + 1 ) & mask )
+                {
+                    Node* child = index[slot];
+
+                    if ( child->nameHash == hash && child->name.getNumBytes() == length && memcmp( child->name.c_str(), name, length ) == 0 )
+                        return ( child->isDirectory == wantDirectory ) ? child : nullptr;
+                }
 
                 return nullptr;
             }
 
+            Node* find( const char* name, bool wantDirectory )
+            {
+                return find( name, name != nullptr ? strlen( name ) : 0, wantDirectory );
+            }
+
             void print( unsigned indent ) const
             {
                 printf( "  " );
@@ -93,16 +153,158 @@ namespace Moxillan
             }
     };
 
+    // Thread-safe access to the native package file, either through a memory mapping or positional reads
+    class PackageMapping
+    {
+#ifdef __li_MSW
+        HANDLE file, fileMapping;
+#else
+        int fd;
+#endif
+
+        public:
+            const uint8_t* data;
+            uint64_t size;
+
+        public:
+            PackageMapping();
+            ~PackageMapping();
+
+            bool open( const char* fileName, bool memoryMap );
+            size_t readAt( void* output, size_t length, uint64_t offset );
+    };
+
+    PackageMapping::PackageMapping() : data( nullptr ), size( 0 )
+    {
+#ifdef __li_MSW
+        file = INVALID_HANDLE_VALUE;
+        fileMapping = nullptr;
+#else
+        fd = -1;
+#endif
+    }
+
+    PackageMapping::~PackageMapping()
+    {
+#ifdef __li_MSW
+        if ( data != nullptr )
+            UnmapViewOfFile( data );
+
+        if ( fileMapping != nullptr )
+            CloseHandle( fileMapping );
+
+        if ( file != INVALID_HANDLE_VALUE )
+            CloseHandle( file );
+#else
+        if ( data != nullptr )
+            munmap( ( void* ) data, ( size_t ) size );
+
+        if ( fd >= 0 )
+            close( fd );
+#endif
+    }
+
+    bool PackageMapping::open( const char* fileName, bool memoryMap )
+    {
+#ifdef __li_MSW
+        file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr );
+
+        if ( file == INVALID_HANDLE_VALUE )
+            return false;
+
+        LARGE_INTEGER fileSize;
+
+        if ( !GetFileSizeEx( file, &fileSize ) )
+            return false;
+
+        size = fileSize.QuadPart;
+
+        // Mapping failures are not fatal, we can still do positional reads
+        if ( memoryMap && size > 0 && size <= SIZE_MAX )
+        {
+            fileMapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+            if ( fileMapping != nullptr )
+                data = ( const uint8_t* ) MapViewOfFile( fileMapping, FILE_MAP_READ, 0, 0, 0 );
+        }
+#else
+        fd = ::open( fileName, O_RDONLY );
+
+        if ( fd < 0 )
+            return false;
+
+        struct stat st;
+
+        if ( fstat( fd, &st ) != 0 )
+            return false;
+
+        size = st.st_size;
+
+        // Mapping failures are not fatal, we can still do positional reads
+        if ( memoryMap && size > 0 && size <= SIZE_MAX )
+        {
+            void* mapped = mmap( nullptr, ( size_t ) size, PROT_READ, MAP_SHARED, fd, 0 );
+
+            if ( mapped != MAP_FAILED )
+                data = ( const uint8_t* ) mapped;
+        }
+#endif
+
+        return true;
+    }
+
+    size_t PackageMapping::readAt( void* output, size_t length, uint64_t offset )
+    {
+        if ( offset >= size )
+            return 0;
+
+        if ( offset + length > size )
+            length = ( size_t )( size - offset );
+
+        if ( data != nullptr )
+        {
+            memcpy( output, data + offset, length );
+            return length;
+        }
+
+        size_t total = 0;
+
+        while ( total < length )
+        {
+#ifdef __li_MSW
+            OVERLAPPED overlapped;
+            memset( &overlapped, 0, sizeof( overlapped ) );
+            overlapped.Offset = ( DWORD )( offset + total );
+            overlapped.OffsetHigh = ( DWORD )( ( offset + total ) >> 32 );
+
+            DWORD count = 0;
+
+            if ( !ReadFile( file, ( uint8_t* ) output + total, ( DWORD ) minimum<size_t>( length - total, 0x40000000 ), &count, &overlapped ) || count == 0 )
+                break;
+#else
+            ssize_t count = pread( fd, ( uint8_t* ) output + total, length - total, ( off_t )( offset + total ) );
+
+            if ( count <= 0 )
+                break;
+#endif
+
+            total += count;
+        }
+
+        return total;
+    }
+
     class MoxillanFileStream : public SeekableInputStream
     {
         protected:
             Package* package;
+            PackageMapping* mapping;
             Reference<SeekableInputStream> input;
             uint64_t offset, size, pos;
 
         public:
-            MoxillanFileStream( Package* package, SeekableInputStream* input, uint64_t offset, uint64_t size )
-                    : package( package ), input( input ), offset( offset ), size( size ), pos( 0 )
+            MoxillanFileStream( Package* package, PackageMapping* mapping, SeekableInputStream* input, uint64_t offset, uint64_t size )
+                    : package( package ), mapping( mapping ), input( input ), offset( offset ), size( size ), pos( 0 )
             {
             }
 
@@ -138,14 +340,22 @@ namespace Moxillan
 
             virtual size_t read( void* output, size_t length )
             {
-                CriticalSection lock( package );
-
                 if ( isEof() )
                     return 0;
 
                 if ( pos + length > size )
                     length = ( size_t )( size - pos );
 
+                if ( mapping != nullptr )
+                {
+                    length = mapping->readAt( output, length, offset + pos );
+                    pos += length;
+
+                    return length;
+                }
+
+                CriticalSection lock( package );
+
                 input->setPos( offset + pos );
                 pos += length;
 
@@ -159,6 +369,19 @@ namespace Moxillan
     };
 
 #ifndef moxillan_no_zlib
+    // zlib counts bytes in 32-bit uInts, so larger buffers are handed to it in slices
+    // Tops up an exhausted avail_in/avail_out from the bytes left; returns false once both are used up
+    static inline bool feedSlice( uInt& available, uint64_t& left )
+    {
+        if ( available == 0 )
+        {
+            available = ( uInt ) minimum<uint64_t>( left, ( uInt ) -1 );
+            left -= available;
+        }
+
+        return available > 0;
+    }
+
     class MoxillanCompressedFileStream : public MoxillanFileStream
     {
         uint64_t pos, size;
@@ -168,8 +391,8 @@ namespace Moxillan
         uint8_t* inputBuffer;
 
         public:
-            MoxillanCompressedFileStream( Package* package, SeekableInputStream* input, uint64_t offset, uint64_t compressedSize, uint64_t size, size_t inputBufferSize )
-                    : MoxillanFileStream( package, input, offset, compressedSize ), pos( 0 ), size( size ), inputBufferSize( inputBufferSize ), inputBuffer( nullptr )
+            MoxillanCompressedFileStream( Package* package, PackageMapping* mapping, SeekableInputStream* input, uint64_t offset, uint64_t compressedSize, uint64_t size, size_t inputBufferSize )
+                    : MoxillanFileStream( package, mapping, input, offset, compressedSize ), pos( 0 ), size( size ), inputBufferSize( inputBufferSize ), inputBuffer( nullptr )
             {
                 inputBuffer = Allocator<>::allocate( inputBufferSize );
 
@@ -185,7 +408,7 @@ namespace Moxillan
 
             ~MoxillanCompressedFileStream()
             {
-                inflateInit( &stream );
+                inflateEnd( &stream );
 
                 Allocator<>::release( inputBuffer );
             }
@@ -236,7 +459,10 @@ namespace Moxillan
                 if ( pos + length > size )
                     length = ( size_t )( size - pos );
 
-                stream.avail_out = length;
+                // Past 4 GiB this is a short read; callers keep reading until they get 0
+                length = ( size_t ) minimum<uint64_t>( length, ( uInt ) -1 );
+
+                stream.avail_out = ( uInt ) length;
                 stream.next_out = ( Bytef* ) output;
 
                 // Go on as long as we need more data
@@ -254,8 +480,6 @@ namespace Moxillan
                         stream.next_in = ( Bytef* ) inputBuffer;
                     }
 
-                    printf( "inb4 inflate(): %u to %u\n", stream.avail_in, stream.avail_out );
-
                     inflate( &stream, Z_SYNC_FLUSH );
                 }
 
@@ -270,27 +494,222 @@ namespace Moxillan
     };
 #endif
 
-    static Node* findChild( Node* currentDir, String path, bool wantDirectory )
+#ifndef moxillan_no_zlib
+    class MoxillanChunkedFileStream : public SeekableInputStream
     {
+        Package* package;
+        PackageMapping* mapping;
+        Reference<SeekableInputStream> input;
+        uint64_t offset, size, pos;
+
+        size_t chunkSize;
+        Array<uint64_t> chunkOffsets;
+
+        // The most recently inflated chunk
+        Array<uint8_t> chunk, compressedChunk;
+        size_t currentChunk;
+
+        size_t readRaw( void* output, size_t length, uint64_t rawOffset )
+        {
+            if ( mapping != nullptr )
+                return mapping->readAt( output, length, rawOffset );
+
+            CriticalSection lock( package );
+
+            input->setPos( rawOffset );
+            return input->read( output, length );
+        }
+
+        void loadChunk( size_t index )
+        {
+            const uint64_t begin = chunkOffsets[index];
+            const size_t length = ( size_t )( chunkOffsets[index + 1] - begin );
+            const size_t rawLength = ( size_t ) minimum<uint64_t>( chunkSize, size - ( uint64_t ) index * chunkSize );
+
+            const uint8_t* data;
+
+            if ( mapping != nullptr && mapping->data != nullptr && offset + begin + length <= mapping->size )
+                data = mapping->data + offset + begin;
+            else
+            {
+                compressedChunk.resize( length, false );
+
+                if ( readRaw( compressedChunk.getPtr(), length, offset + begin ) != length )
+                    throw Exception( "Moxillan.MoxillanChunkedFileStream.loadChunk", "UnexpectedEOF", "Unexpected end of package" );
+
+                data = compressedChunk.getPtr();
+            }
+
+            if ( length == rawLength )
+                memcpy( chunk.getPtr(), data, rawLength );
+            else
+            {
+                uLongf inflatedLength = ( uLongf ) rawLength;
+
+                if ( uncompress( chunk.getPtr(), &inflatedLength, data, ( uLong ) length ) != Z_OK || inflatedLength != rawLength )
+                    throw Exception( "Moxillan.MoxillanChunkedFileStream.loadChunk", "DecompressionError", "Corrupted chunk " + String::formatInt( index ) );
+            }
+
+            currentChunk = index;
+        }
+
+        public:
+            MoxillanChunkedFileStream( Package* package, PackageMapping* mapping, SeekableInputStream* input, uint64_t offset, uint64_t size, bool wideOffsets )
+                    : package( package ), mapping( mapping ), input( input ), offset( offset ), size( size ), pos( 0 ), currentChunk( ( size_t ) -1 )
+            {
+                ChunkedEntryHeader_0x0113 header;
+
+                if ( wideOffsets )
+                {
+                    if ( readRaw( &header, sizeof( header ), offset ) != sizeof( header ) )
+                        throw Exception( "Moxillan.MoxillanChunkedFileStream.MoxillanChunkedFileStream", "UnexpectedEOF", "Unexpected end of package" );
+                }
+                else
+                {
+                    ChunkedEntryHeader narrowHeader;
+
+                    if ( readRaw( &narrowHeader, sizeof( narrowHeader ), offset ) != sizeof( narrowHeader ) )
+                        throw Exception( "Moxillan.MoxillanChunkedFileStream.MoxillanChunkedFileStream", "UnexpectedEOF", "Unexpected end of package" );
+
+                    header.chunkSize = narrowHeader.chunkSize;
+                    header.numChunks = narrowHeader.numChunks;
+                    header.chunkTableOffset = narrowHeader.chunkTableOffset;
+                }
+
+                if ( header.chunkSize == 0 || ( uint64_t ) header.numChunks * header.chunkSize < size )
+                    throw Exception( "Moxillan.MoxillanChunkedFileStream.MoxillanChunkedFileStream", "PackageFormatError", "Invalid chunk table" );
+
+                chunkSize = header.chunkSize;
+
+                const size_t numOffsets = header.numChunks + 1;
+                chunkOffsets.resize( numOffsets, false );
+
+                if ( wideOffsets )
+                {
+                    if ( readRaw( chunkOffsets.getPtr(), numOffsets * sizeof( uint64_t ), offset + header.chunkTableOffset ) != numOffsets * sizeof( uint64_t ) )
+                        throw Exception( "Moxillan.MoxillanChunkedFileStream.MoxillanChunkedFileStream", "UnexpectedEOF", "Unexpected end of package" );
+                }
+                else
+                {
+                    Array<uint32_t> narrowOffsets( numOffsets );
+
+                    if ( readRaw( narrowOffsets.getPtr(), numOffsets * sizeof( uint32_t ), offset + header.chunkTableOffset ) != numOffsets * sizeof( uint32_t ) )
+                        throw Exception( "Moxillan.MoxillanChunkedFileStream.MoxillanChunkedFileStream", "UnexpectedEOF", "Unexpected end of package" );
+
+                    for ( size_t i = 0; i < numOffsets; i++ )
+                        chunkOffsets[i] = narrowOffsets[i];
+                }
+
+                chunk.resize( chunkSize, false );
+            }
+
+            virtual uint64_t getPos()
+            {
+                return pos;
+            }
+
+            virtual uint64_t getSize()
+            {
+                return size;
+            }
+
+            virtual bool setPos( uint64_t pos )
+            {
+                // Nothing is decompressed until the next read
+                if ( pos > size )
+                    return false;
+
+                this->pos = pos;
+                return true;
+            }
+
+            virtual bool isEof()
+            {
+                return pos >= size;
+            }
+
+            virtual bool isReadable()
+            {
+                return size > 0;
+            }
+
+            virtual size_t read( void* output, size_t length )
+            {
+                if ( isEof() )
+                    return 0;
+
+                if ( pos + length > size )
+                    length = ( size_t )( size - pos );
+
+                size_t done = 0;
+
+                while ( done < length )
+                {
+                    const size_t index = ( size_t )( pos / chunkSize );
+                    const size_t chunkPos = ( size_t )( pos % chunkSize );
+
+                    if ( index != currentChunk )
+                        loadChunk( index );
+
+                    const size_t count = minimum( length - done, ( size_t ) minimum<uint64_t>( chunkSize - chunkPos, size - pos ) );
+
+                    memcpy( ( uint8_t* ) output + done, chunk.getPtr() + chunkPos, count );
+
+                    done += count;
+                    pos += count;
+                }
+
+                return done;
+            }
+
+            virtual size_t rawRead( void* output, size_t length )
+            {
+                return read( output, length );
+            }
+    };
+#endif
+
+    static inline bool isPathSeparator( char c )
+    {
+        return c == '/' || c == '\\';
+    }
+
+    // Walks the path in place, one component at a time, without copying it
+    static Node* findChild( Node* currentDir, const char* path, bool wantDirectory )
+    {
+        if ( path == nullptr )
+            path = "";
+
         while ( currentDir != nullptr )
         {
-            while ( path.beginsWith( '/' ) || path.beginsWith( '\\' ) )
-                path = path.dropLeftPart( 1 );
+            while ( isPathSeparator( *path ) )
+                path++;
+
+            const char* end = path;
 
-            int pos = maximum( path.findChar( '/' ), path.findChar( '\\' ) );
+            while ( *end != 0 && !isPathSeparator( *end ) )
+                end++;
 
-            if ( pos < 0 )
-                return currentDir->find( path, wantDirectory );
+            if ( *end == 0 )
+                return currentDir->find( path, end - path, wantDirectory );
 
-            currentDir = currentDir->find( path.leftPart( pos ), true );
-            path = path.dropLeftPart( pos + 1 );
+            currentDir = currentDir->find( path, end - path, true );
+            path = end + 1;
         }
 
         return nullptr;
     }
 
-    Package::Package( SeekableInputStream* input ) : input( input )
+    Package::Package( SeekableInputStream* input, const char* nativeFileName, bool memoryMap ) : input( input )
     {
+        if ( nativeFileName != nullptr )
+        {
+            Object<PackageMapping> newMapping = new PackageMapping;
+
+            if ( newMapping->open( nativeFileName, memoryMap ) )
+                mapping = newMapping.detach();
+        }
+
         CommonHeader commonHeader;
 
         if ( !input->read( &commonHeader, sizeof( CommonHeader ) ) )
@@ -299,9 +718,12 @@ namespace Moxillan
         if ( memcmp( commonHeader.magic, headerMagic, 6 ) != 0 )
             throw Exception( "Moxillan.Package.Package", "NotAPackage", "The input is not a valid Moxillan package" );
 
-        Header_0x0111 header;
+        formatVersion = commonHeader.formatVersion;
 
-        if ( commonHeader.formatVersion == 0x0110 )
+        // Widened to the 0x0113 header
+        Header_0x0113 header;
+
+        if ( formatVersion == 0x0110 )
         {
             Header_0x0110 altHeader;
 
@@ -312,7 +734,19 @@ namespace Moxillan
             header.fileTableEnd = altHeader.fileTableEnd;
             header.flags = 0;
         }
-        else if ( commonHeader.formatVersion == 0x0111 )
+        else if ( formatVersion == 0x0111 || formatVersion == 0x0112 )
+        {
+            // 0x0112 only differs in what file entries may contain
+            Header_0x0111 altHeader;
+
+            if ( !input->read( &altHeader, sizeof( altHeader ) ) )
+                throw Exception( "Moxillan.Package.Package", "UnexpectedEOF", "Unexpected end of package" );
+
+            header.fileTableBegin = altHeader.fileTableBegin;
+            header.fileTableEnd = altHeader.fileTableEnd;
+            header.flags = altHeader.flags;
+        }
+        else if ( formatVersion == 0x0113 )
         {
             if ( !input->read( &header, sizeof( header ) ) )
                 throw Exception( "Moxillan.Package.Package", "UnexpectedEOF", "Unexpected end of package" );
@@ -354,6 +788,7 @@ namespace Moxillan
         }
 
         rootNode->size = rootNode->contents.getLength();
+        rootNode->buildIndex();
 
         //rootNode->print( 1 );
     }
@@ -366,39 +801,88 @@ namespace Moxillan
     size_t Package::decompress( uint8_t* buffer, uint64_t offset, uint64_t compressedSize, size_t size )
     {
         z_stream stream;
-        bool started = false;
 
-        stream.avail_out = size;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.next_in = Z_NULL;
+        stream.avail_in = 0;
         stream.next_out = buffer;
+        stream.avail_out = 0;
 
-        input->setPos( offset );
+        if ( inflateInit( &stream ) != Z_OK )
+            return 0;
 
-        uint64_t maxPos = offset + compressedSize;
+        // Input and output not yet handed to zlib
+        uint64_t inputLeft = compressedSize, outputLeft = size;
+        int status = Z_OK;
 
-        while ( stream.avail_out > 0 )
+        if ( mapping != nullptr )
         {
-            size_t count = input->read( ioBuffer.getPtr(), minimum<size_t>( ioBuffer.getCapacity(), ( size_t )( maxPos - input->getPos() ) ) );
+            if ( mapping->data != nullptr && offset + compressedSize <= mapping->size )
+            {
+                // Inflate straight from the mapped package
+                stream.next_in = ( Bytef* ) mapping->data + offset;
 
-            if ( count == 0 )
-                break;
+                while ( status == Z_OK && feedSlice( stream.avail_out, outputLeft ) )
+                {
+                    feedSlice( stream.avail_in, inputLeft );
+                    status = inflate( &stream, Z_SYNC_FLUSH );
+                }
+            }
+            else
+            {
+                uint8_t chunk[0x4000];
+                uint64_t pos = offset;
+
+                while ( status == Z_OK && feedSlice( stream.avail_out, outputLeft ) )
+                {
+                    if ( stream.avail_in == 0 )
+                    {
+                        size_t count = mapping->readAt( chunk, ( size_t ) minimum<uint64_t>( sizeof( chunk ), inputLeft ), pos );
 
-            stream.avail_in = count;
-            stream.next_in = ( Bytef* ) ioBuffer.getPtr();
+                        if ( count == 0 )
+                            break;
 
-            if ( !started )
-            {
-                stream.zalloc = Z_NULL;
-                stream.zfree = Z_NULL;
-                inflateInit( &stream );
-                started = true;
+                        pos += count;
+                        inputLeft -= count;
+
+                        stream.avail_in = ( uInt ) count;
+                        stream.next_in = ( Bytef* ) chunk;
+                    }
+
+                    status = inflate( &stream, Z_SYNC_FLUSH );
+                }
             }
+        }
+        else
+        {
+            // The shared input stream and I/O buffer can only be used by one thread at a time
+            CriticalSection lock( this );
+
+            input->setPos( offset );
+
+            while ( status == Z_OK && feedSlice( stream.avail_out, outputLeft ) )
+            {
+                if ( stream.avail_in == 0 )
+                {
+                    size_t count = input->read( ioBuffer.getPtr(), ( size_t ) minimum<uint64_t>( ioBuffer.getCapacity(), inputLeft ) );
 
-            inflate( &stream, Z_SYNC_FLUSH );
+                    if ( count == 0 )
+                        break;
+
+                    inputLeft -= count;
+
+                    stream.avail_in = ( uInt ) count;
+                    stream.next_in = ( Bytef* ) ioBuffer.getPtr();
+                }
+
+                status = inflate( &stream, Z_SYNC_FLUSH );
+            }
         }
 
         inflateEnd( &stream );
 
-        return size - stream.avail_out;
+        return ( size_t )( size - outputLeft - stream.avail_out );
     }
 #endif
 
@@ -412,9 +896,25 @@ namespace Moxillan
         return findChild( rootNode, path, false );
     }
 
+    const uint8_t* Package::getFileView( Node* node )
+    {
+        if ( node == nullptr || node->isCompressed || mapping == nullptr || mapping->data == nullptr )
+            return nullptr;
+
+        if ( node->offset + node->size > mapping->size )
+            return nullptr;
+
+        return mapping->data + node->offset;
+    }
+
     void Package::getInfo( PackageInfo* info )
     {
-        info->headerLength = sizeof( CommonHeader ) + sizeof( Header_0x0110 );
+        if ( formatVersion >= 0x0113 )
+            info->headerLength = sizeof( CommonHeader ) + sizeof( Header_0x0113 );
+        else if ( formatVersion >= 0x0111 )
+            info->headerLength = sizeof( CommonHeader ) + sizeof( Header_0x0111 );
+        else
+            info->headerLength = sizeof( CommonHeader ) + sizeof( Header_0x0110 );
         info->dataLength = dataLength;
         info->fileTableLength = fileTableLength;
         info->fileTableCompressed = fileTableCompressed;
@@ -434,18 +934,30 @@ namespace Moxillan
             contents.add( * static_cast<const DirEntry*>( directory->contents.current() ) );
     }
 
+    bool Package::isConcurrent() const
+    {
+        return mapping != nullptr;
+    }
+
+    bool Package::isMapped() const
+    {
+        return mapping != nullptr && mapping->data != nullptr;
+    }
+
     SeekableInputStream* Package::openFile( Node* node, AccessStrategy strategy )
     {
         if ( node == nullptr )
             return nullptr;
 
         if ( !node->isCompressed )
-            return new MoxillanFileStream( this, input->reference(), node->offset, node->size );
+            return new MoxillanFileStream( this, mapping, input->reference(), node->offset, node->size );
         else
         {
 #ifndef moxillan_no_zlib
-            if ( strategy == sequential )
-                return new MoxillanCompressedFileStream( this, input->reference(), node->offset, node->compressedSize, node->size, 4096 );
+            if ( node->isChunked )
+                return new MoxillanChunkedFileStream( this, mapping, input->reference(), node->offset, node->size, formatVersion >= 0x0113 );
+            else if ( strategy == sequential )
+                return new MoxillanCompressedFileStream( this, mapping, input->reference(), node->offset, node->compressedSize, node->size, 4096 );
             else
             {
                 Reference<ArrayIOStream> buffer = new ArrayIOStream( ( size_t ) node->size );
@@ -479,9 +991,23 @@ namespace Moxillan
             Object<Node> file = new Node( name, false );
 
             file->isCompressed = ( type & node_compressed ) != 0;
-            file->offset = input->read<uint32_t>();
-            file->compressedSize = input->read<uint32_t>();
-            file->size = input->read<uint32_t>();
+            file->isChunked = ( type & node_chunked ) != 0;
+
+            if ( file->isChunked && ( formatVersion < 0x0112 || !file->isCompressed ) )
+                throw Exception( "Moxillan.Package.Package", "PackageFormatError", "Unexpected chunked entry `" + name + "`" );
+
+            if ( formatVersion >= 0x0113 )
+            {
+                file->offset = input->read<uint64_t>();
+                file->compressedSize = input->read<uint64_t>();
+                file->size = input->read<uint64_t>();
+            }
+            else
+            {
+                file->offset = input->read<uint32_t>();
+                file->compressedSize = input->read<uint32_t>();
+                file->size = input->read<uint32_t>();
+            }
 
             dataLength += file->size;
 
@@ -496,6 +1022,7 @@ namespace Moxillan
                 directory->contents.add( readNode( input ) );
 
             directory->size = directory->contents.getLength();
+            directory->buildIndex();
 
             return directory.detach();
         }
@@ -24,23 +24,210 @@
 #include <Moxillan/BinaryFormat.hpp>
 #include <Moxillan/PackageBuilder.hpp>
 
+#include <littl/HashMap.hpp>
+#include <littl/Thread.hpp>
+
 #ifndef moxillan_no_zlib
 #include <zlib.h>
 
 #include <littl/ZlibCompressor.hpp>
 #endif
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace Moxillan
 {
-    void PackageBuilder::buildPackage( IDirectoryNode* rootDir, SeekableOutputStream* output, int compression, int tableCompression )
+    // Data compressed ahead of the writer is held in memory up to this many bytes
+    static const uint64_t maxBufferedBytes = 64 << 20;
+
+    // Larger files aren't buffered at all; the writer compresses them straight into the package
+    static const uint64_t maxBufferedEntrySize = 8 << 20;
+
+    struct PackageEntry
+    {
+        IFileNode* file;
+        int compression;
+
+        // Filled in by a build thread
+        String key;                         // content hash + storage settings; equal keys are only a candidate for sharing data
+        Reference<ArrayIOStream> data;      // exactly what goes into the package; null if the writer has to compress the file itself
+        uint64_t size;
+        bool chunked;
+        String error;
+
+        bool done;                          // guarded by PackageBuildState::progressMutex
+    };
+
+    class PackageBuildState
+    {
+        public:
+            List<PackageEntry*> entries;
+            size_t chunkSize;
+
+            std::atomic<size_t> next;
+
+            // Signalled whenever an entry is done or written, and on abort
+            std::mutex progressMutex;
+            std::condition_variable progress;
+
+            size_t numWritten;
+            uint64_t bufferedBytes;
+            bool abort;
+
+            // Lowest index of an entry seen with each key
+            Mutex claimMutex;
+            HashMap<String, size_t> claims;
+
+            PackageBuildState( size_t chunkSize ) : chunkSize( chunkSize ), next( 0 ), numWritten( 0 ), bufferedBytes( 0 ), abort( false )
+            {
+            }
+
+            ~PackageBuildState()
+            {
+                iterate ( entries )
+                    delete entries.current();
+            }
+    };
+
+    class PackageBuildThread : public Thread
+    {
+        PackageBuildState* state;
+
+        public:
+            PackageBuildThread( PackageBuildState* state ) : state( state )
+            {
+            }
+
+        protected:
+            virtual void run()
+            {
+                for ( ; ; )
+                {
+                    const size_t index = state->next.fetch_add( 1 );
+
+                    if ( index >= state->entries.getLength() )
+                        break;
+
+                    {
+                        // The entry the writer waits for is always prepared, otherwise a full buffer would never drain
+                        std::unique_lock<std::mutex> lock( state->progressMutex );
+
+                        while ( state->bufferedBytes >= maxBufferedBytes && index != state->numWritten && !state->abort )
+                            state->progress.wait( lock );
+
+                        if ( state->abort )
+                            break;
+                    }
+
+                    PackageBuilder::prepareEntry( state, index );
+                }
+            }
+    };
+
+    // FNV-1a and a word-wise multiplicative hash; 128 bits in total make an accidental collision practically impossible
+    class ContentHash
+    {
+        uint64_t a, b, length;
+
+        uint8_t word[8];
+        size_t wordLength;
+
+        void addWord()
+        {
+            uint64_t value = 0;
+            memcpy( &value, word, wordLength );
+
+            b = ( b ^ value ) * 0xFF51AFD7ED558CCDULL;
+            b ^= b >> 32;
+
+            wordLength = 0;
+        }
+
+        public:
+            ContentHash() : a( 0xCBF29CE484222325ULL ), b( 0x9E3779B97F4A7C15ULL ), length( 0 ), wordLength( 0 )
+            {
+            }
+
+            void add( const uint8_t* data, size_t count )
+            {
+                length += count;
+
+                for ( size_t i = 0; i < count; i++ )
+                    a = ( a ^ data[i] ) * 0x100000001B3ULL;
+
+                while ( count > 0 )
+                {
+                    const size_t part = minimum<size_t>( 8 - wordLength, count );
+
+                    memcpy( word + wordLength, data, part );
+                    wordLength += part;
+                    data += part;
+                    count -= part;
+
+                    if ( wordLength == 8 )
+                        addWord();
+                }
+            }
+
+            void finish( uint64_t hash[2] )
+            {
+                if ( wordLength > 0 )
+                    addWord();
+
+                hash[0] = a;
+                hash[1] = b ^ length;
+            }
+    };
+
+    // Reads until the buffer is full or the stream ends; streams may return short reads
+    static size_t readFully( InputStream* input, uint8_t* buffer, size_t capacity )
+    {
+        size_t length = 0;
+
+        while ( length < capacity )
+        {
+            size_t count = input->read( buffer + length, capacity - length );
+
+            if ( count == 0 )
+                break;
+
+            length += count;
+        }
+
+        return length;
+    }
+
+    static bool isSameContent( IFileNode* file, IFileNode* original )
+    {
+        Reference<InputStream> input = file->getInputStream(), originalInput = original->getInputStream();
+        Array<uint8_t> buffer( 0x10000 ), originalBuffer( 0x10000 );
+
+        for ( ; ; )
+        {
+            const size_t length = readFully( input, buffer.getPtr(), buffer.getCapacity() );
+
+            if ( readFully( originalInput, originalBuffer.getPtr(), originalBuffer.getCapacity() ) != length
+                    || memcmp( buffer.getPtr(), originalBuffer.getPtr(), length ) != 0 )
+                return false;
+
+            if ( length < buffer.getCapacity() )
+                return true;
+        }
+    }
+
+    void PackageBuilder::buildPackage( IDirectoryNode* rootDir, SeekableOutputStream* output, int compression, int tableCompression, size_t chunkSize,
+            unsigned numThreads )
     {
         Reference<> outputGuard( output );
 
         CommonHeader commonHeader;
         memcpy( commonHeader.magic, headerMagic, 6 );
-        commonHeader.formatVersion = 0x0111;
+        commonHeader.formatVersion = 0x0113;
 
-        Header_0x0111 header = { 0, 0, 0 };
+        Header_0x0113 header = { 0, 0, 0, 0 };
 
         if ( tableCompression > 0 )
             header.flags |= Header_0x0111::fileTableCompressed;
@@ -50,11 +237,15 @@ namespace Moxillan
         output->write( header );
 
         // File contents
-        writeNodeData( rootDir, output, maximum( 0, compression ) );
+        {
+            PackageBuildState state( chunkSize );
+
+            collectFiles( rootDir, maximum( 0, compression ), &state );
+            writeEntries( &state, output, numThreads );
+        }
 
         // File database
-        // TODO: safe conversion
-        header.fileTableBegin = ( uint32_t ) output->getPos();
+        header.fileTableBegin = output->getPos();
 
         output->write<uint16_t>( rootDir->iterableGetLength() );
 
@@ -73,19 +264,327 @@ namespace Moxillan
                 writeNode( rootDir->current(), output );
         }
 
-        // TODO: safe conversion
-        header.fileTableEnd = ( uint32_t ) output->getPos();
+        header.fileTableEnd = output->getPos();
 
         output->setPos( sizeof( commonHeader ) );
         output->write( header );
     }
 
+#ifndef moxillan_no_zlib
+    uint64_t PackageBuilder::writeChunkedStream( InputStream* input, SeekableOutputStream* output, int compression, size_t chunkSize )
+    {
+        Reference<> inputGuard( input );
+
+        const uint64_t entryBegin = output->getPos();
+
+        ChunkedEntryHeader_0x0113 header = { ( uint32_t ) chunkSize, 0, 0 };
+        output->write( header );
+
+        List<uint64_t> chunkOffsets;
+
+        Array<uint8_t> chunk( chunkSize );
+        Array<uint8_t> compressed( compressBound( ( uLong ) chunkSize ) );
+
+        uint64_t size = 0;
+
+        while ( true )
+        {
+            // Fill the whole chunk; streams may return short reads
+            size_t length = 0;
+
+            while ( length < chunkSize )
+            {
+                size_t count = input->read( chunk.getPtr() + length, chunkSize - length );
+
+                if ( count == 0 )
+                    break;
+
+                length += count;
+            }
+
+            if ( length == 0 )
+                break;
+
+            chunkOffsets.add( output->getPos() - entryBegin );
+            size += length;
+
+            uLongf compressedLength = ( uLongf ) compressed.getCapacity();
+
+            // A chunk whose stored length equals its uncompressed length is not deflated
+            if ( compress2( compressed.getPtr(), &compressedLength, chunk.getPtr(), ( uLong ) length, compression ) == Z_OK && compressedLength < length )
+                output->write( compressed.getPtr(), compressedLength );
+            else
+                output->write( chunk.getPtr(), length );
+
+            if ( length < chunkSize )
+                break;
+        }
+
+        header.numChunks = chunkOffsets.getLength();
+        chunkOffsets.add( output->getPos() - entryBegin );
+        header.chunkTableOffset = chunkOffsets[header.numChunks];
+
+        for each_in_list ( chunkOffsets, i )
+            output->write<uint64_t>( chunkOffsets[i] );
+
+        const uint64_t entryEnd = output->getPos();
+
+        output->setPos( entryBegin );
+        output->write( header );
+        output->setPos( entryEnd );
+
+        return size;
+    }
+#endif
+
+    void PackageBuilder::collectFiles( INode* node, int compression, PackageBuildState* state )
+    {
+        if ( node->getCompression() != inherit )
+            compression = node->getCompression();
+
+        IFileNode* file = dynamic_cast<IFileNode*>( node );
+
+        if ( file != nullptr )
+        {
+            PackageEntry* entry = new PackageEntry;
+            entry->file = file;
+            entry->compression = compression;
+            entry->size = 0;
+            entry->chunked = false;
+            entry->done = false;
+
+            state->entries.add( entry );
+            return;
+        }
+
+        IDirectoryNode* directory = dynamic_cast<IDirectoryNode*>( node );
+
+        if ( directory != nullptr )
+        {
+            iterate ( *directory )
+                collectFiles( directory->current(), compression, state );
+
+            return;
+        }
+
+        throw Exception( "Moxillan.PackageBuilder.collectFiles", "UnknownNodeType", "Unknown type for file `" + node->getName() + "`" );
+    }
+
+    void PackageBuilder::prepareEntry( PackageBuildState* state, size_t index )
+    {
+        PackageEntry* entry = state->entries[index];
+        uint64_t bufferedBytes = 0;
+
+        try
+        {
+            // Read the file (unless it's too big to buffer), so that it can be hashed before spending time on compressing it
+            Reference<ArrayIOStream> content = new ArrayIOStream();
+            ContentHash hash;
+
+            {
+                Reference<InputStream> input = entry->file->getInputStream();
+                Array<uint8_t> buffer( 0x10000 );
+
+                size_t count;
+
+                while ( ( count = input->read( buffer.getPtr(), buffer.getCapacity() ) ) > 0 )
+                {
+                    hash.add( buffer.getPtr(), count );
+
+                    if ( content != nullptr )
+                    {
+                        content->write( buffer.getPtr(), count );
+
+                        if ( content->getSize() > maxBufferedEntrySize )
+                            content.release();
+                    }
+                }
+            }
+
+#ifndef moxillan_no_zlib
+            entry->chunked = ( entry->compression > 0 && state->chunkSize > 0 );
+#endif
+
+            uint64_t digest[2];
+            hash.finish( digest );
+
+            char key[96];
+            snprintf( key, sizeof( key ), "%016" PRIx64 "%016" PRIx64 ":%d:%u", digest[0], digest[1], entry->compression,
+                    entry->chunked ? ( unsigned ) state->chunkSize : 0u );
+
+            entry->key = key;
+
+            // Files too big to buffer are only hashed; the writer streams them into the package
+            if ( content != nullptr )
+            {
+                CriticalSection lock( state->claimMutex );
+
+                size_t* claim = state->claims.find( entry->key );
+
+                // An earlier file probably has the same content; the writer compares them and only compresses this one if they differ
+                if ( claim != nullptr && *claim < index )
+                    content.release();
+                else
+                    state->claims.set( ( String&& ) String( entry->key ), ( size_t&& ) index );
+            }
+
+            if ( content != nullptr )
+            {
+                entry->size = content->getSize();
+                content->setPos( 0 );
+
+                Reference<ArrayIOStream> stored = new ArrayIOStream();
+
+#ifndef moxillan_no_zlib
+                if ( entry->chunked )
+                    writeChunkedStream( content.detach(), stored, entry->compression, state->chunkSize );
+                else
+#endif
+                    writeStream( content.detach(), stored, entry->compression );
+
+                bufferedBytes = stored->getSize();
+                entry->data = stored.detach();
+            }
+        }
+        catch ( Exception& ex )
+        {
+            entry->error = ex.getDesc();
+        }
+        catch ( ... )
+        {
+            // Whatever happens, the writer must not be left waiting for this entry
+            entry->error = "Unexpected exception";
+        }
+
+        std::lock_guard<std::mutex> lock( state->progressMutex );
+
+        state->bufferedBytes += bufferedBytes;
+        entry->done = true;
+        state->progress.notify_all();
+    }
+
+    void PackageBuilder::writeEntries( PackageBuildState* state, SeekableOutputStream* output, unsigned numThreads )
+    {
+        if ( numThreads == 0 )
+            numThreads = maximum( std::thread::hardware_concurrency(), 1u );
+
+        List<PackageBuildThread*> threads;
+
+        for ( unsigned i = 0; i < numThreads; i++ )
+            threads.add( new PackageBuildThread( state ) );
+
+        iterate ( threads )
+            threads.current()->start();
+
+        // Key => index of the first entry written with that key
+        HashMap<String, size_t> written;
+        String error;
+
+        try
+        {
+            // Entries are written strictly in tree order, which keeps the output independent of thread scheduling
+            for each_in_list ( state->entries, i )
+            {
+                PackageEntry* entry = state->entries[i];
+
+                {
+                    std::unique_lock<std::mutex> lock( state->progressMutex );
+
+                    while ( !entry->done )
+                        state->progress.wait( lock );
+                }
+
+                if ( !entry->error.isEmpty() )
+                {
+                    error = "Failed to add `" + entry->file->getName() + "`: " + entry->error;
+                    break;
+                }
+
+                IFileNode* file = entry->file;
+                size_t* original = written.find( entry->key );
+
+                if ( original != nullptr && isSameContent( file, state->entries[*original]->file ) )
+                {
+                    IFileNode* originalFile = state->entries[*original]->file;
+
+                    file->compressed = originalFile->compressed;
+                    file->chunked = originalFile->chunked;
+                    file->offset = originalFile->offset;
+                    file->compressedSize = originalFile->compressedSize;
+                    file->size = originalFile->size;
+                }
+                else
+                {
+                    file->compressed = ( entry->compression > 0 );
+                    file->chunked = entry->chunked;
+                    file->offset = output->getPos();
+
+                    if ( entry->data != nullptr )
+                    {
+                        file->size = entry->size;
+                        output->write( entry->data->getPtr(), ( size_t ) entry->data->getSize() );
+                    }
+#ifndef moxillan_no_zlib
+                    else if ( entry->chunked )
+                        file->size = writeChunkedStream( file->getInputStream(), output, entry->compression, state->chunkSize );
+#endif
+                    else
+                        file->size = writeStream( file->getInputStream(), output, entry->compression );
+
+                    file->compressedSize = output->getPos() - file->offset;
+
+                    if ( original == nullptr )
+                        written.set( ( String&& ) String( entry->key ), ( size_t&& ) i );
+                }
+
+                std::lock_guard<std::mutex> lock( state->progressMutex );
+
+                if ( entry->data != nullptr )
+                {
+                    state->bufferedBytes -= entry->data->getSize();
+                    entry->data.release();
+                }
+
+                state->numWritten++;
+                state->progress.notify_all();
+            }
+        }
+        catch ( Exception& ex )
+        {
+            error = ex.getDesc();
+        }
+        catch ( ... )
+        {
+            error = "Unexpected exception";
+        }
+
+        // Stop the build threads before the state goes away
+        if ( !error.isEmpty() )
+        {
+            std::lock_guard<std::mutex> lock( state->progressMutex );
+            state->abort = true;
+            state->progress.notify_all();
+        }
+
+        iterate ( threads )
+        {
+            threads.current()->waitFor();
+            delete threads.current();
+        }
+
+        if ( !error.isEmpty() )
+            throw Exception( "Moxillan.PackageBuilder.writeEntries", "BuildError", error );
+    }
+
     uint64_t PackageBuilder::writeStream( InputStream* input, OutputStream* output, int compression )
     {
         Reference<> inputGuard( input );
 
         static const size_t ioBufferCapacity = 0x10000;
-        static uint8_t ioBuffer[ioBufferCapacity];
+
+        // Called from several build threads at once
+        Array<uint8_t> ioBufferArray( ioBufferCapacity ), compressionBufferArray( ioBufferCapacity );
+        uint8_t* ioBuffer = ioBufferArray.getPtr();
 
         uint64_t size = 0;
 
@@ -115,7 +614,7 @@ namespace Moxillan
             stream.zfree = Z_NULL;
             deflateInit( &stream, compression );
 
-            static uint8_t compressionBuffer[ioBufferCapacity];
+            uint8_t* compressionBuffer = compressionBufferArray.getPtr();
 
             while ( true )
             {
@@ -187,10 +686,15 @@ namespace Moxillan
 
         if ( file != nullptr )
         {
-            output->write<uint8_t>( file->compressed ? ( node_file | node_compressed ) : node_file );
-            output->write<uint32_t>( ( uint32_t ) file->offset );
-            output->write<uint32_t>( ( uint32_t ) file->compressedSize );
-            output->write<uint32_t>( ( uint32_t ) file->size );
+            uint8_t type = node_file;
+
+            if ( file->compressed )
+                type |= file->chunked ? ( node_compressed | node_chunked ) : node_compressed;
+
+            output->write<uint8_t>( type );
+            output->write<uint64_t>( file->offset );
+            output->write<uint64_t>( file->compressedSize );
+            output->write<uint64_t>( file->size );
             return;
         }
 
@@ -209,36 +713,5 @@ namespace Moxillan
 
         throw Exception( "Moxillan.PackageBuilder.writeNode", "UnknownNodeType", "Unknown type for node `" + node->getName() + "`" );
     }
-
-    void PackageBuilder::writeNodeData( INode* node, SeekableOutputStream* output, int compression )
-    {
-        if ( node->getCompression() != inherit )
-            compression = node->getCompression();
-
-        IFileNode* file = dynamic_cast<IFileNode*>( node );
-
-        if ( file != nullptr )
-        {
-            file->compressed = ( compression > 0 );
-            file->offset = output->getPos();
-            //printf( "%s begins @ %u\n", node->getName().c_str(), ( unsigned ) output->getPos() );
-            file->size = writeStream( file->getInputStream(), output, compression );
-            //printf( "%s ends @ %u\n", node->getName().c_str(), ( unsigned ) output->getPos() );
-            file->compressedSize = output->getPos() - file->offset;
-            return;
-        }
-
-        IDirectoryNode* directory = dynamic_cast<IDirectoryNode*>( node );
-
-        if ( directory != nullptr )
-        {
-            iterate ( *directory )
-                writeNodeData( directory->current(), output, compression );
-
-            return;
-        }
-
-        throw Exception( "Moxillan.PackageBuilder.writeNodeData", "UnknownNodeType", "Unknown type for file `" + node->getName() + "`" );
-    }
 }
 
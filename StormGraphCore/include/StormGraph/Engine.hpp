@@ -42,6 +42,7 @@ namespace StormGraph
     class IImageLoader;
     class ILineOutput;
     class IOnScreenLog;
+    class IParticleSystem;
     class IProfiler;
     class IResourceManager;
     class IScene;
@@ -164,6 +165,7 @@ namespace StormGraph
             virtual IKeyScanner* createKeyScanner() = 0;
             virtual IHeightMap* createHeightMap( const Vector2<unsigned>& resolution ) = 0;
             virtual IOnScreenLog* createOnScreenLog( const ScreenRect& area, IFont* font = nullptr ) = 0;
+            virtual IParticleSystem* createParticleSystem() = 0;
             virtual IProfiler* createProfiler() = 0;
 
             /**
@@ -36,12 +36,27 @@ namespace StormGraph
             List<unsigned> indices;
             unsigned material;
 
+            // Meshes loaded from Sg_Bsp#1 leave `indices` empty and refer to the index block of their BspTree instead
+            const unsigned* blockIndices;
+            size_t numBlockIndices;
+
         public:
-            BspMesh( unsigned material ) : material( material )
+            BspMesh( unsigned material = 0 ) : material( material ), blockIndices( nullptr ), numBlockIndices( 0 )
+            {
+            }
+
+            const unsigned* getIndices()
+            {
+                return ( blockIndices != nullptr ) ? blockIndices : indices.getPtr();
+            }
+
+            size_t getNumIndices() const
             {
+                return ( blockIndices != nullptr ) ? numBlockIndices : indices.getLength();
             }
     };
 
+    // Nodes don't own their children; the hierarchy belongs to the BspTree
     class BspNode
     {
         public:
@@ -60,9 +75,44 @@ namespace StormGraph
             {
                 iterate ( meshes )
                     delete meshes.current();
+            }
+
+            static void deleteHierarchy( BspNode* node )
+            {
+                if ( node == nullptr )
+                    return;
 
-                delete children[0];
-                delete children[1];
+                deleteHierarchy( node->children[0] );
+                deleteHierarchy( node->children[1] );
+                delete node;
+            }
+    };
+
+    // Deletes a node together with its subtree unless detached, for hierarchies built recursively that may throw halfway
+    class BspNodeGuard
+    {
+        BspNode* node;
+
+        public:
+            BspNodeGuard( BspNode* node ) : node( node )
+            {
+            }
+
+            ~BspNodeGuard()
+            {
+                BspNode::deleteHierarchy( node );
+            }
+
+            BspNode* operator -> ()
+            {
+                return node;
+            }
+
+            BspNode* detach()
+            {
+                BspNode* detached = node;
+                node = nullptr;
+                return detached;
             }
     };
 
@@ -88,6 +138,72 @@ namespace StormGraph
             Array<List<Vertex>> vertices;
             Array<unsigned> totalTriangles;
 
-            Object<BspNode> root;
+            BspNode* root;
+
+            // Trees loaded from Sg_Bsp#1 keep all nodes in one block (root first, children pointing into the block);
+            // generated and Sg_Bsp#0 trees leave this null and own individually allocated nodes instead
+            BspNode* nodeBlock;
+            size_t numNodes;
+
+            // Sg_Bsp#1 only: the meshes of all block nodes, and the blocks as read, which the meshes' indices point into
+            // (16-bit indices are widened once into wideIndices)
+            BspMesh* meshBlock;
+            uint8_t* blockData;
+            unsigned* wideIndices;
+
+        public:
+            BspTree() : root( nullptr ), nodeBlock( nullptr ), numNodes( 0 ), meshBlock( nullptr ), blockData( nullptr ), wideIndices( nullptr )
+            {
+            }
+
+            ~BspTree()
+            {
+                if ( nodeBlock != nullptr )
+                {
+                    // Block nodes only refer to meshes in meshBlock
+                    for ( size_t i = 0; i < numNodes; i++ )
+                        nodeBlock[i].meshes.clear();
+
+                    delete[] nodeBlock;
+                }
+                else
+                    BspNode::deleteHierarchy( root );
+
+                delete[] meshBlock;
+                delete[] blockData;
+                delete[] wideIndices;
+            }
+    };
+
+    // On-disk layout of Sg_Bsp#1
+    // The material table is followed by a BspBlockHeader and the vertex, node, mesh and index blocks it points to.
+    // Every block starts at a multiple of bspBlockAlignment from the BspBlockHeader, so that it can be used in place once read or mapped.
+    static const size_t bspBlockAlignment = 16;
+
+    struct BspBlockHeader
+    {
+        uint32_t numVertices, numNodes, numMeshes, numIndices;
+
+        // relative to the beginning of BspBlockHeader
+        uint32_t vertexOffset, nodeOffset, meshOffset, indexOffset;
+    };
+
+    // Vertices of all materials, in material order
+    struct BspBlockVertex
+    {
+        float pos[3], normal[3], uv[2], lightUv[2];
+    };
+
+    // Nodes in pre-order, so the root is always 0 and no child ever refers back to it; children[] == 0 marks a leaf
+    struct BspBlockNode
+    {
+        float bounds[2][3];
+        uint32_t firstMesh, numMeshes, children[2];
+    };
+
+    // Index ranges are in units of indices (uint16_t or uint32_t, according to the index size byte)
+    struct BspBlockMesh
+    {
+        uint32_t material, firstIndex, numIndices;
     };
 }
@@ -26,26 +26,68 @@
 #include <StormGraph/IO/Bsp.hpp>
 #include <StormGraph/ContentTools.hpp>
 
+#include <littl/HashMap.hpp>
+
 namespace StormGraph
 {
+    struct BspBuildNode;
+
+    // planeSweep:              the original strategy - scan 11 planes across the middle third of the most oversized axis
+    //                          and take the most balanced one
+    // surfaceAreaHeuristic:    nodes over the polygon limit are split where the binned surface area cost is lowest (on any axis);
+    //                          nodes that are only too large still use planeSweep
+    li_enum_class( BspSplitMode ) { planeSweep, surfaceAreaHeuristic };
+
+    struct BspBuildStats
+    {
+        size_t numNodes, numLeaves, numPolygons;
+        unsigned maxDepth;
+        double seconds;
+    };
+
+    // Merges vertices that are within 0.001 in every attribute, per material
+    // Returns the same indices as a linear scan for the first matching vertex, through a spatial hash
+    SgContentToolsClass BspVertexWelder
+    {
+        // Hashed (material, cell) -> most recently added vertex in that cell
+        // Vertices sharing a cell key are chained through chains[material][vertex]
+        HashMap<uint64_t, unsigned, uint64_t, pass> cells;
+        Array<List<unsigned>> chains;
+
+        public:
+            void clear();
+
+            // vertices must be the list that all earlier calls for this material were given
+            unsigned getIndex( unsigned materialIndex, List<Vertex>& vertices, const Vertex& vertex );
+    };
+
     SgContentToolsClass Bsp
     {
         unsigned nodePolyLimit;
         Vector<float> nodeVolumeLimit;
+        BspSplitMode splitMode;
+        unsigned numThreads;
+
+        BspBuildStats stats;
 
         List<BspMaterial> materials;
         Array<unsigned> totalTriangles;
         Object<BspTree> tree;
 
+        BspVertexWelder welder;
+
         unsigned breakPoly( const BspPolygon& polygon, List<unsigned>& indices );
+        BspNode* emit( const BspBuildNode* buildNode, unsigned depth );
         unsigned getVertexIndex( unsigned materialIndex, const Vertex& vertex );
 
         public:
-            Bsp( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit );
+            // numThreads = 0 uses all hardware threads; the resulting tree doesn't depend on it
+            Bsp( unsigned nodePolyLimit, const Vector<float>& nodeVolumeLimit, BspSplitMode splitMode = BspSplitMode::planeSweep, unsigned numThreads = 0 );
             ~Bsp();
 
             BspTree* generate( const BspPolygon* polygons, size_t count );
             unsigned getMaterialIndex( const char* name );
+            const BspBuildStats& getStats() const { return stats; }
 
             BspNode* partition( const BspPolygon* polygons, size_t count );
             unsigned registerMaterial( const char* name, MaterialStaticProperties* material );
@@ -58,9 +100,12 @@ namespace StormGraph
     {
         unsigned indexSize;
 
+        uint32_t flatten( BspNode* node, List<BspBlockNode>& nodes, List<BspBlockMesh>& meshes, List<unsigned>& indices );
         void save( BspNode* node, OutputStream* output );
+        void saveBlocks( BspTree* tree, OutputStream* output );
 
         public:
-            void save( BspTree* tree, OutputStream* output );
+            // revision 1 (Sg_Bsp#1, block layout) is the default; revision 0 writes the legacy node-by-node format
+            void save( BspTree* tree, OutputStream* output, unsigned revision = 1 );
     };
 }
@@ -64,4 +64,58 @@ namespace StormGraph
                 delete children[1];
             }
     };
+
+    // Runtime form of a collision tree: all nodes in one array in depth-first order, all segments packed in another
+    // (Ct2Node is what the generator builds and writes; the file format is unchanged)
+    class Ct2Tree
+    {
+        public:
+            struct Node
+            {
+                Vector2<> bounds[2];
+                uint32_t firstLine, numLines;
+
+                // first node past this node's subtree; when the node has children, the first one is always the next node
+                uint32_t next;
+            };
+
+            struct Query
+            {
+                Vector2<> centre;
+                float radius;
+            };
+
+            List<Node> nodes;
+            List<Ct2Line> lines;
+
+        public:
+            static Ct2Tree* fromNodes( const Ct2Node* root );
+            static Ct2Tree* load( InputStream* input );
+
+            static bool intersects( const Vector2<>& centre, float r, const Vector2<>& min, const Vector2<>& max );
+
+            static bool touches( const Ct2Line& line, const Vector2<>& centre, float r )
+            {
+                float t = line.dir.dot( ( centre - line.a ) * line.normalize );
+
+                if ( t < 0.0f )
+                    t = 0.0f;
+                else if ( t > 1.0f )
+                    t = 1.0f;
+
+                return ( line.a + line.length * t - centre ).getLength() < r;
+            }
+
+            bool hasChildren( size_t node ) { return nodes[node].next > node + 1; }
+
+            /**
+             *  Find the segments touched by a batch of circles.
+             *
+             *  @param hits indices into lines are appended here, grouped by query
+             *  @param firstHits receives, for each query, the position of its first hit in hits
+             *  @param numHits receives, for each query, the number of segments it touches
+             *  @return total number of hits appended
+             */
+            size_t queryCircles( const Query* queries, size_t count, List<uint32_t>& hits, uint32_t* firstHits, uint32_t* numHits );
+    };
 }
@@ -34,7 +34,7 @@ namespace StormGraph
             {
                 String name, path;
                 bool isDirectory;
-                int64_t size;
+                int64_t size;       // -1 if unknown
             };
 
         protected:
@@ -43,8 +43,25 @@ namespace StormGraph
         public:
             li_ReferencedClass_override( IFileSystem )
 
-            ///virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) = 0;
+            /**
+             *  List the contents of a directory.
+             *
+             *  @param path path of the directory, relative to the root of the file system ("" for the root itself)
+             *  @param entries list to append the entries to; their paths are relative to the root of the file system
+             *  @return number of entries appended (0 if the directory doesn't exist)
+             */
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) = 0;
             virtual SeekableInputStream* openInput( const char* fileName ) = 0;
+
+            /**
+             *  @return false if file names differing only in case refer to the same file
+             */
+            virtual bool isCaseSensitive() { return true; }
+
+            /**
+             *  @return true if files can never be added to or removed from the file system once it is created
+             */
+            virtual bool isImmutable() { return false; }
     };
 
     class IUnionFileSystem : public IFileSystem
@@ -58,6 +75,14 @@ namespace StormGraph
             virtual void add( IFileSystem* fs ) = 0;
             virtual void clear() = 0;
             virtual size_t getNumFileSystems() const = 0;
+
+            /**
+             *  Forget the merged path index.
+             *  While all mounted file systems are immutable, files missing from the index are reported as not found without asking
+             *  the file systems again; call this if such a file system changes anyway.
+             *  Lookups missing the index of a mutable file system always ask the file systems directly.
+             */
+            virtual void invalidateIndex() = 0;
     };
 
     class IFileSystemDriver
@@ -0,0 +1,98 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/Abstract.hpp>
+#include <StormGraph/ContentTools.hpp>
+#include <StormGraph/Image.hpp>
+
+namespace StormGraph
+{
+    /**
+     *  Computes static lighting for light map luxels.
+     *
+     *  Luxels are queued while the geometry is being built; bake() then builds a triangle BVH over the finished geometry,
+     *  lights all luxels in parallel (tracing a shadow ray to every light) and writes them to the light maps in queue order.
+     *  The output doesn't depend on the number of worker threads.
+     */
+    SgContentToolsClass LightBaker
+    {
+        public:
+            enum { point, directional };
+
+            struct Light
+            {
+                int type;
+                Vector<> position, direction;
+                Colour ambient, diffuse;
+                float range;
+            };
+
+            struct Luxel
+            {
+                Image* image;
+                size_t offset;
+
+                Vector<> pos, normal;
+                bool castShadows;
+            };
+
+        protected:
+            struct Triangle
+            {
+                Vector<> v0, edge1, edge2;
+            };
+
+            struct BvhNode
+            {
+                Vector<> bounds[2];
+
+                // Leaves: count > 0, triangles [first, first + count)
+                // Inner nodes: children are this + 1 and secondChild
+                unsigned first, count, secondChild;
+            };
+
+            Colour sceneAmbient;
+            List<Light> lights;
+
+            List<Triangle> triangles;
+            List<BvhNode> nodes;
+
+            List<Luxel> luxels;
+
+            unsigned buildBvh( const Vector<>* centres, unsigned* order, unsigned first, unsigned count );
+            void buildTriangles( const List<BspPolygon>& polygons );
+
+        public:
+            LightBaker( const Colour& sceneAmbient );
+
+            // Lights of other types than point and directional are ignored
+            void addLight( const Light& light );
+            void addLuxel( Image* image, size_t offset, const Vector<>& pos, const Vector<>& normal, bool castShadows = true );
+            void bake( const List<BspPolygon>& polygons, unsigned numThreads = 0 );
+
+            Colour calculateAt( const Vector<>& pos, const Vector<>& normal, bool castShadows ) const;
+            bool isOccluded( const Vector<>& origin, const Vector<>& direction, float maxDistance ) const;
+    };
+}
@@ -27,11 +27,14 @@
 
 namespace StormGraph
 {
+    class BspTree;
     class IResourceManager;
 
     class BspLoader
     {
         public:
+            // Loads either revision of the format (Sg_Bsp#0 or Sg_Bsp#1), including the header
+            static BspTree* loadTree( SeekableInputStream* input, IResourceManager* resMgr );
             static IStaticModel* loadStaticModel( IGraphicsDriver* driver, const char* name, SeekableInputStream* input, IResourceManager* resMgr, bool finalized );
     };
 
@@ -23,10 +23,11 @@
 
 #pragma once
 
-#include <StormGraph/Core.hpp>
+#include <StormGraph/Abstract.hpp>
 
 namespace StormGraph
 {
+    class IMaterial;
     class IParticle1;
 
     class IParticleType
@@ -40,23 +41,103 @@ namespace StormGraph
             virtual void renderParticle( IParticle1* particle ) = 0;
     };
 
-    /*class IParticleEmitter
+    class IParticleEmitter;
+
+    struct ParticleEmitterProperties
+    {
+        // Spawning
+        Vector<> pos, velocity, velocitySpread;
+        float rate;
+        size_t maxParticles;
+
+        // Motion
+        Vector<> acceleration;
+        float drag;
+
+        // Appearance over the lifetime of a particle
+        float lifetime, lifetimeSpread;
+        Colour colourBegin, colourEnd;
+        float sizeBegin, sizeEnd;
+
+        /**
+         *  Material used by the default (driver-backed) renderer.
+         *  Ownership of the reference is transferred.
+         */
+        IMaterial* material;
+    };
+
+    /**
+     *  One particle as emitted into a vertex stream; the renderer is expected to expand it into a billboard.
+     */
+    struct ParticleVertex
+    {
+        Vector<> pos;
+        float size;
+        Colour colour;
+    };
+
+    class IParticleRenderer
+    {
+        public:
+            virtual ~IParticleRenderer() {}
+
+            /**
+             *  @brief Render all live particles of one emitter.
+             *
+             *  Called once per emitter and frame.
+             */
+            virtual void renderParticles( IParticleEmitter* emitter, const ParticleVertex* vertices, size_t count ) = 0;
+    };
+
+    class IParticleEmitter
     {
         public:
             virtual ~IParticleEmitter() {}
 
-            virtual void onUpdate( double delta ) = 0;
-    };*/
+            /**
+             *  @brief Spawn a burst of particles immediately (limited by maxParticles).
+             *
+             *  @return the number of particles actually spawned
+             */
+            virtual size_t emit( size_t count ) = 0;
+
+            virtual size_t getNumParticles() = 0;
+            virtual const ParticleEmitterProperties& getProperties() = 0;
+
+            virtual void setPos( const Vector<>& pos ) = 0;
+            virtual void setRate( float rate ) = 0;
+    };
 
-    /*class IParticleSystem
+    /**
+     *  Particle system storing particles as structure-of-arrays, one block per emitter.
+     */
+    class IParticleSystem
     {
         public:
             virtual ~IParticleSystem() {}
 
-            //virtual void addEmitter( IParticleEmitter* emitter ) = 0;
+            /**
+             *  @brief Create a new emitter. The emitter is owned by the particle system.
+             */
+            virtual IParticleEmitter* addEmitter( const ParticleEmitterProperties& properties ) = 0;
 
-            virtual void add( IParticleType* type ) = 0;
-    };*/
+            virtual size_t getNumParticles() = 0;
+            virtual void removeEmitter( IParticleEmitter* emitter ) = 0;
+
+            /**
+             *  @brief Emit one vertex stream per emitter.
+             *
+             *  Uses the custom renderer if one was set, otherwise the graphics driver (as camera-facing quads).
+             */
+            virtual void render() = 0;
+
+            /**
+             *  @brief Set a custom renderer. Ownership is not transferred; pass nullptr to restore the default.
+             */
+            virtual void setRenderer( IParticleRenderer* renderer ) = 0;
+
+            virtual void update( double delta ) = 0;
+    };
 
     class IParticleSystem1
     {
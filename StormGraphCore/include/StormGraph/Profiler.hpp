@@ -27,16 +27,89 @@
 
 namespace StormGraph
 {
+    /**
+     *  Per-scope statistics aggregated over all frames seen by IProfiler::markFrame.
+     *  Frame times are the total time (in microseconds) spent in the scope during one frame, summed over all threads.
+     */
+    struct ProfilerScopeStats
+    {
+        String name;
+
+        uint64_t numCalls, numFrames;
+        uint64_t minFrameTime, maxFrameTime, totalFrameTime;
+    };
+
+    /**
+     *  Low-overhead scope profiler.
+     *
+     *  enter/reenter/leave may be called from any thread; each thread records its finished scopes into its own
+     *  ring buffer, so only the most recent events are kept for trace export. The per-scope statistics are not
+     *  limited by the ring size.
+     */
     class IProfiler
     {
         public:
             virtual ~IProfiler() {}
 
+            /**
+             *  @brief Register a scope by name and enter it.
+             *
+             *  @return the scope id; equal names always map to the same id
+             */
             virtual unsigned enter( const char* name ) = 0;
+
+            /**
+             *  @brief Get the duration of the most recently finished run of the scope, in microseconds.
+             */
             virtual int64_t getDelta( unsigned id ) = 0;
+
+            /**
+             *  @brief Register a scope by name without entering it.
+             */
+            virtual unsigned getScopeId( const char* name ) = 0;
+
+            virtual void getStats( List<ProfilerScopeStats>& stats ) = 0;
             virtual void leave( unsigned id ) = 0;
+
+            /**
+             *  @brief Mark the end of a frame.
+             *
+             *  Must be called from one thread only (normally the one running the main loop).
+             */
+            virtual void markFrame() = 0;
+
             virtual void reenter( unsigned id ) = 0;
 
+            /**
+             *  @brief Write the buffered events in the Chrome trace-event JSON format (chrome://tracing, Perfetto).
+             */
+            virtual void exportChromeTrace( OutputStream* output ) = 0;
+
+            /**
+             *  @brief Print the per-scope min/avg/max frame times.
+             *
+             *  @param output the stream to write to; if nullptr, the statistics are printed to the console
+             */
             virtual void printStats( OutputStream* output ) = 0;
     };
+
+    /**
+     *  Enters a profiler scope for the lifetime of the object.
+     */
+    class ProfilerScope
+    {
+        IProfiler* profiler;
+        unsigned id;
+
+        public:
+            ProfilerScope( IProfiler* profiler, unsigned id ) : profiler( profiler ), id( id )
+            {
+                profiler->reenter( id );
+            }
+
+            ~ProfilerScope()
+            {
+                profiler->leave( id );
+            }
+    };
 }
@@ -27,10 +27,11 @@
 
 namespace StormGraph
 {
-    class Ct2Node;
+    class Ct2Tree;
     class IFont;
     class IMaterial;
     class IModel;
+    class IResourceManager;
     class ISceneGraph;
     class ISoundStream;
     class IStaticModel;
@@ -42,6 +43,22 @@ namespace StormGraph
 
     li_enum_class( LoadFlag ) { useDynamicLighting, useLightMapping, useShadowMapping, maxLoadFlag };
 
+    class IStreamingListener
+    {
+        public:
+            virtual ~IStreamingListener() {}
+
+            /**
+             *  Called from IResourceManager::processStreaming once a streamed resource has been finalized.
+             *
+             *  @param ticket the ticket returned by streamModel/streamTexture
+             *  @param resource the finalized resource, or null if loading failed.
+             *      The reference is borrowed; call reference() to keep it.
+             *  @param errorDesc description of the failure, or null
+             */
+            virtual void onStreamingComplete( IResourceManager* resMgr, unsigned ticket, IResource* resource, const char* errorDesc ) = 0;
+    };
+
     class IResourceManager : public IResource
     {
         public:
@@ -51,9 +68,17 @@ namespace StormGraph
 
             virtual void addPath( const char* path ) = 0;
 
+            /**
+             *  Cancel a streaming request.
+             *  The listener will not be called for a cancelled request.
+             *
+             *  @return false if the request has already completed (or the ticket is unknown)
+             */
+            virtual bool cancelStreaming( unsigned ticket ) = 0;
+
             virtual void finalizePreloads() = 0;
 
-            virtual Ct2Node* loadCtree2( const char* name, bool required ) = 0;
+            virtual Ct2Tree* loadCtree2( const char* name, bool required ) = 0;
             virtual IModel* loadModel( const char* name ) = 0;
             virtual ISceneGraph* loadSceneGraph( const char* name, bool required ) = 0;
             virtual ITexture* loadTexture( const char* name ) = 0;
@@ -64,6 +89,7 @@ namespace StormGraph
 
             virtual IFont* getFont( const char* name, unsigned size, unsigned style ) = 0;
             virtual int getLoadFlag( LoadFlag flag ) = 0;
+            virtual unsigned getNumPendingStreams() = 0;
             virtual IMaterial* getMaterial( const char* name, bool finalized ) = 0;
             virtual IModel* getModel( const char* name ) = 0;
             virtual ISoundStream* getSoundStream( const char* name ) = 0;
@@ -76,8 +102,25 @@ namespace StormGraph
 
             virtual void parseMaterial( const char* name, MaterialStaticProperties* properties ) = 0;
 
+            /**
+             *  Finalize streamed resources whose decoding has completed and notify their listeners.
+             *  Must be called from the thread owning the graphics driver (usually once per frame).
+             *  File I/O and decoding never happen here; only the upload to the driver does.
+             *
+             *  @param maxMicroseconds time budget; at least one resource is finalized if any is ready
+             *  @return number of requests completed
+             */
+            virtual size_t processStreaming( unsigned maxMicroseconds ) = 0;
+
             virtual void releaseUnused() = 0;
 
+            /**
+             *  Remove a path added by addPath (or the default path).
+             *
+             *  @return false if the path wasn't in the list
+             */
+            virtual bool removePath( const char* path ) = 0;
+
             /**
              *  Set a boolean or unsigned load flag.
              *
@@ -85,5 +128,22 @@ namespace StormGraph
              *  @param value new value of the specified flag (-1 to use default where applicable)
              */
             virtual void setLoadFlag( LoadFlag flag, int value ) = 0;
+
+            /**
+             *  Set the number of background threads decoding streamed resources.
+             *  0 selects a default based on the number of hardware threads.
+             */
+            virtual void setNumStreamingWorkers( unsigned numWorkers ) = 0;
+            virtual bool setStreamingPriority( unsigned ticket, int priority ) = 0;
+
+            /**
+             *  Queue a model or texture for loading in the background.
+             *  Requests with higher priority are decoded and finalized first.
+             *  Resource paths should not be changed while requests are pending.
+             *
+             *  @return a ticket identifying the request (never 0)
+             */
+            virtual unsigned streamModel( const char* name, int priority, IStreamingListener* listener ) = 0;
+            virtual unsigned streamTexture( const char* name, int priority, IStreamingListener* listener ) = 0;
     };
 }
@@ -38,6 +38,31 @@ namespace StormGraph
             virtual ~IPointLightNode() {}
 
             //virtual void move( const Vector<>& vec, bool absolute = false ) = 0;
+
+            /**
+             *  @brief Check whether the light got a shadow map selected (rendered or reused) in the last prerender().
+             */
+            virtual bool isShadowed() = 0;
+
+            /**
+             *  @brief Enable or disable shadow casting for this light (enabled by default).
+             */
+            virtual void setCastsShadows( bool castsShadows ) = 0;
+
+            /**
+             *  @brief Change the position, direction or colours of the light.
+             *
+             *  Invalidates the cached shadow map.
+             */
+            virtual void setProperties( const PointLightProperties& properties ) = 0;
+
+            /**
+             *  @brief Mark the light as static (disabled by default).
+             *
+             *  The shadow map of a static light is only re-rendered after the light or the scene geometry within its range
+             *  has changed; otherwise the map from an earlier frame is reused.
+             */
+            virtual void setStatic( bool isStatic ) = 0;
     };
 
     class IModelNode
@@ -56,6 +81,31 @@ namespace StormGraph
             virtual ~IStaticModelNode() {}
     };
 
+    struct SceneCullingStats
+    {
+        // Camera pass (last render())
+        unsigned numDrawn, numCulled;
+
+        // Model meshes of the camera pass drawn as instances by the render queue, and the number of instanced draws used for them
+        unsigned numInstanced, numInstanceBatches;
+
+        // Shadow map passes (last prerender()), summed over all lights
+        unsigned numShadowDrawn, numShadowCulled;
+    };
+
+    struct SceneShadowStats
+    {
+        // All point lights / those that cast shadows and have a shadow map
+        unsigned numLights, numCasters;
+
+        // Casters selected in the last prerender() and how their shadow maps were obtained
+        // (every update is one depth pass over the scene)
+        unsigned numShadowed, numUpdated, numReused;
+
+        // Casters in view that needed an update, but didn't fit in the per-frame budget
+        unsigned numDeferred;
+    };
+
     class ISceneGraph : public IResource
     {
         public:
@@ -81,10 +131,39 @@ namespace StormGraph
             virtual IModelNode* addModel( IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll ) = 0;
             virtual IStaticModelNode* addStaticModel( IStaticModel* model ) = 0;
 
+            /**
+             *  @brief Retrieve the number of model nodes drawn and frustum-culled in the last frame.
+             */
+            virtual void getCullingStats( SceneCullingStats* stats ) = 0;
+
+            /**
+             *  @brief Retrieve the shadow map selection of the last frame.
+             */
+            virtual void getShadowStats( SceneShadowStats* stats ) = 0;
+
             virtual void prerender() = 0;
             virtual void render() = 0;
             //virtual void render( IRenderQueue* renderQueue ) = 0;
 
+            /**
+             *  @brief Enable or disable instanced drawing in the camera pass (enabled by default).
+             *
+             *  See IRenderQueue::setInstancing. Shadow map passes never draw through the render queue and are not instanced.
+             */
+            virtual void setInstancing( bool enabled ) = 0;
+
             virtual void setSceneAmbient( const Colour& sceneAmbient ) = 0;
+
+            /**
+             *  @brief Limit the shadow mapping work done per frame.
+             *
+             *  Lights are ranked by their estimated influence on the screen (the view frustum of the previous frame is used).
+             *  Only the best ranked casters get a shadow map and at most maxUpdates of those are re-rendered in a single prerender();
+             *  cached maps of static lights don't count against maxUpdates.
+             *
+             *  @param maxShadowedLights maximum number of lights with a shadow map (default 4)
+             *  @param maxUpdates maximum number of shadow map passes per frame (default 4)
+             */
+            virtual void setShadowBudget( unsigned maxShadowedLights, unsigned maxUpdates ) = 0;
     };
 }
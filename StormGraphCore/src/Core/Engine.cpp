@@ -28,6 +28,8 @@
 #include <StormGraph/GraphicsDriver.hpp>
 #include <StormGraph/GuiDriver.hpp>
 #include <StormGraph/Image.hpp>
+#include <StormGraph/ParticleSystem.hpp>
+#include <StormGraph/Profiler.hpp>
 #include <StormGraph/ResourceManager.hpp>
 #include <StormGraph/Scene.hpp>
 #include <StormGraph/SoundDriver.hpp>
@@ -145,6 +147,9 @@ namespace StormGraph
 
             Library *driverLibrary, *guiDriverLibrary;
 
+            // display.driver as given on the command line; takes precedence over startup scripts and app defaults
+            String commandLineDriver;
+
         private:
             Engine( const Engine& );
             const Engine& operator = ( const Engine& );
@@ -172,6 +177,7 @@ namespace StormGraph
             virtual IKeyScanner* createKeyScanner() override;
             virtual IHeightMap* createHeightMap( const Vector2<unsigned>& resolution ) override;
             virtual IOnScreenLog* createOnScreenLog( const ScreenRect& area, IFont* font ) override { return StormGraph::createOnScreenLog( this, area, font ); }
+            virtual IParticleSystem* createParticleSystem() override;
             virtual IProfiler* createProfiler() override;
             virtual IResourceManager* createResourceManager( const char* name, bool addDefaultPath, IFileSystem* fileSystem ) override;
             virtual ISceneGraph* createSceneGraph( const char* name ) override;
@@ -255,7 +261,12 @@ namespace StormGraph
             int colon = arg.findChar( ':' );
 
             if ( colon > 0 )
+            {
                 variables.set( arg.left( colon ), new StringVariable( arg.dropLeft( colon + 1 ) ) );
+
+                if ( arg.left( colon ) == "display.driver" )
+                    commandLineDriver = arg.dropLeft( colon + 1 );
+            }
         }
 
         Common::logEvent( "StormGraph.Engine", "Minexew Games StormGraph Engine " + getEngineBuild() );
@@ -400,6 +411,11 @@ namespace StormGraph
         return StormGraph::createKeyScanner( this );
     }
 
+    IParticleSystem* Engine::createParticleSystem()
+    {
+        return StormGraph::createParticleSystem( this );
+    }
+
     IProfiler* Engine::createProfiler()
     {
         return StormGraph::createProfiler( this );
@@ -686,6 +702,36 @@ namespace StormGraph
             return true;
         }
 
+        if ( tokens[0] == "profiler.stats" || tokens[0] == "profiler.trace" )
+        {
+            if ( profiler == nullptr )
+            {
+                if ( lineOutput != nullptr )
+                    lineOutput->writeLine( "\\rWarning: no profiler is attached to the engine" );
+
+                return true;
+            }
+
+            if ( tokens[0] == "profiler.stats" && tokens.getLength() < 2 )
+            {
+                profiler->printStats( nullptr );
+                return true;
+            }
+
+            const String fileName = ( tokens.getLength() > 1 ) ? tokens[1] : String( "Trace.json" );
+            Reference<File> file = File::open( fileName, "wb" );
+
+            if ( file == nullptr )
+                throw Exception( "StormGraph.Engine.onCommand", "FileOpenError", "Failed to open `" + fileName + "` for writing." );
+
+            if ( tokens[0] == "profiler.stats" )
+                profiler->printStats( file );
+            else
+                profiler->exportChromeTrace( file );
+
+            return true;
+        }
+
         if ( tokens[0] == "say" )
         {
             for ( size_t i = 1; i < tokens.getLength(); i++ )
@@ -783,6 +829,9 @@ namespace StormGraph
 
         if ( soundDriver )
             soundDriver->onFrameEnd();
+
+        if ( profiler != nullptr )
+            profiler->markFrame();
     }
 
     void Engine::onKeyState( int16_t key, Key::State state, Unicode::Char character )
@@ -907,10 +956,32 @@ namespace StormGraph
 
     void Engine::startupGraphics()
     {
+        String driverName = commandLineDriver;
+
+        if ( driverName.isEmpty() )
+        {
+            IVariable* variable = variables.get( "display.driver" );
+
+            if ( variable != nullptr )
+                driverName = variable->getValue();
+        }
+
 #ifdef StormGraph_Static_GraphicsDriver
-        graphicsDriver = createGraphicsDriver( StormGraph_Static_GraphicsDriver, this );
+        if ( driverName.isEmpty() )
+            driverName = StormGraph_Static_GraphicsDriver;
+
+        // The statically linked driver only answers to its own name(s); anything else is loaded as a module
+        graphicsDriver = createGraphicsDriver( driverName, this );
+
+        if ( graphicsDriver == nullptr )
+            loadGraphicsDriver( driverName );
+        else
+            Common::logEvent( "StormGraph.Engine", "Using static graphics driver " + File::formatFileName( driverName ) );
 #else
-        loadGraphicsDriver( getVariableValue( "display.driver", true ) );
+        if ( driverName.isEmpty() )
+            throw Exception( "StormGraph.Engine.startupGraphics", "VariableUndefined", "Undefined variable `display.driver`" );
+
+        loadGraphicsDriver( driverName );
 #endif
 
         graphicsDriver->startup();
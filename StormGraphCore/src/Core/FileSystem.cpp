@@ -28,6 +28,16 @@
 #include <Moxillan/Package.hpp>
 
 #include <littl/File.hpp>
+#include <littl/HashMap.hpp>
+
+#ifdef __li_MSW
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <ctype.h>
 
 namespace StormGraph
 {
@@ -67,6 +77,8 @@ namespace StormGraph
             MoxFileSystem( Moxillan::Package* package, const String& prefix );
             virtual ~MoxFileSystem();
 
+            virtual bool isImmutable() override { return true; }
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) override;
             virtual SeekableInputStream* openInput( const char* fileName ) override;
     };
 
@@ -78,21 +90,47 @@ namespace StormGraph
             NativeFileSystem( const char* prefix );
             virtual ~NativeFileSystem();
 
+            virtual bool isCaseSensitive() override;
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) override;
             virtual SeekableInputStream* openInput( const char* fileName ) override;
     };
 
     class UnionFileSystem : public IUnionFileSystem
     {
+        // Guards fileSystems as well as the index
+        Mutex indexMutex;
         List<IFileSystem*> fileSystems;
 
+        // Merged index of all mounted file systems, filled in one directory at a time as paths are resolved
+        // Maps each path to the first file system containing it, or to nullptr if there is none (negative lookup cache)
+        HashMap<String, IFileSystem*> pathIndex;
+        HashMap<String, bool> indexedDirectories;
+
+        // Keys are folded to lower case while any mount ignores case; misses are only cached while every mount is immutable
+        bool foldCase, cacheMisses;
+
+        // Bumped whenever the index is cleared, so that listings started before are dropped
+        unsigned indexGeneration;
+
+        static String foldPath( const String& path );
+        static bool getIndexKey( const char* fileName, String* key, String* directory );
+
+        void getFileSystems( List<IFileSystem*>& snapshot );
+        void indexDirectory( const String& directory, const String& directoryKey );
+        void listMerged( const char* path, List<DirEntry>& entries, List<IFileSystem*>& owners );
+        IFileSystem* resolve( const char* fileName, bool* indexed );
+        static void releaseFileSystems( List<IFileSystem*>& snapshot );
+
         public:
             UnionFileSystem();
             virtual ~UnionFileSystem();
 
             virtual void add( IFileSystem* fs ) override;
             virtual void clear() override;
-            virtual SeekableInputStream* openInput( const char* fileName ) override;
             virtual size_t getNumFileSystems() const override;
+            virtual void invalidateIndex() override;
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) override;
+            virtual SeekableInputStream* openInput( const char* fileName ) override;
     };
 
     MoxFileSystemDriver::~MoxFileSystemDriver()
@@ -117,7 +155,7 @@ namespace StormGraph
         File* file = File::open( packageName );
 
         if ( file )
-            return new MoxFileSystem( new Moxillan::Package( file ), prefix );
+            return new MoxFileSystem( new Moxillan::Package( file, packageName ), prefix );
 
         return nullptr;
     }
@@ -163,6 +201,32 @@ namespace StormGraph
     {
     }
 
+    unsigned MoxFileSystem::listDirectory( const char* path, List<DirEntry>& entries )
+    {
+        if ( !package )
+            return 0;
+
+        Moxillan::Node* directory = package->findDirectory( prefix + path );
+
+        if ( directory == nullptr )
+            return 0;
+
+        List<Moxillan::DirEntry> contents;
+        package->listDirectory( directory, contents );
+
+        const String parent = ( *path != 0 && !String( path ).endsWith( "/" ) ) ? ( String ) path + "/" : ( String ) path;
+
+        iterate2 ( i, contents )
+        {
+            const Moxillan::DirEntry& item = i;
+
+            DirEntry entry = { item.name, parent + item.name, item.isDirectory, item.isDirectory ? -1 : ( int64_t ) item.size };
+            entries.add( ( DirEntry&& ) entry );
+        }
+
+        return contents.getLength();
+    }
+
     SeekableInputStream* MoxFileSystem::openInput( const char* fileName )
     {
         if ( !package )
@@ -185,6 +249,81 @@ namespace StormGraph
     {
     }
 
+    bool NativeFileSystem::isCaseSensitive()
+    {
+#ifdef __li_MSW
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    unsigned NativeFileSystem::listDirectory( const char* path, List<DirEntry>& entries )
+    {
+        // Entry types come with the listing itself, so that nothing has to be opened per entry
+        const String directoryName = prefix + path;
+        const String parent = ( *path != 0 && !String( path ).endsWith( "/" ) ) ? ( String ) path + "/" : ( String ) path;
+
+        unsigned count = 0;
+
+#ifdef __li_MSW
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA( directoryName.isEmpty() ? ( String ) "*" : directoryName + "/*", &data );
+
+        if ( find == INVALID_HANDLE_VALUE )
+            return 0;
+
+        do
+        {
+            const String name = data.cFileName;
+
+            if ( name == "." || name == ".." )
+                continue;
+
+            const bool isDirectory = ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) != 0;
+            const int64_t size = isDirectory ? -1 : ( ( int64_t ) data.nFileSizeHigh << 32 | data.nFileSizeLow );
+
+            DirEntry entry = { name, parent + name, isDirectory, size };
+            entries.add( ( DirEntry&& ) entry );
+            count++;
+        }
+        while ( FindNextFileA( find, &data ) );
+
+        FindClose( find );
+#else
+        DIR* directory = opendir( directoryName.isEmpty() ? "." : directoryName.c_str() );
+
+        if ( directory == nullptr )
+            return 0;
+
+        while ( struct dirent* item = readdir( directory ) )
+        {
+            const String name = item->d_name;
+
+            if ( name == "." || name == ".." )
+                continue;
+
+            bool isDirectory = ( item->d_type == DT_DIR );
+
+            // Some file systems don't report types; symlinks are followed
+            if ( item->d_type == DT_UNKNOWN || item->d_type == DT_LNK )
+            {
+                struct stat info;
+                isDirectory = ( stat( prefix + parent + name, &info ) == 0 && S_ISDIR( info.st_mode ) );
+            }
+
+            // Sizes would take an extra stat per file; nobody needs them yet
+            DirEntry entry = { name, parent + name, isDirectory, -1 };
+            entries.add( ( DirEntry&& ) entry );
+            count++;
+        }
+
+        closedir( directory );
+#endif
+
+        return count;
+    }
+
     SeekableInputStream* NativeFileSystem::openInput( const char* fileName )
     {
         File* file = File::open( prefix + fileName );
@@ -193,6 +332,7 @@ namespace StormGraph
     }
 
     UnionFileSystem::UnionFileSystem()
+            : foldCase( false ), cacheMisses( true ), indexGeneration( 0 )
     {
     }
 
@@ -205,28 +345,95 @@ namespace StormGraph
     {
         SG_assert3( fs != nullptr, "StormGraph.UnionFileSystem.add" )
 
+        CriticalSection cs( indexMutex );
+
         fileSystems.add( fs );
+
+        foldCase = foldCase || !fs->isCaseSensitive();
+        cacheMisses = cacheMisses && fs->isImmutable();
+
+        pathIndex.clear();
+        indexedDirectories.clear();
+        indexGeneration++;
     }
 
     void UnionFileSystem::clear()
     {
-        reverse_iterate ( fileSystems )
-            fileSystems.current()->release();
+        List<IFileSystem*> removed;
+
+        {
+            CriticalSection cs( indexMutex );
+
+            iterate ( fileSystems )
+                removed.add( fileSystems.current() );
+
+            fileSystems.clear();
+
+            foldCase = false;
+            cacheMisses = true;
+
+            pathIndex.clear();
+            indexedDirectories.clear();
+            indexGeneration++;
+        }
+
+        // Lookups still in progress hold their own references
+        releaseFileSystems( removed );
+    }
+
+    String UnionFileSystem::foldPath( const String& path )
+    {
+        Array<char> folded( path.getNumBytes() + 1 );
+
+        for ( size_t i = 0; i <= path.getNumBytes(); i++ )
+            folded[i] = ( char ) tolower( ( unsigned char ) path.c_str()[i] );
 
-        fileSystems.clear();
+        return String( folded.getPtr() );
     }
 
-    SeekableInputStream* UnionFileSystem::openInput( const char* fileName )
+    bool UnionFileSystem::getIndexKey( const char* fileName, String* key, String* directory )
     {
-        iterate ( fileSystems )
+        // The index only knows canonical relative paths (a/b/c); anything else is resolved by asking each file system in turn
+
+        if ( *fileName == 0 || *fileName == '/' || *fileName == '\\' )
+            return false;
+
+        *key = String( fileName ).replaceAll( '\\', '/' );
+
+        int lastSlash = -1;
+
+        for ( size_t i = 0, segmentStart = 0; ; i++ )
         {
-            SeekableInputStream* input = fileSystems.current()->openInput( fileName );
+            const char c = fileName[i];
+
+            if ( c == '/' || c == '\\' || c == 0 )
+            {
+                const size_t segmentLength = i - segmentStart;
+
+                // Empty, `.` and `..` segments
+                if ( segmentLength == 0 || ( fileName[segmentStart] == '.' && ( segmentLength == 1 || ( segmentLength == 2 && fileName[segmentStart + 1] == '.' ) ) ) )
+                    return false;
+
+                if ( c == 0 )
+                    break;
 
-            if ( input != nullptr )
-                return input;
+                lastSlash = ( int ) i;
+                segmentStart = i + 1;
+            }
+            else if ( c == ':' )
+                return false;
         }
 
-        return nullptr;
+        *directory = ( lastSlash >= 0 ) ? key->leftPart( lastSlash ) : String();
+        return true;
+    }
+
+    void UnionFileSystem::getFileSystems( List<IFileSystem*>& snapshot )
+    {
+        CriticalSection cs( indexMutex );
+
+        iterate ( fileSystems )
+            snapshot.add( fileSystems.current()->reference() );
     }
 
     size_t UnionFileSystem::getNumFileSystems() const
@@ -234,6 +441,184 @@ namespace StormGraph
         return fileSystems.getLength();
     }
 
+    void UnionFileSystem::indexDirectory( const String& directory, const String& directoryKey )
+    {
+        unsigned generation;
+
+        {
+            CriticalSection cs( indexMutex );
+
+            if ( indexedDirectories.find( directoryKey ) != nullptr )
+                return;
+
+            generation = indexGeneration;
+        }
+
+        // List outside of the lock; another thread indexing the same directory at the same time just does redundant work
+        List<DirEntry> entries;
+        List<IFileSystem*> owners;
+
+        listMerged( directory, entries, owners );
+
+        CriticalSection cs( indexMutex );
+
+        // The index was cleared while listing; the listing may already be stale
+        if ( generation != indexGeneration )
+            return;
+
+        for each_in_list ( entries, i )
+        {
+            String key = foldCase ? foldPath( entries[i].path ) : entries[i].path;
+
+            if ( pathIndex.find( key ) == nullptr )
+                pathIndex.set( ( String&& ) key, ( IFileSystem*&& ) owners[i] );
+        }
+
+        indexedDirectories.set( ( String&& ) String( directoryKey ), true );
+    }
+
+    void UnionFileSystem::invalidateIndex()
+    {
+        CriticalSection cs( indexMutex );
+
+        pathIndex.clear();
+        indexedDirectories.clear();
+        indexGeneration++;
+    }
+
+    unsigned UnionFileSystem::listDirectory( const char* path, List<DirEntry>& entries )
+    {
+        List<DirEntry> merged;
+        List<IFileSystem*> owners;
+
+        listMerged( path, merged, owners );
+
+        for each_in_list ( merged, i )
+            entries.add( merged[i] );
+
+        return merged.getLength();
+    }
+
+    void UnionFileSystem::listMerged( const char* path, List<DirEntry>& entries, List<IFileSystem*>& owners )
+    {
+        // Earlier file systems shadow later ones, the same as in openInput
+        HashMap<String, bool> seen;
+
+        List<IFileSystem*> snapshot;
+        getFileSystems( snapshot );
+
+        iterate ( snapshot )
+        {
+            List<DirEntry> fsEntries;
+            snapshot.current()->listDirectory( path, fsEntries );
+
+            iterate2 ( i, fsEntries )
+            {
+                DirEntry& entry = i;
+
+                if ( seen.find( entry.name ) != nullptr )
+                    continue;
+
+                seen.set( ( String&& ) String( entry.name ), true );
+
+                entries.add( entry );
+                owners.add( snapshot.current() );
+            }
+        }
+
+        // The index only compares owners; it never dereferences them
+        releaseFileSystems( snapshot );
+    }
+
+    SeekableInputStream* UnionFileSystem::openInput( const char* fileName )
+    {
+        bool indexed;
+        IFileSystem* fs = resolve( fileName, &indexed );
+
+        if ( indexed && fs == nullptr )
+            return nullptr;
+
+        List<IFileSystem*> snapshot;
+        getFileSystems( snapshot );
+
+        SeekableInputStream* input = nullptr;
+
+        // The indexed owner first; it may still fail if the file was removed or its name differs in case
+        if ( fs != nullptr )
+            iterate ( snapshot )
+                if ( snapshot.current() == fs )
+                {
+                    input = fs->openInput( fileName );
+                    break;
+                }
+
+        if ( input == nullptr )
+            iterate ( snapshot )
+            {
+                if ( snapshot.current() != fs )
+                    input = snapshot.current()->openInput( fileName );
+
+                if ( input != nullptr )
+                    break;
+            }
+
+        releaseFileSystems( snapshot );
+        return input;
+    }
+
+    void UnionFileSystem::releaseFileSystems( List<IFileSystem*>& snapshot )
+    {
+        reverse_iterate ( snapshot )
+            snapshot.current()->release();
+
+        snapshot.clear();
+    }
+
+    IFileSystem* UnionFileSystem::resolve( const char* fileName, bool* indexed )
+    {
+        String key, directory;
+
+        *indexed = getIndexKey( fileName, &key, &directory );
+
+        if ( !*indexed )
+            return nullptr;
+
+        String directoryKey;
+
+        {
+            CriticalSection cs( indexMutex );
+
+            if ( foldCase )
+                key = foldPath( key );
+
+            directoryKey = foldCase ? foldPath( directory ) : directory;
+
+            IFileSystem** fs = pathIndex.find( key );
+
+            if ( fs != nullptr )
+                return *fs;
+        }
+
+        indexDirectory( directory, directoryKey );
+
+        CriticalSection cs( indexMutex );
+
+        IFileSystem** fs = pathIndex.find( key );
+
+        if ( fs != nullptr )
+            return *fs;
+
+        // A mutable file system may gain the file at any time; let the caller ask all of them
+        if ( !cacheMisses )
+        {
+            *indexed = false;
+            return nullptr;
+        }
+
+        pathIndex.set( ( String&& ) key, ( IFileSystem* ) nullptr );
+        return nullptr;
+    }
+
     IFileSystemDriver* createMoxFileSystemDriver()
     {
         return new MoxFileSystemDriver();
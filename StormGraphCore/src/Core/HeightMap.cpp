@@ -22,6 +22,7 @@
 */
 
 #include <StormGraph/HeightMap.hpp>
+#include <StormGraph/VectorBatch.hpp>
 
 namespace StormGraph
 {
@@ -109,32 +110,39 @@ namespace StormGraph
         // *** Calculate normals ***
 
         Array<unsigned> connections( buildInfo->resolution.x * buildInfo->resolution.y );
+        List<Vector<>> faceNormals;
 
+        // Face normals of all polygons first, so that they can be normalized as one batch
         for ( unsigned y = 0; y < buildInfo->resolution.y - 1; y++ )
             for ( unsigned x = 0; x < buildInfo->resolution.x - 1; x++ )
                 for ( int tri = 0; tri < 2; tri++ )
                 {
-                    Vector<> corners[3], sides[2], normal;
-
-                    //printf( "%u, %u, %i: ", x, y, tri );
+                    Vector<> corners[3], sides[2];
 
                     // Get the corners of this polygon
                     for ( int i = 0; i < 3; i++ )
                     {
                         unsigned vertexIndex = ( y + offsets[tri][i][1] ) * buildInfo->resolution.x + x + offsets[tri][i][0];
-//printf( "<+%u,%u=%u>", offsets[tri][i][0], offsets[tri][i][1], vertexIndex );
                         corners[i] = vertices[vertexIndex].pos;
                     }
 
-                    //printf( "vertices: [%s]\n\t[%s][%s]\n", corners[0].toString().c_str(),
-                    //        corners[1].toString().c_str(), corners[2].toString().c_str() );
-
                     // Calculate vectors representing two sides of this poly
                     sides[0] = corners[1] - corners[0];
                     sides[1] = corners[2] - corners[0];
 
-                    // Get the cross-product of those two vectors and normalize it to get a direction vector
-                    normal = sides[0].crossProduct( sides[1] ).normalize();
+                    // Their cross-product, once normalized, is the direction vector
+                    faceNormals.add( sides[0].crossProduct( sides[1] ) );
+                }
+
+        VectorBatch::normalize( faceNormals.getPtrUnsafe(), faceNormals.getPtrUnsafe(), faceNormals.getLength() );
+
+        size_t faceIndex = 0;
+
+        for ( unsigned y = 0; y < buildInfo->resolution.y - 1; y++ )
+            for ( unsigned x = 0; x < buildInfo->resolution.x - 1; x++ )
+                for ( int tri = 0; tri < 2; tri++ )
+                {
+                    const Vector<>& normal = faceNormals[faceIndex++];
 
                     for ( int i = 0; i < 3; i++ )
                     {
@@ -145,8 +153,6 @@ namespace StormGraph
 
                         // And add this normal to the normal-sum
                         vertices[vertexIndex].normal += normal;
-
-                        //printf( "setting with n = %s\n", vertices[vertexIndex].normal.toString().c_str() );
                     }
                 }
 
@@ -37,6 +37,7 @@ namespace StormGraph
     class IImageLoader;
     class IKeyScanner;
     class IOnScreenLog;
+    class IParticleSystem;
     class IProfiler;
     class IResourceManager;
     class ISceneGraph;
@@ -51,6 +52,7 @@ namespace StormGraph
     IImageLoader* createImageLoader( IEngine* engine );
     IKeyScanner* createKeyScanner( IEngine* engine );
     IOnScreenLog* createOnScreenLog( IEngine* engine, const ScreenRect& area, IFont* font );
+    IParticleSystem* createParticleSystem( IEngine* engine );
     IProfiler* createProfiler( IEngine* engine );
     IResourceManager* createResourceManager( IEngine* engine, const char* name, bool addDefaultPath, IFileSystem* fileSystem );
     ISceneGraph* createSceneGraph( IEngine* engine, const char* name );
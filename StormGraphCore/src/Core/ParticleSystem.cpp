@@ -0,0 +1,357 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Internal.hpp"
+
+#include <StormGraph/Engine.hpp>
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/ParticleSystem.hpp>
+
+namespace StormGraph
+{
+    class ParticleEmitter : public IParticleEmitter
+    {
+        public:
+            ParticleEmitterProperties properties;
+            Reference<IMaterial> material;
+
+            // Structure-of-arrays storage; live particles are kept dense in [0, numParticles)
+            Array<float> posX, posY, posZ, velX, velY, velZ, age, lifetime;
+            size_t numParticles;
+
+            float spawnAccumulator;
+            uint32_t seed;
+
+            // Per-frame output, reused between frames
+            Array<ParticleVertex> stream;
+            Array<Vertex> vertices;
+
+            // Billboards for the default renderer; created on first use with room for maxParticles, then updated in place
+            Reference<IModel> model;
+
+        private:
+            void createModel( IGraphicsDriver* driver );
+            float random();
+
+        public:
+            ParticleEmitter( const ParticleEmitterProperties& properties, uint32_t seed );
+            virtual ~ParticleEmitter() {}
+
+            size_t buildStream();
+            void renderBillboards( IGraphicsDriver* driver, size_t count );
+            void update( float delta );
+
+            virtual size_t emit( size_t count ) override;
+            virtual size_t getNumParticles() override { return numParticles; }
+            virtual const ParticleEmitterProperties& getProperties() override { return properties; }
+            virtual void setPos( const Vector<>& pos ) override { properties.pos = pos; }
+            virtual void setRate( float rate ) override { properties.rate = rate; }
+    };
+
+    class ParticleSystem : public IParticleSystem
+    {
+        IEngine* engine;
+        IParticleRenderer* renderer;
+
+        List<ParticleEmitter*> emitters;
+        uint32_t nextSeed;
+
+        public:
+            ParticleSystem( IEngine* engine );
+            virtual ~ParticleSystem();
+
+            virtual IParticleEmitter* addEmitter( const ParticleEmitterProperties& properties ) override;
+            virtual size_t getNumParticles() override;
+            virtual void removeEmitter( IParticleEmitter* emitter ) override;
+            virtual void render() override;
+            virtual void setRenderer( IParticleRenderer* renderer ) override { this->renderer = renderer; }
+            virtual void update( double delta ) override;
+    };
+
+    ParticleEmitter::ParticleEmitter( const ParticleEmitterProperties& properties, uint32_t seed )
+            : properties( properties ), material( properties.material ), numParticles( 0 ), spawnAccumulator( 0.0f ), seed( seed )
+    {
+        this->properties.material = nullptr;
+
+        const size_t capacity = properties.maxParticles;
+
+        posX.resize( capacity );
+        posY.resize( capacity );
+        posZ.resize( capacity );
+        velX.resize( capacity );
+        velY.resize( capacity );
+        velZ.resize( capacity );
+        age.resize( capacity );
+        lifetime.resize( capacity );
+    }
+
+    size_t ParticleEmitter::buildStream()
+    {
+        stream.resize( numParticles );
+
+        const float* ages = age.getPtr(), * lifetimes = lifetime.getPtr();
+        ParticleVertex* out = stream.getPtr();
+
+        const Colour& c0 = properties.colourBegin, & c1 = properties.colourEnd;
+
+        for ( size_t i = 0; i < numParticles; i++ )
+        {
+            const float t = ages[i] / lifetimes[i];
+
+            out[i].pos = Vector<>( posX[i], posY[i], posZ[i] );
+            out[i].size = properties.sizeBegin + ( properties.sizeEnd - properties.sizeBegin ) * t;
+            out[i].colour = Colour( c0.r + ( c1.r - c0.r ) * t, c0.g + ( c1.g - c0.g ) * t, c0.b + ( c1.b - c0.b ) * t, c0.a + ( c1.a - c0.a ) * t );
+        }
+
+        return numParticles;
+    }
+
+    void ParticleEmitter::createModel( IGraphicsDriver* driver )
+    {
+        static const float cornerUvs[] = { 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f };
+
+        const size_t capacity = properties.maxParticles;
+
+        // Texture coordinates and indices never change; positions are streamed every frame
+        Array<float> coords( capacity * 4 * 3 ), uvs( capacity * 4 * 2 );
+        Array<unsigned> indices( capacity * 6 );
+
+        memset( coords.getPtr(), 0, capacity * 4 * 3 * sizeof( float ) );
+
+        for ( size_t i = 0; i < capacity; i++ )
+        {
+            memcpy( uvs.getPtr() + i * 8, cornerUvs, sizeof( cornerUvs ) );
+
+            const unsigned base = ( unsigned )( i * 4 );
+            const unsigned quad[] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+
+            memcpy( indices.getPtr() + i * 6, quad, sizeof( quad ) );
+        }
+
+        IMaterial* material = ( this->material != nullptr ) ? this->material->reference() : driver->getSolidMaterial();
+
+        MeshCreationInfo3 mesh = { MeshFormat::triangleList, MeshLayout::indexed, material, capacity * 4, capacity * 6,
+                coords.getPtr(), nullptr, { uvs.getPtr() }, nullptr, indices.getPtr() };
+
+        model = driver->createModelFromMemory( "StormGraph.ParticleSystem", &mesh, 1, IModel::streamedVertices );
+    }
+
+    size_t ParticleEmitter::emit( size_t count )
+    {
+        count = minimum( count, properties.maxParticles - numParticles );
+
+        const Vector<>& spread = properties.velocitySpread;
+
+        for ( size_t i = numParticles; i < numParticles + count; i++ )
+        {
+            posX[i] = properties.pos.x;
+            posY[i] = properties.pos.y;
+            posZ[i] = properties.pos.z;
+
+            velX[i] = properties.velocity.x + spread.x * random();
+            velY[i] = properties.velocity.y + spread.y * random();
+            velZ[i] = properties.velocity.z + spread.z * random();
+
+            age[i] = 0.0f;
+            lifetime[i] = maximum( properties.lifetime + properties.lifetimeSpread * random(), 0.001f );
+        }
+
+        numParticles += count;
+        return count;
+    }
+
+    float ParticleEmitter::random()
+    {
+        // xorshift32; returns a value in [-1, 1]
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        return ( float ) ( seed & 0xFFFFFF ) / ( float ) 0x7FFFFF - 1.0f;
+    }
+
+    void ParticleEmitter::renderBillboards( IGraphicsDriver* driver, size_t count )
+    {
+        if ( model == nullptr )
+            createModel( driver );
+
+        // Camera-facing quads; the rows of the view rotation are the camera axes in world space
+        const glm::mat4& view = driver->getModelView();
+
+        const Vector<> right( view[0][0], view[1][0], view[2][0] ), up( view[0][1], view[1][1], view[2][1] );
+        const Vector<> normal( view[0][2], view[1][2], view[2][2] );
+
+        static const float cornerX[] = { -0.5f, 0.5f, 0.5f, -0.5f }, cornerY[] = { -0.5f, -0.5f, 0.5f, 0.5f };
+
+        vertices.resize( count * 4 );
+
+        const ParticleVertex* in = stream.getPtr();
+        Vertex* out = vertices.getPtr();
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            for ( int corner = 0; corner < 4; corner++ )
+            {
+                Vertex& v = out[i * 4 + corner];
+
+                v.pos = in[i].pos + ( right * cornerX[corner] + up * cornerY[corner] ) * in[i].size;
+                v.normal = normal;
+                v.colour = in[i].colour;
+                v.uv[0] = Vector2<>( cornerX[corner] + 0.5f, cornerY[corner] + 0.5f );
+                v.lightUv = Vector2<>();
+            }
+        }
+
+        if ( model->updateVertices( 0, 0, out, count * 4 ) )
+            model->renderRange( 0, 0, count * 6 );
+    }
+
+    void ParticleEmitter::update( float delta )
+    {
+        const float ax = properties.acceleration.x * delta, ay = properties.acceleration.y * delta, az = properties.acceleration.z * delta;
+        const float damping = 1.0f - minimum( properties.drag * delta, 1.0f );
+
+        float* px = posX.getPtr(), * py = posY.getPtr(), * pz = posZ.getPtr();
+        float* vx = velX.getPtr(), * vy = velY.getPtr(), * vz = velZ.getPtr();
+        float* ages = age.getPtr();
+        const float* lifetimes = lifetime.getPtr();
+
+        const size_t count = numParticles;
+
+        // Straight-line loops over plain float arrays, one per attribute group, so that the compiler can vectorize them
+        for ( size_t i = 0; i < count; i++ )
+        {
+            vx[i] = vx[i] * damping + ax;
+            vy[i] = vy[i] * damping + ay;
+            vz[i] = vz[i] * damping + az;
+        }
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            px[i] += vx[i] * delta;
+            py[i] += vy[i] * delta;
+            pz[i] += vz[i] * delta;
+        }
+
+        for ( size_t i = 0; i < count; i++ )
+            ages[i] += delta;
+
+        // Retire dead particles by moving the last live one into the hole
+        for ( size_t i = 0; i < numParticles; )
+        {
+            if ( ages[i] < lifetimes[i] )
+            {
+                i++;
+                continue;
+            }
+
+            const size_t last = --numParticles;
+
+            px[i] = px[last];
+            py[i] = py[last];
+            pz[i] = pz[last];
+            vx[i] = vx[last];
+            vy[i] = vy[last];
+            vz[i] = vz[last];
+            ages[i] = ages[last];
+            lifetime[i] = lifetimes[last];
+        }
+
+        spawnAccumulator += properties.rate * delta;
+
+        if ( spawnAccumulator >= 1.0f )
+        {
+            const size_t spawn = ( size_t ) spawnAccumulator;
+            spawnAccumulator -= spawn;
+
+            emit( spawn );
+        }
+    }
+
+    ParticleSystem::ParticleSystem( IEngine* engine )
+            : engine( engine ), renderer( nullptr ), nextSeed( 0x9E3779B9 )
+    {
+    }
+
+    ParticleSystem::~ParticleSystem()
+    {
+        iterate ( emitters )
+            delete emitters.current();
+    }
+
+    IParticleEmitter* ParticleSystem::addEmitter( const ParticleEmitterProperties& properties )
+    {
+        ParticleEmitter* emitter = new ParticleEmitter( properties, nextSeed );
+        nextSeed = nextSeed * 1664525 + 1013904223;
+
+        emitters.add( emitter );
+        return emitter;
+    }
+
+    size_t ParticleSystem::getNumParticles()
+    {
+        size_t count = 0;
+
+        iterate ( emitters )
+            count += emitters.current()->numParticles;
+
+        return count;
+    }
+
+    void ParticleSystem::removeEmitter( IParticleEmitter* emitter )
+    {
+        if ( emitters.removeItem( static_cast<ParticleEmitter*>( emitter ) ) )
+            delete emitter;
+    }
+
+    void ParticleSystem::render()
+    {
+        IGraphicsDriver* driver = ( renderer == nullptr && engine != nullptr ) ? engine->getGraphicsDriver() : nullptr;
+
+        iterate ( emitters )
+        {
+            ParticleEmitter* emitter = emitters.current();
+
+            const size_t count = emitter->buildStream();
+
+            if ( count == 0 )
+                continue;
+
+            if ( renderer != nullptr )
+                renderer->renderParticles( emitter, emitter->stream.getPtr(), count );
+            else if ( driver != nullptr )
+                emitter->renderBillboards( driver, count );
+        }
+    }
+
+    void ParticleSystem::update( double delta )
+    {
+        iterate ( emitters )
+            emitters.current()->update( ( float ) delta );
+    }
+
+    IParticleSystem* createParticleSystem( IEngine* engine )
+    {
+        return new ParticleSystem( engine );
+    }
+}
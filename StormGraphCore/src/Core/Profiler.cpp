@@ -25,84 +25,341 @@
 
 #include <StormGraph/Profiler.hpp>
 
+#include <atomic>
+#include <thread>
+
 namespace StormGraph
 {
     class Profiler : public IProfiler
     {
-        struct Section
+        enum { maxScopes = 1024, ringSize = 16384, maxFrameMarks = 4096 };
+
+        struct Event
         {
-            const char* name;
+            unsigned scope;
             uint64_t begin, end;
-            bool printed;
         };
 
-        List<Section> sections;
+        struct Scope
+        {
+            String name;
+
+            std::atomic<int64_t> lastDelta;
+            std::atomic<uint64_t> frameTime, frameCalls;
+
+            // Guarded by statsMutex
+            uint64_t numCalls, numFrames;
+            uint64_t minFrameTime, maxFrameTime, totalFrameTime;
+        };
+
+        struct ThreadBuffer
+        {
+            std::thread::id threadId;
+            unsigned index;
+
+            // Written only by the owning thread; numEvents is published with release semantics
+            uint64_t openScopes[maxScopes];
+            Event events[ringSize];
+            std::atomic<uint64_t> numEvents;
+        };
+
+        unsigned instanceId;
+        uint64_t epoch;
+
+        Scope scopes[maxScopes];
+        std::atomic<unsigned> numScopes;
+        HashMap<String, unsigned> scopeIds;
+        Mutex scopeMutex;
+
+        List<ThreadBuffer*> threads;
+        Mutex threadMutex;
+
+        Array<uint64_t> frameMarks;
+        uint64_t numFrameMarks;
+        Mutex statsMutex;
 
-        void printRangeStats( uint64_t min, uint64_t max, uint64_t offset, unsigned depth );
+        static std::atomic<unsigned> nextInstanceId;
+
+        ThreadBuffer* getThreadBuffer();
 
         public:
-            virtual ~Profiler() {}
+            Profiler();
+            virtual ~Profiler();
 
             virtual unsigned enter( const char* name ) override;
-            virtual int64_t getDelta( unsigned id ) override { return sections[id].end - sections[id].begin; }
+            virtual void exportChromeTrace( OutputStream* output ) override;
+            virtual int64_t getDelta( unsigned id ) override { return scopes[id].lastDelta.load( std::memory_order_relaxed ); }
+            virtual unsigned getScopeId( const char* name ) override;
+            virtual void getStats( List<ProfilerScopeStats>& stats ) override;
             virtual void leave( unsigned id ) override;
-            virtual void reenter( unsigned id ) override;
-
+            virtual void markFrame() override;
             virtual void printStats( OutputStream* output ) override;
+            virtual void reenter( unsigned id ) override;
     };
 
-    unsigned Profiler::enter( const char* name )
+    std::atomic<unsigned> Profiler::nextInstanceId( 1 );
+
+    static String escapeJson( const String& string )
+    {
+        String escaped;
+
+        for ( size_t i = 0; i < string.getNumBytes(); i++ )
+        {
+            const char c = string[i];
+
+            if ( c == '"' || c == '\\' )
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ( ( unsigned char ) c < 0x20 )
+                escaped += ' ';
+            else
+                escaped += c;
+        }
+
+        return escaped;
+    }
+
+    Profiler::Profiler()
+            : instanceId( nextInstanceId++ ), epoch( Timer::getRelativeMicroseconds() ), numScopes( 0 ), frameMarks( maxFrameMarks ), numFrameMarks( 0 )
     {
-#ifdef li_GCC4
-        return sections.add( Section { name, Timer::getRelativeMicroseconds() } );
-#else
-        Section sect = { name, Timer::getRelativeMicroseconds() };
-        return sections.add( sect );
-#endif
     }
 
-    void Profiler::leave( unsigned id )
+    Profiler::~Profiler()
+    {
+        iterate ( threads )
+            delete threads.current();
+    }
+
+    unsigned Profiler::enter( const char* name )
     {
-        sections[id].end = Timer::getRelativeMicroseconds();
+        const unsigned id = getScopeId( name );
+
+        reenter( id );
+        return id;
     }
 
-    void Profiler::printRangeStats( uint64_t min, uint64_t max, uint64_t offset, unsigned depth )
+    void Profiler::exportChromeTrace( OutputStream* output )
     {
-        iterate2 ( i, sections )
+        output->writeLine( "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" );
+
+        output->writeLine( "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"StormGraph\"}}" );
+
+        CriticalSection threadLock( threadMutex );
+
+        iterate ( threads )
         {
-            Section& section = i;
+            ThreadBuffer* buffer = threads.current();
 
-            if ( section.printed )
-                continue;
+            output->writeLine( ( String ) ",{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " + String::formatInt( buffer->index )
+                    + ", \"args\": {\"name\": \"thread " + String::formatInt( buffer->index ) + "\"}}" );
+
+            const uint64_t written = buffer->numEvents.load( std::memory_order_acquire );
 
-            if ( depth == 0 || ( section.begin >= min && section.end <= max ) )
+            // The slot of event `written - ringSize` is the next one to be written, so it's never safe to read
+            for ( uint64_t i = ( written >= ringSize ) ? written - ringSize + 1 : 0; i < written; i++ )
             {
-                section.printed = true;
+                const Event event = buffer->events[i % ringSize];
 
-                repeat ( depth )
-                    printf( "  " );
+                // The owning thread keeps writing while we read (seqlock-style); event `i + ringSize` goes to the same slot
+                // and may have been in progress if its index has been reached, so drop whatever may be torn
+                std::atomic_thread_fence( std::memory_order_acquire );
+                const uint64_t writtenNow = buffer->numEvents.load( std::memory_order_relaxed );
 
-                printf( "[%" PRIu64 " ..\t%" PRIu64 "]\t(%" PRIu64 " us)\t%s\n", section.begin - offset, section.end - offset, section.end - section.begin, section.name );
+                if ( i + ringSize <= writtenNow )
+                    continue;
 
-                printRangeStats( section.begin, section.end, offset, depth + 1 );
+                output->writeLine( ( String ) ",{\"name\": \"" + escapeJson( scopes[event.scope].name ) + "\", \"ph\": \"X\", \"pid\": 0, \"tid\": "
+                        + String::formatInt( buffer->index ) + ", \"ts\": " + String::formatInt( event.begin - epoch )
+                        + ", \"dur\": " + String::formatInt( event.end - event.begin ) + "}" );
             }
         }
+
+        CriticalSection statsLock( statsMutex );
+
+        for ( uint64_t i = ( numFrameMarks > maxFrameMarks ) ? numFrameMarks - maxFrameMarks : 0; i < numFrameMarks; i++ )
+            output->writeLine( ( String ) ",{\"name\": \"frame\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": 0, \"ts\": "
+                    + String::formatInt( frameMarks[i % maxFrameMarks] - epoch ) + "}" );
+
+        output->writeLine( "]}" );
+    }
+
+    unsigned Profiler::getScopeId( const char* name )
+    {
+        CriticalSection lock( scopeMutex );
+
+        unsigned* existing = scopeIds.find( name );
+
+        if ( existing != nullptr )
+            return *existing;
+
+        unsigned id = numScopes.load( std::memory_order_relaxed );
+
+        if ( id >= maxScopes )
+            throw Exception( "StormGraph.Profiler.getScopeId", "TooManyScopes",
+                    ( String ) "Cannot register profiler scope `" + name + "`; the limit of " + String::formatInt( maxScopes ) + " scopes was reached." );
+
+        Scope& scope = scopes[id];
+        scope.name = name;
+        scope.lastDelta = 0;
+        scope.frameTime = 0;
+        scope.frameCalls = 0;
+        scope.numCalls = 0;
+        scope.numFrames = 0;
+        scope.minFrameTime = 0;
+        scope.maxFrameTime = 0;
+        scope.totalFrameTime = 0;
+
+        scopeIds.set( String( name ), ( unsigned&& ) id );
+        numScopes.store( id + 1, std::memory_order_release );
+
+        return id;
+    }
+
+    void Profiler::getStats( List<ProfilerScopeStats>& stats )
+    {
+        CriticalSection lock( statsMutex );
+
+        const unsigned count = numScopes.load( std::memory_order_acquire );
+
+        for ( unsigned i = 0; i < count; i++ )
+        {
+            const Scope& scope = scopes[i];
+
+            ProfilerScopeStats entry = { scope.name, scope.numCalls, scope.numFrames, scope.minFrameTime, scope.maxFrameTime, scope.totalFrameTime };
+            stats.add( ( ProfilerScopeStats&& ) entry );
+        }
+    }
+
+    Profiler::ThreadBuffer* Profiler::getThreadBuffer()
+    {
+        // Single-entry cache; keyed by instance id rather than by pointer so that a new profiler at a recycled address is never confused with a dead one
+        static thread_local unsigned cachedInstance = 0;
+        static thread_local ThreadBuffer* cachedBuffer = nullptr;
+
+        if ( cachedInstance == instanceId )
+            return cachedBuffer;
+
+        const std::thread::id threadId = std::this_thread::get_id();
+
+        CriticalSection lock( threadMutex );
+
+        ThreadBuffer* buffer = nullptr;
+
+        iterate ( threads )
+            if ( threads.current()->threadId == threadId )
+                buffer = threads.current();
+
+        if ( buffer == nullptr )
+        {
+            buffer = new ThreadBuffer;
+            buffer->threadId = threadId;
+            buffer->index = threads.getLength();
+            buffer->numEvents = 0;
+            memset( buffer->openScopes, 0, sizeof( buffer->openScopes ) );
+
+            threads.add( buffer );
+        }
+
+        cachedInstance = instanceId;
+        cachedBuffer = buffer;
+        return buffer;
+    }
+
+    void Profiler::leave( unsigned id )
+    {
+        const uint64_t end = Timer::getRelativeMicroseconds();
+
+        ThreadBuffer* buffer = getThreadBuffer();
+        const uint64_t begin = buffer->openScopes[id];
+
+        const uint64_t index = buffer->numEvents.load( std::memory_order_relaxed );
+        Event& event = buffer->events[index % ringSize];
+
+        // Pairs with the acquire fence in exportChromeTrace: a reader that sees any of this event's fields also sees `index`
+        std::atomic_thread_fence( std::memory_order_release );
+
+        event.scope = id;
+        event.begin = begin;
+        event.end = end;
+        buffer->numEvents.store( index + 1, std::memory_order_release );
+
+        Scope& scope = scopes[id];
+        scope.lastDelta.store( end - begin, std::memory_order_relaxed );
+        scope.frameTime.fetch_add( end - begin, std::memory_order_relaxed );
+        scope.frameCalls.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    void Profiler::markFrame()
+    {
+        CriticalSection lock( statsMutex );
+
+        frameMarks[numFrameMarks % maxFrameMarks] = Timer::getRelativeMicroseconds();
+        numFrameMarks++;
+
+        const unsigned count = numScopes.load( std::memory_order_acquire );
+
+        for ( unsigned i = 0; i < count; i++ )
+        {
+            Scope& scope = scopes[i];
+
+            const uint64_t calls = scope.frameCalls.exchange( 0, std::memory_order_relaxed );
+            const uint64_t time = scope.frameTime.exchange( 0, std::memory_order_relaxed );
+
+            if ( calls == 0 )
+                continue;
+
+            if ( scope.numFrames == 0 )
+            {
+                scope.minFrameTime = time;
+                scope.maxFrameTime = time;
+            }
+            else
+            {
+                scope.minFrameTime = minimum( scope.minFrameTime, time );
+                scope.maxFrameTime = maximum( scope.maxFrameTime, time );
+            }
+
+            scope.numCalls += calls;
+            scope.numFrames++;
+            scope.totalFrameTime += time;
+        }
     }
 
     void Profiler::printStats( OutputStream* output )
     {
-        if ( !sections.isEmpty() )
+        List<ProfilerScopeStats> stats;
+        getStats( stats );
+
+        const String header = "scope\tcalls\tframes\tmin (us)\tavg (us)\tmax (us)";
+
+        if ( output != nullptr )
+            output->writeLine( header );
+        else
+            printf( "%s\n", header.c_str() );
+
+        iterate2 ( i, stats )
         {
-            iterate2 ( i, sections )
-                ( *i ).printed = false;
+            const ProfilerScopeStats& scope = i;
+
+            if ( scope.numFrames == 0 )
+                continue;
+
+            const String line = scope.name + "\t" + String::formatInt( scope.numCalls ) + "\t" + String::formatInt( scope.numFrames )
+                    + "\t" + String::formatInt( scope.minFrameTime ) + "\t" + String::formatInt( scope.totalFrameTime / scope.numFrames )
+                    + "\t" + String::formatInt( scope.maxFrameTime );
 
-            printRangeStats( 0, 0, sections[0].begin, 0 );
+            if ( output != nullptr )
+                output->writeLine( line );
+            else
+                printf( "%s\n", line.c_str() );
         }
     }
 
     void Profiler::reenter( unsigned id )
     {
-        sections[id].begin = Timer::getRelativeMicroseconds();
+        getThreadBuffer()->openScopes[id] = Timer::getRelativeMicroseconds();
     }
 
     IProfiler* createProfiler( IEngine* engine )
@@ -32,6 +32,13 @@
 #include <StormGraph/IO/ModelLoader.hpp>
 
 #include <littl/File.hpp>
+#include <littl/HashMap.hpp>
+#include <littl/Thread.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace StormGraph
 {
@@ -47,21 +54,98 @@ namespace StormGraph
             virtual unsigned getLod( unsigned globalLod ) { return fixedValue; }
     };
 
+    li_enum_class( ResourceKind ) { font, material, model, soundStream, staticModel, texture, maxResourceKind };
+
+    class ResourceManager;
+
+    struct StreamingRequest
+    {
+        unsigned ticket;
+        ResourceKind kind;
+        String name;
+        int priority;
+        IStreamingListener* listener;
+
+        // Written by the worker which decodes the request
+        IResource* preload;
+        bool cancelled, failed;
+        String error;
+    };
+
+    class StreamingWorker : public Thread
+    {
+        ResourceManager* resMgr;
+
+        public:
+            StreamingWorker( ResourceManager* resMgr ) : resMgr( resMgr ) {}
+
+        protected:
+            virtual void run();
+    };
+
     class ResourceManager : public IResourceManager
     {
+        friend class StreamingWorker;
+
         protected:
             IEngine* engine;
             String name;
 
+            // Read by streaming workers (also through model loaders), hence the lock; use getResourcePaths to iterate
+            Mutex settingsMutex;
             List<String> resourcePaths;
             int loadFlags[( size_t ) LoadFlag::maxLoadFlag];
 
             Reference<IFileSystem> fileSystem;
+
+            // Guards `resources` and `index`; streaming workers register texture preloads while the owner thread is running
+            // Never held during file I/O, decoding or finalization
+            Mutex resourceMutex;
             List<IResource*> resources;
 
+            // Name-keyed index of `resources`, partitioned by resource kind
+            // Preloads share the slot of the resource they finalize into
+            HashMap<String, IResource*> index[( size_t ) ResourceKind::maxResourceKind];
+
+            // Streaming
+            // A request is in exactly one of the lists below, from streamModel/streamTexture until processStreaming hands it to the listener
+            Mutex streamingMutex;
+            List<StreamingRequest*> pendingRequests, activeRequests, completedRequests;
+            unsigned nextTicket;
+
+            List<StreamingWorker*> streamingWorkers;
+            unsigned numStreamingWorkers;
+            std::atomic<bool> stopStreaming;
+
+            // Idle workers sleep until new requests arrive (or they are stopped); the generation avoids lost wake-ups
+            std::mutex wakeMutex;
+            std::condition_variable wakeCondition;
+            uint64_t wakeGeneration;
+
+            IResource* decodeStreamed( StreamingRequest* request );
+            IResource* finalizeStreamed( StreamingRequest* request );
+            void runStreamingWorker();
+            void startStreamingWorkers();
+            void stopStreamingWorkers();
+            unsigned stream( ResourceKind kind, const char* name, int priority, IStreamingListener* listener );
+            void wakeStreamingWorkers();
+
+            static void releaseRequest( StreamingRequest* request );
+            static StreamingRequest* takeHighestPriority( List<StreamingRequest*>& queue );
+
+            IModel* finalizeModel( IModelPreload* preload );
+            ITexture* finalizeTexture( ITexturePreload* preload );
+
+            static String getFontKey( const char* name, unsigned size, unsigned style );
+            void getResourcePaths( List<String>& paths );
+            static bool getIndexKey( IResource* resource, ResourceKind* kind, String* key );
+
+            IResource** findIndexed( ResourceKind kind, const String& key );
+            void rebuildIndex();
+            void registerResource( IResource* resource, bool addToList = true );
+
             ILodFunction* getTextureLodFunction( const String& name );
 
-            Ct2Node* loadCtree2Node( InputStream* input );
             IFont* loadFont( const char* name, unsigned size, unsigned style );
             //IModel* loadModel( IModelPreload* preload );
             void loadSceneGraphGroup( ISceneGraph* sceneGraph, InputStream* input );
@@ -79,12 +163,14 @@ namespace StormGraph
 
             virtual void addPath( const char* path ) override;
 
+            virtual bool cancelStreaming( unsigned ticket ) override;
+
             virtual void finalizePreloads() override;
 
             virtual const char* getClassName() const { return "StormGraph.ResourceManager"; }
             virtual const char* getName() const { return name; }
 
-            virtual Ct2Node* loadCtree2( const char* name, bool required ) override;
+            virtual Ct2Tree* loadCtree2( const char* name, bool required ) override;
             virtual IModel* loadModel( const char* name ) override;
             virtual ISceneGraph* loadSceneGraph( const char* name, bool required ) override;
             virtual ITexture* loadTexture( const char* name ) override;
@@ -96,6 +182,7 @@ namespace StormGraph
             virtual IFont* getFont( const char* name, unsigned size, unsigned style );
             virtual int getLoadFlag( LoadFlag flag ) override;
             virtual IMaterial* getMaterial( const char* name, bool finalized );
+            virtual unsigned getNumPendingStreams() override;
             virtual IModel* getModel( const char* name );
             virtual ISoundStream* getSoundStream( const char* name );
             virtual IStaticModel* getStaticModel( const char* name, bool finalized, bool required ) override;
@@ -107,13 +194,21 @@ namespace StormGraph
 
             virtual void parseMaterial( const char* name, MaterialStaticProperties* properties ) override;
 
+            virtual size_t processStreaming( unsigned maxMicroseconds ) override;
+
             virtual void releaseUnused() override;
+            virtual bool removePath( const char* path ) override;
 
             virtual void setLoadFlag( LoadFlag flag, int value ) override;
+            virtual void setNumStreamingWorkers( unsigned numWorkers ) override;
+            virtual bool setStreamingPriority( unsigned ticket, int priority ) override;
+
+            virtual unsigned streamModel( const char* name, int priority, IStreamingListener* listener ) override;
+            virtual unsigned streamTexture( const char* name, int priority, IStreamingListener* listener ) override;
     };
 
     ResourceManager::ResourceManager( IEngine* engine, const char* name, bool addDefaultPath, IFileSystem* fileSystem )
-            : engine( engine ), name( name ), fileSystem( fileSystem )
+            : engine( engine ), name( name ), fileSystem( fileSystem ), nextTicket( 1 ), numStreamingWorkers( 0 ), stopStreaming( false ), wakeGeneration( 0 )
     {
         if ( addDefaultPath )
             resourcePaths.add( "" );
@@ -126,6 +221,14 @@ namespace StormGraph
 
     ResourceManager::~ResourceManager()
     {
+        stopStreamingWorkers();
+
+        iterate ( pendingRequests )
+            releaseRequest( pendingRequests.current() );
+
+        iterate ( completedRequests )
+            releaseRequest( completedRequests.current() );
+
         iterate ( resources )
             resources.current()->release();
 
@@ -134,47 +237,208 @@ namespace StormGraph
 
     void ResourceManager::addPath( const char* path )
     {
+        CriticalSection cs( settingsMutex );
+
         resourcePaths.add( path );
     }
 
+    bool ResourceManager::cancelStreaming( unsigned ticket )
+    {
+        CriticalSection cs( streamingMutex );
+
+        iterate ( pendingRequests )
+            if ( pendingRequests.current()->ticket == ticket )
+            {
+                releaseRequest( pendingRequests.current() );
+                pendingRequests.remove( pendingRequests.iter() );
+                return true;
+            }
+
+        // Can't interrupt a worker; it will drop the result when it's done
+        iterate ( activeRequests )
+            if ( activeRequests.current()->ticket == ticket )
+            {
+                activeRequests.current()->cancelled = true;
+                return true;
+            }
+
+        iterate ( completedRequests )
+            if ( completedRequests.current()->ticket == ticket )
+            {
+                releaseRequest( completedRequests.current() );
+                completedRequests.remove( completedRequests.iter() );
+                return true;
+            }
+
+        return false;
+    }
+
+    IResource* ResourceManager::decodeStreamed( StreamingRequest* request )
+    {
+        // Runs on a streaming worker. Nothing is uploaded to the graphics driver here.
+
+        {
+            CriticalSection cs( resourceMutex );
+
+            // Loaded (or at least preloaded) since the request was made; processStreaming will pick it up from the index
+            if ( findIndexed( request->kind, request->name ) != nullptr )
+                return nullptr;
+        }
+
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
+        {
+            IResource* preload;
+
+            if ( request->kind == ResourceKind::texture )
+                preload = preloadTexture( paths.current() + request->name );
+            else
+                preload = preloadModel( paths.current() + request->name );
+
+            if ( preload != nullptr )
+                return preload;
+        }
+
+        throw Exception( "StormGraph.ResourceManager.decodeStreamed", "ResourceLoadError",
+                ( String ) "Failed to load " + File::formatFileName( request->name ) + " (file not found)" );
+    }
+
+    IResource** ResourceManager::findIndexed( ResourceKind kind, const String& key )
+    {
+        return index[( size_t ) kind].find( key );
+    }
+
+    IModel* ResourceManager::finalizeModel( IModelPreload* preload )
+    {
+        // Only the owner thread replaces or removes registered resources, so `preload` stays valid while unlocked
+        IModel* model = preload->getFinalized();
+
+        CriticalSection cs( resourceMutex );
+
+        IResource** slot = findIndexed( ResourceKind::model, preload->getName() );
+
+        if ( slot != nullptr && *slot == preload )
+            *slot = model;
+
+        resources.removeItem( preload );
+        preload->release();
+
+        printf( "ResourceManager: registering finalized model `%s`\n", model->getName() );
+        resources.add( model );
+        return model->reference();
+    }
+
     void ResourceManager::finalizePreloads()
     {
-        reverse_iterate ( resources )
+        List<ITexturePreload*> preloads;
+
         {
-            ITexturePreload* preload = dynamic_cast<ITexturePreload*>( resources.current() );
+            CriticalSection cs( resourceMutex );
 
-            if ( preload )
+            reverse_iterate ( resources )
             {
-                ITexture* texture = preload->getFinalized();
-                preload->release();
-                resources.remove( resources.iter() );
+                ITexturePreload* preload = dynamic_cast<ITexturePreload*>( resources.current() );
 
-                printf( "ResourceManager: explicitly registering finalized texture `%s`\n", texture->getName() );
-                resources.add( texture );
+                if ( preload )
+                    preloads.add( preload );
             }
         }
+
+        iterate ( preloads )
+            finalizeTexture( preloads.current() )->release();
     }
 
-    IFont* ResourceManager::getFont( const char* name, unsigned size, unsigned style )
+    IResource* ResourceManager::finalizeStreamed( StreamingRequest* request )
     {
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
+        IResource* resource;
+
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( request->kind, request->name );
+
+            if ( slot != nullptr )
+                resource = *slot;
+            else
             {
-                IFont* font = dynamic_cast<IFont*>( resources.current() );
+                if ( request->preload == nullptr )
+                    throw Exception( "StormGraph.ResourceManager.finalizeStreamed", "ResourceLoadError",
+                            ( String ) "Resource " + File::formatFileName( request->name ) + " was released before it could be finalized" );
+
+                printf( "ResourceManager: registering streamed preload `%s`\n", request->preload->getName() );
 
-                if ( font && font->getSize() == size && font->getStyle() == style )
-                    return font->reference();
+                resource = request->preload;
+                registerResource( resource );
+                request->preload = nullptr;
             }
+        }
 
-        iterate ( resourcePaths )
+        // Lost a race with a synchronous load of the same resource
+        if ( request->preload != nullptr )
         {
-            IFont* font = loadFont( resourcePaths.current() + name, size, style );
+            request->preload->release();
+            request->preload = nullptr;
+        }
+
+        ITexturePreload* texturePreload = dynamic_cast<ITexturePreload*>( resource );
+
+        if ( texturePreload != nullptr )
+            return finalizeTexture( texturePreload );
+
+        IModelPreload* modelPreload = dynamic_cast<IModelPreload*>( resource );
+
+        if ( modelPreload != nullptr )
+            return finalizeModel( modelPreload );
+
+        return resource->reference();
+    }
+
+    ITexture* ResourceManager::finalizeTexture( ITexturePreload* preload )
+    {
+        // Only the owner thread replaces or removes registered resources, so `preload` stays valid while unlocked
+        ITexture* texture = preload->getFinalized();
+
+        CriticalSection cs( resourceMutex );
+
+        IResource** slot = findIndexed( ResourceKind::texture, preload->getName() );
+
+        if ( slot != nullptr && *slot == preload )
+            *slot = texture;
+
+        resources.removeItem( preload );
+        preload->release();
+
+        printf( "ResourceManager: registering finalized texture `%s`\n", texture->getName() );
+        resources.add( texture );
+        return texture->reference();
+    }
+
+    IFont* ResourceManager::getFont( const char* name, unsigned size, unsigned style )
+    {
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( ResourceKind::font, getFontKey( name, size, style ) );
+
+            if ( slot != nullptr )
+                return dynamic_cast<IFont*>( *slot )->reference();
+        }
+
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
+        {
+            IFont* font = loadFont( paths.current() + name, size, style );
 
             if ( font )
             {
                 //printf( "ResourceManager: registering font `%s`\n", name );
 
-                resources.add( font );
+                CriticalSection cs( resourceMutex );
+                registerResource( font );
                 return font->reference();
             }
         }
@@ -182,25 +446,68 @@ namespace StormGraph
         throw Exception( "StormGraph.ResourceManager.getFont", "FontLoadError", ( String ) "Failed to load font `" + name + "`" );
     }
 
+    String ResourceManager::getFontKey( const char* name, unsigned size, unsigned style )
+    {
+        return ( String ) name + "#" + String::formatInt( size ) + "#" + String::formatInt( style );
+    }
+
+    bool ResourceManager::getIndexKey( IResource* resource, ResourceKind* kind, String* key )
+    {
+        *key = resource->getName();
+
+        if ( dynamic_cast<ITexture*>( resource ) != nullptr || dynamic_cast<ITexturePreload*>( resource ) != nullptr )
+            *kind = ResourceKind::texture;
+        else if ( dynamic_cast<IMaterial*>( resource ) != nullptr )
+            *kind = ResourceKind::material;
+        else if ( dynamic_cast<IModel*>( resource ) != nullptr || dynamic_cast<IModelPreload*>( resource ) != nullptr )
+            *kind = ResourceKind::model;
+        else if ( dynamic_cast<IStaticModel*>( resource ) != nullptr )
+            *kind = ResourceKind::staticModel;
+        else if ( dynamic_cast<ISoundStream*>( resource ) != nullptr )
+            *kind = ResourceKind::soundStream;
+        else
+        {
+            IFont* font = dynamic_cast<IFont*>( resource );
+
+            if ( font == nullptr )
+                return false;
+
+            *kind = ResourceKind::font;
+            *key = getFontKey( resource->getName(), font->getSize(), font->getStyle() );
+        }
+
+        return true;
+    }
+
     int ResourceManager::getLoadFlag( LoadFlag flag )
     {
         SG_assert( ( size_t ) flag < ( size_t ) LoadFlag::maxLoadFlag )
 
+        CriticalSection cs( settingsMutex );
+
         return loadFlags[( size_t ) flag];
     }
 
+    void ResourceManager::getResourcePaths( List<String>& paths )
+    {
+        CriticalSection cs( settingsMutex );
+
+        iterate ( resourcePaths )
+            paths.add( resourcePaths.current() );
+    }
+
     IMaterial* ResourceManager::getMaterial( const char* name, bool finalized )
     {
         SG_assert ( finalized == true )
 
-        iterate2 ( resource, resources )
-            if ( String::equals( resource->getName(), name ) )
-            {
-                IMaterial* material = dynamic_cast<IMaterial*>( ( IResource* ) resource );
+        {
+            CriticalSection cs( resourceMutex );
 
-                if ( material != nullptr )
-                    return material->reference();
-            }
+            IResource** slot = findIndexed( ResourceKind::material, name );
+
+            if ( slot != nullptr )
+                return dynamic_cast<IMaterial*>( *slot )->reference();
+        }
 
         /*iterate ( resourcePaths )
         {
@@ -261,47 +568,47 @@ namespace StormGraph
 
         printf( "ResourceManager: registering material `%s`\n", name );
 
-        resources.add( material );
+        CriticalSection cs( resourceMutex );
+        registerResource( material );
         return material->reference();
     }
 
     IModel* ResourceManager::getModel( const char* name )
     {
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
+        IModelPreload* preload = nullptr;
+
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( ResourceKind::model, name );
+
+            if ( slot != nullptr )
             {
-                IModel* model = dynamic_cast<IModel*>( resources.current() );
+                IModel* model = dynamic_cast<IModel*>( *slot );
 
                 if ( model )
                     return model->reference();
+
+                preload = dynamic_cast<IModelPreload*>( *slot );
             }
+        }
 
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
-            {
-                IModelPreload* preload = dynamic_cast<IModelPreload*>( resources.current() );
+        if ( preload != nullptr )
+            return finalizeModel( preload );
 
-                if ( preload )
-                {
-                    IModel* model = preload->getFinalized();
-                    preload->release();
-                    resources.remove( resources.iter() );
-
-                    printf( "ResourceManager: registering finalized model `%s`\n", name );
-                    resources.add( model );
-                    return model->reference();
-                }
-            }
+        List<String> paths;
+        getResourcePaths( paths );
 
-        iterate ( resourcePaths )
+        iterate ( paths )
         {
-            Reference<IModel> model = loadModel( resourcePaths.current() + name );
+            Reference<IModel> model = loadModel( paths.current() + name );
 
             if ( model != nullptr )
             {
                 printf( "ResourceManager: registering model `%s`\n", name );
 
-                resources.add( model->reference() );
+                CriticalSection cs( resourceMutex );
+                registerResource( model->reference() );
                 return model.detach();
             }
         }
@@ -309,26 +616,37 @@ namespace StormGraph
         throw Exception( "StormGraph.ResourceManager.getModel", "ModelLoadError", ( String ) "Failed to load model " + File::formatFileName( name ) + " (file not found)" );
     }
 
+    unsigned ResourceManager::getNumPendingStreams()
+    {
+        CriticalSection cs( streamingMutex );
+
+        return pendingRequests.getLength() + activeRequests.getLength() + completedRequests.getLength();
+    }
+
     ISoundStream* ResourceManager::getSoundStream( const char* name )
     {
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
-            {
-                ISoundStream* soundStream = dynamic_cast<ISoundStream*>( resources.current() );
+        {
+            CriticalSection cs( resourceMutex );
 
-                if ( soundStream != nullptr )
-                    return soundStream->reference();
-            }
+            IResource** slot = findIndexed( ResourceKind::soundStream, name );
 
-        iterate ( resourcePaths )
+            if ( slot != nullptr )
+                return dynamic_cast<ISoundStream*>( *slot )->reference();
+        }
+
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
         {
-            ISoundStream* soundStream = openSoundStream( resourcePaths.current() + name );
+            ISoundStream* soundStream = openSoundStream( paths.current() + name );
 
             if ( soundStream != nullptr )
             {
                 printf( "ResourceManager: registering soundStream `%s`\n", name );
 
-                resources.add( soundStream );
+                CriticalSection cs( resourceMutex );
+                registerResource( soundStream );
                 return soundStream->reference();
             }
         }
@@ -339,27 +657,55 @@ namespace StormGraph
 
     IStaticModel* ResourceManager::getStaticModel( const char* name, bool finalized, bool required )
     {
-        iterate2 ( resource, resources )
-            if ( String::equals( resource->getName(), name ) )
+        IStaticModel* model = nullptr;
+
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( ResourceKind::staticModel, name );
+
+            if ( slot != nullptr )
+                model = dynamic_cast<IStaticModel*>( *slot );
+        }
+
+        if ( model != nullptr )
+        {
+            IStaticModel* finalizedModel = model->finalize();
+
+            if ( finalizedModel != model )
             {
-                IStaticModel* model = dynamic_cast<IStaticModel*>( ( IResource* ) resource );
+                CriticalSection cs( resourceMutex );
 
-                if ( model != nullptr )
-                {
-                    resource = static_cast<IResource*>( model = model->finalize() );
-                    return model->reference();
-                }
+                // finalize() may hand back a different object; keep both the list and the index pointing at it
+                iterate2 ( resource, resources )
+                    if ( ( IResource* ) resource == static_cast<IResource*>( model ) )
+                    {
+                        resource = static_cast<IResource*>( finalizedModel );
+                        break;
+                    }
+
+                IResource** slot = findIndexed( ResourceKind::staticModel, name );
+
+                if ( slot != nullptr )
+                    *slot = finalizedModel;
             }
 
-        iterate ( resourcePaths )
+            return finalizedModel->reference();
+        }
+
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
         {
-            Reference<SeekableInputStream> input = fileSystem->openInput( resourcePaths.current() + name );
+            Reference<SeekableInputStream> input = fileSystem->openInput( paths.current() + name );
 
             if ( input != nullptr )
             {
                 Reference<IStaticModel> model = ModelLoader::loadStaticModel( engine->getGraphicsDriver(), name, input.detach(), this, finalized );
 
-                resources.add( model->reference() );
+                CriticalSection cs( resourceMutex );
+                registerResource( model->reference() );
                 return model.detach();
             }
         }
@@ -369,41 +715,40 @@ namespace StormGraph
 
     ITexture* ResourceManager::getTexture( const char* name )
     {
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
+        ITexturePreload* preload = nullptr;
+
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( ResourceKind::texture, name );
+
+            if ( slot != nullptr )
             {
-                ITexture* texture = dynamic_cast<ITexture*>( resources.current() );
+                ITexture* texture = dynamic_cast<ITexture*>( *slot );
 
                 if ( texture != nullptr )
                     return texture->reference();
-            }
 
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
-            {
-                ITexturePreload* preload = dynamic_cast<ITexturePreload*>( resources.current() );
+                preload = dynamic_cast<ITexturePreload*>( *slot );
+            }
+        }
 
-                if ( preload != nullptr )
-                {
-                    ITexture* texture = preload->getFinalized();
-                    preload->release();
-                    resources.remove( resources.iter() );
+        if ( preload != nullptr )
+            return finalizeTexture( preload );
 
-                    printf( "ResourceManager: registering finalized texture `%s`\n", name );
-                    resources.add( texture );
-                    return texture->reference();
-                }
-            }
+        List<String> paths;
+        getResourcePaths( paths );
 
-        iterate ( resourcePaths )
+        iterate ( paths )
         {
-            ITexture* texture = loadTexture( resourcePaths.current() + name );
+            ITexture* texture = loadTexture( paths.current() + name );
 
             if ( texture )
             {
                 printf( "ResourceManager: registering texture `%s`\n", name );
 
-                resources.add( texture );
+                CriticalSection cs( resourceMutex );
+                registerResource( texture );
                 return texture->reference();
             }
         }
@@ -433,37 +778,56 @@ namespace StormGraph
         *texturePreloadPtr = 0;
 
         if ( texturePtr )
-        {
             *texturePtr = 0;
 
-            iterate ( resources )
-                if ( String::equals( resources.current()->getName(), name ) )
+        // Also called from streaming workers (model preloads), hence the locking
+        {
+            CriticalSection cs( resourceMutex );
+
+            IResource** slot = findIndexed( ResourceKind::texture, name );
+
+            if ( slot != nullptr )
+            {
+                if ( texturePtr )
                 {
-                    *texturePtr = dynamic_cast<ITexture*>( resources.current() );
+                    *texturePtr = dynamic_cast<ITexture*>( *slot );
 
                     if ( *texturePtr )
                         return true;
                 }
-        }
 
-        iterate ( resources )
-            if ( String::equals( resources.current()->getName(), name ) )
-            {
-                *texturePreloadPtr = dynamic_cast<ITexturePreload*>( resources.current() );
+                *texturePreloadPtr = dynamic_cast<ITexturePreload*>( *slot );
 
                 if ( *texturePreloadPtr )
                     return false;
             }
+        }
 
-        iterate ( resourcePaths )
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
         {
-            ITexturePreload* preload = preloadTexture( resourcePaths.current() + name );
+            ITexturePreload* preload = preloadTexture( paths.current() + name );
 
             if ( preload )
             {
+                CriticalSection cs( resourceMutex );
+
+                // Another thread may have preloaded the same texture while we were decoding
+                IResource** slot = findIndexed( ResourceKind::texture, name );
+
+                if ( slot != nullptr && dynamic_cast<ITexturePreload*>( *slot ) != nullptr )
+                {
+                    preload->release();
+
+                    *texturePreloadPtr = dynamic_cast<ITexturePreload*>( *slot )->reference();
+                    return false;
+                }
+
                 printf( "ResourceManager: registering texture preload `%s`\n", name );
 
-                resources.add( preload );
+                registerResource( preload );
 
                 *texturePreloadPtr = preload->reference();
                 return false;
@@ -512,49 +876,18 @@ namespace StormGraph
         initialized->receivesShadows = properties->receivesShadows;
     }
 
-    Ct2Node* ResourceManager::loadCtree2( const char* name, bool required )
+    Ct2Tree* ResourceManager::loadCtree2( const char* name, bool required )
     {
         Reference<SeekableInputStream> input = fileSystem->openInput( name );
 
         if ( input != nullptr )
-            return loadCtree2Node( input );
+            return Ct2Tree::load( input );
         else if ( required )
             throw Exception( "StormGraph.ResourceManager.loadCtree2", "Ctree2LoadError", ( String ) "Failed to load collision tree `" + name + "`." );
 
         return nullptr;
     }
 
-    Ct2Node* ResourceManager::loadCtree2Node( InputStream* input )
-    {
-        Object<Ct2Node> node = new Ct2Node;
-
-        SG_assert( input->readItems<Vector2<float>>( node->bounds, 2 ) == 2 )
-
-        uint32_t numLines;
-
-        SG_assert( input->readItems<uint32_t>( &numLines, 1 ) == 1 )
-
-        for ( size_t i = 0; i < numLines; i++ )
-        {
-            Ct2Line line;
-
-            SG_assert( input->readItems<Vector2<>>( &line.a, 1 ) == 1 )
-            SG_assert( input->readItems<Vector2<>>( &line.b, 1 ) == 1 )
-
-            line.recalc();
-
-            node->lines.add( line );
-        }
-
-        if ( input->read<uint8_t>() != 0 )
-        {
-            node->children[0] = loadCtree2Node( input );
-            node->children[1] = loadCtree2Node( input );
-        }
-
-        return node.detach();
-    }
-
     IFont* ResourceManager::loadFont( const char* name, unsigned size, unsigned style )
     {
         SeekableInputStream* input = fileSystem->openInput( name );
@@ -682,9 +1015,12 @@ namespace StormGraph
 
     void ResourceManager::parseMaterial( const char* name, MaterialStaticProperties* properties )
     {
-        iterate ( resourcePaths )
+        List<String> paths;
+        getResourcePaths( paths );
+
+        iterate ( paths )
         {
-            cfx2::Document materialDoc = engine->loadCfx2Asset( resourcePaths.current() + name, false, fileSystem );
+            cfx2::Document materialDoc = engine->loadCfx2Asset( paths.current() + name, false, fileSystem );
 
             if ( materialDoc.isOk() )
             {
@@ -752,28 +1088,333 @@ namespace StormGraph
 
     void ResourceManager::listResources()
     {
+        CriticalSection cs( resourceMutex );
+
         iterate ( resources )
             printf( " - %s `%s`\n", resources.current()->getClassName(), resources.current()->getName() );
     }
 
+    size_t ResourceManager::processStreaming( unsigned maxMicroseconds )
+    {
+        const uint64_t start = Timer::getRelativeMicroseconds();
+        size_t numCompleted = 0;
+
+        for ( ; ; )
+        {
+            StreamingRequest* request;
+
+            {
+                CriticalSection cs( streamingMutex );
+
+                request = takeHighestPriority( completedRequests );
+            }
+
+            if ( request == nullptr )
+                break;
+
+            IResource* resource = nullptr;
+
+            if ( !request->failed )
+            {
+                try
+                {
+                    resource = finalizeStreamed( request );
+                }
+                catch ( Exception& ex )
+                {
+                    request->failed = true;
+                    request->error = ex.getDesc();
+                }
+            }
+
+            if ( request->listener != nullptr )
+                request->listener->onStreamingComplete( this, request->ticket, resource, request->failed ? request->error.c_str() : nullptr );
+
+            if ( resource != nullptr )
+                resource->release();
+
+            releaseRequest( request );
+            numCompleted++;
+
+            if ( Timer::getRelativeMicroseconds() - start >= maxMicroseconds )
+                break;
+        }
+
+        return numCompleted;
+    }
+
+    void ResourceManager::rebuildIndex()
+    {
+        for ( size_t i = 0; i < ( size_t ) ResourceKind::maxResourceKind; i++ )
+            index[i].clear();
+
+        // The first resource registered under a key wins, the same as the lookup order before indexing
+        iterate ( resources )
+            registerResource( resources.current(), false );
+    }
+
+    void ResourceManager::registerResource( IResource* resource, bool addToList )
+    {
+        if ( addToList )
+            resources.add( resource );
+
+        ResourceKind kind;
+        String key;
+
+        if ( !getIndexKey( resource, &kind, &key ) )
+            return;
+
+        if ( findIndexed( kind, key ) == nullptr )
+            index[( size_t ) kind].set( ( String&& ) key, ( IResource*&& ) resource );
+    }
+
+    void ResourceManager::releaseRequest( StreamingRequest* request )
+    {
+        if ( request->preload != nullptr )
+            request->preload->release();
+
+        delete request;
+    }
+
     void ResourceManager::releaseUnused()
     {
+        CriticalSection cs( resourceMutex );
+
+        bool removedAny = false;
+
         reverse_iterate ( resources )
             if ( !resources.current()->hasOtherReferences() )
             {
                 printf( "releaseUnused(): removing %s `%s`\n", resources.current()->getClassName(), resources.current()->getName() );
                 resources.current()->release();
                 resources.remove( resources.iter() );
+
+                removedAny = true;
+            }
+
+        if ( removedAny )
+            rebuildIndex();
+    }
+
+    bool ResourceManager::removePath( const char* path )
+    {
+        CriticalSection cs( settingsMutex );
+
+        iterate ( resourcePaths )
+            if ( resourcePaths.current() == path )
+            {
+                resourcePaths.remove( resourcePaths.iter() );
+                return true;
             }
+
+        return false;
+    }
+
+    void ResourceManager::runStreamingWorker()
+    {
+        while ( !stopStreaming )
+        {
+            uint64_t generation;
+
+            {
+                std::lock_guard<std::mutex> lock( wakeMutex );
+                generation = wakeGeneration;
+            }
+
+            StreamingRequest* request;
+
+            {
+                CriticalSection cs( streamingMutex );
+
+                request = takeHighestPriority( pendingRequests );
+
+                if ( request != nullptr )
+                    activeRequests.add( request );
+            }
+
+            if ( request == nullptr )
+            {
+                std::unique_lock<std::mutex> lock( wakeMutex );
+
+                wakeCondition.wait( lock, [this, generation] { return wakeGeneration != generation || stopStreaming; } );
+                continue;
+            }
+
+            try
+            {
+                request->preload = decodeStreamed( request );
+            }
+            catch ( Exception& ex )
+            {
+                request->failed = true;
+                request->error = ex.getDesc();
+            }
+
+            CriticalSection cs( streamingMutex );
+
+            activeRequests.removeItem( request );
+
+            if ( request->cancelled )
+                releaseRequest( request );
+            else
+                completedRequests.add( request );
+        }
     }
 
     void ResourceManager::setLoadFlag( LoadFlag flag, int value )
     {
         SG_assert( ( size_t ) flag < ( size_t ) LoadFlag::maxLoadFlag )
 
+        CriticalSection cs( settingsMutex );
+
         loadFlags[( size_t ) flag] = value;
     }
 
+    void ResourceManager::setNumStreamingWorkers( unsigned numWorkers )
+    {
+        // Workers finish the request they're on; the new count takes effect with the next request
+        stopStreamingWorkers();
+
+        numStreamingWorkers = numWorkers;
+
+        if ( getNumPendingStreams() > 0 )
+            startStreamingWorkers();
+    }
+
+    bool ResourceManager::setStreamingPriority( unsigned ticket, int priority )
+    {
+        CriticalSection cs( streamingMutex );
+
+        iterate ( pendingRequests )
+            if ( pendingRequests.current()->ticket == ticket )
+            {
+                pendingRequests.current()->priority = priority;
+                return true;
+            }
+
+        iterate ( activeRequests )
+            if ( activeRequests.current()->ticket == ticket )
+            {
+                activeRequests.current()->priority = priority;
+                return true;
+            }
+
+        iterate ( completedRequests )
+            if ( completedRequests.current()->ticket == ticket )
+            {
+                completedRequests.current()->priority = priority;
+                return true;
+            }
+
+        return false;
+    }
+
+    void ResourceManager::startStreamingWorkers()
+    {
+        if ( !streamingWorkers.isEmpty() )
+            return;
+
+        unsigned numWorkers = numStreamingWorkers;
+
+        // Leave one hardware thread to the owner thread
+        if ( numWorkers == 0 )
+            numWorkers = maximum( std::thread::hardware_concurrency(), 2u ) - 1;
+
+        for ( unsigned i = 0; i < numWorkers; i++ )
+        {
+            StreamingWorker* worker = new StreamingWorker( this );
+            streamingWorkers.add( worker );
+            worker->start();
+        }
+    }
+
+    void ResourceManager::stopStreamingWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock( wakeMutex );
+            stopStreaming = true;
+        }
+
+        wakeCondition.notify_all();
+
+        iterate ( streamingWorkers )
+        {
+            streamingWorkers.current()->waitFor();
+            delete streamingWorkers.current();
+        }
+
+        streamingWorkers.clear();
+        stopStreaming = false;
+    }
+
+    unsigned ResourceManager::stream( ResourceKind kind, const char* name, int priority, IStreamingListener* listener )
+    {
+        StreamingRequest* request = new StreamingRequest;
+        request->kind = kind;
+        request->name = name;
+        request->priority = priority;
+        request->listener = listener;
+        request->preload = nullptr;
+        request->cancelled = false;
+        request->failed = false;
+
+        unsigned ticket;
+
+        {
+            CriticalSection cs( streamingMutex );
+
+            ticket = request->ticket = nextTicket++;
+            pendingRequests.add( request );
+        }
+
+        startStreamingWorkers();
+        wakeStreamingWorkers();
+
+        return ticket;
+    }
+
+    unsigned ResourceManager::streamModel( const char* name, int priority, IStreamingListener* listener )
+    {
+        return stream( ResourceKind::model, name, priority, listener );
+    }
+
+    unsigned ResourceManager::streamTexture( const char* name, int priority, IStreamingListener* listener )
+    {
+        return stream( ResourceKind::texture, name, priority, listener );
+    }
+
+    StreamingRequest* ResourceManager::takeHighestPriority( List<StreamingRequest*>& queue )
+    {
+        if ( queue.isEmpty() )
+            return nullptr;
+
+        // Oldest first among requests of equal priority
+        size_t best = 0;
+
+        for ( size_t i = 1; i < queue.getLength(); i++ )
+            if ( queue[i]->priority > queue[best]->priority )
+                best = i;
+
+        StreamingRequest* request = queue[best];
+        queue.remove( best );
+        return request;
+    }
+
+    void ResourceManager::wakeStreamingWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock( wakeMutex );
+            wakeGeneration++;
+        }
+
+        wakeCondition.notify_one();
+    }
+
+    void StreamingWorker::run()
+    {
+        resMgr->runStreamingWorker();
+    }
+
     IResourceManager* createResourceManager( IEngine* engine, const char* name, bool addDefaultPath, IFileSystem* fileSystem )
     {
         return new ResourceManager( engine, name, addDefaultPath, fileSystem );
@@ -23,13 +23,94 @@
 
 #include <StormGraph/Engine.hpp>
 #include <StormGraph/SceneGraph.hpp>
+#include <StormGraph/ViewFrustum.hpp>
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+
 namespace StormGraph
 {
     class SceneGraph;
 
+    // Maps shadow map clip space [-1, 1] to texture space [0, 1]
+    static const glm::mat4 shadowBiasMatrix( 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f );
+
+    // Common base of all nodes that draw geometry and can therefore be culled
+    class DrawableNode
+    {
+        public:
+            // World-space bounding box; ignored if !bounded
+            Vector<> bounds[2];
+            bool bounded;
+
+        public:
+            DrawableNode() : bounded( false ) {}
+            virtual ~DrawableNode() {}
+
+            virtual void render() = 0;
+
+            // Colour pass; nodes that can be sorted by the queue submit themselves, the rest draw immediately
+            virtual void render( IRenderQueue* renderQueue ) { render(); }
+    };
+
+    /**
+     *  Transformation of a model node together with its composed matrix.
+     *
+     *  Model nodes have no parents, so the local matrix doubles as the world matrix. Changing any of the transforms
+     *  only marks the matrix dirty; SceneGraph recomposes all the dirty ones in a single pass before drawing.
+     */
+    struct NodeTransform
+    {
+        // rotation about Z, X, Y; translation
+        Transform transforms[4];
+
+        // Transform::matrix; out of date while dirty
+        Transform world;
+        bool dirty;
+
+        NodeTransform() : world( glm::mat4() ), dirty( false ) {}
+
+        static void markDirty( NodeTransform* transform, List<NodeTransform*>& dirtyList );
+        static void updateDirty( List<NodeTransform*>& dirtyList );
+    };
+
+    /**
+     *  Bounding volume hierarchy over the scene graph's drawable nodes.
+     *
+     *  The tree topology is rebuilt only when nodes are added; moving nodes only refits the boxes.
+     *  Nodes are stored in pre-order, so every child has a higher index than its parent.
+     */
+    class NodeBvh
+    {
+        struct BvhNode
+        {
+            Vector<> bounds[2];
+
+            // Inner nodes: index of the second child (the first one immediately follows)
+            // Leaves: drawable != nullptr
+            size_t secondChild;
+            DrawableNode* drawable;
+        };
+
+        List<BvhNode> nodes;
+        List<DrawableNode*> unbounded;
+
+        size_t build( DrawableNode** drawables, size_t count );
+        void cullNode( size_t index, const ViewFrustum* frustum, bool fullyInside, List<DrawableNode*>& visible, unsigned& numCulled );
+        static size_t countLeaves( const List<BvhNode>& nodes, size_t index );
+
+        public:
+            bool needsRebuild, needsRefit;
+
+        public:
+            NodeBvh() : needsRebuild( false ), needsRefit( false ) {}
+
+            void cull( const ViewFrustum* frustum, List<DrawableNode*>& visible, unsigned& numCulled );
+            void rebuild( const List<DrawableNode*>& drawables );
+            void refit();
+    };
+
     class DirectionalLightNode : public IDirectionalLightNode
     {
         public:
@@ -60,43 +141,66 @@ namespace StormGraph
             glm::mat4 lightProjection, lightView;
             float shadowFov;
 
+            bool castsShadows, isStatic;
+
+            // Shadow map state: rendered at least once; out of date since the light or geometry in its range changed
+            bool hasShadowMap, shadowDirty;
+
+            // Selection for the current frame
+            float influence;
+            bool shadowed;
+
             //Transform transforms[1];
 
+            void updateView();
+
         public:
             PointLightNode( SceneGraph* sceneGraph, const PointLightProperties& properties, bool cubeShadowMapping, float shadowFov, unsigned shadowMapDetail );
             virtual ~PointLightNode();
 
-            void render();
+            float getScreenInfluence( const ViewFrustum* frustum ) const;
+            bool isShadowCached() const;
+            bool isInRange( const Vector<> bounds[2] ) const;
+            virtual bool isShadowed() override { return shadowed; }
+            void render( ITexture* shadowMap );
             //void render( IRenderQueue* renderQueue );
-
             void renderDepthBuffer();
+            virtual void setCastsShadows( bool castsShadows ) override { this->castsShadows = castsShadows; }
+            virtual void setProperties( const PointLightProperties& properties ) override;
+            virtual void setStatic( bool isStatic ) override { this->isStatic = isStatic; }
     };
 
-    class ModelNode : public IModelNode
+    class ModelNode : public IModelNode, public DrawableNode
     {
+        SceneGraph* sceneGraph;
         Reference<IModel> model;
         //Vector<> pos, yawPitchRoll;
 
-        Transform transforms[4];
+        NodeTransform transform;
+
+        // The model is only ever rotated about its origin, so a sphere of this radius around the position bounds it
+        float boundingRadius;
+
+        void updateBounds();
 
         public:
-            ModelNode( IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll );
+            ModelNode( SceneGraph* sceneGraph, IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll );
 
-            virtual Vector<> getPos() override { return transforms[3].vector; }
+            virtual Vector<> getPos() override { return transform.transforms[3].vector; }
             virtual void move( const Vector<>& vec, bool absolute = false ) override;
-            void render();
-            //void render( IRenderQueue* renderQueue );
-            virtual void setYaw( float yaw ) override { transforms[0].angle = yaw; }
+            virtual void render() override;
+            virtual void render( IRenderQueue* renderQueue ) override;
+            virtual void setYaw( float yaw ) override;
     };
 
-    class StaticModelNode : public IStaticModelNode
+    class StaticModelNode : public IStaticModelNode, public DrawableNode
     {
         Reference<IStaticModel> model;
 
         public:
-            StaticModelNode( IStaticModel* model ) : model( model ) {}
+            StaticModelNode( IStaticModel* model ) : model( model ) { bounded = model->getBounds( bounds ); }
 
-            void render() { model->render(); }
+            virtual void render() override { model->render(); }
             //void render( IRenderQueue* renderQueue );
     };
 
@@ -111,11 +215,37 @@ namespace StormGraph
 
             List<DirectionalLightNode*> directionalLights;
             List<PointLightNode*> pointLights;
+
+            // pointLights ordered by their influence on the last frame (best first)
+            List<PointLightNode*> rankedLights;
+
+            unsigned maxShadowedLights, maxShadowUpdates;
+            SceneShadowStats shadowStats;
+
+            // Bound for lights without a shadow map of their own (cleared to the far plane, so it never shadows anything)
+            Reference<ITexture> blankShadowMap;
             
             List<StaticModelNode*> staticModels;
             List<ModelNode*> models;
 
-            void renderScene();
+            List<DrawableNode*> drawables;
+            NodeBvh bvh;
+
+            // Model nodes whose matrices need to be recomposed
+            List<NodeTransform*> dirtyTransforms;
+
+            // Per-pass scratch list, kept to avoid reallocating it every frame
+            List<DrawableNode*> visibleNodes;
+
+            // Sorts the colour pass by state and depth and instances runs of the same mesh; depth passes draw directly
+            Object<IRenderQueue> renderQueue;
+
+            SceneCullingStats cullingStats;
+
+            void invalidateShadows( const DrawableNode* node );
+            void rankLights();
+            void renderDrawables( const List<DrawableNode*>& nodes, IRenderQueue* renderQueue );
+            void renderScene( const ViewFrustum* frustum, IRenderQueue* renderQueue, unsigned& numDrawn, unsigned& numCulled );
 
         public:
             SceneGraph( IEngine* engine, const String& name );
@@ -126,11 +256,15 @@ namespace StormGraph
             virtual IModelNode* addModel( IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll ) override;
             virtual IStaticModelNode* addStaticModel( IStaticModel* model ) override;
             virtual const char* getClassName() const { return "StormGraph.SceneGraph"; }
+            virtual void getCullingStats( SceneCullingStats* stats ) override { *stats = cullingStats; }
+            virtual void getShadowStats( SceneShadowStats* stats ) override { *stats = shadowStats; }
             virtual const char* getName() const { return name; }
             virtual void prerender() override;
             virtual void render() override;
             //virtual void render( IRenderQueue* renderQueue ) override;
+            virtual void setInstancing( bool enabled ) override { renderQueue->setInstancing( enabled ); }
             virtual void setSceneAmbient( const Colour& sceneAmbient ) override { this->sceneAmbient = sceneAmbient; };
+            virtual void setShadowBudget( unsigned maxShadowedLights, unsigned maxUpdates ) override;
     };
 
     DirectionalLightNode::DirectionalLightNode( SceneGraph* sceneGraph, const DirectionalLightProperties& properties )
@@ -154,7 +288,8 @@ namespace StormGraph
     }*/
 
     PointLightNode::PointLightNode( SceneGraph* sceneGraph, const PointLightProperties& properties, bool cubeShadowMapping, float shadowFov, unsigned shadowMapDetail )
-            : sceneGraph( sceneGraph ), properties( properties ), shadowFov( shadowFov )
+            : sceneGraph( sceneGraph ), properties( properties ), shadowFov( shadowFov ), castsShadows( true ), isStatic( false ),
+            hasShadowMap( false ), shadowDirty( true ), influence( 0.0f ), shadowed( false )
     {
         graphicsDriver = sceneGraph->graphicsDriver;
 
@@ -162,18 +297,19 @@ namespace StormGraph
 
         lightProjection = glm::perspective( shadowFov, 1.0f, 2.0f, 10.0f );
 
+        // Every light gets its own name, so that the passes can be told apart in a command log
+        const String index = String::formatInt( sceneGraph->pointLights.getLength() );
+
         if ( !cubeShadowMapping )
         {
-            depthTexture = sceneGraph->graphicsDriver->createDepthTexture( "PointLightNode.depthTexture", Vector2<unsigned>( shadowMapDetail, shadowMapDetail ) );
+            depthTexture = sceneGraph->graphicsDriver->createDepthTexture( "PointLightNode.depthTexture#" + index, Vector2<unsigned>( shadowMapDetail, shadowMapDetail ) );
             depthBuffer = sceneGraph->graphicsDriver->createRenderBuffer( depthTexture->reference() );
 
-            glm::vec3 up = properties.direction.x != 0 ? glm::vec3( -properties.direction.y, properties.direction.x, properties.direction.z )
-                : glm::vec3( properties.direction.x, properties.direction.z, -properties.direction.y );
-            lightView = glm::mat4() * glm::lookAt( properties.pos, properties.pos + properties.direction, up );
+            updateView();
         }
         else
         {
-            depthCubeMap = sceneGraph->graphicsDriver->createDepthCubeMap( "PointLightNode.depthCubeMap", Vector2<unsigned>( shadowMapDetail, shadowMapDetail ) );
+            depthCubeMap = sceneGraph->graphicsDriver->createDepthCubeMap( "PointLightNode.depthCubeMap#" + index, Vector2<unsigned>( shadowMapDetail, shadowMapDetail ) );
             depthBuffer = sceneGraph->graphicsDriver->createRenderBuffer( depthCubeMap->reference() );
         }
     }
@@ -182,28 +318,84 @@ namespace StormGraph
     {
     }
 
-    void PointLightNode::render()
+    float PointLightNode::getScreenInfluence( const ViewFrustum* frustum ) const
+    {
+        const Vector<> pos( properties.pos.x, properties.pos.y, properties.pos.z );
+
+        if ( frustum == nullptr )
+            return 1.0f;
+
+        if ( frustum->sphereInFrustum( pos, properties.range ) == ViewFrustum::outside )
+            return 0.0f;
+
+        // Roughly the share of the view the light can reach: 1 with the eye (the centre of the near plane) inside its range,
+        // falling off with the square of the distance beyond that
+        const Vector<> eye = ( frustum->ntl + frustum->nbr ) * 0.5f;
+        const float distanceSquared = ( pos - eye ).getLength() * ( pos - eye ).getLength();
+        const float rangeSquared = properties.range * properties.range;
+
+        const float brightness = maximum( maximum( properties.diffuse.r, properties.diffuse.g ), properties.diffuse.b );
+
+        return rangeSquared / maximum( distanceSquared, maximum( rangeSquared, 0.0001f ) ) * maximum( brightness, 0.01f );
+    }
+
+    bool PointLightNode::isInRange( const Vector<> bounds[2] ) const
+    {
+        // Squared distance from the light to the closest point of the box
+        const float pos[3] = { properties.pos.x, properties.pos.y, properties.pos.z };
+        const float min[3] = { bounds[0].x, bounds[0].y, bounds[0].z };
+        const float max[3] = { bounds[1].x, bounds[1].y, bounds[1].z };
+
+        float distanceSquared = 0.0f;
+
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            if ( pos[axis] < min[axis] )
+                distanceSquared += ( min[axis] - pos[axis] ) * ( min[axis] - pos[axis] );
+            else if ( pos[axis] > max[axis] )
+                distanceSquared += ( pos[axis] - max[axis] ) * ( pos[axis] - max[axis] );
+        }
+
+        return distanceSquared <= properties.range * properties.range;
+    }
+
+    bool PointLightNode::isShadowCached() const
+    {
+        return isStatic && hasShadowMap && !shadowDirty;
+    }
+
+    void PointLightNode::render( ITexture* shadowMap )
     {
         //light->render( transforms, lengthof( transforms ) );
 
         int index = graphicsDriver->addPointLight( properties, true );
 
-        if ( index >= 0 )
-            graphicsDriver->setPointLightShadowMap( index, depthTexture, glm::mat4( 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f ) * lightProjection * lightView );
+        if ( index >= 0 && shadowMap != nullptr )
+            graphicsDriver->setPointLightShadowMap( index, shadowMap, shadowBiasMatrix * lightProjection * lightView );
     }
 
     void PointLightNode::renderDepthBuffer()
     {
         if ( depthBuffer != nullptr )
         {
+            // lightView is only set up for single-texture shadow maps
+            ViewFrustum lightFrustum;
+
+            if ( depthTexture != nullptr )
+                lightFrustum.setViewProjection( lightProjection * lightView );
+
             graphicsDriver->pushRenderBuffer( depthBuffer );
             graphicsDriver->clear();
             graphicsDriver->setProjection( lightProjection );
             graphicsDriver->setViewTransform( lightView );
             //graphicsDriver->beginDepthRendering();
-            sceneGraph->renderScene();
+            sceneGraph->renderScene( depthTexture != nullptr ? &lightFrustum : nullptr, nullptr,
+                    sceneGraph->cullingStats.numShadowDrawn, sceneGraph->cullingStats.numShadowCulled );
             //graphicsDriver->endDepthRendering();
             graphicsDriver->popRenderBuffer();
+
+            hasShadowMap = true;
+            shadowDirty = false;
         }
 
         //First pass - from light's point of view
@@ -234,37 +426,274 @@ namespace StormGraph
         glColorMask(1, 1, 1, 1);*/
     }
 
-    ModelNode::ModelNode( IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll )
-            : model( model )
+    void PointLightNode::setProperties( const PointLightProperties& properties )
+    {
+        this->properties = properties;
+
+        if ( depthTexture != nullptr )
+            updateView();
+
+        shadowDirty = true;
+    }
+
+    void PointLightNode::updateView()
     {
-        transforms[0] = Transform( Transform::rotate, Vector<>( 0.0f, 0.0f, 1.0f ), yawPitchRoll.z );
-        transforms[1] = Transform( Transform::rotate, Vector<>( 1.0f, 0.0f, 0.0f ), yawPitchRoll.y );
-        transforms[2] = Transform( Transform::rotate, Vector<>( 0.0f, 1.0f, 0.0f ), yawPitchRoll.x );
-        transforms[3] = Transform( Transform::translate, pos );
+        glm::vec3 up = properties.direction.x != 0 ? glm::vec3( -properties.direction.y, properties.direction.x, properties.direction.z )
+            : glm::vec3( properties.direction.x, properties.direction.z, -properties.direction.y );
+        lightView = glm::mat4() * glm::lookAt( properties.pos, properties.pos + properties.direction, up );
+    }
+
+    ModelNode::ModelNode( SceneGraph* sceneGraph, IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll )
+            : sceneGraph( sceneGraph ), model( model ), boundingRadius( 0.0f )
+    {
+        transform.transforms[0] = Transform( Transform::rotate, Vector<>( 0.0f, 0.0f, 1.0f ), yawPitchRoll.z );
+        transform.transforms[1] = Transform( Transform::rotate, Vector<>( 1.0f, 0.0f, 0.0f ), yawPitchRoll.y );
+        transform.transforms[2] = Transform( Transform::rotate, Vector<>( 0.0f, 1.0f, 0.0f ), yawPitchRoll.x );
+        transform.transforms[3] = Transform( Transform::translate, pos );
+
+        NodeTransform::markDirty( &transform, sceneGraph->dirtyTransforms );
+
+        Vector<> modelBounds[2];
+
+        if ( model->getBounds( modelBounds ) )
+        {
+            // The farthest point of a box from the origin is always one of its corners
+            for ( int i = 0; i < 8; i++ )
+            {
+                const Vector<> corner( modelBounds[i & 1].x, modelBounds[( i >> 1 ) & 1].y, modelBounds[( i >> 2 ) & 1].z );
+                boundingRadius = maximum( boundingRadius, corner.getLength() );
+            }
+
+            bounded = true;
+            updateBounds();
+        }
     }
 
     void ModelNode::move( const Vector<>& vec, bool absolute )
     {
+        // Lights that saw the node where it was and where it ends up
+        sceneGraph->invalidateShadows( this );
+
         if ( absolute )
-            transforms[3].vector = vec;
+            transform.transforms[3].vector = vec;
         else
-            transforms[3].vector += vec;
+            transform.transforms[3].vector += vec;
+
+        NodeTransform::markDirty( &transform, sceneGraph->dirtyTransforms );
+
+        if ( bounded )
+        {
+            updateBounds();
+            sceneGraph->bvh.needsRefit = true;
+        }
+
+        sceneGraph->invalidateShadows( this );
     }
 
     void ModelNode::render()
     {
-        model->render( transforms, lengthof( transforms ) );
+        model->render( &transform.world, 1 );
     }
 
-    /*void ModelNode::render( IRenderQueue* renderQueue )
+    void ModelNode::render( IRenderQueue* renderQueue )
     {
-        renderQueue->add( model, transforms, 4 );
-    }*/
+        renderQueue->add( model, &transform.world, 1 );
+    }
+
+    void ModelNode::setYaw( float yaw )
+    {
+        transform.transforms[0].angle = yaw;
+        NodeTransform::markDirty( &transform, sceneGraph->dirtyTransforms );
+
+        // The bounds don't change with rotation
+        sceneGraph->invalidateShadows( this );
+    }
+
+    void ModelNode::updateBounds()
+    {
+        const Vector<> extent( boundingRadius, boundingRadius, boundingRadius );
+
+        bounds[0] = transform.transforms[3].vector - extent;
+        bounds[1] = transform.transforms[3].vector + extent;
+    }
+
+    void NodeTransform::markDirty( NodeTransform* transform, List<NodeTransform*>& dirtyList )
+    {
+        if ( !transform->dirty )
+        {
+            transform->dirty = true;
+            dirtyList.add( transform );
+        }
+    }
+
+    void NodeTransform::updateDirty( List<NodeTransform*>& dirtyList )
+    {
+        iterate2 ( i, dirtyList )
+        {
+            NodeTransform* transform = i;
+
+            transform->world.transformation = Transform::compose( transform->transforms, lengthof( transform->transforms ) );
+            transform->dirty = false;
+        }
+
+        dirtyList.clear();
+    }
+
+    size_t NodeBvh::build( DrawableNode** drawables, size_t count )
+    {
+        const size_t index = nodes.getLength();
+
+        BvhNode node;
+        node.bounds[0] = drawables[0]->bounds[0];
+        node.bounds[1] = drawables[0]->bounds[1];
+
+        for ( size_t i = 1; i < count; i++ )
+        {
+            const Vector<>* bounds = drawables[i]->bounds;
+
+            node.bounds[0] = Vector<>( minimum( node.bounds[0].x, bounds[0].x ), minimum( node.bounds[0].y, bounds[0].y ), minimum( node.bounds[0].z, bounds[0].z ) );
+            node.bounds[1] = Vector<>( maximum( node.bounds[1].x, bounds[1].x ), maximum( node.bounds[1].y, bounds[1].y ), maximum( node.bounds[1].z, bounds[1].z ) );
+        }
+
+        node.secondChild = 0;
+        node.drawable = nullptr;
+
+        if ( count == 1 )
+        {
+            node.drawable = drawables[0];
+            nodes.add( node );
+            return index;
+        }
+
+        // Split at the median centre along the longest axis of the centres' extent
+        Vector<> centreMin = ( drawables[0]->bounds[0] + drawables[0]->bounds[1] ) * 0.5f, centreMax = centreMin;
+
+        for ( size_t i = 1; i < count; i++ )
+        {
+            const Vector<> centre = ( drawables[i]->bounds[0] + drawables[i]->bounds[1] ) * 0.5f;
+
+            centreMin = Vector<>( minimum( centreMin.x, centre.x ), minimum( centreMin.y, centre.y ), minimum( centreMin.z, centre.z ) );
+            centreMax = Vector<>( maximum( centreMax.x, centre.x ), maximum( centreMax.y, centre.y ), maximum( centreMax.z, centre.z ) );
+        }
+
+        const Vector<> extent = centreMax - centreMin;
+        const int axis = ( extent.x >= extent.y && extent.x >= extent.z ) ? 0 : ( extent.y >= extent.z ? 1 : 2 );
+
+        std::nth_element( drawables, drawables + count / 2, drawables + count, [axis]( DrawableNode* a, DrawableNode* b )
+        {
+            const Vector<> ca = a->bounds[0] + a->bounds[1], cb = b->bounds[0] + b->bounds[1];
+
+            return ( axis == 0 ) ? ca.x < cb.x : ( ( axis == 1 ) ? ca.y < cb.y : ca.z < cb.z );
+        } );
+
+        nodes.add( node );
+
+        build( drawables, count / 2 );
+        const size_t secondChild = build( drawables + count / 2, count - count / 2 );
+
+        nodes[index].secondChild = secondChild;
+        return index;
+    }
+
+    void NodeBvh::cull( const ViewFrustum* frustum, List<DrawableNode*>& visible, unsigned& numCulled )
+    {
+        iterate2 ( i, unbounded )
+            visible.add( i );
+
+        if ( !nodes.isEmpty() )
+            cullNode( 0, frustum, frustum == nullptr, visible, numCulled );
+    }
+
+    void NodeBvh::cullNode( size_t index, const ViewFrustum* frustum, bool fullyInside, List<DrawableNode*>& visible, unsigned& numCulled )
+    {
+        const BvhNode& node = nodes[index];
+
+        if ( !fullyInside )
+        {
+            ViewFrustum::TestResult result = frustum->boxInFrustum( node.bounds[0], node.bounds[1] );
+
+            if ( result == ViewFrustum::outside )
+            {
+                numCulled += countLeaves( nodes, index );
+                return;
+            }
+
+            fullyInside = ( result == ViewFrustum::inside );
+        }
+
+        if ( node.drawable != nullptr )
+        {
+            visible.add( node.drawable );
+            return;
+        }
+
+        cullNode( index + 1, frustum, fullyInside, visible, numCulled );
+        cullNode( node.secondChild, frustum, fullyInside, visible, numCulled );
+    }
+
+    size_t NodeBvh::countLeaves( const List<BvhNode>& nodes, size_t index )
+    {
+        if ( nodes[index].drawable != nullptr )
+            return 1;
+
+        return countLeaves( nodes, index + 1 ) + countLeaves( nodes, nodes[index].secondChild );
+    }
+
+    void NodeBvh::rebuild( const List<DrawableNode*>& drawables )
+    {
+        nodes.clear();
+        unbounded.clear();
+
+        List<DrawableNode*> bounded;
+
+        iterate2 ( i, drawables )
+        {
+            if ( i->bounded )
+                bounded.add( i );
+            else
+                unbounded.add( i );
+        }
+
+        if ( !bounded.isEmpty() )
+            build( bounded.getPtrUnsafe(), bounded.getLength() );
+
+        needsRebuild = false;
+
+        // Covers any nodes moved since the last frame and clears needsRefit
+        refit();
+    }
+
+    void NodeBvh::refit()
+    {
+        for ( size_t i = nodes.getLength(); i-- > 0; )
+        {
+            BvhNode& node = nodes[i];
+
+            if ( node.drawable != nullptr )
+            {
+                node.bounds[0] = node.drawable->bounds[0];
+                node.bounds[1] = node.drawable->bounds[1];
+            }
+            else
+            {
+                const BvhNode& a = nodes[i + 1], & b = nodes[node.secondChild];
+
+                node.bounds[0] = Vector<>( minimum( a.bounds[0].x, b.bounds[0].x ), minimum( a.bounds[0].y, b.bounds[0].y ), minimum( a.bounds[0].z, b.bounds[0].z ) );
+                node.bounds[1] = Vector<>( maximum( a.bounds[1].x, b.bounds[1].x ), maximum( a.bounds[1].y, b.bounds[1].y ), maximum( a.bounds[1].z, b.bounds[1].z ) );
+            }
+        }
+
+        needsRefit = false;
+    }
 
     SceneGraph::SceneGraph( IEngine* engine, const String& name )
-            : engine( engine ), name( name )
+            : engine( engine ), name( name ), maxShadowedLights( 4 ), maxShadowUpdates( 4 )
     {
         graphicsDriver = engine->getGraphicsDriver();
+        renderQueue = graphicsDriver->createRenderQueue();
+
+        memset( &cullingStats, 0, sizeof( cullingStats ) );
+        memset( &shadowStats, 0, sizeof( shadowStats ) );
     }
 
     SceneGraph::~SceneGraph()
@@ -293,13 +722,17 @@ namespace StormGraph
     {
         PointLightNode* node = new PointLightNode( this, properties, cubeShadowMapping, fov, shadowMapDetail );
         pointLights.add( node );
+        rankedLights.add( node );
         return node;
     }
 
     IModelNode* SceneGraph::addModel( IModel* model, const Vector<>& pos, const Vector<>& yawPitchRoll )
     {
-        ModelNode* node = new ModelNode( model, pos, yawPitchRoll );
+        ModelNode* node = new ModelNode( this, model, pos, yawPitchRoll );
         models.add( node );
+        drawables.add( node );
+        bvh.needsRebuild = true;
+        invalidateShadows( node );
         return node;
     }
 
@@ -307,13 +740,94 @@ namespace StormGraph
     {
         StaticModelNode* node = new StaticModelNode( model );
         staticModels.add( node );
+        drawables.add( node );
+        bvh.needsRebuild = true;
+        invalidateShadows( node );
         return node;
     }
 
-    void SceneGraph::prerender()
+    void SceneGraph::invalidateShadows( const DrawableNode* node )
     {
         iterate2 ( i, pointLights )
-            i->renderDepthBuffer();
+            if ( !node->bounded || i->isInRange( node->bounds ) )
+                i->shadowDirty = true;
+    }
+
+    void SceneGraph::prerender()
+    {
+        cullingStats.numShadowDrawn = 0;
+        cullingStats.numShadowCulled = 0;
+
+        memset( &shadowStats, 0, sizeof( shadowStats ) );
+        shadowStats.numLights = pointLights.getLength();
+
+        rankLights();
+
+        bool needsBlankShadowMap = false;
+
+        iterate2 ( i, rankedLights )
+        {
+            PointLightNode* light = i;
+
+            light->shadowed = false;
+
+            // Cube shadow maps aren't implemented
+            if ( !light->castsShadows || light->depthTexture == nullptr )
+            {
+                needsBlankShadowMap = true;
+                continue;
+            }
+
+            shadowStats.numCasters++;
+
+            if ( light->influence > 0.0f && shadowStats.numShadowed < maxShadowedLights )
+            {
+                if ( light->isShadowCached() )
+                    shadowStats.numReused++;
+                else if ( shadowStats.numUpdated < maxShadowUpdates )
+                {
+                    light->renderDepthBuffer();
+                    shadowStats.numUpdated++;
+                }
+                else
+                {
+                    // Its last map is out of date; it goes without shadows until there's room for an update
+                    shadowStats.numDeferred++;
+                    needsBlankShadowMap = true;
+                    continue;
+                }
+
+                light->shadowed = true;
+                shadowStats.numShadowed++;
+            }
+            else
+                needsBlankShadowMap = true;
+        }
+
+        if ( needsBlankShadowMap && blankShadowMap == nullptr )
+        {
+            blankShadowMap = graphicsDriver->createDepthTexture( "SceneGraph.blankShadowMap", Vector2<unsigned>( 1, 1 ) );
+
+            Reference<IRenderBuffer> renderBuffer = graphicsDriver->createRenderBuffer( blankShadowMap->reference() );
+
+            graphicsDriver->pushRenderBuffer( renderBuffer );
+            graphicsDriver->clear();
+            graphicsDriver->popRenderBuffer();
+        }
+    }
+
+    void SceneGraph::rankLights()
+    {
+        const ViewFrustum* frustum = graphicsDriver->getViewFrustum();
+
+        iterate2 ( i, rankedLights )
+            i->influence = i->getScreenInfluence( frustum );
+
+        // Stable, so that equally ranked lights keep their order between frames
+        std::stable_sort( rankedLights.getPtrUnsafe(), rankedLights.getPtrUnsafe() + rankedLights.getLength(), []( PointLightNode* a, PointLightNode* b )
+        {
+            return a->influence > b->influence;
+        } );
     }
 
     void SceneGraph::render()
@@ -325,18 +839,30 @@ namespace StormGraph
         iterate2 ( i, directionalLights )
             i->render();
 
-        iterate2 ( i, pointLights )
-            i->render();
+        // Best ranked first, so that they get the driver's light slots
+        // The fixed-function shadow mapping path only supports a single light; that's the best ranked shadowed one
+        PointLightNode* primary = nullptr;
+
+        // Lights not selected this frame get the blank map, never a stale one of their own
+        iterate2 ( i, rankedLights )
+        {
+            i->render( i->shadowed ? i->depthTexture : blankShadowMap );
 
-        //glm::mat4 biasMatrix = glm::translate( glm::scale( glm::mat4(), glm::vec3( 0.5f, 0.5f, 0.5f ) ), glm::vec3( 1.0f, 1.0f, 1.0f ) );
-        const glm::mat4 biasMatrix( 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f );
-        const glm::mat4 textureMatrix = biasMatrix * pointLights[0]->lightProjection * pointLights[0]->lightView;
+            if ( primary == nullptr && i->shadowed )
+                primary = i;
+        }
 
-        graphicsDriver->beginShadowMapping( pointLights[0]->depthTexture, textureMatrix );
+        if ( primary != nullptr )
+            graphicsDriver->beginShadowMapping( primary->depthTexture, shadowBiasMatrix * primary->lightProjection * primary->lightView );
 
-        renderScene();
+        cullingStats.numDrawn = 0;
+        cullingStats.numCulled = 0;
 
-        graphicsDriver->endShadowMapping();
+        renderScene( graphicsDriver->getViewFrustum(), renderQueue, cullingStats.numDrawn, cullingStats.numCulled );
+        renderQueue->getInstancingStats( &cullingStats.numInstanced, &cullingStats.numInstanceBatches );
+
+        if ( primary != nullptr )
+            graphicsDriver->endShadowMapping();
     }
 
     /*void SceneGraph::render( IRenderQueue* renderQueue )
@@ -348,13 +874,40 @@ namespace StormGraph
             i->render( renderQueue );
     }*/
 
-    void SceneGraph::renderScene()
+    void SceneGraph::setShadowBudget( unsigned maxShadowedLights, unsigned maxUpdates )
     {
-        iterate2 ( i, staticModels )
-            i->render();
+        this->maxShadowedLights = maxShadowedLights;
+        this->maxShadowUpdates = maxUpdates;
+    }
 
-        iterate2 ( i, models )
-            i->render();
+    void SceneGraph::renderDrawables( const List<DrawableNode*>& nodes, IRenderQueue* renderQueue )
+    {
+        iterate2 ( i, nodes )
+        {
+            if ( renderQueue != nullptr )
+                i->render( renderQueue );
+            else
+                i->render();
+        }
+    }
+
+    void SceneGraph::renderScene( const ViewFrustum* frustum, IRenderQueue* renderQueue, unsigned& numDrawn, unsigned& numCulled )
+    {
+        NodeTransform::updateDirty( dirtyTransforms );
+
+        if ( bvh.needsRebuild )
+            bvh.rebuild( drawables );
+        else if ( bvh.needsRefit )
+            bvh.refit();
+
+        visibleNodes.clear();
+        bvh.cull( frustum, visibleNodes, numCulled );
+
+        numDrawn += visibleNodes.getLength();
+        renderDrawables( visibleNodes, renderQueue );
+
+        if ( renderQueue != nullptr )
+            renderQueue->render();
     }
 
     ISceneGraph* createSceneGraph( IEngine* engine, const char* name )
@@ -31,7 +31,8 @@ namespace StormGraph
 {
     static BspNode* readNode( InputStream* input, unsigned indexSize )
     {
-        Object<BspNode> node = new BspNode;
+        // Nodes don't delete their children, so a failed read has to free the subtree read so far
+        BspNodeGuard node( new BspNode );
 
         node->bounds[0] = input->read<Vector<float>>();
         node->bounds[1] = input->read<Vector<float>>();
@@ -76,115 +77,265 @@ namespace StormGraph
         return node.detach();
     }
 
-    static BspTree* doLoad( InputStream* input, IResourceManager* resMgr )
+    static void readMaterial( InputStream* input, BspTree* tree, IResourceManager* resMgr )
     {
-        Reference<> inputGuard( input );
+        String name = input->readString();
+        bool isEmbedded = input->read<uint8_t>() != 0;
 
-        /*String header = input->readString();
+        if ( isEmbedded )
+        {
+            Object<MaterialStaticProperties> properties = new MaterialStaticProperties;
+            //printf( "[Cbsp] Material %s\n", name.c_str() );
 
-        if ( header != "Sg_Bsp#0" )
-            throw Exception( "StormGraph.BspLoader.doLoad", "StreamFormatError", "The input is not a valid StormGraph BSP file" );*/
+            properties->colour = Colour::fromRgbaUint32( input->read<uint32_t>() );
+            //printf( "[Cbsp] Material Colour %s\n", properties->colour.toString().c_str() );
 
-        Object<BspTree> tree = new BspTree;
+            properties->numTextures = input->read<uint32_t>();
+            //printf( "[Cbsp] Textures %u\n", properties->numTextures );
 
-        unsigned indexSize = input->read<uint8_t>();
+            for ( unsigned i = 0; i < properties->numTextures; i++ )
+                properties->textureNames[i] = input->readString();
 
-        size_t numMaterials = input->read<uint32_t>();
-        tree->materials.resize( numMaterials );
+            properties->dynamicLighting = input->read<uint8_t>() != 0;
+            //printf( "[Cbsp] dynamicLighting %i\n", properties->dynamicLighting );
+
+            if ( properties->dynamicLighting )
+            {
+                properties->dynamicLightingResponse.ambient = Colour::fromRgbaUint32( input->read<uint32_t>() );
+                properties->dynamicLightingResponse.diffuse = Colour::fromRgbaUint32( input->read<uint32_t>() );
+                properties->dynamicLightingResponse.emissive = Colour::fromRgbaUint32( input->read<uint32_t>() );
+                properties->dynamicLightingResponse.specular = Colour::fromRgbaUint32( input->read<uint32_t>() );
+                properties->dynamicLightingResponse.shininess = input->read<float>();
+            }
+
+            properties->lightMapping = input->read<uint8_t>() != 0;
+            //printf( "[Cbsp] lightMapping %i\n\n", properties->lightMapping );
+
+            if ( properties->lightMapping )
+            {
+                if ( resMgr->getLoadFlag( LoadFlag::useLightMapping ) != 0 )
+                    properties->lightMapName = input->readString();
+                else
+                    input->readString();
+            }
+
+            properties->castsShadows = input->read<uint8_t>() != 0;
+            properties->receivesShadows = input->read<uint8_t>() != 0;
+
+            switch ( resMgr->getLoadFlag( LoadFlag::useShadowMapping ) )
+            {
+                case 0: properties->receivesShadows = false; break;
+                case 1: properties->receivesShadows = true; break;
+            }
+
+#ifdef li_GCC4
+            tree->materials.add( BspMaterial { name, properties.detach() } );
+#else
+            BspMaterial mat = { name, properties.detach() };
+            tree->materials.add( ( BspMaterial&& ) mat );
+#endif
+        }
+        else
+#ifdef li_GCC4
+            tree->materials.add( BspMaterial { name, nullptr } );
+#else
+        {
+            BspMaterial mat = { name, nullptr };
+            tree->materials.add( ( BspMaterial&& ) mat );
+        }
+#endif
+    }
+
+    static inline bool isBlockValid( uint32_t offset, uint32_t count, size_t unitSize, uint64_t end )
+    {
+        return offset >= sizeof( BspBlockHeader ) && offset % bspBlockAlignment == 0 && offset + ( uint64_t ) count * unitSize <= end;
+    }
+
+    // Sg_Bsp#1: all geometry follows the material table in aligned blocks, fetched with a single read
+    static void readBlocks( InputStream* input, BspTree* tree, unsigned indexSize, Array<uint32_t>& numVertices, size_t numMaterials )
+    {
+        BspBlockHeader header;
+
+        if ( input->read( &header, sizeof( header ) ) != sizeof( header ) )
+            throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Unexpected end of BSP file" );
+
+        const uint64_t end = header.indexOffset + ( uint64_t ) header.numIndices * indexSize;
+
+        if ( !isBlockValid( header.vertexOffset, header.numVertices, sizeof( BspBlockVertex ), end )
+                || !isBlockValid( header.nodeOffset, header.numNodes, sizeof( BspBlockNode ), end )
+                || !isBlockValid( header.meshOffset, header.numMeshes, sizeof( BspBlockMesh ), end )
+                || !isBlockValid( header.indexOffset, header.numIndices, indexSize, end ) )
+            throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Invalid BSP block layout" );
+
+        // The tree keeps the blocks, so that meshes can refer to the index block in place
+        tree->blockData = new uint8_t[( size_t ) end];
+        memcpy( tree->blockData, &header, sizeof( header ) );
+
+        const size_t remaining = ( size_t ) end - sizeof( header );
+
+        if ( input->read( tree->blockData + sizeof( header ), remaining ) != remaining )
+            throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Unexpected end of BSP file" );
+
+        // Vertices
+        const BspBlockVertex* vertices = ( const BspBlockVertex* )( tree->blockData + header.vertexOffset );
+        size_t vertexIndex = 0;
 
         for ( size_t i = 0; i < numMaterials; i++ )
         {
-            String name = input->readString();
-            bool isEmbedded = input->read<uint8_t>() != 0;
+            if ( vertexIndex + numVertices[i] > header.numVertices )
+                throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "BSP vertex block too short" );
+
+            tree->vertices[i].resize( numVertices[i] );
 
-            if ( isEmbedded )
+            for ( size_t j = 0; j < numVertices[i]; j++, vertexIndex++ )
             {
-                Object<MaterialStaticProperties> properties = new MaterialStaticProperties;
-                //printf( "[Cbsp] Material %s\n", name.c_str() );
+                const BspBlockVertex& in = vertices[vertexIndex];
+                Vertex v;
 
-                properties->colour = Colour::fromRgbaUint32( input->read<uint32_t>() );
-                //printf( "[Cbsp] Material Colour %s\n", properties->colour.toString().c_str() );
+                v.pos = Vector<float>( in.pos[0], in.pos[1], in.pos[2] );
+                v.normal = Vector<float>( in.normal[0], in.normal[1], in.normal[2] );
+                v.uv[0] = Vector2<float>( in.uv[0], in.uv[1] );
+                v.lightUv = Vector2<float>( in.lightUv[0], in.lightUv[1] );
 
-                properties->numTextures = input->read<uint32_t>();
-                //printf( "[Cbsp] Textures %u\n", properties->numTextures );
+                tree->vertices[i].add( v );
+            }
+        }
 
-                for ( unsigned i = 0; i < properties->numTextures; i++ )
-                    properties->textureNames[i] = input->readString();
+        // Nodes and meshes, allocated as one block each
+        const BspBlockNode* nodes = ( const BspBlockNode* )( tree->blockData + header.nodeOffset );
+        const BspBlockMesh* meshes = ( const BspBlockMesh* )( tree->blockData + header.meshOffset );
+        const unsigned* indices;
 
-                properties->dynamicLighting = input->read<uint8_t>() != 0;
-                //printf( "[Cbsp] dynamicLighting %i\n", properties->dynamicLighting );
+        if ( header.numNodes == 0 )
+            return;
 
-                if ( properties->dynamicLighting )
-                {
-                    properties->dynamicLightingResponse.ambient = Colour::fromRgbaUint32( input->read<uint32_t>() );
-                    properties->dynamicLightingResponse.diffuse = Colour::fromRgbaUint32( input->read<uint32_t>() );
-                    properties->dynamicLightingResponse.emissive = Colour::fromRgbaUint32( input->read<uint32_t>() );
-                    properties->dynamicLightingResponse.specular = Colour::fromRgbaUint32( input->read<uint32_t>() );
-                    properties->dynamicLightingResponse.shininess = input->read<float>();
-                }
+        if ( indexSize == 2 )
+        {
+            const uint16_t* in16 = ( const uint16_t* )( tree->blockData + header.indexOffset );
 
-                properties->lightMapping = input->read<uint8_t>() != 0;
-                //printf( "[Cbsp] lightMapping %i\n\n", properties->lightMapping );
+            tree->wideIndices = new unsigned[header.numIndices];
 
-                if ( properties->lightMapping )
-                {
-                    if ( resMgr->getLoadFlag( LoadFlag::useLightMapping ) != 0 )
-                        properties->lightMapName = input->readString();
-                    else
-                        input->readString();
-                }
+            for ( size_t i = 0; i < header.numIndices; i++ )
+                tree->wideIndices[i] = in16[i];
 
-                properties->castsShadows = input->read<uint8_t>() != 0;
-                properties->receivesShadows = input->read<uint8_t>() != 0;
+            indices = tree->wideIndices;
+        }
+        else
+            indices = ( const unsigned* )( tree->blockData + header.indexOffset );
 
-                switch ( resMgr->getLoadFlag( LoadFlag::useShadowMapping ) )
-                {
-                    case 0: properties->receivesShadows = false; break;
-                    case 1: properties->receivesShadows = true; break;
-                }
+        tree->meshBlock = new BspMesh[header.numMeshes];
 
-#ifdef li_GCC4
-                tree->materials.add( BspMaterial { name, properties.detach() } );
-#else
-                BspMaterial mat = { name, properties.detach() };
-                tree->materials.add( ( BspMaterial&& ) mat );
-#endif
-            }
-            else
-#ifdef li_GCC4
-                tree->materials.add( BspMaterial { name, nullptr } );
-#else
+        for ( size_t i = 0; i < header.numMeshes; i++ )
+        {
+            if ( ( uint64_t ) meshes[i].firstIndex + meshes[i].numIndices > header.numIndices || meshes[i].material >= numMaterials )
+                throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Invalid BSP index range" );
+
+            BspMesh* mesh = &tree->meshBlock[i];
+
+            mesh->material = meshes[i].material;
+            mesh->blockIndices = indices + meshes[i].firstIndex;
+            mesh->numBlockIndices = meshes[i].numIndices;
+        }
+
+        tree->nodeBlock = new BspNode[header.numNodes];
+        tree->numNodes = header.numNodes;
+
+        for ( size_t i = 0; i < header.numNodes; i++ )
+        {
+            const BspBlockNode& in = nodes[i];
+            BspNode* node = &tree->nodeBlock[i];
+
+            node->bounds[0] = Vector<float>( in.bounds[0][0], in.bounds[0][1], in.bounds[0][2] );
+            node->bounds[1] = Vector<float>( in.bounds[1][0], in.bounds[1][1], in.bounds[1][2] );
+
+            if ( ( uint64_t ) in.firstMesh + in.numMeshes > header.numMeshes )
+                throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Invalid BSP mesh range" );
+
+            node->meshes.resize( in.numMeshes );
+
+            for ( size_t j = in.firstMesh; j < in.firstMesh + in.numMeshes; j++ )
+                node->meshes.add( &tree->meshBlock[j] );
+
+            // Pre-order guarantees that children come after their parent, which rules out cycles
+            if ( in.children[0] != 0 || in.children[1] != 0 )
             {
-                BspMaterial mat = { name, nullptr };
-                tree->materials.add( ( BspMaterial&& ) mat );
+                if ( in.children[0] <= i || in.children[1] <= i || in.children[0] >= header.numNodes || in.children[1] >= header.numNodes )
+                    throw Exception( "StormGraph.BspLoader.readBlocks", "StreamFormatError", "Invalid BSP node link" );
+
+                node->children[0] = &tree->nodeBlock[in.children[0]];
+                node->children[1] = &tree->nodeBlock[in.children[1]];
             }
-#endif
+        }
+
+        tree->root = &tree->nodeBlock[0];
+    }
+
+    static BspTree* doLoad( InputStream* input, IResourceManager* resMgr )
+    {
+        Reference<> inputGuard( input );
+
+        String header = input->readString();
+        unsigned revision;
+
+        if ( header == "Sg_Bsp#0" )
+            revision = 0;
+        else if ( header == "Sg_Bsp#1" )
+            revision = 1;
+        else
+            throw Exception( "StormGraph.BspLoader.doLoad", "StreamFormatError", "The input is not a valid StormGraph BSP file" );
+
+        Object<BspTree> tree = new BspTree;
+
+        unsigned indexSize = input->read<uint8_t>();
+
+        if ( indexSize != 2 && indexSize != 4 )
+            throw Exception( "StormGraph.BspLoader.doLoad", "StreamFormatError", "Invalid BSP index size" );
+
+        size_t numMaterials = input->read<uint32_t>();
+        tree->materials.resize( numMaterials );
 
-            size_t numVertices = input->read<uint32_t>();
+        Array<uint32_t> numVertices( numMaterials );
+
+        for ( size_t i = 0; i < numMaterials; i++ )
+        {
+            readMaterial( input, tree, resMgr );
+
+            numVertices[i] = input->read<uint32_t>();
             tree->totalTriangles[i] = input->read<uint32_t>();
 
             //printf( "@@ READ: MaterialGroup %"PRIuPTR" contains %"PRIuPTR" vertices\n", i, numVertices );
 
-            tree->vertices[i].resize( numVertices );
-
-            for ( size_t j = 0; j < numVertices; j++ )
+            if ( revision == 0 )
             {
-                Vertex v;
+                tree->vertices[i].resize( numVertices[i] );
 
-                v.pos = input->read<Vector<float>>();
-                v.normal = input->read<Vector<float>>();
-                v.uv[0] = input->read<Vector2<float>>();
-                v.lightUv = input->read<Vector2<float>>();
+                for ( size_t j = 0; j < numVertices[i]; j++ )
+                {
+                    Vertex v;
 
-                tree->vertices[i].add( v );
+                    v.pos = input->read<Vector<float>>();
+                    v.normal = input->read<Vector<float>>();
+                    v.uv[0] = input->read<Vector2<float>>();
+                    v.lightUv = input->read<Vector2<float>>();
+
+                    tree->vertices[i].add( v );
+                }
             }
         }
 
-        tree->root = readNode( input, indexSize );
+        if ( revision == 0 )
+            tree->root = readNode( input, indexSize );
+        else
+            readBlocks( input, tree, indexSize, numVertices, numMaterials );
 
         return tree.detach();
     }
 
+    BspTree* BspLoader::loadTree( SeekableInputStream* input, IResourceManager* resMgr )
+    {
+        return doLoad( input, resMgr );
+    }
+
     IStaticModel* BspLoader::loadStaticModel( IGraphicsDriver* driver, const char* name, SeekableInputStream* input, IResourceManager* resMgr, bool finalized )
     {
         Object<BspTree> tree = doLoad( input, resMgr );
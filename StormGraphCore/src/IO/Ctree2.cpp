@@ -0,0 +1,180 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include <StormGraph/IO/Ctree2.hpp>
+
+namespace StormGraph
+{
+    // On-disk node header: bounds[2], numLines
+    struct Ct2NodeRecord
+    {
+        float bounds[2][2];
+        uint32_t numLines;
+    };
+
+    static void flattenNode( Ct2Tree* tree, const Ct2Node* node )
+    {
+        Ct2Tree::Node flat;
+
+        flat.bounds[0] = node->bounds[0];
+        flat.bounds[1] = node->bounds[1];
+        flat.firstLine = tree->lines.getLength();
+        flat.numLines = node->lines.getLength();
+
+        iterate2 ( i, node->lines )
+            tree->lines.add( i );
+
+        const size_t index = tree->nodes.add( flat );
+
+        if ( node->children[0] != nullptr && node->children[1] != nullptr )
+        {
+            flattenNode( tree, node->children[0] );
+            flattenNode( tree, node->children[1] );
+        }
+
+        tree->nodes[index].next = tree->nodes.getLength();
+    }
+
+    static void loadNode( Ct2Tree* tree, InputStream* input, Array<float>& lineBuffer )
+    {
+        Ct2NodeRecord record;
+
+        if ( input->read( &record, sizeof( record ) ) != sizeof( record ) )
+            throw Exception( "StormGraph.Ct2Tree.load", "Ctree2LoadError", "Unexpected end of collision tree" );
+
+        Ct2Tree::Node flat;
+
+        flat.bounds[0] = Vector2<>( record.bounds[0][0], record.bounds[0][1] );
+        flat.bounds[1] = Vector2<>( record.bounds[1][0], record.bounds[1][1] );
+        flat.firstLine = tree->lines.getLength();
+        flat.numLines = record.numLines;
+
+        // All of the node's segments in one read
+        const size_t numFloats = record.numLines * 4;
+
+        if ( lineBuffer.getCapacity() < numFloats )
+            lineBuffer.resize( numFloats, false );
+
+        if ( input->read( lineBuffer.getPtr(), numFloats * sizeof( float ) ) != numFloats * sizeof( float ) )
+            throw Exception( "StormGraph.Ct2Tree.load", "Ctree2LoadError", "Unexpected end of collision tree" );
+
+        for ( size_t i = 0; i < record.numLines; i++ )
+        {
+            Ct2Line line;
+
+            line.a = Vector2<>( lineBuffer[i * 4], lineBuffer[i * 4 + 1] );
+            line.b = Vector2<>( lineBuffer[i * 4 + 2], lineBuffer[i * 4 + 3] );
+            line.recalc();
+
+            tree->lines.add( line );
+        }
+
+        const size_t index = tree->nodes.add( flat );
+
+        if ( input->read<uint8_t>() != 0 )
+        {
+            loadNode( tree, input, lineBuffer );
+            loadNode( tree, input, lineBuffer );
+        }
+
+        tree->nodes[index].next = tree->nodes.getLength();
+    }
+
+    Ct2Tree* Ct2Tree::fromNodes( const Ct2Node* root )
+    {
+        Object<Ct2Tree> tree = new Ct2Tree;
+
+        if ( root != nullptr )
+            flattenNode( tree, root );
+
+        return tree.detach();
+    }
+
+    Ct2Tree* Ct2Tree::load( InputStream* input )
+    {
+        Object<Ct2Tree> tree = new Ct2Tree;
+        Array<float> lineBuffer;
+
+        loadNode( tree, input, lineBuffer );
+
+        return tree.detach();
+    }
+
+    bool Ct2Tree::intersects( const Vector2<>& centre, float r, const Vector2<>& min, const Vector2<>& max )
+    {
+        // http://stackoverflow.com/questions/401847/circle-rectangle-collision-detection-intersection
+
+        const Vector2<> halfRect = ( max - min ) / 2.0f;
+        const Vector2<> circleDistance = ( min + halfRect - centre ).fabs();
+
+        if ( circleDistance.x > halfRect.x + r || circleDistance.y > halfRect.y + r )
+            return false;
+
+        if ( circleDistance.x <= halfRect.x || circleDistance.y <= halfRect.y )
+            return true;
+
+        const float dx = circleDistance.x - halfRect.x;
+        const float dy = circleDistance.y - halfRect.y;
+
+        return dx * dx + dy * dy <= r * r;
+    }
+
+    size_t Ct2Tree::queryCircles( const Query* queries, size_t count, List<uint32_t>& hits, uint32_t* firstHits, uint32_t* numHits )
+    {
+        const Node* nodeArray = nodes.getPtr();
+        const Ct2Line* lineArray = lines.getPtr();
+        const size_t numNodes = nodes.getLength();
+
+        const size_t numHitsBefore = hits.getLength();
+
+        for ( size_t q = 0; q < count; q++ )
+        {
+            const Vector2<> centre = queries[q].centre;
+            const float r = queries[q].radius;
+
+            firstHits[q] = hits.getLength();
+
+            // Stackless depth-first walk: a rejected node skips its whole subtree
+            for ( size_t i = 0; i < numNodes; )
+            {
+                const Node& node = nodeArray[i];
+
+                if ( !intersects( centre, r, node.bounds[0], node.bounds[1] ) )
+                {
+                    i = node.next;
+                    continue;
+                }
+
+                for ( uint32_t j = node.firstLine; j < node.firstLine + node.numLines; j++ )
+                    if ( touches( lineArray[j], centre, r ) )
+                        hits.add( j );
+
+                i++;
+            }
+
+            numHits[q] = hits.getLength() - firstHits[q];
+        }
+
+        return hits.getLength() - numHitsBefore;
+    }
+}
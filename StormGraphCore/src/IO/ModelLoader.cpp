@@ -42,8 +42,11 @@ namespace StormGraph
     {
         String header = input->readString();
 
-        if ( header == "Sg_Bsp#0" )
+        if ( header == "Sg_Bsp#0" || header == "Sg_Bsp#1" )
+        {
+            input->setPos( 0 );
             return BspLoader::loadStaticModel( driver, name, input, resMgr, finalized );
+        }
 
         if ( finalized )
         {
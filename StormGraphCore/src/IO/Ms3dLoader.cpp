@@ -112,9 +112,39 @@ namespace StormGraph
         List<Vertex> vertices;
     };
 
+    // Bounds-checked cursor over an MS3D file held in memory; records are decoded straight from the buffer
+    class Ms3dBlockReader
+    {
+        const uint8_t* pos, * end;
+
+        public:
+            Ms3dBlockReader( const uint8_t* data, size_t length ) : pos( data ), end( data + length )
+            {
+            }
+
+            template <typename T> const T* take( size_t count )
+            {
+                if ( count > ( size_t )( end - pos ) / sizeof( T ) )
+                    throw StormGraph::Exception( "StormGraph.Ms3dLoader.decode", "InvalidFormat", "unexpected end of MS3D data" );
+
+                const T* items = ( const T* ) pos;
+                pos += count * sizeof( T );
+                return items;
+            }
+
+            template <typename T> T get()
+            {
+                T value;
+                memcpy( &value, take<uint8_t>( sizeof( T ) ), sizeof( T ) );
+                return value;
+            }
+    };
+
     class Ms3dLoaderImpl
     {
         List<Mesh*> meshes;
+        List<int> materialIndices;
+        List<ms3d_material_t> materialInfos;
 
         public:
             ~Ms3dLoaderImpl()
@@ -123,83 +153,113 @@ namespace StormGraph
                     delete mesh;
             }
 
+            void decode( const uint8_t* data, size_t length );
             void doLoad( IGraphicsDriver* driver, const char* name, SeekableInputStream* input, IResourceManager* resMgr, List<MeshCreationInfo2*>& meshCreationInfos );
+            void readAndDecode( SeekableInputStream* input );
     };
 
-    void Ms3dLoaderImpl::doLoad( IGraphicsDriver* driver, const char* name, SeekableInputStream* input, IResourceManager* resMgr, List<MeshCreationInfo2*>& meshCreationInfos )
+    static inline void checkHeader( const ms3d_header_t& header )
     {
-        static const bool finalized = true;
-
-        Reference<> inputGuard( input );
-
-        List<IMaterial*> materials;
-        List<int> materialIndices;
-
-        ms3d_header_t header;
-        List<ms3d_vertex_t> vertices;
-        List<ms3d_triangle_t> polygons;
-
-        unsigned numVertices, numPolygons, numMeshes, numMaterials;
-
-        SG_assert( input->readItems( &header, 1 ) == 1 )
-
         if ( header.version != 4 )
             throw StormGraph::Exception( "OpenGlDriver.Ms3dLoader.load", "InvalidFormat", ( String )"expected MS3D version 4 scene (got version " + header.version + ")" );
+    }
 
-        numVertices = input->read<unsigned short>();
+    void Ms3dLoaderImpl::decode( const uint8_t* data, size_t length )
+    {
+        Ms3dBlockReader reader( data, length );
 
-        while ( numVertices-- )
-            vertices.add( input->readUnsafe<ms3d_vertex_t>() );
+        checkHeader( *reader.take<ms3d_header_t>( 1 ) );
 
-        numPolygons = input->read<unsigned short>();
+        const unsigned numVertices = reader.get<unsigned short>();
+        const ms3d_vertex_t* vertices = reader.take<ms3d_vertex_t>( numVertices );
 
-        while ( numPolygons-- )
-            polygons.add( input->readUnsafe<ms3d_triangle_t>() );
+        const unsigned numPolygons = reader.get<unsigned short>();
+        const ms3d_triangle_t* polygons = reader.take<ms3d_triangle_t>( numPolygons );
 
-        numMeshes = input->read<unsigned short>();
+        const unsigned numMeshes = reader.get<unsigned short>();
 
         for ( unsigned i = 0; i < numMeshes; i++ )
         {
-            ms3d_group_prologue_t meshInfo = input->readUnsafe<ms3d_group_prologue_t>();
+            const ms3d_group_prologue_t* meshInfo = reader.take<ms3d_group_prologue_t>( 1 );
 
             Object<Mesh> mesh = new Mesh;
 
-            mesh->name = meshInfo.name;
+            char meshName[sizeof( meshInfo->name ) + 1];
+            memcpy( meshName, meshInfo->name, sizeof( meshInfo->name ) );
+            meshName[sizeof( meshInfo->name )] = 0;
+
+            mesh->name = meshName;
+            mesh->vertices.resize( meshInfo->numTriangles * 3 );
 
-            for ( unsigned j = 0; j < meshInfo.numTriangles; j++ )
+            for ( unsigned j = 0; j < meshInfo->numTriangles; j++ )
             {
-                int polyIdx = input->read<unsigned short>();
+                const unsigned polyIdx = reader.get<unsigned short>();
+
+                if ( polyIdx >= numPolygons )
+                    throw StormGraph::Exception( "StormGraph.Ms3dLoader.decode", "InvalidFormat", "MS3D triangle index out of range" );
+
+                const ms3d_triangle_t& polygon = polygons[polyIdx];
 
                 for ( int faceVtx = 0; faceVtx < 3; faceVtx++ )
                 {
+                    if ( polygon.vertexIndices[faceVtx] >= numVertices )
+                        throw StormGraph::Exception( "StormGraph.Ms3dLoader.decode", "InvalidFormat", "MS3D vertex index out of range" );
+
+                    const ms3d_vertex_t& vertex = vertices[polygon.vertexIndices[faceVtx]];
                     Vertex v;
 
-                    v.pos.x = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[0];
-                    v.pos.y = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[2];
-                    v.pos.z = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[1];
+                    v.pos.x = vertex.vertex[0];
+                    v.pos.y = vertex.vertex[2];
+                    v.pos.z = vertex.vertex[1];
 
-                    v.normal.x = polygons[polyIdx].vertexNormals[faceVtx][0];
-                    v.normal.y = polygons[polyIdx].vertexNormals[faceVtx][2];
-                    v.normal.z = polygons[polyIdx].vertexNormals[faceVtx][1];
+                    v.normal.x = polygon.vertexNormals[faceVtx][0];
+                    v.normal.y = polygon.vertexNormals[faceVtx][2];
+                    v.normal.z = polygon.vertexNormals[faceVtx][1];
 
-                    v.uv[0].x = polygons[polyIdx].s[faceVtx];
-                    v.uv[0].y = polygons[polyIdx].t[faceVtx];
+                    v.uv[0].x = polygon.s[faceVtx];
+                    v.uv[0].y = polygon.t[faceVtx];
 
                     mesh->vertices.add( v );
                 }
             }
 
-            //preload->meshes.add( meshPreload );
-
             meshes.add( mesh.detach() );
-            materialIndices.add( input->read<char>() );
+            materialIndices.add( reader.get<char>() );
         }
 
-        numMaterials = input->read<unsigned short>();
+        const unsigned numMaterials = reader.get<unsigned short>();
+        const ms3d_material_t* materials = reader.take<ms3d_material_t>( numMaterials );
 
         for ( unsigned i = 0; i < numMaterials; i++ )
+            materialInfos.add( materials[i] );
+    }
+
+    void Ms3dLoaderImpl::readAndDecode( SeekableInputStream* input )
+    {
+        // One read for the whole file instead of one virtual call per field
+        const size_t length = ( size_t )( input->getSize() - input->getPos() );
+
+        Array<uint8_t> data( length );
+
+        if ( input->read( data.getPtr(), length ) != length )
+            throw StormGraph::Exception( "StormGraph.Ms3dLoader.decode", "InvalidFormat", "unexpected end of MS3D data" );
+
+        decode( data.getPtr(), length );
+    }
+
+    void Ms3dLoaderImpl::doLoad( IGraphicsDriver* driver, const char* name, SeekableInputStream* input, IResourceManager* resMgr, List<MeshCreationInfo2*>& meshCreationInfos )
+    {
+        static const bool finalized = true;
+
+        Reference<> inputGuard( input );
+
+        List<IMaterial*> materials;
+
+        readAndDecode( input );
+
+        iterate ( materialInfos )
         {
-            ms3d_material_t matInfo = input->readUnsafe<ms3d_material_t>();
+            const ms3d_material_t& matInfo = materialInfos.current();
 
             MaterialProperties2 properties;
             memset( &properties, 0, sizeof( properties ) );
@@ -0,0 +1,383 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/IO/BspGenerator.hpp>
+#include <StormGraph/IO/ModelLoader.hpp>
+#include <StormGraph/ResourceManager.hpp>
+
+namespace Tests
+{
+    // Bsp::getVertexIndex as it was before the spatial hash
+    static unsigned getVertexIndexLinear( List<Vertex>& vertices, const Vertex& vertex )
+    {
+        iterate ( vertices )
+        {
+            const Vertex& current = vertices.current();
+
+            if ( current.pos.equals( vertex.pos, 0.001f ) && current.normal.equals( vertex.normal, 0.001f )
+                    && current.uv[0].equals( vertex.uv[0], 0.001f )
+                    && current.uv[1].equals( vertex.uv[1], 0.001f )
+                    && current.uv[2].equals( vertex.uv[2], 0.001f )
+                    && current.lightUv.equals( vertex.lightUv, 0.001f ) )
+                return vertices.iter();
+        }
+
+        return vertices.add( vertex );
+    }
+
+    SgTest( Bsp, vertexWelding )
+    {
+        const size_t numTriangles = getParameter( "triangles", 1000000 );
+
+        // Small patches, so that the linear reference stays affordable at a million triangles
+        const unsigned numMaterials = 2048;
+        const int patchSize = 16;
+
+        BspVertexWelder welder;
+        welder.clear();
+
+        Array<List<Vertex>> expectedVertices( numMaterials ), actualVertices( numMaterials );
+        Array<Vector<>> patchOrigins( numMaterials );
+
+        uint32_t seed = 1;
+
+        for ( unsigned i = 0; i < numMaterials; i++ )
+            patchOrigins[i] = Vector<>( getRandom( seed, -100.0f, 100.0f ), getRandom( seed, -100.0f, 100.0f ), getRandom( seed, -100.0f, 100.0f ) );
+
+        for ( size_t i = 0; i < numTriangles; i++ )
+        {
+            const unsigned material = ( unsigned )( ( i / ( 2 * patchSize * patchSize ) ) % numMaterials );
+
+            // Two triangles per grid quad; spacing and jitter are close to the weld tolerance and the cell size,
+            // so that both near misses and vertices straddling cell borders are common
+            const int quad = ( int )( i / 2 ) % ( patchSize * patchSize );
+            const int qx = quad % patchSize, qy = quad / patchSize;
+
+            static const int corners[2][3][2] = { { { 0, 0 }, { 1, 0 }, { 1, 1 } }, { { 0, 0 }, { 1, 1 }, { 0, 1 } } };
+
+            for ( int j = 0; j < 3; j++ )
+            {
+                const int x = qx + corners[i & 1][j][0], y = qy + corners[i & 1][j][1];
+
+                Vertex vertex;
+
+                vertex.pos = patchOrigins[material] + Vector<>( x * 0.005f + getRandom( seed, -0.0007f, 0.0007f ),
+                        y * 0.005f + getRandom( seed, -0.0007f, 0.0007f ), getRandom( seed, -0.0007f, 0.0007f ) );
+                vertex.normal = Vector<>( 0.0f, 0.0f, 1.0f );
+                vertex.uv[0] = Vector2<>( x / ( float ) patchSize, y / ( float ) patchSize );
+                vertex.lightUv = vertex.uv[0];
+
+                const unsigned expected = getVertexIndexLinear( expectedVertices[material], vertex );
+                const unsigned actual = welder.getIndex( material, actualVertices[material], vertex );
+
+                SgCheck( actual == expected );
+            }
+        }
+
+        for ( unsigned i = 0; i < numMaterials; i++ )
+            SgCheck( actualVertices[i].getLength() == expectedVertices[i].getLength() );
+    }
+
+    static void addQuad( List<BspPolygon>& polygons, unsigned materialIndex, const Vector<>& origin, const Vector<>& u, const Vector<>& v )
+    {
+        const Vector<> corners[4] = { origin, origin + u, origin + u + v, origin + v };
+
+        BspPolygon polygon;
+
+        polygon.numVertices = 4;
+        polygon.materialIndex = materialIndex;
+
+        for ( unsigned i = 0; i < 4; i++ )
+        {
+            Vertex& vertex = polygon.v[i];
+
+            vertex.pos = corners[i];
+            vertex.normal = u.crossProduct( v ).normalize();
+            vertex.colour = Colour::white();
+
+            for ( unsigned j = 0; j < TEXTURES_PER_VERTEX; j++ )
+                vertex.uv[j] = Vector2<>( ( i == 1 || i == 2 ) ? 1.0f : 0.0f, ( i >= 2 ) ? 1.0f : 0.0f );
+
+            vertex.lightUv = vertex.uv[0];
+        }
+
+        polygons.add( polygon );
+    }
+
+    // Same limits as the default world export settings
+    static const unsigned nodePolyLimit = 500;
+    static const float nodeSizeLimit = 50.0f;
+
+    // Scattered boxes in two materials, compiled with the default world export limits
+    static BspTree* compileBoxes( unsigned numBoxes, BspSplitMode splitMode = BspSplitMode::planeSweep, unsigned numThreads = 0,
+            BspBuildStats* stats = nullptr )
+    {
+        Bsp bsp( nodePolyLimit, Vector<>( nodeSizeLimit, nodeSizeLimit, nodeSizeLimit ), splitMode, numThreads );
+
+        const unsigned materials[2] = { bsp.getMaterialIndex( "wall" ), bsp.getMaterialIndex( "floor" ) };
+        const float extent = sqrtf( ( float ) numBoxes ) * 12.0f;
+
+        List<BspPolygon> polygons;
+        uint32_t seed = 1;
+
+        for ( unsigned i = 0; i < numBoxes; i++ )
+        {
+            const Vector<> x( getRandom( seed, 1.0f, 8.0f ), 0.0f, 0.0f ), y( 0.0f, getRandom( seed, 1.0f, 8.0f ), 0.0f ),
+                    z( 0.0f, 0.0f, getRandom( seed, 2.0f, 20.0f ) );
+            const Vector<> pos( getRandom( seed, 0.0f, extent ), getRandom( seed, 0.0f, extent ), 0.0f );
+
+            addQuad( polygons, materials[1], pos, y, x );
+            addQuad( polygons, materials[0], pos + z, x, y );
+            addQuad( polygons, materials[0], pos, x, z );
+            addQuad( polygons, materials[0], pos + y, z, x );
+            addQuad( polygons, materials[0], pos, z, y );
+            addQuad( polygons, materials[0], pos + x, y, z );
+        }
+
+        BspTree* tree = bsp.generate( polygons.getPtr(), polygons.getLength() );
+
+        if ( stats != nullptr )
+            *stats = bsp.getStats();
+
+        return tree;
+    }
+
+    static ArrayIOStream* saveTree( BspTree* tree, unsigned revision )
+    {
+        Reference<ArrayIOStream> image = new ArrayIOStream();
+        BspWriter().save( tree, image->reference(), revision );
+
+        image->setPos( 0 );
+        return image.detach();
+    }
+
+    static size_t checkSameNodes( BspNode* expected, BspNode* actual )
+    {
+        SgCheck( ( expected == nullptr ) == ( actual == nullptr ) );
+
+        if ( expected == nullptr )
+            return 0;
+
+        SgCheck( expected->bounds[0].equals( actual->bounds[0], 1.0e-6f ) && expected->bounds[1].equals( actual->bounds[1], 1.0e-6f ) );
+        SgCheck( expected->meshes.getLength() == actual->meshes.getLength() );
+
+        for each_in_list ( expected->meshes, i )
+        {
+            BspMesh* expectedMesh = expected->meshes[i];
+            BspMesh* actualMesh = actual->meshes[i];
+
+            SgCheck( expectedMesh->material == actualMesh->material );
+            SgCheck( expectedMesh->getNumIndices() == actualMesh->getNumIndices() );
+            SgCheck( memcmp( expectedMesh->getIndices(), actualMesh->getIndices(), expectedMesh->getNumIndices() * sizeof( unsigned ) ) == 0 );
+        }
+
+        return 1 + checkSameNodes( expected->children[0], actual->children[0] ) + checkSameNodes( expected->children[1], actual->children[1] );
+    }
+
+    SgTest( Bsp, blockFormat )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<BspTree> compiled = compileBoxes( getParameter( "boxes", 2000 ) );
+
+        Reference<ArrayIOStream> images[2] = { saveTree( compiled, 0 ), saveTree( compiled, 1 ) };
+
+        // Both revisions load into the same tree; Sg_Bsp#1 keeps its nodes in one block
+        for ( unsigned revision = 0; revision < 2; revision++ )
+        {
+            Object<BspTree> tree = BspLoader::loadTree( images[revision]->reference(), sg->getSharedResourceManager() );
+
+            SgCheck( tree->materials.getLength() == compiled->materials.getLength() );
+
+            for each_in_list ( compiled->materials, i )
+            {
+                SgCheck( tree->vertices[i].getLength() == compiled->vertices[i].getLength() );
+                SgCheck( tree->totalTriangles[i] == compiled->totalTriangles[i] );
+
+                for each_in_list ( compiled->vertices[i], j )
+                    SgCheck( tree->vertices[i][j].pos.equals( compiled->vertices[i][j].pos, 1.0e-6f ) );
+            }
+
+            const size_t numNodes = checkSameNodes( compiled->root, tree->root );
+
+            SgCheck( numNodes > 1 );
+            SgCheck( revision == 0 ? tree->nodeBlock == nullptr : tree->numNodes == numNodes );
+        }
+
+        // A truncated block section is reported, and whatever was loaded so far is freed
+        Reference<ArrayIOStream> truncated = new ArrayIOStream( images[1]->getPtr(), ( size_t ) images[1]->getSize() - 1 );
+        bool failed = false;
+
+        try
+        {
+            Object<BspTree> tree = BspLoader::loadTree( truncated.detach(), sg->getSharedResourceManager() );
+        }
+        catch ( Exception& ex )
+        {
+            failed = ( ex.name == "StreamFormatError" );
+        }
+
+        SgCheck( failed );
+    }
+
+    struct TreeCheck
+    {
+        size_t numNodes, numLeaves;
+        bool valid;
+    };
+
+    // Children lie within their parent, only leaves have meshes, and leaves respect the polygon and size limits
+    // Boxes only produce axis-aligned quads, which stay quads when split, so a leaf holds at most two triangles per polygon
+    static void checkTree( BspTree* tree, BspNode* node, TreeCheck& check )
+    {
+        check.numNodes++;
+
+        const Vector<> size = node->bounds[1] - node->bounds[0];
+        check.valid = check.valid && size.x >= 0.0f && size.y >= 0.0f && size.z >= 0.0f;
+
+        if ( node->children[0] != nullptr || node->children[1] != nullptr )
+        {
+            check.valid = check.valid && node->children[0] != nullptr && node->children[1] != nullptr && node->meshes.isEmpty();
+
+            for ( int i = 0; i < 2 && check.valid; i++ )
+            {
+                const BspNode* child = node->children[i];
+
+                check.valid = child->bounds[0].x >= node->bounds[0].x - 1.0e-3f && child->bounds[1].x <= node->bounds[1].x + 1.0e-3f
+                        && child->bounds[0].y >= node->bounds[0].y - 1.0e-3f && child->bounds[1].y <= node->bounds[1].y + 1.0e-3f
+                        && child->bounds[0].z >= node->bounds[0].z - 1.0e-3f && child->bounds[1].z <= node->bounds[1].z + 1.0e-3f;
+
+                if ( check.valid )
+                    checkTree( tree, node->children[i], check );
+            }
+
+            return;
+        }
+
+        check.numLeaves++;
+
+        const float maxSize = nodeSizeLimit * 1.001f;
+        check.valid = check.valid && size.x <= maxSize && size.y <= maxSize && size.z <= maxSize;
+
+        size_t numTriangles = 0;
+
+        iterate ( node->meshes )
+        {
+            BspMesh* mesh = node->meshes.current();
+            const unsigned* indices = mesh->getIndices();
+
+            check.valid = check.valid && mesh->material < tree->materials.getLength() && mesh->getNumIndices() % 3 == 0;
+
+            for ( size_t i = 0; i < mesh->getNumIndices() && check.valid; i++ )
+                check.valid = indices[i] < tree->vertices[mesh->material].getLength();
+
+            numTriangles += mesh->getNumIndices() / 3;
+        }
+
+        check.valid = check.valid && numTriangles <= 2 * nodePolyLimit;
+    }
+
+    SgTest( Bsp, parallelDeterminism )
+    {
+        const unsigned numBoxes = getParameter( "boxes", 10000 );
+        const BspSplitMode modes[] = { BspSplitMode::planeSweep, BspSplitMode::surfaceAreaHeuristic };
+
+        for ( size_t i = 0; i < lengthof( modes ); i++ )
+        {
+            BspBuildStats serialStats, parallelStats;
+
+            // Explicitly more than one thread, so that the task queue is used even on a single core
+            Object<BspTree> serial = compileBoxes( numBoxes, modes[i], 1, &serialStats );
+            Object<BspTree> parallel = compileBoxes( numBoxes, modes[i], 4, &parallelStats );
+
+            Reference<ArrayIOStream> serialImage = saveTree( serial, 1 );
+            Reference<ArrayIOStream> parallelImage = saveTree( parallel, 1 );
+
+            // The thread count doesn't change a single byte
+            SgCheck( serialImage->getSize() == parallelImage->getSize() );
+            SgCheck( memcmp( serialImage->getPtr(), parallelImage->getPtr(), ( size_t ) serialImage->getSize() ) == 0 );
+
+            SgCheck( serialStats.numNodes == parallelStats.numNodes );
+            SgCheck( serialStats.numLeaves == parallelStats.numLeaves );
+            SgCheck( serialStats.numPolygons == parallelStats.numPolygons );
+            SgCheck( serialStats.maxDepth == parallelStats.maxDepth );
+
+            // Both strategies produce a valid tree, and the statistics describe it
+            TreeCheck check = { 0, 0, true };
+            checkTree( parallel, parallel->root, check );
+
+            SgCheck( check.valid );
+            SgCheck( check.numLeaves > 1 );
+            SgCheck( check.numNodes == parallelStats.numNodes );
+            SgCheck( check.numLeaves == parallelStats.numLeaves );
+
+            // Splitting only ever adds polygons
+            SgCheck( parallelStats.numPolygons >= numBoxes * 6 );
+        }
+    }
+
+    SgBenchmark( Bsp, partitionBench )
+    {
+        const unsigned numBoxes = getParameter( "boxes", 10000 );
+        const unsigned numThreads = getParameter( "threads", 0 );
+
+        const BspSplitMode modes[] = { BspSplitMode::planeSweep, BspSplitMode::surfaceAreaHeuristic };
+        const char* modeNames[] = { "sweep", "sah" };
+
+        for ( size_t i = 0; i < lengthof( modes ); i++ )
+            for ( unsigned pass = 0; pass < 2; pass++ )
+            {
+                BspBuildStats stats;
+                Object<BspTree> tree = compileBoxes( numBoxes, modes[i], pass == 0 ? 1 : numThreads, &stats );
+
+                printf( "Bsp.partitionBench: %-5s %3s thread(s), %u boxes: %8.1f ms, %" PRIuPTR " nodes, %" PRIuPTR " leaves, %" PRIuPTR " polygons, depth %u\n",
+                        modeNames[i], pass == 0 ? "1" : ( numThreads == 0 ? "all" : String::formatInt( numThreads ).c_str() ), numBoxes,
+                        stats.seconds * 1000.0, stats.numNodes, stats.numLeaves, stats.numPolygons, stats.maxDepth );
+            }
+    }
+
+    SgBenchmark( Bsp, loadBench )
+    {
+        const unsigned iterations = getParameter( "iterations", 20 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<BspTree> compiled = compileBoxes( getParameter( "boxes", 20000 ) );
+
+        for ( unsigned revision = 0; revision < 2; revision++ )
+        {
+            Reference<ArrayIOStream> image = saveTree( compiled, revision );
+
+            const uint64_t start = Timer::getRelativeMicroseconds();
+
+            for ( unsigned i = 0; i < iterations; i++ )
+            {
+                image->setPos( 0 );
+                Object<BspTree> tree = BspLoader::loadTree( image->reference(), sg->getSharedResourceManager() );
+            }
+
+            printf( "Bsp.loadBench: Sg_Bsp#%u, %u us per load of %u bytes\n", revision,
+                    ( unsigned )( ( Timer::getRelativeMicroseconds() - start ) / maximum( iterations, 1u ) ), ( unsigned ) image->getSize() );
+        }
+    }
+}
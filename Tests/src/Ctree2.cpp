@@ -0,0 +1,262 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/IO/Ctree2.hpp>
+
+namespace Tests
+{
+    static const float mapSize = 1000.0f;
+
+    // Short walls scattered over the map, as a generated level would have
+    static void generateSegments( Array<Ct2Line>& segments, size_t count, uint32_t& seed )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            Ct2Line line;
+
+            line.a = Vector2<>( getRandom( seed, 0.0f, mapSize ), getRandom( seed, 0.0f, mapSize ) );
+            line.b = line.a + Vector2<>( getRandom( seed, -5.0f, 5.0f ), getRandom( seed, -5.0f, 5.0f ) ) + Vector2<>( 0.01f, 0.0f );
+            line.recalc();
+
+            segments[i] = line;
+        }
+    }
+
+    static void generateQueries( Array<Ct2Tree::Query>& queries, size_t count, uint32_t& seed )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            queries[i].centre = Vector2<>( getRandom( seed, 0.0f, mapSize ), getRandom( seed, 0.0f, mapSize ) );
+            queries[i].radius = 0.8f;
+        }
+    }
+
+    // A pointer tree like the one Ctree2Generator builds, split at the middle of the longer axis by segment midpoint
+    static Ct2Node* buildNode( Ct2Line* lines, size_t count )
+    {
+        Object<Ct2Node> node = new Ct2Node;
+
+        node->bounds[0] = Vector2<>( lines[0].a.x, lines[0].a.y );
+        node->bounds[1] = node->bounds[0];
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            node->bounds[0] = Vector2<>( minimum( node->bounds[0].x, minimum( lines[i].a.x, lines[i].b.x ) ), minimum( node->bounds[0].y, minimum( lines[i].a.y, lines[i].b.y ) ) );
+            node->bounds[1] = Vector2<>( maximum( node->bounds[1].x, maximum( lines[i].a.x, lines[i].b.x ) ), maximum( node->bounds[1].y, maximum( lines[i].a.y, lines[i].b.y ) ) );
+        }
+
+        if ( count <= 8 )
+        {
+            for ( size_t i = 0; i < count; i++ )
+                node->lines.add( lines[i] );
+
+            return node.detach();
+        }
+
+        const int axis = ( node->bounds[1].x - node->bounds[0].x >= node->bounds[1].y - node->bounds[0].y ) ? 0 : 1;
+        const float split = ( axis == 0 ) ? ( node->bounds[0].x + node->bounds[1].x ) : ( node->bounds[0].y + node->bounds[1].y );
+
+        size_t numFront = 0;
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const float mid = ( axis == 0 ) ? ( lines[i].a.x + lines[i].b.x ) : ( lines[i].a.y + lines[i].b.y );
+
+            if ( mid < split )
+            {
+                Ct2Line swap = lines[i];
+                lines[i] = lines[numFront];
+                lines[numFront++] = swap;
+            }
+        }
+
+        // Degenerate split (everything on one side): halve the range instead
+        if ( numFront == 0 || numFront == count )
+            numFront = count / 2;
+
+        node->children[0] = buildNode( lines, numFront );
+        node->children[1] = buildNode( lines + numFront, count - numFront );
+
+        return node.detach();
+    }
+
+    // Same layout as Ctree2Writer
+    static void writeNode( const Ct2Node* node, OutputStream* output )
+    {
+        output->writeItems<Vector2<float>>( node->bounds, 2 );
+        output->write<uint32_t>( node->lines.getLength() );
+
+        iterate2 ( i, node->lines )
+        {
+            output->write<Vector2<>>( ( *i ).a );
+            output->write<Vector2<>>( ( *i ).b );
+        }
+
+        output->write<uint8_t>( node->children[0] != nullptr ? 1 : 0 );
+
+        if ( node->children[0] != nullptr )
+        {
+            writeNode( node->children[0], output );
+            writeNode( node->children[1], output );
+        }
+    }
+
+    // The traversal Duel used before Ct2Tree
+    static void queryPointerTree( const Ct2Node* node, const Vector2<>& centre, float r, List<const Ct2Line*>& hits )
+    {
+        iterate2 ( i, node->lines )
+            if ( Ct2Tree::touches( i, centre, r ) )
+                hits.add( &( *i ) );
+
+        for ( int i = 0; i < 2; i++ )
+            if ( node->children[i] != nullptr && Ct2Tree::intersects( centre, r, node->children[i]->bounds[0], node->children[i]->bounds[1] ) )
+                queryPointerTree( node->children[i], centre, r, hits );
+    }
+
+    SgTest( Ctree2, flatQueries )
+    {
+        static const size_t batchSize = 64;
+
+        const size_t numSegments = maximum( getParameter( "count", 5000 ), 1 );
+        const size_t numQueries = maximum( getParameter( "iterations", 20000 ), 1 );
+
+        uint32_t seed = 0x12345678;
+
+        Array<Ct2Line> segments( numSegments );
+        generateSegments( segments, numSegments, seed );
+
+        Object<Ct2Node> root = buildNode( segments.getPtr(), numSegments );
+
+        Reference<ArrayIOStream> image = new ArrayIOStream();
+        writeNode( root, image );
+        image->setPos( 0 );
+
+        Object<Ct2Tree> tree = Ct2Tree::load( image );
+        Object<Ct2Tree> flattened = Ct2Tree::fromNodes( root );
+
+        SgCheck( tree->nodes.getLength() == flattened->nodes.getLength() );
+        SgCheck( tree->lines.getLength() == numSegments );
+        SgCheck( flattened->lines.getLength() == numSegments );
+
+        for each_in_list ( tree->nodes, i )
+        {
+            SgCheck( tree->nodes[i].firstLine == flattened->nodes[i].firstLine );
+            SgCheck( tree->nodes[i].numLines == flattened->nodes[i].numLines );
+            SgCheck( tree->nodes[i].next == flattened->nodes[i].next );
+        }
+
+        Array<Ct2Tree::Query> queries( numQueries );
+        generateQueries( queries, numQueries, seed );
+
+        List<uint32_t> hits;
+        Array<uint32_t> firstHits( batchSize ), numHits( batchSize );
+        List<const Ct2Line*> expected;
+
+        size_t numMatched = 0;
+
+        for ( size_t i = 0; i < numQueries; i += batchSize )
+        {
+            const size_t count = minimum( batchSize, numQueries - i );
+
+            hits.clear();
+            tree->queryCircles( queries.getPtr() + i, count, hits, firstHits.getPtr(), numHits.getPtr() );
+
+            for ( size_t q = 0; q < count; q++ )
+            {
+                const Ct2Tree::Query& query = queries[i + q];
+
+                // Both walks visit the segments in the same depth-first order
+                expected.clear();
+
+                if ( Ct2Tree::intersects( query.centre, query.radius, root->bounds[0], root->bounds[1] ) )
+                    queryPointerTree( root, query.centre, query.radius, expected );
+
+                SgCheck( numHits[q] == expected.getLength() );
+
+                for ( uint32_t j = 0; j < numHits[q]; j++ )
+                {
+                    const Ct2Line& line = tree->lines[hits[firstHits[q] + j]];
+
+                    SgCheck( line.a.x == expected[j]->a.x && line.a.y == expected[j]->a.y );
+                    SgCheck( line.b.x == expected[j]->b.x && line.b.y == expected[j]->b.y );
+                }
+
+                numMatched += numHits[q];
+            }
+        }
+
+        // Make sure the queries actually hit something
+        SgCheck( numMatched > 0 );
+    }
+
+    SgBenchmark( Ctree2, queryBench )
+    {
+        static const size_t batchSize = 256;
+
+        const size_t numSegments = maximum( getParameter( "count", 200000 ), 1 );
+        const size_t numQueries = maximum( getParameter( "iterations", 1000000 ), 1 );
+
+        uint32_t seed = 0x12345678;
+
+        Array<Ct2Line> segments( numSegments );
+        generateSegments( segments, numSegments, seed );
+
+        Object<Ct2Node> root = buildNode( segments.getPtr(), numSegments );
+        Object<Ct2Tree> tree = Ct2Tree::fromNodes( root );
+
+        Array<Ct2Tree::Query> queries( numQueries );
+        generateQueries( queries, numQueries, seed );
+
+        List<uint32_t> hits;
+        Array<uint32_t> firstHits( batchSize ), numHits( batchSize );
+
+        uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( size_t i = 0; i < numQueries; i += batchSize )
+        {
+            hits.clear();
+            tree->queryCircles( queries.getPtr() + i, minimum( batchSize, numQueries - i ), hits, firstHits.getPtr(), numHits.getPtr() );
+        }
+
+        const uint64_t flatTime = maximum<uint64_t>( Timer::getRelativeMicroseconds() - start, 1 );
+
+        List<const Ct2Line*> pointerHits;
+
+        start = Timer::getRelativeMicroseconds();
+
+        for ( size_t i = 0; i < numQueries; i++ )
+        {
+            pointerHits.clear();
+
+            if ( Ct2Tree::intersects( queries[i].centre, queries[i].radius, root->bounds[0], root->bounds[1] ) )
+                queryPointerTree( root, queries[i].centre, queries[i].radius, pointerHits );
+        }
+
+        const uint64_t pointerTreeTime = maximum<uint64_t>( Timer::getRelativeMicroseconds() - start, 1 );
+
+        printf( "Ctree2.queryBench: %u segments, flat tree %u queries/s, pointer tree %u queries/s\n", ( unsigned ) numSegments,
+                ( unsigned )( numQueries * 1e6 / flatTime ), ( unsigned )( numQueries * 1e6 / pointerTreeTime ) );
+    }
+}
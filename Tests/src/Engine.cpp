@@ -0,0 +1,117 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <NullDriver/NullDriver.hpp>
+
+#include <StormGraph/GeometryFactory.hpp>
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/Scene.hpp>
+
+namespace Tests
+{
+    class CuboidScene : public IScene
+    {
+        IGraphicsDriver* driver;
+        Reference<IModel> cuboid;
+
+        public:
+            unsigned numFrames;
+
+        public:
+            CuboidScene( IGraphicsDriver* driver ) : driver( driver ), numFrames( 0 ) {}
+
+            virtual void init() override
+            {
+                CuboidCreationInfo2 creationInfo( Vector<>(), Vector<>( 1.0f, 1.0f, 1.0f ), Vector<>(), true );
+
+                cuboid = driver->createCuboid( "cuboid", creationInfo, driver->getSolidMaterial(), IModel::fullStatic );
+            }
+
+            virtual void uninit() override
+            {
+                cuboid.release();
+            }
+
+            virtual bool isRunning() override { return true; }
+
+            virtual void onRender() override
+            {
+                driver->set3dMode( 1.0f, 100.0f );
+                driver->setCamera( Vector<>( 5.0f, 5.0f, 5.0f ), Vector<>(), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+                cuboid->render();
+                numFrames++;
+            }
+    };
+
+    SgTest( Engine, headlessMainLoop )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+        SgCheck( driver->isRecording() );
+
+        sg->setVariableValue( "driver.maxFrames", "3" );
+
+        Reference<CuboidScene> scene = new CuboidScene( driver );
+        sg->run( scene->reference() );
+
+        // The main loop ends after driver.maxFrames frames and the last one is still in the command log
+        SgCheck( scene->numFrames == 3 );
+        SgCheck( driver->getFrameStats().frame == 3 );
+        SgCheck( driver->getFrameStats().numDrawCalls == 1 );
+
+        bool drawn = false;
+
+        iterate ( driver->getCommandLog() )
+            if ( driver->getCommandLog().current().type == NullDriver::CommandType::drawMesh
+                    && driver->getCommandLog().current().subject == "cuboid" )
+                drawn = true;
+
+        SgCheck( drawn );
+    }
+
+    SgTest( Engine, commandLineDriver )
+    {
+        char* argv[] = { ( char* ) "StormGraphTests", ( char* ) "display.driver:Null" };
+
+        Object<IEngine> sg = Common::getCore( StormGraph_API_Version )->createEngine( "Tests", 2, argv );
+        sg->addFileSystem( "native", true );
+
+        // Startup scripts and app defaults must not override the driver chosen on the command line
+        sg->command( "set display.driver OpenGl" );
+        sg->setVariable( "display.driver", sg->createStringVariable( "OpenGl" ), true );
+
+        sg->startup();
+        sg->startupGraphics();
+
+        IGraphicsDriver::Info info;
+        sg->getGraphicsDriver()->getDriverInfo( &info );
+
+        SgCheck( dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() ) != nullptr );
+        SgCheck( info.renderer == "Null (headless)" );
+    }
+}
@@ -0,0 +1,190 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <ctype.h>
+#include <stdio.h>
+
+namespace Tests
+{
+    // Stores lower-case names and ignores case on lookup, like a Windows directory
+    class FoldingFileSystem : public MemoryFileSystem
+    {
+        protected:
+            virtual ~FoldingFileSystem() {}
+
+        public:
+            static String fold( const char* name )
+            {
+                const size_t length = strlen( name ) + 1;
+                Array<char> folded( length );
+
+                for ( size_t i = 0; i < length; i++ )
+                    folded[i] = ( char ) tolower( ( unsigned char ) name[i] );
+
+                return String( folded.getPtr() );
+            }
+
+            void addFile( const char* name, const void* data, size_t size ) { MemoryFileSystem::addFile( fold( name ), data, size ); }
+
+            virtual bool isCaseSensitive() override { return false; }
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) override { return MemoryFileSystem::listDirectory( fold( path ), entries ); }
+            virtual SeekableInputStream* openInput( const char* fileName ) override { return MemoryFileSystem::openInput( fold( fileName ) ); }
+    };
+
+    static bool canOpen( IFileSystem* fs, const char* fileName )
+    {
+        Reference<SeekableInputStream> input = fs->openInput( fileName );
+
+        return input != nullptr;
+    }
+
+    static char readFirstByte( IFileSystem* fs, const char* fileName )
+    {
+        Reference<SeekableInputStream> input = fs->openInput( fileName );
+        SgCheck( input != nullptr );
+
+        char c = 0;
+        input->read( &c, 1 );
+        return c;
+    }
+
+    SgTest( FileSystem, unionIndex )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+
+        // Immutable mounts only: misses are cached until the index is invalidated
+        Reference<MemoryFileSystem> first = new MemoryFileSystem( true ), second = new MemoryFileSystem( true );
+
+        first->addFile( "a/x.txt", "1", 1 );
+        second->addFile( "a/x.txt", "2", 1 );
+        second->addFile( "a/y.txt", "2", 1 );
+
+        Reference<IUnionFileSystem> fs = sg->createUnionFileSystem();
+        fs->add( first->reference() );
+        fs->add( second->reference() );
+
+        // Earlier file systems shadow later ones
+        SgCheck( readFirstByte( fs, "a/x.txt" ) == '1' );
+        SgCheck( readFirstByte( fs, "a/y.txt" ) == '2' );
+
+        SgCheck( !canOpen( fs, "a/z.txt" ) );
+        first->addFile( "a/z.txt", "1", 1 );
+        SgCheck( !canOpen( fs, "a/z.txt" ) );
+
+        fs->invalidateIndex();
+        SgCheck( canOpen( fs, "a/z.txt" ) );
+
+        // A mutable mount is asked again on every miss
+        Reference<MemoryFileSystem> mutableFs = new MemoryFileSystem();
+        fs->add( mutableFs->reference() );
+
+        SgCheck( !canOpen( fs, "a/w.txt" ) );
+        mutableFs->addFile( "a/w.txt", "3", 1 );
+        SgCheck( readFirstByte( fs, "a/w.txt" ) == '3' );
+
+        // Paths the index doesn't handle still work
+        SgCheck( canOpen( fs, "a/../a/x.txt" ) == canOpen( first, "a/../a/x.txt" ) );
+
+        // Unmounting drops the index along with the file systems
+        fs->clear();
+        SgCheck( !canOpen( fs, "a/x.txt" ) );
+        SgCheck( fs->getNumFileSystems() == 0 );
+    }
+
+    SgTest( FileSystem, caseFolding )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+
+        Reference<MemoryFileSystem> exact = new MemoryFileSystem( true );
+        exact->addFile( "Tex/Stone.png", "1", 1 );
+
+        Reference<FoldingFileSystem> folding = new FoldingFileSystem;
+        folding->addFile( "Tex/Grass.png", "2", 1 );
+
+        Reference<IUnionFileSystem> fs = sg->createUnionFileSystem();
+        fs->add( exact->reference() );
+        fs->add( folding->reference() );
+
+        // Found whatever the case, as the mount itself would
+        SgCheck( canOpen( fs, "Tex/Grass.png" ) );
+        SgCheck( canOpen( fs, "tex/GRASS.PNG" ) );
+
+        // ...but a case-sensitive mount still wants the exact name
+        SgCheck( canOpen( fs, "Tex/Stone.png" ) );
+        SgCheck( !canOpen( fs, "tex/stone.png" ) );
+    }
+
+    SgTest( FileSystem, native )
+    {
+        // The test assets (bin/Drivers.cfx2) are in the working directory
+        Object<IEngine> sg = createHeadlessEngine();
+
+        Reference<IFileSystem> native = sg->createFileSystem( "native" );
+        SgCheck( native != nullptr );
+        SgCheck( !native->isImmutable() );
+
+        List<IFileSystem::DirEntry> entries;
+        native->listDirectory( "", entries );
+
+        bool haveBin = false;
+
+        iterate2 ( i, entries )
+            if ( i.name == "bin" )
+                haveBin = i.isDirectory;
+
+        SgCheck( haveBin );
+
+        entries.clear();
+        native->listDirectory( "bin", entries );
+
+        bool haveDrivers = false;
+
+        iterate2 ( i, entries )
+            if ( i.name == "Drivers.cfx2" )
+                haveDrivers = !i.isDirectory && i.path == "bin/Drivers.cfx2";
+
+        SgCheck( haveDrivers );
+
+        // Files created after the directory was indexed are found without invalidating the index
+        Reference<IUnionFileSystem> fs = sg->createUnionFileSystem();
+        fs->add( native->reference() );
+
+        const char* fileName = "bin/FileSystem.native.tmp";
+        remove( fileName );
+
+        SgCheck( canOpen( fs, "bin/Drivers.cfx2" ) );
+        SgCheck( !canOpen( fs, fileName ) );
+
+        FILE* file = fopen( fileName, "wb" );
+        SgCheck( file != nullptr );
+        fputc( '!', file );
+        fclose( file );
+
+        const bool found = canOpen( fs, fileName );
+        remove( fileName );
+
+        SgCheck( found );
+    }
+}
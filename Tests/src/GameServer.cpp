@@ -0,0 +1,302 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <GameServer.hpp>
+
+#ifdef Duel_epoll_server
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Tests
+{
+    using namespace Duel;
+
+    // Blocking loopback client speaking the raw Duel protocol
+    struct SoakClient
+    {
+        int fd;
+
+        List<uint8_t> input;
+        bool welcomed, spawned;
+        unsigned numMoves;
+
+        SoakClient() : fd( -1 ), welcomed( false ), spawned( false ), numMoves( 0 ) {}
+        ~SoakClient() { if ( fd >= 0 ) close( fd ); }
+
+        void connectTo( int port )
+        {
+            fd = socket( AF_INET, SOCK_STREAM, 0 );
+            SgCheck( fd >= 0 );
+
+            sockaddr_in address;
+            memset( &address, 0, sizeof( address ) );
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+            address.sin_port = htons( port );
+
+            SgCheck( connect( fd, ( sockaddr* ) &address, sizeof( address ) ) == 0 );
+        }
+
+        void send( const void* data, size_t length )
+        {
+            for ( size_t sent = 0; sent < length; )
+            {
+                ssize_t count = ::send( fd, ( const uint8_t* ) data + sent, length - sent, MSG_NOSIGNAL );
+                SgCheck( count > 0 || ( count < 0 && errno == EINTR ) );
+
+                if ( count > 0 )
+                    sent += count;
+            }
+        }
+
+        // Reads whatever is available and parses all complete messages
+        void receive()
+        {
+            uint8_t buffer[0x1000];
+
+            for ( ; ; )
+            {
+                ssize_t count = recv( fd, buffer, sizeof( buffer ), MSG_DONTWAIT );
+
+                if ( count < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                    break;
+
+                SgCheck( count > 0 || ( count < 0 && errno == EINTR ) );
+
+                for ( ssize_t i = 0; i < count; i++ )
+                    input.add( buffer[i] );
+            }
+
+            size_t pos = 0;
+
+            for ( ; ; )
+            {
+                const uint8_t* data = input.getPtrUnsafe() + pos;
+                const size_t available = input.getLength() - pos;
+
+                if ( !welcomed )
+                {
+                    uint32_t length;
+
+                    if ( available < sizeof( length ) )
+                        break;
+
+                    memcpy( &length, data, sizeof( length ) );
+
+                    if ( available < sizeof( length ) + length )
+                        break;
+
+                    welcomed = true;
+                    pos += sizeof( length ) + length;
+                    continue;
+                }
+
+                MsgType type;
+
+                if ( available < sizeof( type ) )
+                    break;
+
+                memcpy( &type, data, sizeof( type ) );
+
+                size_t length;
+
+                if ( type == MSG_PLAYER_SPAWN )
+                    length = sizeof( PlayerSpawnMessage );
+                else if ( type == MSG_ENT_MOVE || type == MSG_ENT_TELE )
+                    length = sizeof( EntMoveMessage );
+                else if ( type == MSG_ENT_SPAWN )
+                {
+                    EntSpawnMessageHeader header;
+
+                    if ( available < sizeof( header ) )
+                        break;
+
+                    memcpy( &header, data, sizeof( header ) );
+                    length = sizeof( header ) + header.nameLength;
+                }
+                else
+                    throw Exception( "Tests.SoakClient.receive", "UnexpectedMessage", "message type " + String::formatInt( type ) );
+
+                if ( available < length )
+                    break;
+
+                if ( type == MSG_PLAYER_SPAWN )
+                    spawned = true;
+                else if ( type == MSG_ENT_MOVE )
+                    numMoves++;
+
+                pos += length;
+            }
+
+            // Keep the incomplete tail
+            List<uint8_t> tail;
+
+            for ( size_t i = pos; i < input.getLength(); i++ )
+                tail.add( input[i] );
+
+            input = ( List<uint8_t>&& ) tail;
+        }
+    };
+
+    // Stops the server and closes the clients however the test ends
+    class SoakCleanup
+    {
+        GameServerThread* thread;
+        List<SoakClient*>& clients;
+
+        public:
+            SoakCleanup( GameServerThread* thread, List<SoakClient*>& clients ) : thread( thread ), clients( clients ) {}
+
+            ~SoakCleanup()
+            {
+                iterate2 ( i, clients )
+                    delete i;
+
+                thread->end();
+                thread->waitFor();
+            }
+    };
+
+    static void waitForInput( List<SoakClient*>& clients, int timeout )
+    {
+        List<pollfd> fds;
+
+        iterate2 ( i, clients )
+        {
+            pollfd fd = { i->fd, POLLIN, 0 };
+            fds.add( fd );
+        }
+
+        poll( fds.getPtrUnsafe(), fds.getLength(), timeout );
+    }
+
+    /*
+     *  Many clients join the epoll server and move at the same time, while bots keep broadcasting every tick.
+     *  Every client must get every other client's movement, exactly once and intact.
+     */
+    SgTest( GameServer, soak )
+    {
+        const int numClients = getParameter( "clients", 256 );
+        const int numMoves = getParameter( "moves", 100 );
+        const int numBots = getParameter( "bots", 4 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+
+        sg->setVariable( "host_max",        sg->createIntVariable( -1 ),        true );
+        sg->setVariable( "host_port",       sg->createIntVariable( 0 ),         true );
+        sg->setVariable( "host_tickrate",   sg->createIntVariable( 500 ),       true );
+        sg->setVariable( "map_name",        sg->createStringVariable( "soak" ), true );
+
+        Object<GameServerThread> thread = new GameServerThread( sg );
+        thread->initTcpHost();
+        thread->start();
+
+        // Bound to whatever port was free, so that parallel runs don't collide
+        const int port = thread->hostPort;
+        SgCheck( port > 0 );
+
+        List<SoakClient*> clients;
+
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        // Bounds the whole test; a lost or mangled message shows up as a timeout
+        const uint64_t deadline = 60 * 1000000ull;
+
+        {
+            SoakCleanup cleanup( thread, clients );
+
+            for ( int i = 0; i < numClients; i++ )
+            {
+                SoakClient* client = new SoakClient;
+                clients.add( client );
+
+                client->connectTo( port );
+
+                const String name = "soak" + String::formatInt( i );
+                const JoinHeader join = { MSG_JOIN, ( uint16_t ) name.getNumBytes() };
+
+                client->send( &join, sizeof( join ) );
+                client->send( name.c_str(), name.getNumBytes() );
+            }
+
+            // Spawned from this thread, while the server is already serving the clients
+            for ( int i = 0; i < numBots; i++ )
+                thread->spawnBot1();
+
+            // Movement is only relayed to players already connected; wait until everyone is in
+            for ( bool ready = false; !ready; )
+            {
+                SgCheck( Timer::getRelativeMicroseconds() - start < deadline );
+
+                waitForInput( clients, 10 );
+
+                ready = true;
+
+                iterate2 ( i, clients )
+                {
+                    i->receive();
+                    ready = ready && i->spawned;
+                }
+            }
+
+            for ( int move = 0; move < numMoves; move++ )
+            {
+                iterate2 ( i, clients )
+                {
+                    const PlayerMoveMessage message = { MSG_PLAYER_MOVE, 0.01f, 0.0f, 0.0f };
+                    i->send( &message, sizeof( message ) );
+                }
+
+                // Keep reading, so that neither side's socket buffers fill up
+                iterate2 ( i, clients )
+                    i->receive();
+            }
+
+            const unsigned expected = ( unsigned )( numMoves * ( numClients - 1 ) );
+
+            for ( bool done = false; !done; )
+            {
+                SgCheck( Timer::getRelativeMicroseconds() - start < deadline );
+
+                waitForInput( clients, 10 );
+
+                done = true;
+
+                iterate2 ( i, clients )
+                {
+                    i->receive();
+
+                    SgCheck( i->numMoves <= expected );
+                    done = done && i->numMoves == expected;
+                }
+            }
+        }
+    }
+}
+#endif
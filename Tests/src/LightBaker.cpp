@@ -0,0 +1,142 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/IO/LightBaker.hpp>
+
+namespace Tests
+{
+    static void addQuad( List<BspPolygon>& polygons, const Vector<>& min, const Vector<>& max, float z )
+    {
+        BspPolygon polygon;
+
+        polygon.numVertices = 4;
+        polygon.v[0].pos = Vector<>( min.x, min.y, z );
+        polygon.v[1].pos = Vector<>( max.x, min.y, z );
+        polygon.v[2].pos = Vector<>( max.x, max.y, z );
+        polygon.v[3].pos = Vector<>( min.x, max.y, z );
+
+        polygons.add( polygon );
+    }
+
+    static LightBaker::Light getLight( int type, const Vector<>& position, const Vector<>& direction, const Colour& diffuse, float range )
+    {
+        return LightBaker::Light { type, position, direction, Colour( 0.0f, 0.0f, 0.0f ), diffuse, range };
+    }
+
+    SgTest( LightBaker, golden )
+    {
+        // A floor and a 2x2 occluder one unit above it; luxels pick up 0.2 ambient plus 0.4 from an unoccluded light
+        List<BspPolygon> polygons;
+        addQuad( polygons, Vector<>( -10.0f, -10.0f ), Vector<>( 10.0f, 10.0f ), 0.0f );
+        addQuad( polygons, Vector<>( -1.0f, -1.0f ), Vector<>( 1.0f, 1.0f ), 1.0f );
+
+        const Vector<> up( 0.0f, 0.0f, 1.0f ), down( 0.0f, 0.0f, -1.0f );
+        const Vector<> shadowed( 0.3f, -0.2f, 0.0f ), lit( 3.0f, 0.0f, 0.0f );
+
+        Image image;
+        image.data.resize( 6 * 3, false );
+
+        LightBaker directional( Colour( 0.2f, 0.2f, 0.2f ) );
+        directional.addLight( getLight( LightBaker::directional, Vector<>(), down, Colour( 0.4f, 0.4f, 0.4f ), 0.0f ) );
+
+        directional.addLuxel( &image, 0, shadowed, up );
+        directional.addLuxel( &image, 3, lit, up );
+        directional.addLuxel( &image, 6, shadowed, up, false );
+        directional.addLuxel( &image, 9, lit, down );
+        directional.bake( polygons );
+
+        // A point light right above the occluder; the lit luxel gets 0.2 + (2 / sqrt( 29 )) * 4 / ( 2 * sqrt( 29 ) + 0.001 )
+        LightBaker point( Colour( 0.2f, 0.2f, 0.2f ) );
+        point.addLight( getLight( LightBaker::point, Vector<>( 0.0f, 0.0f, 2.0f ), Vector<>(), Colour( 1.0f, 1.0f, 1.0f ), 4.0f ) );
+
+        point.addLuxel( &image, 12, shadowed, up );
+        point.addLuxel( &image, 15, Vector<>( 5.0f, 0.0f, 0.0f ), up );
+        point.bake( polygons );
+
+        static const uint8_t expected[] = { 51, 153, 153, 51, 51, 86 };
+
+        for ( size_t i = 0; i < lengthof( expected ); i++ )
+            for ( size_t channel = 0; channel < 3; channel++ )
+                SgCheck( image.data[i * 3 + channel] == expected[i] );
+    }
+
+    SgTest( LightBaker, threadCount )
+    {
+        const unsigned resolution = getParameter( "resolution", 64 );
+
+        // Random occluders above a floor, lit from two point lights and the sun
+        List<BspPolygon> polygons;
+        addQuad( polygons, Vector<>( -10.0f, -10.0f ), Vector<>( 10.0f, 10.0f ), 0.0f );
+
+        uint32_t seed = 1;
+
+        for ( int i = 0; i < 200; i++ )
+        {
+            const Vector<> min( getRandom( seed, -10.0f, 9.0f ), getRandom( seed, -10.0f, 9.0f ) );
+
+            addQuad( polygons, min, min + Vector<>( getRandom( seed, 0.1f, 1.0f ), getRandom( seed, 0.1f, 1.0f ) ), getRandom( seed, 0.5f, 3.0f ) );
+        }
+
+        Image images[2];
+        unsigned numShadowed = 0, numLit = 0;
+
+        for ( int pass = 0; pass < 2; pass++ )
+        {
+            images[pass].data.resize( resolution * resolution * 3, false );
+
+            LightBaker baker( Colour( 0.1f, 0.1f, 0.1f ) );
+            baker.addLight( getLight( LightBaker::point, Vector<>( -3.0f, 2.0f, 6.0f ), Vector<>(), Colour( 0.5f, 0.4f, 0.3f ), 20.0f ) );
+            baker.addLight( getLight( LightBaker::point, Vector<>( 4.0f, -1.0f, 4.0f ), Vector<>(), Colour( 0.2f, 0.3f, 0.5f ), 10.0f ) );
+            baker.addLight( getLight( LightBaker::directional, Vector<>(), Vector<>( 0.3f, 0.2f, -1.0f ).normalize(), Colour( 0.3f, 0.3f, 0.3f ), 0.0f ) );
+
+            for ( unsigned y = 0; y < resolution; y++ )
+                for ( unsigned x = 0; x < resolution; x++ )
+                {
+                    const Vector<> pos( -10.0f + 20.0f * ( x + 0.5f ) / resolution, -10.0f + 20.0f * ( y + 0.5f ) / resolution, 0.0f );
+
+                    baker.addLuxel( &images[pass], ( y * resolution + x ) * 3, pos, Vector<>( 0.0f, 0.0f, 1.0f ) );
+                }
+
+            baker.bake( polygons, pass == 0 ? 1 : 4 );
+
+            // The scene must actually exercise the shadow rays (towards the sun, here)
+            for ( unsigned y = 0; y < resolution && pass == 0; y++ )
+                for ( unsigned x = 0; x < resolution; x++ )
+                {
+                    const Vector<> pos( -10.0f + 20.0f * ( x + 0.5f ) / resolution, -10.0f + 20.0f * ( y + 0.5f ) / resolution, 0.01f );
+
+                    if ( baker.isOccluded( pos, Vector<>( -0.3f, -0.2f, 1.0f ).normalize(), 1.0e30f ) )
+                        numShadowed++;
+                    else
+                        numLit++;
+                }
+        }
+
+        SgCheck( numShadowed > 0 && numLit > 0 );
+
+        for ( size_t i = 0; i < resolution * resolution * 3; i++ )
+            SgCheck( images[0].data[i] == images[1].data[i] );
+    }
+}
@@ -0,0 +1,220 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+namespace Tests
+{
+    static List<String> parameters;
+
+    static List<Test>& getRegistry()
+    {
+        static List<Test> tests;
+
+        return tests;
+    }
+
+    TestRegistration::TestRegistration( const char* name, TestFunction function, bool isBenchmark )
+    {
+        Test test = { name, function, isBenchmark };
+        getRegistry().add( test );
+    }
+
+    MemoryFileSystem::~MemoryFileSystem()
+    {
+        iterate ( fileNames )
+            delete files.get( fileNames.current() );
+    }
+
+    void MemoryFileSystem::addFile( const char* name, const void* data, size_t size )
+    {
+        File** existing = files.find( name );
+
+        if ( existing != nullptr )
+        {
+            delete *existing;
+            *existing = new File( data, size );
+        }
+        else
+        {
+            files.set( name, new File( data, size ) );
+            fileNames.add( name );
+        }
+    }
+
+    unsigned MemoryFileSystem::listDirectory( const char* path, List<DirEntry>& entries )
+    {
+        const String prefix = ( *path != 0 ) ? ( String ) path + "/" : String();
+        HashMap<String, bool> seen;
+        unsigned count = 0;
+
+        iterate ( fileNames )
+        {
+            const String& fileName = fileNames.current();
+
+            if ( !fileName.beginsWith( prefix ) )
+                continue;
+
+            // Only the first path component below `path`; deeper files show up as their directory
+            const String rest = fileName.dropLeftPart( prefix.getNumBytes() );
+            const int slash = rest.findChar( '/' );
+            const String name = ( slash < 0 ) ? rest : rest.leftPart( slash );
+
+            if ( seen.find( name ) != nullptr )
+                continue;
+
+            seen.set( name, true );
+
+            DirEntry entry = { name, prefix + name, slash >= 0, slash < 0 ? ( int64_t ) files.get( fileName )->size : -1 };
+            entries.add( entry );
+            count++;
+        }
+
+        return count;
+    }
+
+    SeekableInputStream* MemoryFileSystem::openInput( const char* fileName )
+    {
+        File** file = files.find( fileName );
+
+        if ( file == nullptr )
+            return nullptr;
+
+        return new ArrayIOStream( ( *file )->data.getPtr(), ( *file )->size );
+    }
+
+    void check( bool condition, const char* expression, const char* file, int line )
+    {
+        if ( !condition )
+            throw Exception( "Tests.check", "CheckFailed", ( String ) file + ":" + String::formatInt( line ) + ": `" + expression + "`" );
+    }
+
+    IEngine* createHeadlessEngine( const char* driverName )
+    {
+        List<String> arguments;
+        List<char*> argv;
+
+        arguments.add( "StormGraphTests" );
+        arguments.add( ( String ) "display.driver:" + driverName );
+
+        iterate ( parameters )
+            arguments.add( parameters.current() );
+
+        iterate ( arguments )
+            argv.add( const_cast<char*>( arguments.current().c_str() ) );
+
+        Object<IEngine> engine = Common::getCore( StormGraph_API_Version )->createEngine( "Tests", argv.getLength(), argv.getPtr() );
+
+        engine->addFileSystem( "native", true );
+        engine->startup();
+        engine->startupGraphics();
+
+        return engine.detach();
+    }
+
+    int getParameter( const char* name, int defaultValue )
+    {
+        const String prefix = ( String ) name + ":";
+
+        iterate ( parameters )
+            if ( parameters.current().beginsWith( prefix ) )
+                return String::toInt( parameters.current().dropLeftPart( prefix.getNumBytes() ) );
+
+        return defaultValue;
+    }
+
+    float getRandom( uint32_t& seed, float min, float max )
+    {
+        seed = seed * 1664525 + 1013904223;
+
+        return min + ( seed >> 8 ) * ( max - min ) / ( float )( 1 << 24 );
+    }
+}
+
+using namespace Tests;
+
+int main( int argc, char** argv )
+{
+    List<Test>& tests = getRegistry();
+    List<String> names;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strchr( argv[i], ':' ) != nullptr )
+            parameters.add( argv[i] );
+        else
+            names.add( argv[i] );
+    }
+
+    if ( names.isEmpty() )
+    {
+        printf( "usage: StormGraphTests <test | benchmark | all>... [name:value]...\n\n" );
+
+        iterate ( tests )
+            printf( "    %s%s\n", tests.current().name, tests.current().isBenchmark ? " (benchmark)" : "" );
+
+        return 0;
+    }
+
+    unsigned numRun = 0, numFailed = 0;
+
+    iterate ( names )
+    {
+        const String& name = names.current();
+        bool found = false;
+
+        iterate2 ( test, tests )
+        {
+            // `all` runs every test, but no benchmarks
+            if ( name == "all" ? ( *test ).isBenchmark : name != ( *test ).name )
+                continue;
+
+            found = true;
+            numRun++;
+
+            const uint64_t start = Timer::getRelativeMicroseconds();
+
+            try
+            {
+                ( *test ).function();
+
+                printf( "[  OK  ] %s (%u ms)\n", ( *test ).name, ( unsigned )( ( Timer::getRelativeMicroseconds() - start ) / 1000 ) );
+            }
+            catch ( Exception& ex )
+            {
+                printf( "[FAILED] %s\n    %s: %s\n    %s\n", ( *test ).name, ex.name.c_str(), ex.functionName.c_str(), ex.description.c_str() );
+                numFailed++;
+            }
+        }
+
+        if ( !found )
+        {
+            printf( "[FAILED] %s\n    no such test or benchmark\n", name.c_str() );
+            numFailed++;
+        }
+    }
+
+    printf( "\n%u run, %u failed\n", numRun, numFailed );
+
+    return numFailed > 0 ? 1 : 0;
+}
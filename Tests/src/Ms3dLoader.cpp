@@ -0,0 +1,367 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <NullDriver/NullDriver.hpp>
+
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/ResourceManager.hpp>
+#include <StormGraph/IO/ModelLoader.hpp>
+
+#pragma pack(1)
+
+namespace Tests
+{
+    struct Ms3dHeader
+    {
+        char id[10];
+        int version;
+    };
+
+    struct Ms3dVertex
+    {
+        unsigned char flags;
+        float vertex[3];
+        char boneId;
+        unsigned char referenceCount;
+    };
+
+    struct Ms3dTriangle
+    {
+        unsigned short flags;
+        unsigned short vertexIndices[3];
+        float vertexNormals[3][3];
+        float s[3];
+        float t[3];
+        unsigned char smoothingGroup;
+        unsigned char groupIndex;
+    };
+
+    struct Ms3dGroupPrologue
+    {
+        unsigned char flags;
+        char name[32];
+        unsigned short numTriangles;
+    };
+
+    struct Ms3dMaterial
+    {
+        char name[32];
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float emissive[4];
+        float shininess;
+        float transparency;
+        char mode;
+        char texture[128];
+        char alphamap[128];
+    };
+
+#pragma pack()
+
+    struct Ms3dMesh
+    {
+        String name;
+        List<Vertex> vertices;
+        bool hasMaterial;
+    };
+
+    // Keeps a copy of the meshes that loaders hand to createModelFromMemory
+    class MeshRecordingDriver : public NullDriver::NullDriver
+    {
+        public:
+            List<Ms3dMesh*> meshes;
+
+        public:
+            MeshRecordingDriver( IEngine* engine ) : NullDriver::NullDriver( engine, false )
+            {
+            }
+
+            ~MeshRecordingDriver()
+            {
+                clear();
+            }
+
+            void clear()
+            {
+                iterate ( meshes )
+                    delete meshes.current();
+
+                meshes.clear();
+            }
+
+            using NullDriver::NullDriver::createModelFromMemory;
+
+            virtual IModel* createModelFromMemory( const char* name, MeshCreationInfo2** meshes, size_t count, unsigned flags ) override
+            {
+                for ( size_t i = 0; i < count; i++ )
+                {
+                    Ms3dMesh* mesh = new Ms3dMesh;
+
+                    mesh->name = meshes[i]->name;
+                    mesh->hasMaterial = ( meshes[i]->material != nullptr );
+
+                    for ( size_t j = 0; j < meshes[i]->numVertices; j++ )
+                        mesh->vertices.add( meshes[i]->vertices[j] );
+
+                    this->meshes.add( mesh );
+                }
+
+                return NullDriver::NullDriver::createModelFromMemory( name, meshes, count, flags );
+            }
+    };
+
+    // Ms3dLoader as it was before the bulk read: one virtual stream call per field
+    static void decodeStreamed( SeekableInputStream* input, List<Ms3dMesh*>& meshes )
+    {
+        Ms3dHeader header;
+        input->readItems( &header, 1 );
+
+        List<Ms3dVertex> vertices;
+        List<Ms3dTriangle> polygons;
+
+        unsigned numVertices = input->read<unsigned short>();
+
+        while ( numVertices-- )
+            vertices.add( input->readUnsafe<Ms3dVertex>() );
+
+        unsigned numPolygons = input->read<unsigned short>();
+
+        while ( numPolygons-- )
+            polygons.add( input->readUnsafe<Ms3dTriangle>() );
+
+        const unsigned numMeshes = input->read<unsigned short>();
+        List<int> materialIndices;
+
+        for ( unsigned i = 0; i < numMeshes; i++ )
+        {
+            Ms3dGroupPrologue meshInfo = input->readUnsafe<Ms3dGroupPrologue>();
+
+            Ms3dMesh* mesh = new Ms3dMesh;
+            meshes.add( mesh );
+
+            char meshName[sizeof( meshInfo.name ) + 1];
+            memcpy( meshName, meshInfo.name, sizeof( meshInfo.name ) );
+            meshName[sizeof( meshInfo.name )] = 0;
+
+            mesh->name = meshName;
+
+            for ( unsigned j = 0; j < meshInfo.numTriangles; j++ )
+            {
+                int polyIdx = input->read<unsigned short>();
+
+                for ( int faceVtx = 0; faceVtx < 3; faceVtx++ )
+                {
+                    Vertex v;
+
+                    v.pos.x = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[0];
+                    v.pos.y = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[2];
+                    v.pos.z = vertices[polygons[polyIdx].vertexIndices[faceVtx]].vertex[1];
+
+                    v.normal.x = polygons[polyIdx].vertexNormals[faceVtx][0];
+                    v.normal.y = polygons[polyIdx].vertexNormals[faceVtx][2];
+                    v.normal.z = polygons[polyIdx].vertexNormals[faceVtx][1];
+
+                    v.uv[0].x = polygons[polyIdx].s[faceVtx];
+                    v.uv[0].y = polygons[polyIdx].t[faceVtx];
+
+                    mesh->vertices.add( v );
+                }
+            }
+
+            materialIndices.add( input->read<char>() );
+        }
+
+        const unsigned numMaterials = input->read<unsigned short>();
+
+        for ( unsigned i = 0; i < numMaterials; i++ )
+            input->readUnsafe<Ms3dMaterial>();
+
+        for each_in_list ( meshes, i )
+            meshes[i]->hasMaterial = ( materialIndices[i] >= 0 && ( unsigned ) materialIndices[i] < numMaterials );
+    }
+
+    // A valid MS3D image of numTriangles triangles (at most 65535), split into groups like a typical character model;
+    // every other group uses the only material
+    static ArrayIOStream* buildSyntheticModel( unsigned numTriangles )
+    {
+        Reference<ArrayIOStream> output = new ArrayIOStream();
+
+        const unsigned numVertices = minimum( numTriangles + 2, 0xFFFFu );
+        const unsigned trianglesPerGroup = 2048;
+
+        Ms3dHeader header;
+        memcpy( header.id, "MS3D000000", 10 );
+        header.version = 4;
+        output->write( &header, sizeof( header ) );
+
+        output->write<unsigned short>( numVertices );
+
+        for ( unsigned i = 0; i < numVertices; i++ )
+        {
+            Ms3dVertex vertex = { 0, { ( float ) i, ( float )( i % 7 ), ( float )( i % 13 ) }, -1, 1 };
+            output->write( &vertex, sizeof( vertex ) );
+        }
+
+        output->write<unsigned short>( numTriangles );
+
+        for ( unsigned i = 0; i < numTriangles; i++ )
+        {
+            Ms3dTriangle triangle;
+            memset( &triangle, 0, sizeof( triangle ) );
+
+            for ( int j = 0; j < 3; j++ )
+            {
+                triangle.vertexIndices[j] = ( unsigned short )( ( i + j ) % numVertices );
+                triangle.vertexNormals[j][j] = 1.0f;
+                triangle.s[j] = j * 0.5f;
+                triangle.t[j] = ( i % 16 ) / 16.0f;
+            }
+
+            triangle.groupIndex = ( unsigned char )( i / trianglesPerGroup );
+            output->write( &triangle, sizeof( triangle ) );
+        }
+
+        const unsigned numGroups = ( numTriangles + trianglesPerGroup - 1 ) / trianglesPerGroup;
+        output->write<unsigned short>( numGroups );
+
+        for ( unsigned i = 0; i < numGroups; i++ )
+        {
+            Ms3dGroupPrologue group;
+            memset( &group, 0, sizeof( group ) );
+            snprintf( group.name, sizeof( group.name ), "group%u", i );
+            group.numTriangles = ( unsigned short ) minimum( trianglesPerGroup, numTriangles - i * trianglesPerGroup );
+            output->write( &group, sizeof( group ) );
+
+            for ( unsigned j = 0; j < group.numTriangles; j++ )
+                output->write<unsigned short>( i * trianglesPerGroup + j );
+
+            output->write<char>( ( i % 2 == 0 ) ? 0 : -1 );
+        }
+
+        Ms3dMaterial material;
+        memset( &material, 0, sizeof( material ) );
+        strcpy( material.name, "synthetic" );
+        material.transparency = 1.0f;
+
+        output->write<unsigned short>( 1 );
+        output->write( &material, sizeof( material ) );
+
+        output->setPos( 0 );
+        return output.detach();
+    }
+
+    SgTest( Ms3dLoader, bulkDecoding )
+    {
+        // The engine goes first; it keeps the variables and command listener the driver registers with it
+        Object<MeshRecordingDriver> driver;
+        Object<IEngine> sg = createHeadlessEngine();
+        driver = new MeshRecordingDriver( sg );
+
+        Reference<ArrayIOStream> image = buildSyntheticModel( getParameter( "count", 10000 ) );
+
+        List<Ms3dMesh*> expected;
+        decodeStreamed( image, expected );
+
+        image->setPos( 0 );
+        Reference<IModel> model = Ms3dLoader::load( driver, "synthetic", image->reference(), sg->getSharedResourceManager() );
+
+        SgCheck( driver->meshes.getLength() == expected.getLength() );
+
+        for each_in_list ( expected, i )
+        {
+            const Ms3dMesh* a = expected[i], * b = driver->meshes[i];
+
+            SgCheck( a->name == b->name );
+            SgCheck( a->hasMaterial == b->hasMaterial );
+            SgCheck( a->vertices.getLength() == b->vertices.getLength() );
+
+            // Only the fields the loader sets; the rest of Vertex is left uninitialized
+            for each_in_list ( a->vertices, j )
+            {
+                const Vertex& va = a->vertices[j], & vb = b->vertices[j];
+
+                SgCheck( va.pos.x == vb.pos.x && va.pos.y == vb.pos.y && va.pos.z == vb.pos.z );
+                SgCheck( va.normal.x == vb.normal.x && va.normal.y == vb.normal.y && va.normal.z == vb.normal.z );
+                SgCheck( va.uv[0].x == vb.uv[0].x && va.uv[0].y == vb.uv[0].y );
+            }
+        }
+
+        iterate ( expected )
+            delete expected.current();
+
+        // Truncated files are rejected instead of being read past the end
+        Reference<ArrayIOStream> truncated = new ArrayIOStream( image->getPtr(), ( size_t ) image->getSize() / 2 );
+        bool failed = false;
+
+        try
+        {
+            Reference<IModel> broken = Ms3dLoader::load( driver, "truncated", truncated.detach(), sg->getSharedResourceManager() );
+        }
+        catch ( Exception& ex )
+        {
+            failed = ( ex.name == "InvalidFormat" );
+        }
+
+        SgCheck( failed );
+    }
+
+    SgBenchmark( Ms3dLoader, decodeBench )
+    {
+        const unsigned numTriangles = minimum( getParameter( "count", 60000 ), 0xFFFF );
+        const unsigned iterations = maximum( getParameter( "iterations", 20 ), 1 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Reference<ArrayIOStream> image = buildSyntheticModel( numTriangles );
+
+        uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; i < iterations; i++ )
+        {
+            List<Ms3dMesh*> meshes;
+
+            image->setPos( 0 );
+            decodeStreamed( image, meshes );
+
+            iterate ( meshes )
+                delete meshes.current();
+        }
+
+        const uint64_t streamedTime = ( Timer::getRelativeMicroseconds() - start ) / iterations;
+
+        start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; i < iterations; i++ )
+        {
+            image->setPos( 0 );
+            Reference<IModel> model = Ms3dLoader::load( sg->getGraphicsDriver(), "synthetic", image->reference(), sg->getSharedResourceManager() );
+        }
+
+        const uint64_t loadTime = ( Timer::getRelativeMicroseconds() - start ) / iterations;
+
+        printf( "Ms3dLoader.decodeBench: %u triangles, per-field decoding %u us, bulk load %u us\n", numTriangles,
+                ( unsigned ) streamedTime, ( unsigned ) loadTime );
+    }
+}
@@ -0,0 +1,958 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <Moxillan/BinaryFormat.hpp>
+#include <Moxillan/Package.hpp>
+#include <Moxillan/PackageBuilder.hpp>
+
+#include <littl/File.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <zlib.h>
+
+namespace Tests
+{
+    // Empty, tiny, around and past the 64 KiB chunk size
+    static const size_t syntheticFileSizes[] = { 0, 1, 100, 4096, 65535, 65536, 65537, 200000, 1 << 20 };
+
+    // A package's worth of files: odd ones live in a subdirectory, and every third one is stored rather than deflated
+    class SyntheticFiles
+    {
+        public:
+            Array<uint8_t> content;
+            size_t offsets[lengthof( syntheticFileSizes )];
+
+        public:
+            SyntheticFiles() : content( getTotalSize() )
+            {
+                for ( size_t i = 0, offset = 0; i < getCount(); offset += getSize( i ), i++ )
+                    offsets[i] = offset;
+
+                // Compressible, but not trivially so
+                uint32_t seed = 0x12345678;
+
+                for ( size_t i = 0; i < content.getCapacity(); i++ )
+                {
+                    seed = seed * 1664525 + 1013904223;
+                    content[i] = "etaoin shrdlu\n"[( seed >> 16 ) % 14];
+                }
+            }
+
+            static size_t getCount() { return lengthof( syntheticFileSizes ); }
+            static int getCompression( size_t i ) { return ( i % 3 == 0 ) ? 0 : 6; }
+            static String getName( size_t i ) { return "file" + String::formatInt( ( int ) i ); }
+            static String getPath( size_t i ) { return ( i % 2 == 1 ) ? "dir/" + getName( i ) : getName( i ); }
+            static size_t getSize( size_t i ) { return syntheticFileSizes[i]; }
+
+            static size_t getTotalSize()
+            {
+                size_t total = 0;
+
+                for ( size_t i = 0; i < getCount(); i++ )
+                    total += getSize( i );
+
+                return total;
+            }
+
+            const uint8_t* getData( size_t i ) const { return content.getPtr() + offsets[i]; }
+
+            // Current format, through PackageBuilder
+            void build( SeekableOutputStream* output, size_t chunkSize ) const
+            {
+                Object<Moxillan::DirectoryNode> rootDir = new Moxillan::DirectoryNode();
+                Moxillan::DirectoryNode* dir = new Moxillan::DirectoryNode( "dir" );
+
+                for ( size_t i = 0; i < getCount(); i++ )
+                {
+                    Moxillan::MemoryFileNode* file = new Moxillan::MemoryFileNode( getName( i ), ( uint8_t* ) getData( i ), getSize( i ), getCompression( i ) );
+
+                    if ( i % 2 == 1 )
+                        dir->add( file );
+                    else
+                        rootDir->add( file );
+                }
+
+                rootDir->add( dir );
+
+                Moxillan::PackageBuilder::buildPackage( rootDir, output->reference(), 0, 0, chunkSize );
+            }
+
+            // 0x0110 (all stored) or 0x0111 (whole-file deflate), as written before chunked entries existed
+            void buildLegacy( SeekableOutputStream* output, uint16_t formatVersion ) const
+            {
+                const bool deflate = ( formatVersion >= 0x0111 );
+
+                Moxillan::CommonHeader commonHeader;
+                memcpy( commonHeader.magic, Moxillan::headerMagic, 6 );
+                commonHeader.formatVersion = formatVersion;
+
+                // 0x0110 lacks the flags, but is otherwise laid out the same
+                Moxillan::Header_0x0111 header = { 0, 0, deflate ? ( uint32_t ) Moxillan::Header_0x0111::usesDeflate : 0 };
+                const size_t headerSize = deflate ? sizeof( Moxillan::Header_0x0111 ) : sizeof( Moxillan::Header_0x0110 );
+
+                output->write( commonHeader );
+                output->write( &header, headerSize );
+
+                uint32_t entries[lengthof( syntheticFileSizes )][2];
+
+                for ( size_t i = 0; i < getCount(); i++ )
+                {
+                    entries[i][0] = ( uint32_t ) output->getPos();
+
+                    if ( deflate && getCompression( i ) > 0 )
+                    {
+                        Array<uint8_t> compressed( compressBound( ( uLong ) getSize( i ) ) );
+                        uLongf compressedLength = ( uLongf ) compressed.getCapacity();
+
+                        compress2( compressed.getPtr(), &compressedLength, getData( i ), ( uLong ) getSize( i ), getCompression( i ) );
+                        output->write( compressed.getPtr(), compressedLength );
+                    }
+                    else
+                        output->write( getData( i ), getSize( i ) );
+
+                    entries[i][1] = ( uint32_t )( output->getPos() - entries[i][0] );
+                }
+
+                header.fileTableBegin = ( uint32_t ) output->getPos();
+
+                // Even files, then the subdirectory with the odd ones
+                for ( unsigned odd = 0; odd < 2; odd++ )
+                {
+                    if ( odd == 0 )
+                        output->write<uint16_t>( ( uint16_t )( ( getCount() + 1 ) / 2 + 1 ) );
+                    else
+                    {
+                        output->writeString( "dir" );
+                        output->write<uint8_t>( Moxillan::node_dir );
+                        output->write<uint16_t>( ( uint16_t )( getCount() / 2 ) );
+                    }
+
+                    for ( size_t i = odd; i < getCount(); i += 2 )
+                    {
+                        const bool compressed = deflate && getCompression( i ) > 0;
+
+                        output->writeString( getName( i ) );
+                        output->write<uint8_t>( compressed ? ( Moxillan::node_file | Moxillan::node_compressed ) : Moxillan::node_file );
+                        output->write<uint32_t>( entries[i][0] );
+                        output->write<uint32_t>( entries[i][1] );
+                        output->write<uint32_t>( ( uint32_t ) getSize( i ) );
+                    }
+                }
+
+                header.fileTableEnd = ( uint32_t ) output->getPos();
+
+                output->setPos( sizeof( commonHeader ) );
+                output->write( &header, headerSize );
+            }
+    };
+
+    // The three ways a Package reads file data: the shared (locked) input stream, positional reads and a memory mapping
+    enum PackageAccess { accessStream, accessPositional, accessMapped };
+
+    static const char* accessNames[] = { "stream", "positional", "mapped" };
+
+    static Moxillan::Package* openPackage( const char* fileName, PackageAccess access )
+    {
+        File* file = File::open( fileName );
+
+        if ( file == nullptr )
+            return nullptr;
+
+        return new Moxillan::Package( file, ( access != accessStream ) ? fileName : nullptr, access == accessMapped );
+    }
+
+    // Writes the synthetic files in one of the package formats to a native file
+    static bool writeSyntheticPackage( const char* fileName, const SyntheticFiles& files, unsigned format )
+    {
+        Reference<File> output = File::open( fileName, "wb" );
+
+        if ( output == nullptr )
+            return false;
+
+        switch ( format )
+        {
+            case 0: files.buildLegacy( output, 0x0110 ); break;
+            case 1: files.buildLegacy( output, 0x0111 ); break;
+            case 2: files.build( output, 0 ); break;
+            default: files.build( output, Moxillan::defaultChunkSize );
+        }
+
+        return true;
+    }
+
+    static const char* formatNames[] = { "0x0110", "0x0111", "whole-file", "chunked" };
+
+    static bool readsAll( Moxillan::Package* package, const char* path, Moxillan::Package::AccessStrategy strategy, const uint8_t* expected, size_t length,
+            uint8_t* buffer, size_t bufferCapacity )
+    {
+        Reference<SeekableInputStream> file = package->openFile( path, strategy );
+
+        if ( file == nullptr || file->getSize() != length )
+            return false;
+
+        size_t total = 0, count;
+
+        while ( ( count = file->read( buffer, bufferCapacity ) ) > 0 )
+        {
+            if ( total + count > length || memcmp( buffer, expected + total, count ) != 0 )
+                return false;
+
+            total += count;
+        }
+
+        return total == length;
+    }
+    // Mostly zeros, so that entries past 4 GiB deflate to a few MiB; every 64 KiB block begins with an 8-byte marker
+    static inline uint8_t syntheticByte( uint32_t seed, uint64_t pos )
+    {
+        const uint64_t block = pos >> 16;
+        const unsigned offset = ( unsigned )( pos & 0xFFFF );
+
+        if ( offset >= 8 )
+            return 0;
+
+        return ( uint8_t )( ( block * 0x9E3779B97F4A7C15ULL + seed ) >> ( 8 * offset ) );
+    }
+
+    // Generates its content on the fly instead of holding it in memory or on disk
+    class SyntheticStream : public SeekableInputStream
+    {
+        uint32_t seed;
+        uint64_t size, pos;
+
+        public:
+            SyntheticStream( uint32_t seed, uint64_t size ) : seed( seed ), size( size ), pos( 0 )
+            {
+            }
+
+            virtual uint64_t getPos() { return pos; }
+            virtual uint64_t getSize() { return size; }
+            virtual bool setPos( uint64_t pos ) { this->pos = pos; return true; }
+            virtual bool isEof() { return pos >= size; }
+            virtual bool isReadable() { return pos < size; }
+
+            virtual size_t read( void* output, size_t length )
+            {
+                length = ( size_t ) minimum<uint64_t>( length, size - pos );
+
+                uint8_t* bytes = ( uint8_t* ) output;
+                memset( bytes, 0, length );
+
+                // Fill in the markers overlapping [pos, pos + length)
+                for ( uint64_t block = pos >> 16; ( block << 16 ) < pos + length; block++ )
+                    for ( uint64_t at = block << 16; at < ( block << 16 ) + 8; at++ )
+                        if ( at >= pos && at < pos + length )
+                            bytes[at - pos] = syntheticByte( seed, at );
+
+                pos += length;
+                return length;
+            }
+
+            virtual size_t rawRead( void* output, size_t length )
+            {
+                return read( output, length );
+            }
+    };
+
+    class SyntheticFileNode : public Moxillan::IFileNode
+    {
+        String fileName;
+        uint32_t seed;
+        uint64_t size;
+        int compression;
+
+        public:
+            SyntheticFileNode( const char* fileName, uint32_t seed, uint64_t size, int compression )
+                    : fileName( fileName ), seed( seed ), size( size ), compression( compression )
+            {
+            }
+
+            virtual int getCompression() override { return compression; }
+            virtual InputStream* getInputStream() override { return new SyntheticStream( seed, size ); }
+            virtual String getName() override { return fileName; }
+    };
+
+    static bool readsBack( Moxillan::Package* package, const char* path, Moxillan::Package::AccessStrategy strategy, const String& expected )
+    {
+        Reference<SeekableInputStream> file = package->openFile( path, strategy );
+
+        if ( file == nullptr )
+            return false;
+
+        Array<char> buffer( expected.getNumBytes() + 1 );
+        size_t total = 0, count;
+
+        while ( ( count = file->read( buffer.getPtr() + total, buffer.getCapacity() - total ) ) > 0 )
+            total += count;
+
+        return total == expected.getNumBytes() && memcmp( buffer.getPtr(), expected.c_str(), total ) == 0;
+    }
+
+    static bool matchesSynthetic( SeekableInputStream* file, uint32_t seed, uint64_t pos, size_t length )
+    {
+        uint8_t buffer[64];
+
+        if ( !file->setPos( pos ) || file->read( buffer, length ) != length )
+            return false;
+
+        for ( size_t i = 0; i < length; i++ )
+            if ( buffer[i] != syntheticByte( seed, pos + i ) )
+                return false;
+
+        return true;
+    }
+
+    SgTest( Package, largeEntries )
+    {
+        // Past 4 GiB, so that every 32-bit size and offset (in the format and in zlib's counters) would overflow
+        const uint64_t entrySize = ( uint64_t ) getParameter( "mib", 4608 ) << 20;
+        const String trailer = "stored after the large entry";
+
+        for ( unsigned chunked = 0; chunked < 2; chunked++ )
+        {
+            Reference<ArrayIOStream> image = new ArrayIOStream();
+
+            {
+                Object<Moxillan::DirectoryNode> rootDir = new Moxillan::DirectoryNode();
+                rootDir->add( new SyntheticFileNode( "large", 1, entrySize, 1 ) );
+                rootDir->add( new Moxillan::MemoryFileNode( "trailer", trailer, 1 ) );
+
+                Moxillan::PackageBuilder::buildPackage( rootDir, image->reference(), 0, 0, chunked ? Moxillan::defaultChunkSize : 0 );
+            }
+
+            printf( "%s: %" PRIu64 " MiB packed into %" PRIu64 " KiB\n", chunked ? "chunked" : "whole-file", entrySize >> 20, image->getSize() >> 10 );
+
+            image->setPos( 0 );
+            Object<Moxillan::Package> package = new Moxillan::Package( image.detach() );
+
+            Moxillan::Node* node = package->findFile( "large" );
+            SgCheck( node != nullptr );
+
+            if ( node == nullptr )
+                continue;
+
+            Moxillan::DirEntry info;
+            package->getNodeInfo( node, &info );
+
+            SgCheck( info.size == entrySize );
+            SgCheck( info.isCompressed && info.isChunked == ( chunked != 0 ) );
+
+            // The entry behind the large one must be found at its full 64-bit offset
+            SgCheck( readsBack( package, "trailer", Moxillan::Package::sequential, trailer ) );
+            SgCheck( readsBack( package, "trailer", Moxillan::Package::random, trailer ) );
+
+            if ( chunked )
+            {
+                // Seek across the 4 GiB mark and to the very end
+                Reference<SeekableInputStream> file = package->openFile( node, Moxillan::Package::random );
+
+                SgCheck( matchesSynthetic( file, 1, 0, 32 ) );
+                SgCheck( matchesSynthetic( file, 1, minimum<uint64_t>( 1ULL << 32, entrySize - 16 ) - 16, 32 ) );
+                SgCheck( matchesSynthetic( file, 1, entrySize - 32, 32 ) );
+            }
+            else
+            {
+                // Inflate the whole stream, comparing it against the generator as it goes
+                Reference<SeekableInputStream> file = package->openFile( node, Moxillan::Package::sequential );
+                SyntheticStream expected( 1, entrySize );
+
+                Array<uint8_t> buffer( 16 << 20 ), expectedBuffer( 16 << 20 );
+                uint64_t total = 0;
+                bool equal = true;
+                size_t count;
+
+                while ( ( count = file->read( buffer.getPtr(), buffer.getCapacity() ) ) > 0 )
+                {
+                    equal = equal && expected.read( expectedBuffer.getPtr(), count ) == count
+                            && memcmp( buffer.getPtr(), expectedBuffer.getPtr(), count ) == 0;
+                    total += count;
+                }
+
+                SgCheck( total == entrySize );
+                SgCheck( equal );
+            }
+        }
+    }
+
+    // Seeks to random positions (and to every chunk boundary, the last partial chunk and the end) and reads back
+    static bool seeksCorrectly( SeekableInputStream* file, const uint8_t* expected, uint64_t size, size_t chunkSize, uint32_t seed )
+    {
+        Array<uint8_t> buffer( 3 * chunkSize + 1 );
+
+        List<uint64_t> positions;
+        List<size_t> lengths;
+
+        // Across each chunk boundary, backwards so that every read has to load a chunk other than the current one
+        for ( uint64_t boundary = ( size / chunkSize ) * chunkSize; boundary > 0; boundary -= chunkSize )
+        {
+            positions.add( boundary - minimum<uint64_t>( boundary, 7 ) );
+            lengths.add( 16 );
+        }
+
+        // Into and past the last (partial) chunk
+        positions.add( size - minimum<uint64_t>( size, 100 ) );
+        lengths.add( 200 );
+
+        for ( unsigned i = 0; i < 200; i++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            positions.add( ( seed >> 8 ) % ( size + 1 ) );
+
+            seed = seed * 1664525 + 1013904223;
+            lengths.add( ( seed >> 8 ) % buffer.getCapacity() );
+        }
+
+        for ( size_t i = 0; i < positions.getLength(); i++ )
+        {
+            const uint64_t pos = positions[i];
+            const size_t count = ( size_t ) minimum<uint64_t>( lengths[i], size - pos );
+
+            if ( !file->setPos( pos ) || file->getPos() != pos )
+                return false;
+
+            if ( file->read( buffer.getPtr(), lengths[i] ) != count || memcmp( buffer.getPtr(), expected + pos, count ) != 0 )
+                return false;
+
+            if ( file->getPos() != pos + count || file->isEof() != ( pos + count == size ) )
+                return false;
+        }
+
+        // Exactly at the end there's nothing left to read, and past it there's no seeking
+        if ( !file->setPos( size ) || file->read( buffer.getPtr(), 1 ) != 0 || !file->isEof() )
+            return false;
+
+        if ( file->setPos( size + 1 ) || file->getPos() != size )
+            return false;
+
+        // Back to the start after all that
+        const size_t count = ( size_t ) minimum<uint64_t>( size, buffer.getCapacity() );
+
+        return file->setPos( 0 ) && file->read( buffer.getPtr(), buffer.getCapacity() ) == count && memcmp( buffer.getPtr(), expected, count ) == 0;
+    }
+
+    // Same as the one Package uses to index directories (FNV-1a)
+    static uint32_t hashName( const char* name )
+    {
+        uint32_t hash = 0x811C9DC5;
+
+        for ( ; *name != 0; name++ )
+            hash = ( hash ^ ( uint8_t ) *name ) * 0x01000193;
+
+        return hash;
+    }
+
+    // Package::findFile/findDirectory as they were before the hashed index: a scan of each directory on the path,
+    // where the first child of a matching name decides (even if it has the wrong type)
+    static Moxillan::Node* findLinear( Moxillan::Package* package, Moxillan::Node* directory, const char* path, bool wantDirectory )
+    {
+        while ( directory != nullptr )
+        {
+            while ( *path == '/' || *path == '\\' )
+                path++;
+
+            const char* end = path;
+
+            while ( *end != 0 && *end != '/' && *end != '\\' )
+                end++;
+
+            const bool last = ( *end == 0 );
+
+            if ( end == path )
+                return ( last && wantDirectory ) ? directory : nullptr;
+
+            List<Moxillan::DirEntry> contents;
+            package->listDirectory( directory, contents );
+
+            Moxillan::Node* next = nullptr;
+
+            iterate ( contents )
+                if ( contents.current().name.getNumBytes() == ( size_t )( end - path )
+                        && memcmp( contents.current().name.c_str(), path, end - path ) == 0 )
+                {
+                    if ( contents.current().isDirectory == ( last ? wantDirectory : true ) )
+                        next = contents.current().node;
+
+                    break;
+                }
+
+            if ( last )
+                return next;
+
+            directory = next;
+            path = end + 1;
+        }
+
+        return nullptr;
+    }
+
+    static Moxillan::Package* buildInMemory( Moxillan::IDirectoryNode* rootDir )
+    {
+        Reference<ArrayIOStream> image = new ArrayIOStream();
+        Moxillan::PackageBuilder::buildPackage( rootDir, image->reference() );
+
+        image->setPos( 0 );
+        return new Moxillan::Package( image.detach() );
+    }
+
+    // Names in a directory spread over numDirectories subdirectories; lookups of every fourth one miss
+    static Moxillan::Package* buildLookupPackage( unsigned numEntries, unsigned numDirectories, List<String>& paths, unsigned numLookups )
+    {
+        Object<Moxillan::DirectoryNode> rootDir = new Moxillan::DirectoryNode();
+        List<Moxillan::DirectoryNode*> directories;
+
+        for ( unsigned i = 0; i < numDirectories; i++ )
+        {
+            Moxillan::DirectoryNode* directory = new Moxillan::DirectoryNode( "dir" + String::formatInt( i ) );
+            rootDir->add( directory );
+            directories.add( directory );
+        }
+
+        for ( unsigned i = 0; i < numEntries; i++ )
+        {
+            const String name = "file" + String::formatInt( i );
+            directories[i % numDirectories]->add( new Moxillan::MemoryFileNode( name, name ) );
+        }
+
+        uint32_t seed = 0x12345678;
+
+        for ( unsigned i = 0; i < numLookups; i++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            const unsigned entry = ( seed >> 8 ) % numEntries;
+
+            paths.add( "/dir" + String::formatInt( entry % numDirectories ) + "/file" + String::formatInt( ( i % 4 == 3 ) ? entry + numEntries : entry ) );
+        }
+
+        return buildInMemory( rootDir );
+    }
+
+    SgTest( Package, lookup )
+    {
+        Object<Moxillan::DirectoryNode> rootDir = new Moxillan::DirectoryNode();
+
+        // Two names with the same 32-bit hash; only the name comparison can tell them apart
+        String colliding[2];
+        {
+            const unsigned numNames = 1 << 18;
+            Array<uint64_t> hashes( numNames );
+
+            for ( unsigned i = 0; i < numNames; i++ )
+                hashes[i] = ( ( uint64_t ) hashName( "c" + String::formatInt( i ) ) << 32 ) | i;
+
+            std::sort( hashes.getPtr(), hashes.getPtr() + numNames );
+
+            for ( unsigned i = 1; i < numNames && colliding[0].isEmpty(); i++ )
+                if ( ( hashes[i] >> 32 ) == ( hashes[i - 1] >> 32 ) )
+                {
+                    colliding[0] = "c" + String::formatInt( ( unsigned )( hashes[i - 1] & 0xFFFFFFFF ) );
+                    colliding[1] = "c" + String::formatInt( ( unsigned )( hashes[i] & 0xFFFFFFFF ) );
+                }
+        }
+
+        SgCheck( !colliding[0].isEmpty() );
+
+        rootDir->add( new Moxillan::MemoryFileNode( colliding[0], "first" ) );
+        rootDir->add( new Moxillan::MemoryFileNode( colliding[1], "second" ) );
+
+        // 8 children make a 16-slot index; four of them hash to the last slot and two to the first,
+        // so that probing wraps around and runs into other chains
+        Moxillan::DirectoryNode* probe = new Moxillan::DirectoryNode( "probe" );
+        List<String> probeNames, probeMisses;
+        unsigned numLast = 0, numFirst = 0, numOther = 0;
+
+        for ( unsigned i = 0; probeNames.getLength() < 8 || probeMisses.getLength() < 4; i++ )
+        {
+            const String name = "w" + String::formatInt( i );
+            const uint32_t slot = hashName( name ) & 15;
+
+            if ( slot == 15 && numLast < 4 )
+                numLast++;
+            else if ( slot == 0 && numFirst < 2 )
+                numFirst++;
+            else if ( slot != 0 && slot != 15 && numOther < 2 )
+                numOther++;
+            else
+            {
+                // Lands in the crowded slots, but isn't there
+                if ( ( slot == 0 || slot == 15 ) && probeMisses.getLength() < 4 )
+                    probeMisses.add( name );
+
+                continue;
+            }
+
+            probeNames.add( name );
+            probe->add( new Moxillan::MemoryFileNode( name, name ) );
+        }
+
+        rootDir->add( probe );
+
+        // A file and a directory, each looked up as the other type
+        Moxillan::DirectoryNode* dir = new Moxillan::DirectoryNode( "dir" );
+        dir->add( new Moxillan::MemoryFileNode( "file", "file" ) );
+        dir->add( new Moxillan::MemoryFileNode( "file1", "file1" ) );
+        dir->add( new Moxillan::DirectoryNode( "sub" ) );
+        rootDir->add( dir );
+        rootDir->add( new Moxillan::MemoryFileNode( "file", "root file" ) );
+
+        Object<Moxillan::Package> package = buildInMemory( rootDir );
+        Moxillan::Node* root = package->findDirectory( "" );
+
+        SgCheck( root != nullptr );
+
+        // Colliding hashes
+        SgCheck( readsBack( package, colliding[0], Moxillan::Package::sequential, "first" ) );
+        SgCheck( readsBack( package, colliding[1], Moxillan::Package::sequential, "second" ) );
+        SgCheck( package->findFile( colliding[0] ) != package->findFile( colliding[1] ) );
+
+        // Wrapped-around probe sequences, hits and misses
+        iterate ( probeNames )
+            SgCheck( readsBack( package, "probe/" + probeNames.current(), Moxillan::Package::sequential, probeNames.current() ) );
+
+        iterate ( probeMisses )
+            SgCheck( package->findFile( "probe/" + probeMisses.current() ) == nullptr );
+
+        // Wrong types
+        SgCheck( package->findDirectory( "file" ) == nullptr );
+        SgCheck( package->findFile( "dir" ) == nullptr );
+        SgCheck( package->findDirectory( "dir/file" ) == nullptr );
+        SgCheck( package->findFile( "dir/sub" ) == nullptr );
+        SgCheck( package->findFile( "file/file" ) == nullptr );
+        SgCheck( package->findDirectory( "dir/sub" ) != nullptr );
+
+        // Names that are prefixes of each other, or differ in case only
+        SgCheck( readsBack( package, "dir/file", Moxillan::Package::sequential, "file" ) );
+        SgCheck( readsBack( package, "dir/file1", Moxillan::Package::sequential, "file1" ) );
+        SgCheck( package->findFile( "dir/fil" ) == nullptr );
+        SgCheck( package->findFile( "dir/file12" ) == nullptr );
+        SgCheck( package->findFile( "dir/FILE" ) == nullptr );
+
+        // Empty path components and trailing separators
+        SgCheck( package->findDirectory( "" ) == root );
+        SgCheck( package->findDirectory( "/" ) == root );
+        SgCheck( package->findFile( "" ) == nullptr );
+        SgCheck( package->findFile( "/" ) == nullptr );
+        SgCheck( package->findFile( "//dir///file" ) == package->findFile( "dir/file" ) );
+        SgCheck( package->findFile( "\\dir\\file" ) == package->findFile( "dir/file" ) );
+        SgCheck( package->findDirectory( "dir/" ) == package->findDirectory( "dir" ) );
+        SgCheck( package->findDirectory( "dir//sub//" ) == package->findDirectory( "dir/sub" ) );
+        SgCheck( package->findFile( "dir/file/" ) == nullptr );
+        SgCheck( package->findFile( "dir/" ) == nullptr );
+        SgCheck( package->findFile( "nowhere/file" ) == nullptr );
+
+        const char* paths[] = { "", "/", "file", "dir", "dir/", "dir/file", "dir//file1", "dir/sub", "dir/sub/", "dir/file/", "/dir/sub/x", "probe",
+                "probe/w0", "\\probe\\", "file/", "nowhere", "nowhere/" };
+
+        for ( size_t i = 0; i < lengthof( paths ); i++ )
+        {
+            SgCheck( package->findFile( paths[i] ) == findLinear( package, root, paths[i], false ) );
+            SgCheck( package->findDirectory( paths[i] ) == findLinear( package, root, paths[i], true ) );
+        }
+
+        // Many entries per directory, against the linear scan
+        List<String> lookups;
+        Object<Moxillan::Package> large = buildLookupPackage( 20000, 20, lookups, 2000 );
+        Moxillan::Node* largeRoot = large->findDirectory( "" );
+
+        unsigned numFound = 0;
+        bool same = true;
+
+        iterate ( lookups )
+        {
+            Moxillan::Node* node = large->findFile( lookups.current() );
+
+            same = same && node == findLinear( large, largeRoot, lookups.current(), false );
+            numFound += ( node != nullptr ) ? 1 : 0;
+        }
+
+        SgCheck( same );
+        SgCheck( numFound == lookups.getLength() - lookups.getLength() / 4 );
+    }
+
+    SgTest( Package, chunkedSeeks )
+    {
+        const char* fileName = "bin/Package.chunkedSeeks.tmp";
+
+        SyntheticFiles files;
+        SgCheck( writeSyntheticPackage( fileName, files, 3 ) );
+
+        for ( unsigned access = accessStream; access <= accessMapped; access++ )
+        {
+            Object<Moxillan::Package> package = openPackage( fileName, ( PackageAccess ) access );
+            SgCheck( package != nullptr );
+
+            if ( package == nullptr )
+                continue;
+
+            for ( size_t i = 0; i < files.getCount(); i++ )
+            {
+                Moxillan::DirEntry info;
+                package->getNodeInfo( package->findFile( files.getPath( i ) ), &info );
+
+                if ( !info.isChunked )
+                    continue;
+
+                Reference<SeekableInputStream> file = package->openFile( info.node, Moxillan::Package::random );
+                SgCheck( seeksCorrectly( file, files.getData( i ), files.getSize( i ), Moxillan::defaultChunkSize, ( uint32_t ) i + 1 ) );
+            }
+        }
+
+        remove( fileName );
+
+        // Small chunks of incompressible data, which are stored rather than deflated
+        const size_t chunkSize = 4096, size = 10 * chunkSize + 1234;
+
+        Array<uint8_t> noise( size );
+        uint32_t seed = 1;
+
+        for ( size_t i = 0; i < size; i++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            noise[i] = ( uint8_t )( seed >> 24 );
+        }
+
+        Reference<ArrayIOStream> image = new ArrayIOStream();
+
+        {
+            Object<Moxillan::DirectoryNode> rootDir = new Moxillan::DirectoryNode();
+            rootDir->add( new Moxillan::MemoryFileNode( "noise", noise.getPtr(), size, 6 ) );
+
+            Moxillan::PackageBuilder::buildPackage( rootDir, image->reference(), 0, 0, chunkSize );
+        }
+
+        image->setPos( 0 );
+        Object<Moxillan::Package> package = new Moxillan::Package( image.detach() );
+
+        Reference<SeekableInputStream> file = package->openFile( "noise", Moxillan::Package::random );
+        SgCheck( file != nullptr && seeksCorrectly( file, noise.getPtr(), size, chunkSize, 1234 ) );
+    }
+
+    SgTest( Package, concurrentReads )
+    {
+        const unsigned numThreads = getParameter( "threads", 4 );
+        const unsigned iterations = getParameter( "iterations", 4 );
+        const char* fileName = "bin/Package.concurrentReads.tmp";
+
+        SyntheticFiles files;
+
+        for ( unsigned format = 0; format < lengthof( formatNames ); format++ )
+        {
+            SgCheck( writeSyntheticPackage( fileName, files, format ) );
+
+            for ( unsigned access = accessStream; access <= accessMapped; access++ )
+            {
+                Object<Moxillan::Package> package = openPackage( fileName, ( PackageAccess ) access );
+                SgCheck( package != nullptr );
+
+                if ( package == nullptr )
+                    continue;
+
+                SgCheck( package->isConcurrent() == ( access != accessStream ) );
+                SgCheck( package->isMapped() == ( access == accessMapped ) );
+
+                // Every thread reads every file, sequentially and for random access, a few times over
+                std::atomic<unsigned> failures( 0 );
+                List<std::thread*> threads;
+
+                for ( unsigned i = 0; i < numThreads; i++ )
+                    threads.add( new std::thread( [&]()
+                    {
+                        // Odd-sized, so that reads straddle chunk boundaries
+                        Array<uint8_t> buffer( 10007 );
+
+                        for ( unsigned j = 0; j < iterations; j++ )
+                            for ( size_t k = 0; k < files.getCount(); k++ )
+                                for ( int strategy = Moxillan::Package::sequential; strategy <= Moxillan::Package::random; strategy++ )
+                                    if ( !readsAll( package, files.getPath( k ), ( Moxillan::Package::AccessStrategy ) strategy, files.getData( k ),
+                                            files.getSize( k ), buffer.getPtr(), buffer.getCapacity() ) )
+                                        failures++;
+                    } ) );
+
+                iterate ( threads )
+                {
+                    threads.current()->join();
+                    delete threads.current();
+                }
+
+                if ( failures > 0 )
+                    printf( "%s, %s: %u failed reads\n", formatNames[format], accessNames[access], failures.load() );
+
+                SgCheck( failures == 0 );
+
+                // Stored files can be viewed in place, but only when mapped
+                for ( size_t i = 0; i < files.getCount(); i++ )
+                {
+                    Moxillan::Node* node = package->findFile( files.getPath( i ) );
+                    SgCheck( node != nullptr );
+
+                    Moxillan::DirEntry info;
+                    package->getNodeInfo( node, &info );
+                    SgCheck( info.size == files.getSize( i ) );
+                    SgCheck( info.isCompressed == ( format > 0 && files.getCompression( i ) > 0 ) );
+
+                    const uint8_t* view = package->getFileView( node );
+
+                    if ( access == accessMapped && !info.isCompressed )
+                        SgCheck( view != nullptr && memcmp( view, files.getData( i ), files.getSize( i ) ) == 0 );
+                    else
+                        SgCheck( view == nullptr );
+                }
+            }
+        }
+
+        remove( fileName );
+    }
+
+    SgBenchmark( Package, readBench )
+    {
+        const unsigned numThreads = getParameter( "threads", 4 );
+        const unsigned iterations = getParameter( "iterations", 20 );
+        const char* fileName = "bin/Package.readBench.tmp";
+
+        SyntheticFiles files;
+
+        for ( unsigned format = 0; format < lengthof( formatNames ); format++ )
+        {
+            if ( !writeSyntheticPackage( fileName, files, format ) )
+                break;
+
+            for ( unsigned access = accessStream; access <= accessMapped; access++ )
+            {
+                Object<Moxillan::Package> package = openPackage( fileName, ( PackageAccess ) access );
+
+                if ( package == nullptr )
+                    continue;
+
+                std::atomic<uint64_t> bytesRead( 0 );
+                List<std::thread*> threads;
+
+                const uint64_t start = Timer::getRelativeMicroseconds();
+
+                for ( unsigned i = 0; i < numThreads; i++ )
+                    threads.add( new std::thread( [&]()
+                    {
+                        Array<uint8_t> buffer( 0x10000 );
+                        uint64_t count = 0;
+
+                        for ( unsigned j = 0; j < iterations; j++ )
+                            for ( size_t k = 0; k < files.getCount(); k++ )
+                            {
+                                Reference<SeekableInputStream> file = package->openFile( files.getPath( k ), Moxillan::Package::random );
+                                size_t length;
+
+                                while ( ( length = file->read( buffer.getPtr(), buffer.getCapacity() ) ) > 0 )
+                                    count += length;
+                            }
+
+                        bytesRead += count;
+                    } ) );
+
+                iterate ( threads )
+                {
+                    threads.current()->join();
+                    delete threads.current();
+                }
+
+                const double seconds = ( Timer::getRelativeMicroseconds() - start ) / 1000000.0;
+
+                printf( "Package.readBench: %-10s %-10s %u thread(s): %" PRIu64 " bytes in %.3f s (%.1f MiB/s)\n", formatNames[format], accessNames[access],
+                        numThreads, bytesRead.load(), seconds, bytesRead.load() / maximum( seconds, 1.0e-6 ) / ( 1024.0 * 1024.0 ) );
+            }
+        }
+
+        remove( fileName );
+    }
+
+    SgBenchmark( Package, seekBench )
+    {
+        const unsigned numReads = getParameter( "reads", 1000 );
+        const size_t readSize = getParameter( "size", 4096 );
+
+        SyntheticFiles files;
+        Array<uint8_t> buffer( readSize );
+
+        // Inflating whole files up to the requested position against inflating a single chunk
+        for ( unsigned format = 2; format < lengthof( formatNames ); format++ )
+        {
+            Reference<ArrayIOStream> image = new ArrayIOStream();
+            files.build( image, format == 2 ? 0 : Moxillan::defaultChunkSize );
+
+            image->setPos( 0 );
+            Object<Moxillan::Package> package = new Moxillan::Package( image.detach() );
+
+            // Fixed seed, so that both packages see the same sequence of reads
+            uint32_t seed = 0x12345678;
+
+            const uint64_t start = Timer::getRelativeMicroseconds();
+
+            for ( unsigned i = 0; i < numReads; i++ )
+            {
+                seed = seed * 1664525 + 1013904223;
+                const size_t index = ( seed >> 8 ) % files.getCount();
+
+                seed = seed * 1664525 + 1013904223;
+                const size_t size = files.getSize( index );
+                const uint64_t offset = ( size > readSize ) ? ( seed >> 8 ) % ( size - readSize ) : 0;
+
+                Reference<SeekableInputStream> file = package->openFile( files.getPath( index ), Moxillan::Package::random );
+                file->setPos( offset );
+                file->read( buffer.getPtr(), readSize );
+            }
+
+            printf( "Package.seekBench: %-10s %u reads of %u bytes: %.1f us per read\n", formatNames[format], numReads, ( unsigned ) readSize,
+                    ( double )( Timer::getRelativeMicroseconds() - start ) / maximum( numReads, 1u ) );
+        }
+    }
+
+    SgBenchmark( Package, lookupBench )
+    {
+        const unsigned numEntries = maximum( getParameter( "entries", 100000 ), 1 );
+        const unsigned numLookups = getParameter( "lookups", 1000000 );
+
+        // Directory lengths are stored as 16-bit counts, so spread the entries over subdirectories
+        const unsigned numDirectories = maximum( numEntries / 1000, 1u );
+
+        List<String> paths;
+
+        uint64_t start = Timer::getRelativeMicroseconds();
+        Object<Moxillan::Package> package = buildLookupPackage( numEntries, numDirectories, paths, numLookups );
+        const uint64_t buildTime = Timer::getRelativeMicroseconds() - start;
+
+        unsigned numFound = 0;
+
+        start = Timer::getRelativeMicroseconds();
+
+        iterate ( paths )
+            if ( package->findFile( paths.current() ) != nullptr )
+                numFound++;
+
+        const uint64_t lookupTime = Timer::getRelativeMicroseconds() - start;
+
+        printf( "Package.lookupBench: %u entries in %u directories, built and opened in %.1f ms\n", numEntries, numDirectories, buildTime / 1000.0 );
+        printf( "Package.lookupBench: %u lookups (%u hits): %.1f ns per lookup\n", numLookups, numFound, lookupTime * 1000.0 / maximum( numLookups, 1u ) );
+    }
+}
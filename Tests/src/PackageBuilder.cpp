@@ -0,0 +1,399 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <Moxillan/BinaryFormat.hpp>
+#include <Moxillan/Package.hpp>
+#include <Moxillan/PackageBuilder.hpp>
+
+#include <zlib.h>
+
+namespace Tests
+{
+    // Moxillan::PackageBuilder as it was before parallel compression and deduplication (format 0x0112):
+    // one file at a time, in tree order, on the calling thread
+    class LegacyPackageBuilder
+    {
+        struct Entry
+        {
+            bool compressed, chunked;
+            uint64_t offset, compressedSize, size;
+        };
+
+        List<Entry> entries;
+        size_t nextEntry;
+
+        static uint64_t writeChunkedStream( InputStream* input, SeekableOutputStream* output, int compression, size_t chunkSize )
+        {
+            Reference<> inputGuard( input );
+
+            const uint64_t entryBegin = output->getPos();
+
+            Moxillan::ChunkedEntryHeader header = { ( uint32_t ) chunkSize, 0, 0 };
+            output->write( header );
+
+            List<uint32_t> chunkOffsets;
+
+            Array<uint8_t> chunk( chunkSize );
+            Array<uint8_t> compressed( compressBound( ( uLong ) chunkSize ) );
+
+            uint64_t size = 0;
+
+            while ( true )
+            {
+                size_t length = 0;
+
+                while ( length < chunkSize )
+                {
+                    size_t count = input->read( chunk.getPtr() + length, chunkSize - length );
+
+                    if ( count == 0 )
+                        break;
+
+                    length += count;
+                }
+
+                if ( length == 0 )
+                    break;
+
+                chunkOffsets.add( ( uint32_t )( output->getPos() - entryBegin ) );
+                size += length;
+
+                uLongf compressedLength = ( uLongf ) compressed.getCapacity();
+
+                if ( compress2( compressed.getPtr(), &compressedLength, chunk.getPtr(), ( uLong ) length, compression ) == Z_OK && compressedLength < length )
+                    output->write( compressed.getPtr(), compressedLength );
+                else
+                    output->write( chunk.getPtr(), length );
+
+                if ( length < chunkSize )
+                    break;
+            }
+
+            header.numChunks = chunkOffsets.getLength();
+            chunkOffsets.add( ( uint32_t )( output->getPos() - entryBegin ) );
+            header.chunkTableOffset = chunkOffsets[header.numChunks];
+
+            for each_in_list ( chunkOffsets, i )
+                output->write<uint32_t>( chunkOffsets[i] );
+
+            const uint64_t entryEnd = output->getPos();
+
+            output->setPos( entryBegin );
+            output->write( header );
+            output->setPos( entryEnd );
+
+            return size;
+        }
+
+        static uint64_t writeStream( InputStream* input, OutputStream* output, int compression )
+        {
+            Reference<> inputGuard( input );
+
+            static const size_t ioBufferCapacity = 0x10000;
+            static uint8_t ioBuffer[ioBufferCapacity];
+
+            uint64_t size = 0;
+
+            if ( compression == 0 )
+            {
+                size_t count;
+
+                while ( ( count = input->read( ioBuffer, ioBufferCapacity ) ) > 0 )
+                {
+                    size += count;
+                    output->write( ioBuffer, count );
+                }
+
+                return size;
+            }
+
+            z_stream stream;
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            deflateInit( &stream, compression );
+
+            static uint8_t compressionBuffer[ioBufferCapacity];
+
+            while ( true )
+            {
+                size_t count = input->read( ioBuffer, ioBufferCapacity );
+
+                if ( count == 0 )
+                    break;
+
+                size += count;
+
+                stream.next_in = ioBuffer;
+                stream.avail_in = count;
+
+                int status = 0;
+                do
+                {
+                    stream.next_out = compressionBuffer;
+                    stream.avail_out = ioBufferCapacity;
+                    status = deflate( &stream, Z_NO_FLUSH );
+                    output->write( compressionBuffer, ioBufferCapacity - stream.avail_out );
+                }
+                while ( status == Z_OK && stream.avail_in );
+            }
+
+            int status = 0;
+            do
+            {
+                stream.next_out = compressionBuffer;
+                stream.avail_out = ioBufferCapacity;
+                status = deflate( &stream, Z_FINISH );
+                output->write( compressionBuffer, ioBufferCapacity - stream.avail_out );
+            }
+            while ( status == Z_OK );
+
+            deflateEnd( &stream );
+            return size;
+        }
+
+        void writeNodeData( Moxillan::INode* node, SeekableOutputStream* output, int compression, size_t chunkSize )
+        {
+            if ( node->getCompression() != Moxillan::inherit )
+                compression = node->getCompression();
+
+            Moxillan::IFileNode* file = dynamic_cast<Moxillan::IFileNode*>( node );
+
+            if ( file != nullptr )
+            {
+                Entry entry;
+                entry.compressed = ( compression > 0 );
+                entry.chunked = ( entry.compressed && chunkSize > 0 );
+                entry.offset = output->getPos();
+
+                if ( entry.chunked )
+                    entry.size = writeChunkedStream( file->getInputStream(), output, compression, chunkSize );
+                else
+                    entry.size = writeStream( file->getInputStream(), output, compression );
+
+                entry.compressedSize = output->getPos() - entry.offset;
+                entries.add( entry );
+                return;
+            }
+
+            Moxillan::IDirectoryNode* directory = dynamic_cast<Moxillan::IDirectoryNode*>( node );
+
+            iterate ( *directory )
+                writeNodeData( directory->current(), output, compression, chunkSize );
+        }
+
+        void writeNode( Moxillan::INode* node, OutputStream* output )
+        {
+            output->writeString( node->getName() );
+
+            Moxillan::IDirectoryNode* directory = dynamic_cast<Moxillan::IDirectoryNode*>( node );
+
+            if ( directory == nullptr )
+            {
+                const Entry& entry = entries[nextEntry++];
+
+                uint8_t type = Moxillan::node_file;
+
+                if ( entry.compressed )
+                    type |= entry.chunked ? ( Moxillan::node_compressed | Moxillan::node_chunked ) : Moxillan::node_compressed;
+
+                output->write<uint8_t>( type );
+                output->write<uint32_t>( ( uint32_t ) entry.offset );
+                output->write<uint32_t>( ( uint32_t ) entry.compressedSize );
+                output->write<uint32_t>( ( uint32_t ) entry.size );
+                return;
+            }
+
+            output->write<uint8_t>( Moxillan::node_dir );
+            output->write<uint16_t>( directory->iterableGetLength() );
+
+            iterate ( *directory )
+                writeNode( directory->current(), output );
+        }
+
+        public:
+            LegacyPackageBuilder() : nextEntry( 0 )
+            {
+            }
+
+            void buildPackage( Moxillan::IDirectoryNode* rootDir, SeekableOutputStream* output, int compression, size_t chunkSize )
+            {
+                Moxillan::CommonHeader commonHeader;
+                memcpy( commonHeader.magic, Moxillan::headerMagic, 6 );
+                commonHeader.formatVersion = 0x0112;
+
+                Moxillan::Header_0x0112 header = { 0, 0, 0 };
+
+                output->write( commonHeader );
+                output->write( header );
+
+                writeNodeData( rootDir, output, compression, chunkSize );
+
+                header.fileTableBegin = ( uint32_t ) output->getPos();
+
+                output->write<uint16_t>( rootDir->iterableGetLength() );
+
+                iterate ( *rootDir )
+                    writeNode( rootDir->current(), output );
+
+                header.fileTableEnd = ( uint32_t ) output->getPos();
+
+                output->setPos( sizeof( commonHeader ) );
+                output->write( header );
+            }
+    };
+
+    // Compressible, but not trivially so
+    static void fillSynthetic( uint8_t* data, size_t length, uint32_t seed )
+    {
+        for ( size_t i = 0; i < length; i++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            data[i] = "etaoin shrdlu\n"[( seed >> 16 ) % 14];
+        }
+    }
+
+    static Moxillan::DirectoryNode* createSyntheticTree( const Array<uint8_t>& content, unsigned numFiles, size_t fileSize,
+            const Array<uint8_t>& bigFile, int compression )
+    {
+        Moxillan::DirectoryNode* rootDir = new Moxillan::DirectoryNode();
+        Moxillan::DirectoryNode* stored = new Moxillan::DirectoryNode( "stored", 0 );
+
+        for ( unsigned i = 0; i < numFiles; i++ )
+        {
+            // Every fourth file is a copy of an earlier one, like textures shared between models
+            const unsigned source = ( i % 4 == 3 ) ? i / 2 : i;
+
+            rootDir->add( new Moxillan::MemoryFileNode( "file" + String::formatInt( i ), ( uint8_t* ) content.getPtr() + source * fileSize,
+                    fileSize, compression ) );
+        }
+
+        // Too big to be buffered by the builder, and present twice
+        rootDir->add( new Moxillan::MemoryFileNode( "big0", ( uint8_t* ) bigFile.getPtr(), bigFile.getCapacity(), compression ) );
+        rootDir->add( new Moxillan::MemoryFileNode( "big1", ( uint8_t* ) bigFile.getPtr(), bigFile.getCapacity(), compression ) );
+
+        // Same content as the compressed files, but stored; must not share their data
+        rootDir->add( stored );
+
+        for ( unsigned i = 0; i < 4 && i < numFiles; i++ )
+            stored->add( new Moxillan::MemoryFileNode( "file" + String::formatInt( i ), ( uint8_t* ) content.getPtr() + i * fileSize, fileSize ) );
+
+        return rootDir;
+    }
+
+    static bool readsBack( Moxillan::Package* package, const char* path, const uint8_t* expected, size_t length )
+    {
+        Reference<SeekableInputStream> file = package->openFile( path, Moxillan::Package::sequential );
+
+        if ( file == nullptr )
+            return false;
+
+        Array<uint8_t> buffer( length + 1 );
+        size_t total = 0, count;
+
+        while ( ( count = file->read( buffer.getPtr() + total, buffer.getCapacity() - total ) ) > 0 )
+            total += count;
+
+        return total == length && memcmp( buffer.getPtr(), expected, length ) == 0;
+    }
+
+    SgTest( PackageBuilder, legacyComparison )
+    {
+        const unsigned numFiles = getParameter( "files", 64 );
+        const size_t fileSize = getParameter( "kib", 64 ) * 1024;
+        const int compression = getParameter( "level", 6 );
+
+        Array<uint8_t> content( numFiles * fileSize ), bigFile( 9 << 20 );
+        fillSynthetic( content.getPtr(), content.getCapacity(), 0x12345678 );
+        fillSynthetic( bigFile.getPtr(), bigFile.getCapacity(), 0x87654321 );
+
+        // Old builder
+        Reference<ArrayIOStream> legacy = new ArrayIOStream();
+        uint64_t start = Timer::getRelativeMicroseconds();
+
+        {
+            Object<Moxillan::DirectoryNode> rootDir = createSyntheticTree( content, numFiles, fileSize, bigFile, compression );
+
+            LegacyPackageBuilder builder;
+            builder.buildPackage( rootDir, legacy, 0, Moxillan::defaultChunkSize );
+        }
+
+        const uint64_t legacyTime = Timer::getRelativeMicroseconds() - start;
+
+        // Current builder, on one thread and on all of them
+        Reference<ArrayIOStream> images[2];
+        uint64_t times[2];
+
+        for ( unsigned i = 0; i < 2; i++ )
+        {
+            Object<Moxillan::DirectoryNode> rootDir = createSyntheticTree( content, numFiles, fileSize, bigFile, compression );
+
+            images[i] = new ArrayIOStream();
+            start = Timer::getRelativeMicroseconds();
+            Moxillan::PackageBuilder::buildPackage( rootDir, images[i]->reference(), 0, 0, Moxillan::defaultChunkSize, i == 0 ? 1 : 0 );
+            times[i] = Timer::getRelativeMicroseconds() - start;
+        }
+
+        printf( "%u files, %u KiB of input\n", numFiles + 2 + minimum( numFiles, 4u ), ( unsigned )( ( content.getCapacity() + 2 * bigFile.getCapacity() ) >> 10 ) );
+        printf( "old builder         %8.1f ms, %" PRIu64 " bytes\n", legacyTime / 1000.0, legacy->getSize() );
+        printf( "1 thread            %8.1f ms, %" PRIu64 " bytes\n", times[0] / 1000.0, images[0]->getSize() );
+        printf( "all threads         %8.1f ms, %" PRIu64 " bytes\n", times[1] / 1000.0, images[1]->getSize() );
+
+        // The thread count doesn't change a single byte, and copies are only stored once
+        SgCheck( images[0]->getSize() == images[1]->getSize() );
+        SgCheck( memcmp( images[0]->getPtr(), images[1]->getPtr(), ( size_t ) images[0]->getSize() ) == 0 );
+        SgCheck( images[0]->getSize() < legacy->getSize() );
+
+        // Both packages hold exactly the same files
+        legacy->setPos( 0 );
+        images[0]->setPos( 0 );
+
+        Object<Moxillan::Package> legacyPackage = new Moxillan::Package( legacy.detach() );
+        Object<Moxillan::Package> package = new Moxillan::Package( images[0].detach() );
+
+        for ( unsigned i = 0; i < numFiles; i++ )
+        {
+            const String path = "/file" + String::formatInt( i );
+            const uint8_t* expected = content.getPtr() + ( ( i % 4 == 3 ) ? i / 2 : i ) * fileSize;
+
+            SgCheck( readsBack( legacyPackage, path, expected, fileSize ) );
+            SgCheck( readsBack( package, path, expected, fileSize ) );
+        }
+
+        for ( unsigned i = 0; i < 4 && i < numFiles; i++ )
+        {
+            const String path = "/stored/file" + String::formatInt( i );
+
+            SgCheck( readsBack( package, path, content.getPtr() + i * fileSize, fileSize ) );
+
+            Moxillan::DirEntry info;
+            package->getNodeInfo( package->findFile( path ), &info );
+            SgCheck( !info.isCompressed );
+        }
+
+        SgCheck( readsBack( legacyPackage, "/big1", bigFile.getPtr(), bigFile.getCapacity() ) );
+        SgCheck( readsBack( package, "/big0", bigFile.getPtr(), bigFile.getCapacity() ) );
+        SgCheck( readsBack( package, "/big1", bigFile.getPtr(), bigFile.getCapacity() ) );
+    }
+}
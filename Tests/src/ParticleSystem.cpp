@@ -0,0 +1,188 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <NullDriver/NullDriver.hpp>
+
+#include <StormGraph/ParticleSystem.hpp>
+
+namespace Tests
+{
+    // Keeps the sizes of the particles it is handed
+    class SizeRecorder : public IParticleRenderer
+    {
+        public:
+            List<float> sizes;
+
+            virtual void renderParticles( IParticleEmitter* emitter, const ParticleVertex* vertices, size_t count ) override
+            {
+                for ( size_t i = 0; i < count; i++ )
+                    sizes.add( vertices[i].size );
+            }
+    };
+
+    // Takes the vertex streams and does nothing with them, so that only updating and streaming is measured
+    class NullParticleRenderer : public IParticleRenderer
+    {
+        public:
+            virtual void renderParticles( IParticleEmitter* emitter, const ParticleVertex* vertices, size_t count ) override
+            {
+            }
+    };
+
+    static ParticleEmitterProperties getProperties( size_t maxParticles )
+    {
+        ParticleEmitterProperties properties;
+
+        properties.pos = Vector<>();
+        properties.velocity = Vector<>( 0.0f, 0.0f, 1.0f );
+        properties.velocitySpread = Vector<>( 1.0f, 1.0f, 1.0f );
+        properties.rate = 0.0f;
+        properties.maxParticles = maxParticles;
+        properties.acceleration = Vector<>();
+        properties.drag = 0.0f;
+        properties.lifetime = 2.0f;
+        properties.lifetimeSpread = 0.0f;
+        properties.colourBegin = Colour::grey( 1.0f );
+        properties.colourEnd = Colour::grey( 1.0f, 0.0f );
+        properties.sizeBegin = 2.0f;
+        properties.sizeEnd = 0.0f;
+        properties.material = nullptr;
+
+        return properties;
+    }
+
+    SgTest( ParticleSystem, perParticleSize )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<IParticleSystem> system = sg->createParticleSystem();
+
+        SizeRecorder recorder;
+        system->setRenderer( &recorder );
+
+        system->addEmitter( getProperties( 10 ) )->emit( 10 );
+
+        // Halfway through their lifetime
+        system->update( 1.0 );
+        system->render();
+
+        SgCheck( recorder.sizes.getLength() == 10 );
+
+        iterate2 ( i, recorder.sizes )
+            SgCheck( fabs( i - 1.0f ) < 1.0e-4f );
+    }
+
+    SgTest( ParticleSystem, streamedModel )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>( -10.0f, 0.0f, 0.0f ), Vector<>(), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        Object<IParticleSystem> system = sg->createParticleSystem();
+
+        const size_t maxParticles = 100, numParticles = 40;
+        system->addEmitter( getProperties( maxParticles ) )->emit( numParticles );
+
+        const size_t start = driver->getCommandLog().getLength();
+        const unsigned numFrames = 3;
+
+        for ( unsigned frame = 0; frame < numFrames; frame++ )
+        {
+            system->update( 0.1 );
+            system->render();
+        }
+
+        const List<NullDriver::Command>& commands = driver->getCommandLog();
+
+        size_t numUploads = 0, numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+        {
+            const NullDriver::Command& command = commands[i];
+
+            if ( command.subject != "StormGraph.ParticleSystem" )
+                continue;
+
+            if ( command.type == NullDriver::CommandType::uploadMesh )
+            {
+                // The full-capacity model once, then only the live billboards every frame
+                if ( numUploads == 0 )
+                    SgCheck( command.bytes >= maxParticles * 4 * sizeof( Vertex ) );
+                else
+                    SgCheck( command.bytes == numParticles * 4 * sizeof( Vertex ) );
+
+                numUploads++;
+            }
+            else if ( command.type == NullDriver::CommandType::drawMesh )
+            {
+                // Two triangles per live particle
+                SgCheck( command.count == numParticles * 2 );
+                numDraws++;
+            }
+        }
+
+        SgCheck( numUploads == 1 + numFrames );
+        SgCheck( numDraws == numFrames );
+    }
+
+    SgBenchmark( ParticleSystem, updateBench )
+    {
+        const size_t numParticles = getParameter( "count", 1000000 );
+        const unsigned numFrames = getParameter( "iterations", 100 );
+        const size_t numEmitters = 16;
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<IParticleSystem> system = sg->createParticleSystem();
+
+        NullParticleRenderer renderer;
+        system->setRenderer( &renderer );
+
+        ParticleEmitterProperties properties = getProperties( ( numParticles + numEmitters - 1 ) / numEmitters );
+
+        properties.velocity = Vector<>( 0.0f, 0.0f, 5.0f );
+        properties.acceleration = Vector<>( 0.0f, 0.0f, -9.81f );
+        properties.drag = 0.1f;
+        properties.lifetime = 1.0e6f;
+        properties.sizeBegin = 1.0f;
+        properties.sizeEnd = 0.1f;
+
+        for ( size_t i = 0; i < numEmitters; i++ )
+            system->addEmitter( properties )->emit( properties.maxParticles );
+
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned frame = 0; frame < numFrames; frame++ )
+        {
+            system->update( 1.0 / 60.0 );
+            system->render();
+        }
+
+        printf( "ParticleSystem.updateBench: %u us per frame for %u particles\n",
+                ( unsigned )( ( Timer::getRelativeMicroseconds() - start ) / maximum( numFrames, 1u ) ), ( unsigned ) numParticles );
+    }
+}
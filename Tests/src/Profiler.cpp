@@ -0,0 +1,293 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/Profiler.hpp>
+
+#include <thread>
+
+namespace Tests
+{
+    struct TraceEvent
+    {
+        String name, phase;
+        int tid;
+        int64_t ts, dur;
+    };
+
+    // Busy-waits, so that the scope's duration doesn't depend on the scheduler's sleep granularity
+    static void spin( uint64_t microseconds )
+    {
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        while ( Timer::getRelativeMicroseconds() - start < microseconds )
+            ;
+    }
+
+    static const ProfilerScopeStats* findStats( const List<ProfilerScopeStats>& stats, const char* name )
+    {
+        for ( size_t i = 0; i < stats.getLength(); i++ )
+            if ( stats[i].name == name )
+                return &stats[i];
+
+        return nullptr;
+    }
+
+    static int64_t parseField( const char* line, const char* field )
+    {
+        const char* value = strstr( line, field );
+        return ( value != nullptr ) ? strtoll( value + strlen( field ), nullptr, 10 ) : -1;
+    }
+
+    // Parses exportChromeTrace output, which is written one event per line; returns false if the document isn't well-formed
+    // The text is split up in place
+    static bool parseTrace( char* text, List<TraceEvent>& events )
+    {
+        bool opened = false, closed = false;
+
+        for ( char* line = strtok( text, "\r\n" ); line != nullptr; line = strtok( nullptr, "\r\n" ) )
+        {
+            if ( closed )
+                return false;
+
+            if ( !opened )
+            {
+                if ( strncmp( line, "{\"displayTimeUnit\"", 18 ) != 0 )
+                    return false;
+
+                opened = true;
+                continue;
+            }
+
+            if ( strcmp( line, "]}" ) == 0 )
+            {
+                closed = true;
+                continue;
+            }
+
+            char name[256], phase[8];
+
+            if ( *line == ',' )
+                line++;
+
+            if ( sscanf( line, "{\"name\": \"%255[^\"]\", \"ph\": \"%7[^\"]\"", name, phase ) != 2 || line[strlen( line ) - 1] != '}' )
+                return false;
+
+            TraceEvent event = { name, phase, ( int ) parseField( line, "\"tid\": " ), parseField( line, "\"ts\": " ), parseField( line, "\"dur\": " ) };
+            events.add( ( TraceEvent&& ) event );
+        }
+
+        return closed;
+    }
+
+    SgTest( Profiler, frameStats )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<IProfiler> profiler = sg->createProfiler();
+
+        const unsigned work = profiler->getScopeId( "work" );
+        const unsigned rare = profiler->getScopeId( "rare" );
+        profiler->getScopeId( "idle" );
+
+        // Frame f runs `work` f + 1 times for at least 1 ms each; `rare` only runs in frame 2
+        for ( unsigned frame = 0; frame < 4; frame++ )
+        {
+            for ( unsigned i = 0; i <= frame; i++ )
+            {
+                ProfilerScope scope( profiler, work );
+                spin( 1000 );
+            }
+
+            if ( frame == 2 )
+            {
+                ProfilerScope scope( profiler, rare );
+                spin( 500 );
+            }
+
+            profiler->markFrame();
+        }
+
+        // A frame without any calls leaves the statistics alone
+        profiler->markFrame();
+
+        List<ProfilerScopeStats> stats;
+        profiler->getStats( stats );
+
+        SgCheck( stats.getLength() == 3 );
+
+        const ProfilerScopeStats* workStats = findStats( stats, "work" );
+        const ProfilerScopeStats* rareStats = findStats( stats, "rare" );
+        const ProfilerScopeStats* idleStats = findStats( stats, "idle" );
+
+        SgCheck( workStats != nullptr && rareStats != nullptr && idleStats != nullptr );
+
+        if ( workStats == nullptr || rareStats == nullptr || idleStats == nullptr )
+            return;
+
+        SgCheck( workStats->numCalls == 10 );
+        SgCheck( workStats->numFrames == 4 );
+        SgCheck( workStats->minFrameTime >= 1000 );
+        SgCheck( workStats->maxFrameTime >= 4000 );
+        SgCheck( workStats->totalFrameTime >= 10000 );
+        SgCheck( workStats->minFrameTime <= workStats->totalFrameTime / workStats->numFrames );
+        SgCheck( workStats->totalFrameTime / workStats->numFrames <= workStats->maxFrameTime );
+
+        SgCheck( rareStats->numCalls == 1 );
+        SgCheck( rareStats->numFrames == 1 );
+        SgCheck( rareStats->minFrameTime >= 500 );
+        SgCheck( rareStats->minFrameTime == rareStats->maxFrameTime );
+        SgCheck( rareStats->totalFrameTime == rareStats->maxFrameTime );
+
+        SgCheck( idleStats->numCalls == 0 );
+        SgCheck( idleStats->numFrames == 0 );
+
+        // The last delta is that of the final run
+        SgCheck( profiler->getDelta( work ) >= 1000 );
+    }
+
+    SgTest( Profiler, chromeTrace )
+    {
+        const unsigned numEvents = getParameter( "events", 1000 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<IProfiler> profiler = sg->createProfiler();
+
+        const unsigned mainScope = profiler->getScopeId( "main" );
+        const unsigned early = profiler->getScopeId( "worker.early" );
+        const unsigned late = profiler->getScopeId( "worker.late" );
+
+        // The worker overflows its ring buffer, so that only its most recent events can be exported
+        std::thread worker( [&]()
+        {
+            for ( unsigned i = 0; i < numEvents; i++ )
+                ProfilerScope scope( profiler, early );
+
+            for ( unsigned i = 0; i < 20000; i++ )
+                ProfilerScope scope( profiler, late );
+        } );
+
+        for ( unsigned i = 0; i < numEvents; i++ )
+        {
+            ProfilerScope scope( profiler, mainScope );
+
+            if ( i % 100 == 99 )
+                profiler->markFrame();
+        }
+
+        worker.join();
+
+        Reference<ArrayIOStream> output = new ArrayIOStream();
+        profiler->exportChromeTrace( output );
+
+        Array<char> text( ( size_t ) output->getSize() + 1 );
+        memcpy( text.getPtr(), output->getPtr(), ( size_t ) output->getSize() );
+        text.getPtr()[output->getSize()] = 0;
+
+        List<TraceEvent> events;
+        SgCheck( parseTrace( text.getPtr(), events ) );
+
+        int mainTid = -1, workerTid = -1;
+        unsigned numMain = 0, numEarly = 0, numLate = 0, numFrames = 0, numThreadNames = 0;
+        bool valid = true;
+
+        iterate2 ( i, events )
+        {
+            const TraceEvent& event = i;
+
+            if ( event.phase == "M" )
+            {
+                if ( event.name == "thread_name" )
+                    numThreadNames++;
+
+                continue;
+            }
+
+            if ( event.phase == "i" )
+            {
+                numFrames += ( event.name == "frame" ) ? 1 : 0;
+                continue;
+            }
+
+            valid = valid && event.phase == "X" && event.ts >= 0 && event.dur >= 0;
+
+            if ( event.name == "main" )
+            {
+                numMain++;
+                valid = valid && ( mainTid < 0 || mainTid == event.tid );
+                mainTid = event.tid;
+            }
+            else if ( event.name == "worker.early" || event.name == "worker.late" )
+            {
+                if ( event.name == "worker.early" )
+                    numEarly++;
+                else
+                    numLate++;
+
+                valid = valid && ( workerTid < 0 || workerTid == event.tid );
+                workerTid = event.tid;
+            }
+            else
+                valid = false;
+        }
+
+        SgCheck( valid );
+        SgCheck( numThreadNames == 2 );
+        SgCheck( numFrames == numEvents / 100 );
+        SgCheck( mainTid >= 0 && workerTid >= 0 && mainTid != workerTid );
+
+        // Every main-thread event fits into the ring; the worker's early ones have all been overwritten
+        SgCheck( numMain == numEvents );
+        SgCheck( numEarly == 0 );
+        SgCheck( numLate > 0 && numLate < 20000 );
+    }
+
+    SgBenchmark( Profiler, overheadBench )
+    {
+        const unsigned iterations = getParameter( "iterations", 1000000 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Object<IProfiler> profiler = sg->createProfiler();
+
+        const unsigned id = profiler->getScopeId( "overhead" );
+
+        // Warm up the thread buffer and the caches
+        for ( unsigned i = 0; i < 1000; i++ )
+        {
+            profiler->reenter( id );
+            profiler->leave( id );
+        }
+
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; i < iterations; i++ )
+        {
+            profiler->reenter( id );
+            profiler->leave( id );
+        }
+
+        const double time = ( double )( Timer::getRelativeMicroseconds() - start ) * 1000.0 / maximum( iterations, 1u );
+
+        printf( "Profiler.overheadBench: %.1f ns per reenter/leave pair\n", time );
+    }
+}
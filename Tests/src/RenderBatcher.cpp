@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/RenderBatcher.hpp>
+
+namespace Tests
+{
+    // Only their addresses are used, as mesh identities
+    static const int meshes[6] = {};
+
+    static void addItem( RenderBatcher& batcher, int mesh, uint32_t program, uint32_t texture, uint32_t material, float x, bool blended = false )
+    {
+        const Transform transform( Transform::translate, Vector<>( x, 0.0f, 0.0f ) );
+
+        RenderBatcher::Item item;
+
+        item.mesh = &meshes[mesh];
+        item.program = program;
+        item.texture = texture;
+        item.material = material;
+        item.blended = blended;
+        item.localToWorld = Transform::compose( &transform, 1 );
+
+        batcher.add( item );
+    }
+
+    // Submission indices in draw order
+    static void getDrawOrder( const RenderBatcher& batcher, List<size_t>& order )
+    {
+        for ( size_t i = 0; i < batcher.getNumItems(); i++ )
+            order.add( batcher.getItemIndex( i ) );
+    }
+
+    static unsigned countMaterialChanges( const RenderBatcher& batcher )
+    {
+        const List<RenderBatcher::Run>& runs = batcher.getRuns();
+        unsigned numChanges = 0;
+
+        for ( size_t i = 0; i < runs.getLength(); i++ )
+            if ( runs[i].applyMaterial )
+                numChanges++;
+
+        return numChanges;
+    }
+
+    SgTest( RenderBatcher, order )
+    {
+        RenderBatcher batcher;
+
+        // Sparse GL-like names; the batcher has to rank them before they go into the keys
+        addItem( batcher, 0, 0x7000, 0x10000000, 5, 20.0f );
+        addItem( batcher, 1, 0x3000, 0x20000000, 6, 10.0f );
+        addItem( batcher, 2, 0x3000, 0x10000000, 9, 30.0f );
+        addItem( batcher, 3, 0x3000, 0x10000000, 9, 5.0f );
+        addItem( batcher, 4, 0, 0, 4, 10.0f, true );
+        addItem( batcher, 5, 0, 0, 4, 40.0f, true );
+
+        batcher.build( Vector<>(), false );
+
+        // Program, then texture, then material, then mesh (by address, here in array order); blended last, back to front
+        List<size_t> order;
+        getDrawOrder( batcher, order );
+
+        SgCheck( order.getLength() == 6 );
+        SgCheck( order[0] == 2 && order[1] == 3 && order[2] == 1 && order[3] == 0 );
+        SgCheck( order[4] == 5 && order[5] == 4 );
+
+        // One run per item without instancing; the material is only applied when it changes
+        const List<RenderBatcher::Run>& runs = batcher.getRuns();
+
+        SgCheck( runs.getLength() == 6 );
+        SgCheck( runs[0].applyMaterial && !runs[1].applyMaterial && runs[2].applyMaterial && runs[3].applyMaterial );
+        SgCheck( runs[4].applyMaterial && !runs[5].applyMaterial );
+        SgCheck( countMaterialChanges( batcher ) == 4 );
+
+        // Cleared for the next flush
+        batcher.clear();
+        batcher.build( Vector<>(), false );
+
+        SgCheck( batcher.getNumItems() == 0 && batcher.getRuns().isEmpty() );
+    }
+
+    SgTest( RenderBatcher, instancing )
+    {
+        RenderBatcher batcher;
+
+        addItem( batcher, 0, 0, 0, 1, 12.0f );
+        addItem( batcher, 1, 0, 0, 1, 20.0f );
+        addItem( batcher, 0, 0, 0, 1, 10.0f );
+        addItem( batcher, 0, 0, 0, 1, 11.0f );
+
+        // Same mesh, another material: never part of the same run
+        addItem( batcher, 0, 0, 0, 2, 13.0f );
+
+        batcher.build( Vector<>(), true );
+
+        const List<RenderBatcher::Run>& runs = batcher.getRuns();
+
+        SgCheck( runs.getLength() == 3 );
+        SgCheck( runs[0].count == 3 && runs[1].count == 1 && runs[2].count == 1 );
+
+        // The instanced draw selects its own program, so the next draw applies its material again
+        SgCheck( runs[0].applyMaterial && runs[1].applyMaterial && runs[2].applyMaterial );
+
+        // Instance matrices in draw order, front to back
+        const glm::mat4* matrices = batcher.getInstanceMatrices( runs[0] );
+
+        SgCheck( matrices[0][3][0] == 10.0f && matrices[1][3][0] == 11.0f && matrices[2][3][0] == 12.0f );
+
+        unsigned numInstanced, numInstancedDraws;
+        batcher.getInstancingStats( &numInstanced, &numInstancedDraws );
+
+        SgCheck( numInstanced == 3 && numInstancedDraws == 1 );
+
+        // Without instancing, the same items take one draw and two material changes each
+        batcher.build( Vector<>(), false );
+
+        SgCheck( batcher.getRuns().getLength() == 5 );
+        SgCheck( countMaterialChanges( batcher ) == 2 );
+
+        batcher.getInstancingStats( &numInstanced, &numInstancedDraws );
+        SgCheck( numInstanced == 0 && numInstancedDraws == 0 );
+
+        // Two meshes of one material, interleaved in depth, as props sharing an atlas material would be
+        batcher.clear();
+
+        for ( int i = 0; i < 8; i++ )
+            addItem( batcher, 2 + i % 2, 0, 0, 7, 30.0f + i );
+
+        batcher.build( Vector<>(), true );
+
+        SgCheck( batcher.getRuns().getLength() == 2 );
+        SgCheck( batcher.getRuns()[0].count == 4 && batcher.getRuns()[1].count == 4 );
+
+        // Front to back within each mesh
+        matrices = batcher.getInstanceMatrices( batcher.getRuns()[0] );
+
+        SgCheck( matrices[0][3][0] == 30.0f && matrices[1][3][0] == 32.0f && matrices[2][3][0] == 34.0f && matrices[3][3][0] == 36.0f );
+    }
+}
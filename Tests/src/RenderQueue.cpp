@@ -0,0 +1,309 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <NullDriver/NullDriver.hpp>
+
+#include <StormGraph/GeometryFactory.hpp>
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/RenderSortKey.hpp>
+#include <StormGraph/SceneGraph.hpp>
+
+namespace Tests
+{
+    static IModel* createCuboid( IGraphicsDriver* driver, const char* name, IMaterial* material )
+    {
+        CuboidCreationInfo2 creationInfo( Vector<>(), Vector<>( 1.0f, 1.0f, 1.0f ), Vector<>( 0.5f, 0.5f, 0.5f ), true );
+
+        return driver->createCuboid( name, creationInfo, material, IModel::fullStatic );
+    }
+
+    // Subjects of the meshes drawn since the command log had `start` entries
+    static void getDrawnMeshes( NullDriver::NullDriver* driver, size_t start, List<String>& drawn )
+    {
+        const List<NullDriver::Command>& commands = driver->getCommandLog();
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+                drawn.add( commands[i].subject );
+    }
+
+    SgTest( RenderQueue, sortKeys )
+    {
+        // Opaque before blended, whatever the distances
+        SgCheck( RenderSortKey::getOpaque( 255, 4095, 4095, 4095, 1.0e30f ) < RenderSortKey::getBlended( 0, 0.0f ) );
+        SgCheck( !RenderSortKey::isBlended( RenderSortKey::getOpaque( 255, 4095, 4095, 4095, 1.0e30f ) ) );
+        SgCheck( RenderSortKey::isBlended( RenderSortKey::getBlended( 0, 0.0f ) ) );
+
+        // State, then mesh, before depth for opaque draws, front to back within a mesh
+        SgCheck( RenderSortKey::getOpaque( 0, 0, 0, 0, 1.0e6f ) < RenderSortKey::getOpaque( 0, 0, 0, 1, 1.0f ) );
+        SgCheck( RenderSortKey::getOpaque( 0, 0, 0, 1, 1.0e6f ) < RenderSortKey::getOpaque( 0, 0, 1, 0, 1.0f ) );
+        SgCheck( RenderSortKey::getOpaque( 0, 1, 0, 0, 1.0e6f ) < RenderSortKey::getOpaque( 1, 0, 0, 0, 1.0f ) );
+        SgCheck( RenderSortKey::getOpaque( 0, 0, 0, 0, 1.0f ) < RenderSortKey::getOpaque( 0, 0, 0, 0, 4.0f ) );
+
+        // Ids that don't fit are clamped rather than spilling into the neighbouring fields
+        SgCheck( RenderSortKey::getOpaque( 0, 0, 0, 100000, 1.0e30f ) < RenderSortKey::getOpaque( 0, 0, 1, 0, 0.0f ) );
+
+        // Depth before state for blended draws, back to front
+        SgCheck( RenderSortKey::getBlended( 1, 100.0f ) < RenderSortKey::getBlended( 0, 1.0f ) );
+        SgCheck( RenderSortKey::getBlended( 0, 100.0f ) < RenderSortKey::getBlended( 1, 100.0f ) );
+
+        // GL names and material ids are sparse and unbounded; ranks are not
+        uint32_t values[] = { 0x10000000, 5, 0x10000000, 70000, 5 };
+        List<uint32_t> distinct;
+
+        RenderSortKey::makeDense( values, 5, distinct );
+
+        SgCheck( values[0] == 2 && values[1] == 0 && values[2] == 2 && values[3] == 1 && values[4] == 0 );
+    }
+
+    SgTest( RenderQueue, order )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        Reference<IMaterial> a = driver->createSolidMaterial( "a", Colour( 1.0f, 0.0f, 0.0f ), nullptr );
+        Reference<IMaterial> b = driver->createSolidMaterial( "b", Colour( 0.0f, 1.0f, 0.0f ), nullptr );
+        Reference<IMaterial> glass = driver->createSolidMaterial( "glass", Colour( 0.0f, 0.0f, 1.0f, 0.5f ), nullptr );
+
+        Reference<IModel> nearA = createCuboid( driver, "near_a", a ), farA = createCuboid( driver, "far_a", a );
+        Reference<IModel> nearB = createCuboid( driver, "near_b", b ), farB = createCuboid( driver, "far_b", b );
+        Reference<IModel> nearGlass = createCuboid( driver, "near_glass", glass ), farGlass = createCuboid( driver, "far_glass", glass );
+
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>(), Vector<>( 1.0f, 0.0f, 0.0f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        Object<IRenderQueue> queue = driver->createRenderQueue();
+
+        const Transform nearPos( Transform::translate, Vector<>( 10.0f, 0.0f, 0.0f ) ), farPos( Transform::translate, Vector<>( 20.0f, 0.0f, 0.0f ) );
+
+        // Interleaved states, blended geometry first and near to far
+        queue->add( nearGlass, &nearPos, 1 );
+        queue->add( farB, &farPos, 1 );
+        queue->add( farGlass, &farPos, 1 );
+        queue->add( farA, &farPos, 1 );
+        queue->add( nearB, &nearPos, 1 );
+        queue->add( nearA, &nearPos, 1 );
+
+        const size_t start = driver->getCommandLog().getLength();
+        queue->render();
+
+        List<String> drawn;
+        getDrawnMeshes( driver, start, drawn );
+
+        // Opaque meshes are grouped by material, then by mesh (front to back only applies to the instances of one mesh)
+        SgCheck( drawn.getLength() == 6 );
+        SgCheck( ( drawn[0] == "near_a" && drawn[1] == "far_a" ) || ( drawn[0] == "far_a" && drawn[1] == "near_a" ) );
+        SgCheck( ( drawn[2] == "near_b" && drawn[3] == "far_b" ) || ( drawn[2] == "far_b" && drawn[3] == "near_b" ) );
+        SgCheck( drawn[4] == "far_glass" && drawn[5] == "near_glass" );
+
+        // The queue is empty again after a flush
+        const size_t flushed = driver->getCommandLog().getLength();
+        queue->render();
+
+        SgCheck( driver->getCommandLog().getLength() == flushed );
+    }
+
+    SgTest( RenderQueue, sceneGraph )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        Reference<IMaterial> glass = driver->createSolidMaterial( "glass", Colour( 0.0f, 0.0f, 1.0f, 0.5f ), nullptr );
+
+        Reference<IModel> nearGlass = createCuboid( driver, "near_glass", glass ), farGlass = createCuboid( driver, "far_glass", glass );
+
+        Object<ISceneGraph> scene = sg->createSceneGraph( "scene" );
+
+        // Added near to far; the scene graph must leave the blending order to its render queue
+        scene->addModel( nearGlass, Vector<>( 10.0f, 0.0f, 0.0f ), Vector<>() );
+        scene->addModel( farGlass, Vector<>( 20.0f, 0.0f, 0.0f ), Vector<>() );
+
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>(), Vector<>( 1.0f, 0.0f, 0.0f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        const size_t start = driver->getCommandLog().getLength();
+
+        scene->prerender();
+        scene->render();
+
+        List<String> drawn;
+        getDrawnMeshes( driver, start, drawn );
+
+        SgCheck( drawn.getLength() == 2 );
+        SgCheck( drawn[0] == "far_glass" && drawn[1] == "near_glass" );
+    }
+
+    SgTest( RenderQueue, instancing )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        Reference<IMaterial> a = driver->createSolidMaterial( "a", Colour( 1.0f, 0.0f, 0.0f ), nullptr );
+
+        Reference<IModel> box = createCuboid( driver, "box", a ), other = createCuboid( driver, "other", a );
+
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>(), Vector<>( 1.0f, 0.0f, 0.0f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        Object<IRenderQueue> queue = driver->createRenderQueue();
+
+        const Transform positions[] =
+        {
+            Transform( Transform::translate, Vector<>( 10.0f, 0.0f, 0.0f ) ),
+            Transform( Transform::translate, Vector<>( 11.0f, 0.0f, 0.0f ) ),
+            Transform( Transform::translate, Vector<>( 12.0f, 0.0f, 0.0f ) ),
+            Transform( Transform::translate, Vector<>( 20.0f, 0.0f, 0.0f ) )
+        };
+
+        unsigned numInstanced, numInstancedDraws;
+        size_t start;
+
+        // Three boxes sort next to each other and become one draw; the lone mesh doesn't
+        for ( size_t i = 0; i < 3; i++ )
+            queue->add( box, &positions[i], 1 );
+
+        queue->add( other, &positions[3], 1 );
+
+        start = driver->getCommandLog().getLength();
+        queue->render();
+
+        const List<NullDriver::Command>& commands = driver->getCommandLog();
+        unsigned numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+            {
+                SgCheck( commands[i].instances == ( commands[i].subject == "box" ? 3 : 1 ) );
+                numDraws++;
+            }
+
+        SgCheck( numDraws == 2 );
+
+        queue->getInstancingStats( &numInstanced, &numInstancedDraws );
+        SgCheck( numInstanced == 3 && numInstancedDraws == 1 );
+
+        // Two meshes of one material, interleaved in depth: still one instanced draw per mesh
+        queue->add( box, &positions[0], 1 );
+        queue->add( other, &positions[1], 1 );
+        queue->add( box, &positions[2], 1 );
+        queue->add( other, &positions[3], 1 );
+
+        start = commands.getLength();
+        queue->render();
+
+        numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+            {
+                SgCheck( commands[i].instances == 2 );
+                numDraws++;
+            }
+
+        SgCheck( numDraws == 2 );
+
+        queue->getInstancingStats( &numInstanced, &numInstancedDraws );
+        SgCheck( numInstanced == 4 && numInstancedDraws == 2 );
+
+        // Disabled, every mesh is drawn on its own
+        queue->setInstancing( false );
+
+        for ( size_t i = 0; i < 3; i++ )
+            queue->add( box, &positions[i], 1 );
+
+        start = commands.getLength();
+        queue->render();
+
+        numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+            {
+                SgCheck( commands[i].instances == 1 );
+                numDraws++;
+            }
+
+        SgCheck( numDraws == 3 );
+
+        queue->getInstancingStats( &numInstanced, &numInstancedDraws );
+        SgCheck( numInstanced == 0 && numInstancedDraws == 0 );
+
+        // Through a scene graph: the camera pass is instanced, the shadow map pass is not
+        Object<ISceneGraph> scene = sg->createSceneGraph( "scene" );
+
+        PointLightProperties properties;
+
+        properties.ambient = Colour( 0.0f, 0.0f, 0.0f, 1.0f );
+        properties.diffuse = Colour( 1.0f, 1.0f, 1.0f, 1.0f );
+        properties.specular = Colour( 0.0f, 0.0f, 0.0f, 1.0f );
+        properties.direction = glm::vec3( 0.0f, 0.0f, -1.0f );
+        properties.pos = glm::vec3( 11.0f, 0.0f, 8.0f );
+        properties.range = 20.0f;
+
+        scene->addPointLight( properties, false, 90.0f, 64 );
+
+        for ( size_t i = 0; i < 3; i++ )
+            scene->addModel( box, Vector<>( 10.0f + i, 0.0f, 0.0f ), Vector<>() );
+
+        start = commands.getLength();
+        scene->prerender();
+
+        numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+            {
+                SgCheck( commands[i].instances == 1 );
+                numDraws++;
+            }
+
+        SgCheck( numDraws == 3 );
+
+        start = commands.getLength();
+        scene->render();
+
+        numDraws = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == NullDriver::CommandType::drawMesh )
+            {
+                SgCheck( commands[i].instances == 3 );
+                numDraws++;
+            }
+
+        SgCheck( numDraws == 1 );
+
+        SceneCullingStats stats;
+        scene->getCullingStats( &stats );
+
+        SgCheck( stats.numInstanced == 3 && stats.numInstanceBatches == 1 );
+    }
+}
@@ -0,0 +1,489 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/ResourceManager.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Tests
+{
+    // 1x1 RGBA image, the smallest texture the image loader will accept
+    static const uint8_t pixelPng[] =
+    {
+        0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52,
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4,
+        0x89, 0x00, 0x00, 0x00, 0x0B, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0xF8, 0x0F, 0x04, 0x00,
+        0x09, 0xFB, 0x03, 0xFD, 0xFB, 0x5E, 0x6B, 0x2B, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44,
+        0xAE, 0x42, 0x60, 0x82
+    };
+
+    static String getTextureName( unsigned index )
+    {
+        return "tex/" + String::formatInt( index ) + ".png";
+    }
+
+    static void addTextures( MemoryFileSystem* fs, unsigned numTextures )
+    {
+        for ( unsigned i = 0; i < numTextures; i++ )
+            fs->addFile( getTextureName( i ), pixelPng, sizeof( pixelPng ) );
+    }
+
+    static MemoryFileSystem* createTextureFileSystem( unsigned numTextures )
+    {
+        Reference<MemoryFileSystem> fs = new MemoryFileSystem;
+        addTextures( fs, numTextures );
+
+        return fs.detach();
+    }
+
+    // Counts the files opened by the owner thread (the one that created it) and by everybody else,
+    // and can hold a streaming worker inside openInput to pin its request as active
+    class WatchedFileSystem : public MemoryFileSystem
+    {
+        std::thread::id owner;
+
+        // Guards everything below
+        std::mutex gateMutex;
+        std::condition_variable gateCondition;
+        List<String> heldNames, waitingNames, openedNames;
+
+        static bool contains( const List<String>& names, const char* name )
+        {
+            for ( size_t i = 0; i < names.getLength(); i++ )
+                if ( names[i] == name )
+                    return true;
+
+            return false;
+        }
+
+        static void remove( List<String>& names, const char* name )
+        {
+            iterate ( names )
+                if ( names.current() == name )
+                {
+                    names.remove( names.iter() );
+                    return;
+                }
+        }
+
+        protected:
+            virtual ~WatchedFileSystem() {}
+
+        public:
+            std::atomic<unsigned> ownerOpens, workerOpens;
+
+        public:
+            li_ReferencedClass_override( WatchedFileSystem )
+
+            WatchedFileSystem() : owner( std::this_thread::get_id() ), ownerOpens( 0 ), workerOpens( 0 )
+            {
+            }
+
+            // Files in the order they were opened
+            void getOpenedNames( List<String>& names )
+            {
+                std::lock_guard<std::mutex> lock( gateMutex );
+
+                iterate ( openedNames )
+                    names.add( openedNames.current() );
+            }
+
+            // Whoever opens `name` waits until it's released
+            void hold( const char* name )
+            {
+                std::lock_guard<std::mutex> lock( gateMutex );
+                heldNames.add( name );
+            }
+
+            void release( const char* name )
+            {
+                std::lock_guard<std::mutex> lock( gateMutex );
+                remove( heldNames, name );
+                gateCondition.notify_all();
+            }
+
+            // Waits (for at most 30 seconds) until somebody is being held on `name`
+            bool waitUntilHeld( const char* name )
+            {
+                std::unique_lock<std::mutex> lock( gateMutex );
+                return gateCondition.wait_for( lock, std::chrono::seconds( 30 ), [this, name] { return contains( waitingNames, name ); } );
+            }
+
+            virtual SeekableInputStream* openInput( const char* fileName ) override
+            {
+                if ( std::this_thread::get_id() == owner )
+                    ownerOpens++;
+                else
+                    workerOpens++;
+
+                {
+                    std::unique_lock<std::mutex> lock( gateMutex );
+                    openedNames.add( fileName );
+
+                    if ( contains( heldNames, fileName ) )
+                    {
+                        waitingNames.add( fileName );
+                        gateCondition.notify_all();
+
+                        gateCondition.wait( lock, [this, fileName] { return !contains( heldNames, fileName ); } );
+                        remove( waitingNames, fileName );
+                    }
+                }
+
+                return MemoryFileSystem::openInput( fileName );
+            }
+    };
+
+    SgTest( ResourceManager, lookup )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+        Reference<IResourceManager> resMgr = sg->createResourceManager( "lookup", true, createTextureFileSystem( 4 ) );
+
+        Reference<ITexture> first = resMgr->getTexture( getTextureName( 0 ) );
+        Reference<ITexture> second = resMgr->getTexture( getTextureName( 1 ) );
+
+        // Repeated lookups are served from the index
+        Reference<ITexture> again = resMgr->getTexture( getTextureName( 0 ) );
+        SgCheck( ( ITexture* ) again == ( ITexture* ) first );
+        SgCheck( ( ITexture* ) second != ( ITexture* ) first );
+        again.release();
+
+        // releaseUnused drops only what nobody else holds; a dropped texture is simply loaded again
+        second.release();
+        resMgr->releaseUnused();
+
+        Reference<ITexture> kept = resMgr->getTexture( getTextureName( 0 ) );
+        SgCheck( ( ITexture* ) kept == ( ITexture* ) first );
+
+        second = resMgr->getTexture( getTextureName( 1 ) );
+        SgCheck( second != nullptr );
+        SgCheck( strcmp( second->getName(), getTextureName( 1 ) ) == 0 );
+
+        // Preloads share the slot of the texture they finalize into
+        ITexture* texture = nullptr;
+        ITexturePreload* preload = nullptr;
+
+        SgCheck( resMgr->getTexturePreload( getTextureName( 2 ), &texture, &preload ) == false );
+        SgCheck( preload != nullptr );
+        preload->release();
+
+        Reference<ITexture> finalized = resMgr->getTexture( getTextureName( 2 ) );
+        SgCheck( finalized != nullptr );
+
+        // Indexed entries are borrowed, not referenced
+        SgCheck( resMgr->getTexturePreload( getTextureName( 2 ), &texture, &preload ) == true );
+        SgCheck( texture == ( ITexture* ) finalized );
+    }
+
+    class StreamingRecorder : public IStreamingListener
+    {
+        public:
+            List<unsigned> completed, failed;
+
+            virtual void onStreamingComplete( IResourceManager* resMgr, unsigned ticket, IResource* resource, const char* errorDesc ) override
+            {
+                if ( resource != nullptr && errorDesc == nullptr )
+                    completed.add( ticket );
+                else
+                    failed.add( ticket );
+            }
+    };
+
+    SgTest( ResourceManager, streaming )
+    {
+        const unsigned numTextures = getParameter( "count", 256 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+
+        Reference<WatchedFileSystem> fs = new WatchedFileSystem;
+        addTextures( fs, numTextures );
+
+        Reference<IResourceManager> resMgr = sg->createResourceManager( "streaming", true, fs->reference() );
+
+        resMgr->setNumStreamingWorkers( 4 );
+
+        StreamingRecorder recorder;
+        List<unsigned> tickets;
+
+        for ( unsigned i = 0; i < numTextures; i++ )
+            tickets.add( resMgr->streamTexture( getTextureName( i ), i % 3, &recorder ) );
+
+        const unsigned missing = resMgr->streamTexture( "tex/missing.png", 0, &recorder );
+
+        // Meanwhile the owner thread keeps changing the settings the workers read
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; resMgr->getNumPendingStreams() > 0; i++ )
+        {
+            SgCheck( Timer::getRelativeMicroseconds() - start < 30 * 1000000ull );
+
+            if ( i % 2 == 0 )
+                resMgr->addPath( "nowhere/" );
+            else
+                SgCheck( resMgr->removePath( "nowhere/" ) );
+
+            resMgr->setLoadFlag( LoadFlag::useShadowMapping, i % 2 );
+
+            resMgr->processStreaming( 1000 );
+        }
+
+        resMgr->removePath( "nowhere/" );
+        SgCheck( !resMgr->removePath( "nowhere/" ) );
+
+        SgCheck( recorder.completed.getLength() == numTextures );
+        SgCheck( recorder.failed.getLength() == 1 && recorder.failed[0] == missing );
+
+        // Every ticket exactly once
+        for each_in_list ( tickets, i )
+        {
+            size_t count = 0;
+
+            iterate2 ( j, recorder.completed )
+                if ( j == tickets[i] )
+                    count++;
+
+            SgCheck( count == 1 );
+        }
+
+        // Idle workers must wake up for new requests
+        pauseThread( 100 );
+
+        resMgr->streamTexture( getTextureName( 0 ), 0, &recorder );
+
+        while ( resMgr->getNumPendingStreams() > 0 )
+        {
+            SgCheck( Timer::getRelativeMicroseconds() - start < 30 * 1000000ull );
+
+            resMgr->processStreaming( 1000 );
+        }
+
+        SgCheck( recorder.completed.getLength() == numTextures + 1 );
+
+        // All I/O and decoding happened on the workers; the owner thread only finalized
+        SgCheck( fs->ownerOpens == 0 );
+        SgCheck( fs->workerOpens >= numTextures );
+    }
+
+    SgTest( ResourceManager, cancelStreaming )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+
+        Reference<WatchedFileSystem> fs = new WatchedFileSystem;
+        addTextures( fs, 8 );
+
+        Reference<IResourceManager> resMgr = sg->createResourceManager( "cancelStreaming", true, fs->reference() );
+
+        // A single worker, held on the first request while the others queue up behind it
+        resMgr->setNumStreamingWorkers( 1 );
+
+        StreamingRecorder recorder;
+
+        fs->hold( getTextureName( 0 ) );
+        const unsigned active = resMgr->streamTexture( getTextureName( 0 ), 0, &recorder );
+        SgCheck( fs->waitUntilHeld( getTextureName( 0 ) ) );
+
+        const unsigned pending = resMgr->streamTexture( getTextureName( 1 ), 0, &recorder );
+        const unsigned kept = resMgr->streamTexture( getTextureName( 2 ), 0, &recorder );
+        const unsigned completed = resMgr->streamTexture( getTextureName( 3 ), 1, &recorder );
+
+        // Lowest priority, so once the worker is held on it, everything else has been decoded
+        fs->hold( getTextureName( 4 ) );
+        const unsigned last = resMgr->streamTexture( getTextureName( 4 ), -1, &recorder );
+
+        SgCheck( resMgr->cancelStreaming( pending ) );
+        SgCheck( !resMgr->cancelStreaming( pending ) );
+
+        // The worker can't be interrupted, but it will drop the result
+        SgCheck( resMgr->cancelStreaming( active ) );
+
+        fs->release( getTextureName( 0 ) );
+        SgCheck( fs->waitUntilHeld( getTextureName( 4 ) ) );
+
+        // Decoded, but not handed to the listener yet
+        SgCheck( resMgr->getNumPendingStreams() == 3 );
+        SgCheck( resMgr->cancelStreaming( completed ) );
+        SgCheck( !resMgr->cancelStreaming( completed ) );
+        SgCheck( resMgr->getNumPendingStreams() == 2 );
+
+        fs->release( getTextureName( 4 ) );
+
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        while ( resMgr->getNumPendingStreams() > 0 )
+        {
+            SgCheck( Timer::getRelativeMicroseconds() - start < 30 * 1000000ull );
+
+            resMgr->processStreaming( 1000 );
+        }
+
+        // Only the requests that weren't cancelled reach the listener
+        SgCheck( recorder.failed.isEmpty() );
+        SgCheck( recorder.completed.getLength() == 2 && recorder.completed[0] == kept && recorder.completed[1] == last );
+
+        // Too late for those, and the pending one was never even opened
+        SgCheck( !resMgr->cancelStreaming( kept ) );
+        SgCheck( !resMgr->cancelStreaming( 12345 ) );
+
+        List<String> opened;
+        fs->getOpenedNames( opened );
+
+        iterate ( opened )
+            SgCheck( strcmp( opened.current(), getTextureName( 1 ) ) != 0 );
+    }
+
+    SgTest( ResourceManager, streamingPriority )
+    {
+        Object<IEngine> sg = createHeadlessEngine();
+
+        Reference<WatchedFileSystem> fs = new WatchedFileSystem;
+        addTextures( fs, 8 );
+
+        Reference<IResourceManager> resMgr = sg->createResourceManager( "streamingPriority", true, fs->reference() );
+
+        resMgr->setNumStreamingWorkers( 1 );
+
+        StreamingRecorder recorder;
+
+        fs->hold( getTextureName( 0 ) );
+        const unsigned first = resMgr->streamTexture( getTextureName( 0 ), 0, &recorder );
+        SgCheck( fs->waitUntilHeld( getTextureName( 0 ) ) );
+
+        // Textures 1 to 5; the last one is raised above the others while pending
+        const int priorities[] = { 0, 2, 1, 2, 0 };
+        unsigned tickets[lengthof( priorities )];
+
+        for ( size_t i = 0; i < lengthof( priorities ); i++ )
+            tickets[i] = resMgr->streamTexture( getTextureName( i + 1 ), priorities[i], &recorder );
+
+        SgCheck( resMgr->setStreamingPriority( tickets[4], 3 ) );
+
+        fs->hold( getTextureName( 6 ) );
+        const unsigned last = resMgr->streamTexture( getTextureName( 6 ), -1, &recorder );
+
+        fs->release( getTextureName( 0 ) );
+        SgCheck( fs->waitUntilHeld( getTextureName( 6 ) ) );
+
+        // Workers take the highest priority first, the oldest first among equal ones
+        const unsigned expectedOrder[] = { 0, 5, 2, 4, 3, 1, 6 };
+
+        List<String> opened;
+        fs->getOpenedNames( opened );
+
+        SgCheck( opened.getLength() == lengthof( expectedOrder ) );
+
+        for ( size_t i = 0; i < opened.getLength() && i < lengthof( expectedOrder ); i++ )
+            SgCheck( strcmp( opened[i], getTextureName( expectedOrder[i] ) ) == 0 );
+
+        // Completed requests are finalized in the same order
+        resMgr->processStreaming( 30 * 1000000 );
+
+        const unsigned expectedTickets[] = { tickets[4], tickets[1], tickets[3], tickets[2], tickets[0] };
+
+        SgCheck( recorder.completed.getLength() == 1 + lengthof( expectedTickets ) );
+        SgCheck( !recorder.completed.isEmpty() && recorder.completed[0] == first );
+
+        for ( size_t i = 0; i < lengthof( expectedTickets ) && i + 1 < recorder.completed.getLength(); i++ )
+            SgCheck( recorder.completed[i + 1] == expectedTickets[i] );
+
+        fs->release( getTextureName( 6 ) );
+
+        const uint64_t start = Timer::getRelativeMicroseconds();
+
+        while ( resMgr->getNumPendingStreams() > 0 )
+        {
+            SgCheck( Timer::getRelativeMicroseconds() - start < 30 * 1000000ull );
+
+            resMgr->processStreaming( 1000 );
+        }
+
+        SgCheck( recorder.completed.getLength() == 2 + lengthof( expectedTickets ) && recorder.completed[1 + lengthof( expectedTickets )] == last );
+    }
+
+    SgBenchmark( ResourceManager, lookupBench )
+    {
+        const unsigned numTextures = getParameter( "count", 10000 );
+        const unsigned numLookups = getParameter( "iterations", 1000000 );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        Reference<IResourceManager> resMgr = sg->createResourceManager( "lookupBench", true, createTextureFileSystem( numTextures ) );
+
+        // What the lookups used to do: a linear scan with a dynamic_cast and a name comparison per resource
+        List<IResource*> resources;
+        List<String> names;
+
+        for ( unsigned i = 0; i < numTextures; i++ )
+        {
+            names.add( getTextureName( i ) );
+
+            ITexture* texture = resMgr->getTexture( names[i] );
+            resources.add( texture );
+            texture->release();
+        }
+
+        uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; i < numLookups; i++ )
+        {
+            ITexture* texture = resMgr->getTexture( names[( i * 7919u ) % numTextures] );
+            texture->release();
+        }
+
+        const double indexedTime = ( double )( Timer::getRelativeMicroseconds() - start ) / numLookups;
+
+        // The scan is much slower; fewer lookups are enough to measure it
+        const unsigned numScans = maximum( numLookups / 100u, 1u );
+        size_t numFound = 0;
+
+        start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned i = 0; i < numScans; i++ )
+        {
+            const String& name = names[( i * 7919u ) % numTextures];
+
+            iterate ( resources )
+            {
+                ITexture* texture = dynamic_cast<ITexture*>( resources.current() );
+
+                if ( texture != nullptr && name.equals( texture->getName() ) )
+                {
+                    numFound++;
+                    break;
+                }
+            }
+        }
+
+        const double scanTime = ( double )( Timer::getRelativeMicroseconds() - start ) / numScans;
+
+        SgCheck( numFound == numScans );
+
+        printf( "ResourceManager.lookupBench: %u textures, %.3f us per indexed lookup, %.3f us per linear scan\n",
+                numTextures, indexedTime, scanTime );
+    }
+}
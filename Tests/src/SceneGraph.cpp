@@ -0,0 +1,354 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <NullDriver/NullDriver.hpp>
+
+#include <StormGraph/GeometryFactory.hpp>
+#include <StormGraph/GraphicsDriver.hpp>
+#include <StormGraph/SceneGraph.hpp>
+#include <StormGraph/ViewFrustum.hpp>
+
+namespace Tests
+{
+    // Compares the nodes drawn by the scene graph with a per-node frustum test over the same boxes
+    static void checkCulling( NullDriver::NullDriver* driver, ISceneGraph* scene, const List<String>& names, const List<Vector<>>& positions, float radius )
+    {
+        const size_t start = driver->getCommandLog().getLength();
+
+        scene->prerender();
+        scene->render();
+
+        List<bool> drawn;
+
+        for ( size_t i = 0; i < names.getLength(); i++ )
+            drawn.add( false );
+
+        const List<NullDriver::Command>& commands = driver->getCommandLog();
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+        {
+            if ( commands[i].type != NullDriver::CommandType::drawMesh )
+                continue;
+
+            for ( size_t j = 0; j < names.getLength(); j++ )
+                if ( commands[i].subject == names[j] )
+                {
+                    SgCheck( !drawn[j] );
+                    drawn[j] = true;
+                }
+        }
+
+        const ViewFrustum* frustum = driver->getViewFrustum();
+        const Vector<> extent( radius, radius, radius );
+
+        unsigned numVisible = 0;
+
+        for ( size_t i = 0; i < names.getLength(); i++ )
+        {
+            const bool visible = frustum->boxInFrustum( positions[i] - extent, positions[i] + extent ) != ViewFrustum::outside;
+
+            SgCheck( drawn[i] == visible );
+
+            if ( visible )
+                numVisible++;
+        }
+
+        SceneCullingStats stats;
+        scene->getCullingStats( &stats );
+
+        SgCheck( stats.numDrawn == numVisible );
+        SgCheck( stats.numDrawn + stats.numCulled == names.getLength() );
+    }
+
+    SgTest( SceneGraph, bvhCulling )
+    {
+        const size_t count = getParameter( "count", 500 );
+
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        Object<ISceneGraph> scene = sg->createSceneGraph( "scene" );
+
+        CuboidCreationInfo2 creationInfo( Vector<>(), Vector<>( 1.0f, 1.0f, 1.0f ), Vector<>( 0.5f, 0.5f, 0.5f ), true );
+        float radius = 0.0f;
+
+        List<String> names;
+        List<Vector<>> positions;
+        List<IModelNode*> nodes;
+
+        uint32_t seed = 1;
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            // Distinct models, so that every node can be told apart in the command log
+            const String name = "node" + String::formatInt( i );
+            Reference<IModel> model = driver->createCuboid( name, creationInfo, driver->getSolidMaterial(), IModel::fullStatic );
+
+            // ModelNode bounds the model by the sphere through the farthest corner of its box
+            if ( i == 0 )
+            {
+                Vector<> bounds[2];
+                SgCheck( model->getBounds( bounds ) );
+
+                for ( int j = 0; j < 8; j++ )
+                    radius = maximum( radius, Vector<>( bounds[j & 1].x, bounds[( j >> 1 ) & 1].y, bounds[( j >> 2 ) & 1].z ).getLength() );
+            }
+
+            const Vector<> pos( getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ) );
+
+            names.add( name );
+            positions.add( pos );
+            nodes.add( scene->addModel( model, pos, Vector<>() ) );
+        }
+
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>(), Vector<>( 1.0f, 0.2f, 0.1f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        // Freshly built tree
+        checkCulling( driver, scene, names, positions, radius );
+
+        // Refitted tree: half of the nodes moved far from where the tree was built
+        for ( size_t i = 0; i < count; i += 2 )
+        {
+            positions[i] = Vector<>( getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ) );
+            nodes[i]->move( positions[i], true );
+        }
+
+        checkCulling( driver, scene, names, positions, radius );
+
+        // Moved and then rebuilt in the same frame
+        for ( size_t i = 1; i < count; i += 2 )
+        {
+            positions[i] = Vector<>( getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ), getRandom( seed, -60.0f, 60.0f ) );
+            nodes[i]->move( positions[i], true );
+        }
+
+        Reference<IModel> extra = driver->createCuboid( "extra", creationInfo, driver->getSolidMaterial(), IModel::fullStatic );
+
+        names.add( "extra" );
+        positions.add( Vector<>( 20.0f, 0.0f, 0.0f ) );
+        scene->addModel( extra, positions[count], Vector<>() );
+
+        checkCulling( driver, scene, names, positions, radius );
+
+        // Other views of the same tree
+        driver->setCamera( Vector<>( 10.0f, -20.0f, 5.0f ), Vector<>( -1.0f, 0.5f, 0.0f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+        checkCulling( driver, scene, names, positions, radius );
+
+        driver->setCamera( Vector<>( 0.0f, 0.0f, 80.0f ), Vector<>(), Vector<>( 0.0f, 1.0f, 0.0f ) );
+        checkCulling( driver, scene, names, positions, radius );
+    }
+
+    static size_t countCommands( NullDriver::NullDriver* driver, size_t start, NullDriver::CommandType type, const char* subject )
+    {
+        const List<NullDriver::Command>& commands = driver->getCommandLog();
+        size_t count = 0;
+
+        for ( size_t i = start; i < commands.getLength(); i++ )
+            if ( commands[i].type == type && commands[i].subject == subject )
+                count++;
+
+        return count;
+    }
+
+    static IPointLightNode* addShadowedLight( ISceneGraph* scene, const glm::vec3& pos )
+    {
+        PointLightProperties properties;
+
+        properties.ambient = Colour( 0.0f, 0.0f, 0.0f, 1.0f );
+        properties.diffuse = Colour( 1.0f, 1.0f, 1.0f, 1.0f );
+        properties.specular = Colour( 0.0f, 0.0f, 0.0f, 1.0f );
+        properties.direction = glm::vec3( 0.0f, 0.0f, -1.0f );
+        properties.pos = pos;
+        properties.range = 20.0f;
+
+        IPointLightNode* light = scene->addPointLight( properties, false, 90.0f, 64 );
+        light->setStatic( true );
+        return light;
+    }
+
+    SgTest( SceneGraph, shadowInvalidation )
+    {
+        Object<IEngine> sg = createHeadlessEngine( "Recording" );
+
+        NullDriver::NullDriver* driver = dynamic_cast<NullDriver::NullDriver*>( sg->getGraphicsDriver() );
+        SgCheck( driver != nullptr );
+
+        Object<ISceneGraph> scene = sg->createSceneGraph( "scene" );
+
+        // Two static casters far apart and one light that doesn't cast shadows at all
+        IPointLightNode* nearLight = addShadowedLight( scene, glm::vec3( 0.0f, 0.0f, 5.0f ) );
+        IPointLightNode* farLight = addShadowedLight( scene, glm::vec3( 100.0f, 0.0f, 5.0f ) );
+        IPointLightNode* unshadowed = addShadowedLight( scene, glm::vec3( 50.0f, 0.0f, 5.0f ) );
+        unshadowed->setCastsShadows( false );
+
+        CuboidCreationInfo2 creationInfo( Vector<>(), Vector<>( 1.0f, 1.0f, 1.0f ), Vector<>( 0.5f, 0.5f, 0.5f ), true );
+        Reference<IModel> model = driver->createCuboid( "box", creationInfo, driver->getSolidMaterial(), IModel::fullStatic );
+
+        IModelNode* node = scene->addModel( model, Vector<>( 0.0f, 0.0f, 0.0f ), Vector<>() );
+
+        // All three lights in view
+        driver->set3dMode( 1.0f, 1000.0f );
+        driver->setCamera( Vector<>( 50.0f, -150.0f, 50.0f ), Vector<>( 50.0f, 0.0f, 0.0f ), Vector<>( 0.0f, 0.0f, 1.0f ) );
+
+        SceneShadowStats stats;
+        size_t start;
+
+        // First frame: both casters get a map; the third light is bound the blank one
+        start = driver->getCommandLog().getLength();
+        scene->prerender();
+        scene->render();
+
+        scene->getShadowStats( &stats );
+        SgCheck( stats.numCasters == 2 && stats.numShadowed == 2 && stats.numUpdated == 2 );
+        SgCheck( nearLight->isShadowed() && farLight->isShadowed() && !unshadowed->isShadowed() );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap, "PointLightNode.depthTexture#0" ) == 1 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap, "PointLightNode.depthTexture#1" ) == 1 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap, "SceneGraph.blankShadowMap" ) == 1 );
+
+        // Nothing changed: both maps are reused
+        start = driver->getCommandLog().getLength();
+        scene->prerender();
+        scene->render();
+
+        scene->getShadowStats( &stats );
+        SgCheck( stats.numReused == 2 && stats.numUpdated == 0 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setRenderBuffer, "PointLightNode.depthTexture#0" ) == 0 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setRenderBuffer, "PointLightNode.depthTexture#1" ) == 0 );
+
+        // Moving or turning the box only invalidates the light whose range it's in
+        for ( int i = 0; i < 2; i++ )
+        {
+            if ( i == 0 )
+                node->move( Vector<>( 1.0f, 0.0f, 0.0f ) );
+            else
+                node->setYaw( 1.0f );
+
+            start = driver->getCommandLog().getLength();
+            scene->prerender();
+            scene->render();
+
+            scene->getShadowStats( &stats );
+            SgCheck( stats.numUpdated == 1 && stats.numReused == 1 );
+            SgCheck( countCommands( driver, start, NullDriver::CommandType::setRenderBuffer, "PointLightNode.depthTexture#0" ) == 1 );
+            SgCheck( countCommands( driver, start, NullDriver::CommandType::setRenderBuffer, "PointLightNode.depthTexture#1" ) == 0 );
+        }
+
+        // Moving it from one light to the other invalidates both; with room for a single update,
+        // the deferred light is bound the blank map instead of its stale one
+        node->move( Vector<>( 100.0f, 0.0f, 0.0f ), true );
+        scene->setShadowBudget( 4, 1 );
+
+        start = driver->getCommandLog().getLength();
+        scene->prerender();
+        scene->render();
+
+        scene->getShadowStats( &stats );
+        SgCheck( stats.numUpdated == 1 && stats.numDeferred == 1 && stats.numShadowed == 1 );
+        SgCheck( nearLight->isShadowed() != farLight->isShadowed() );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap, "SceneGraph.blankShadowMap" ) == 2 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap,
+                nearLight->isShadowed() ? "PointLightNode.depthTexture#1" : "PointLightNode.depthTexture#0" ) == 0 );
+
+        // The deferred one catches up on the next frame
+        start = driver->getCommandLog().getLength();
+        scene->prerender();
+        scene->render();
+
+        scene->getShadowStats( &stats );
+        SgCheck( stats.numUpdated == 1 && stats.numReused == 1 && stats.numShadowed == 2 );
+        SgCheck( countCommands( driver, start, NullDriver::CommandType::setShadowMap, "SceneGraph.blankShadowMap" ) == 1 );
+    }
+
+    SgBenchmark( SceneGraph, transformBench )
+    {
+        const size_t numNodes = maximum( getParameter( "count", 100000 ), 1 );
+        const unsigned numFrames = maximum( getParameter( "iterations", 100 ), 1 );
+        const size_t numMoving = minimum<size_t>( getParameter( "moving", ( int )( numNodes / 100 ) ), numNodes );
+
+        Object<IEngine> sg = createHeadlessEngine();
+        IGraphicsDriver* driver = sg->getGraphicsDriver();
+
+        Object<ISceneGraph> scene = sg->createSceneGraph( "scene" );
+
+        CuboidCreationInfo2 creationInfo( Vector<>(), Vector<>( 1.0f, 1.0f, 1.0f ), Vector<>( 0.5f, 0.5f, 0.5f ), true );
+        Reference<IModel> model = driver->createCuboid( "box", creationInfo, driver->getSolidMaterial(), IModel::fullStatic );
+
+        List<IModelNode*> nodes;
+        List<Transform> transforms;
+
+        for ( size_t i = 0; i < numNodes; i++ )
+        {
+            const Vector<> pos( ( float )( i % 1000 ), ( float )( i / 1000 ), 0.0f );
+
+            nodes.add( scene->addModel( model, pos, Vector<>( i * 0.01f, 0.0f, 0.0f ) ) );
+
+            transforms.add( Transform( Transform::rotate, Vector<>( 0.0f, 0.0f, 1.0f ), i * 0.01f ) );
+            transforms.add( Transform( Transform::rotate, Vector<>( 1.0f, 0.0f, 0.0f ), 0.0f ) );
+            transforms.add( Transform( Transform::rotate, Vector<>( 0.0f, 1.0f, 0.0f ), 0.0f ) );
+            transforms.add( Transform( Transform::translate, pos ) );
+        }
+
+        // Looking away from the nodes, so that the frame is mostly transform updates and culling
+        driver->set3dMode( 1.0f, 100.0f );
+        driver->setCamera( Vector<>( 0.0f, 0.0f, -10.0f ), Vector<>( 0.0f, 0.0f, -20.0f ), Vector<>( 0.0f, 1.0f, 0.0f ) );
+
+        scene->render();
+
+        uint64_t start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned frame = 0; frame < numFrames; frame++ )
+        {
+            // A different slice of the nodes moves every frame
+            for ( size_t i = 0; i < numMoving; i++ )
+            {
+                IModelNode* node = nodes[( frame * numMoving + i ) % numNodes];
+
+                node->move( Vector<>( 0.0f, 0.0f, 0.1f ) );
+                node->setYaw( frame * 0.01f );
+            }
+
+            scene->render();
+        }
+
+        const uint64_t frameTime = ( Timer::getRelativeMicroseconds() - start ) / numFrames;
+
+        // What every node used to pay on every draw: composing its four transforms
+        float checksum = 0.0f;
+
+        start = Timer::getRelativeMicroseconds();
+
+        for ( unsigned frame = 0; frame < numFrames; frame++ )
+            for ( size_t i = 0; i < numNodes; i++ )
+                checksum += Transform::compose( transforms.getPtr() + i * 4, 4 )[3][2];
+
+        const uint64_t recomposeTime = ( Timer::getRelativeMicroseconds() - start ) / numFrames;
+
+        printf( "SceneGraph.transformBench: %u of %u nodes moving, scene frame %u us, recomposing every node %u us per frame (%g)\n",
+                ( unsigned ) numMoving, ( unsigned ) numNodes, ( unsigned ) frameTime, ( unsigned ) recomposeTime, checksum );
+    }
+}
@@ -0,0 +1,113 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#pragma once
+
+#include <StormGraph/Engine.hpp>
+#include <StormGraph/IO/FileSystem.hpp>
+
+#include <littl/HashMap.hpp>
+#include <littl/List.hpp>
+
+/*
+ *  Minimal test & benchmark registry for the headless test executable.
+ *
+ *  Tests throw (through SgCheck) on failure and are listed in Tests/CMakeLists.txt for ctest.
+ *  Benchmarks are registered the same way, but only run when asked for by name.
+ */
+
+namespace Tests
+{
+    using namespace li;
+    using namespace StormGraph;
+
+    typedef void ( *TestFunction )();
+
+    struct Test
+    {
+        const char* name;
+        TestFunction function;
+        bool isBenchmark;
+    };
+
+    class TestRegistration
+    {
+        public:
+            TestRegistration( const char* name, TestFunction function, bool isBenchmark );
+    };
+
+    // Files kept in memory, so that loaders and resource managers can be exercised without anything on disk
+    class MemoryFileSystem : public IFileSystem
+    {
+        struct File
+        {
+            Array<uint8_t> data;
+            size_t size;
+
+            File( const void* data, size_t size ) : data( size ), size( size ) { memcpy( this->data.getPtr(), data, size ); }
+        };
+
+        HashMap<String, File*> files;
+        List<String> fileNames;
+
+        bool immutable;
+
+        protected:
+            virtual ~MemoryFileSystem();
+
+        public:
+            li_ReferencedClass_override( MemoryFileSystem )
+
+            // An immutable one promises that addFile is only called before it is mounted
+            MemoryFileSystem( bool immutable = false ) : immutable( immutable ) {}
+
+            void addFile( const char* name, const void* data, size_t size );
+
+            virtual bool isImmutable() override { return immutable; }
+            virtual unsigned listDirectory( const char* path, List<DirEntry>& entries ) override;
+            virtual SeekableInputStream* openInput( const char* fileName ) override;
+    };
+
+    void check( bool condition, const char* expression, const char* file, int line );
+
+    // Engine running on the headless driver ("Null" or "Recording") with the native file system mounted
+    IEngine* createHeadlessEngine( const char* driverName = "Null" );
+
+    // `name:value` command-line parameter, for sizing benchmarks (`count:1000000 iterations:10`)
+    int getParameter( const char* name, int defaultValue );
+
+    // Deterministic pseudo-random number in [min, max), for generating test data
+    float getRandom( uint32_t& seed, float min, float max );
+}
+
+#define SgTest( group_, name_ )\
+    static void group_##_##name_();\
+    static Tests::TestRegistration group_##_##name_##Registration( #group_ "." #name_, group_##_##name_, false );\
+    static void group_##_##name_()
+
+#define SgBenchmark( group_, name_ )\
+    static void group_##_##name_();\
+    static Tests::TestRegistration group_##_##name_##Registration( #group_ "." #name_, group_##_##name_, true );\
+    static void group_##_##name_()
+
+#define SgCheck( condition_ ) Tests::check( ( condition_ ), #condition_, __FILE__, __LINE__ )
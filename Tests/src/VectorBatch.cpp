@@ -0,0 +1,223 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/VectorBatch.hpp>
+#include <StormGraph/ViewFrustum.hpp>
+
+namespace Tests
+{
+    static void generateVectors( List<Vector<float>>& vectors, size_t count, uint32_t& seed )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            // Every 16th vector is zero, to cover the special case of normalize()
+            if ( i % 16 == 15 )
+                vectors.add( Vector<float>() );
+            else
+                vectors.add( Vector<float>( getRandom( seed, -100.0f, 100.0f ), getRandom( seed, -100.0f, 100.0f ), getRandom( seed, -100.0f, 100.0f ), getRandom( seed, 0.0f, 1.0f ) ) );
+        }
+    }
+
+    static void generateSpheres( List<float>& x, List<float>& y, List<float>& z, List<float>& radius, size_t count, uint32_t& seed )
+    {
+        for ( size_t i = 0; i < count; i++ )
+        {
+            x.add( getRandom( seed, -500.0f, 500.0f ) );
+            y.add( getRandom( seed, -500.0f, 500.0f ) );
+            z.add( getRandom( seed, -50.0f, 50.0f ) );
+            radius.add( getRandom( seed, 0.5f, 20.0f ) );
+        }
+    }
+
+    static glm::mat4 getTestMatrix()
+    {
+        glm::mat4 matrix;
+
+        matrix[0] = glm::vec4( 0.36f, 0.48f, -0.8f, 0.0f );
+        matrix[1] = glm::vec4( -0.8f, 0.6f, 0.0f, 0.0f );
+        matrix[2] = glm::vec4( 0.48f, 0.64f, 0.6f, 0.0f );
+        matrix[3] = glm::vec4( 10.0f, -20.0f, 5.0f, 1.0f );
+
+        return matrix;
+    }
+
+    static void getTestFrustum( ViewFrustum& frustum )
+    {
+        frustum.setProjection( 60.0f, 4.0f / 3.0f, 1.0f, 400.0f );
+        frustum.setView( Vector<float>( 0.0f, -300.0f, 20.0f ), Vector<float>( 0.0f, 0.0f, 0.0f ), Vector<float>( 0.0f, 0.0f, 1.0f ) );
+    }
+
+    static float getMaxDifference( const List<Vector<float>>& a, const List<Vector<float>>& b )
+    {
+        float maxDifference = 0.0f;
+
+        for ( size_t i = 0; i < a.getLength(); i++ )
+            for ( int axis = 0; axis < 4; axis++ )
+                maxDifference = maximum<float>( maxDifference, fabs( a[i].get( axis ) - b[i].get( axis ) ) );
+
+        return maxDifference;
+    }
+
+    SgTest( VectorBatch, scalarEquivalence )
+    {
+        // Not a multiple of four, so that the scalar tails of the SIMD kernels are covered too
+        static const size_t count = 10001;
+
+        uint32_t seed = 1;
+
+        List<Vector<float>> vectors, scalarVectors, batchVectors;
+        List<float> x, y, z, radius;
+
+        generateVectors( vectors, count, seed );
+        generateSpheres( x, y, z, radius, count, seed );
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            scalarVectors.add( Vector<float>() );
+            batchVectors.add( Vector<float>() );
+        }
+
+        const glm::mat4 matrix = getTestMatrix();
+
+        VectorBatch::transformPointsScalar( matrix, vectors.getPtrUnsafe(), scalarVectors.getPtrUnsafe(), count );
+        VectorBatch::transformPoints( matrix, vectors.getPtrUnsafe(), batchVectors.getPtrUnsafe(), count );
+
+        // Coordinates go up to about 200; the scalar code does the same operations in the same order
+        SgCheck( getMaxDifference( scalarVectors, batchVectors ) < 1.0e-4f );
+
+        VectorBatch::normalizeScalar( vectors.getPtrUnsafe(), scalarVectors.getPtrUnsafe(), count );
+        VectorBatch::normalize( vectors.getPtrUnsafe(), batchVectors.getPtrUnsafe(), count );
+
+        SgCheck( getMaxDifference( scalarVectors, batchVectors ) < 1.0e-6f );
+
+        for ( size_t i = 15; i < count; i += 16 )
+            SgCheck( batchVectors[i].x == 0.0f && batchVectors[i].y == 0.0f && batchVectors[i].z == 0.0f );
+
+        // In place
+        List<Vector<float>> inPlace;
+
+        for ( size_t i = 0; i < count; i++ )
+            inPlace.add( vectors[i] );
+
+        VectorBatch::normalize( inPlace.getPtrUnsafe(), inPlace.getPtrUnsafe(), count );
+        SgCheck( getMaxDifference( inPlace, batchVectors ) == 0.0f );
+
+        ViewFrustum frustum;
+        getTestFrustum( frustum );
+
+        Array<uint8_t> scalarClasses( count ), batchClasses( count );
+
+        VectorBatch::spheresInPlanesScalar( frustum.planes, lengthof( frustum.planes ), x.getPtrUnsafe(), y.getPtrUnsafe(), z.getPtrUnsafe(), radius.getPtrUnsafe(),
+                count, scalarClasses.getPtr() );
+        const size_t numBatchVisible = VectorBatch::spheresInPlanes( frustum.planes, lengthof( frustum.planes ), x.getPtrUnsafe(), y.getPtrUnsafe(), z.getPtrUnsafe(),
+                radius.getPtrUnsafe(), count, batchClasses.getPtr() );
+
+        size_t numVisible = 0;
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            // The distances are computed in the same order as Plane::pointDistance, so there is no rounding to allow for
+            SgCheck( scalarClasses[i] == batchClasses[i] );
+
+            if ( scalarClasses[i] != ViewFrustum::outside )
+                numVisible++;
+        }
+
+        SgCheck( numBatchVisible == numVisible );
+
+        // Both sides of the frustum are actually exercised
+        SgCheck( numVisible > 0 && numVisible < count );
+    }
+
+    SgBenchmark( VectorBatch, batchBench )
+    {
+        const size_t count = maximum( getParameter( "count", 1000000 ), 1 );
+        const unsigned iterations = maximum( getParameter( "iterations", 10 ), 1 );
+
+        uint32_t seed = 1;
+
+        List<Vector<float>> vectors, output;
+        List<float> x, y, z, radius;
+
+        generateVectors( vectors, count, seed );
+        generateSpheres( x, y, z, radius, count, seed );
+
+        for ( size_t i = 0; i < count; i++ )
+            output.add( Vector<float>() );
+
+        Array<uint8_t> classes( count );
+
+        const glm::mat4 matrix = getTestMatrix();
+
+        ViewFrustum frustum;
+        getTestFrustum( frustum );
+
+        static const char* kernels[] = { "transformPoints", "normalize", "spheresInPlanes" };
+
+        for ( int kernel = 0; kernel < 3; kernel++ )
+        {
+            uint64_t times[2];
+
+            for ( int batch = 0; batch < 2; batch++ )
+            {
+                const uint64_t start = Timer::getRelativeMicroseconds();
+
+                for ( unsigned iteration = 0; iteration < iterations; iteration++ )
+                {
+                    switch ( kernel )
+                    {
+                        case 0:
+                            if ( batch )
+                                VectorBatch::transformPoints( matrix, vectors.getPtrUnsafe(), output.getPtrUnsafe(), count );
+                            else
+                                VectorBatch::transformPointsScalar( matrix, vectors.getPtrUnsafe(), output.getPtrUnsafe(), count );
+                            break;
+
+                        case 1:
+                            if ( batch )
+                                VectorBatch::normalize( vectors.getPtrUnsafe(), output.getPtrUnsafe(), count );
+                            else
+                                VectorBatch::normalizeScalar( vectors.getPtrUnsafe(), output.getPtrUnsafe(), count );
+                            break;
+
+                        case 2:
+                            if ( batch )
+                                VectorBatch::spheresInPlanes( frustum.planes, lengthof( frustum.planes ), x.getPtrUnsafe(), y.getPtrUnsafe(), z.getPtrUnsafe(),
+                                        radius.getPtrUnsafe(), count, classes.getPtr() );
+                            else
+                                VectorBatch::spheresInPlanesScalar( frustum.planes, lengthof( frustum.planes ), x.getPtrUnsafe(), y.getPtrUnsafe(), z.getPtrUnsafe(),
+                                        radius.getPtrUnsafe(), count, classes.getPtr() );
+                            break;
+                    }
+                }
+
+                times[batch] = ( Timer::getRelativeMicroseconds() - start ) / iterations;
+            }
+
+            printf( "VectorBatch.batchBench: %s, %u items: scalar %u us, batch %u us\n", kernels[kernel], ( unsigned ) count,
+                    ( unsigned ) times[0], ( unsigned ) times[1] );
+        }
+    }
+}
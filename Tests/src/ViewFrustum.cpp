@@ -0,0 +1,238 @@
+/*
+    Copyright (c) 2011 Xeatheran Minexew
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+#include "Tests.hpp"
+
+#include <StormGraph/ViewFrustum.hpp>
+
+namespace Tests
+{
+    // Spheres and boxes around the same centres, in order along x as in a spatially sorted scene
+    struct CullingVolumes
+    {
+        List<float> x, y, z, radius, box[6];
+
+        CullingVolumes( size_t count )
+        {
+            uint32_t seed = 1;
+
+            for ( size_t i = 0; i < count; i++ )
+            {
+                const float center[3] = { -1000.0f + 2000.0f * i / count + getRandom( seed, -10.0f, 10.0f ), getRandom( seed, -1000.0f, 1000.0f ),
+                        getRandom( seed, -50.0f, 50.0f ) };
+
+                x.add( center[0] );
+                y.add( center[1] );
+                z.add( center[2] );
+                radius.add( getRandom( seed, 0.5f, 20.0f ) );
+
+                const float extents[3] = { getRandom( seed, 0.5f, 20.0f ), getRandom( seed, 0.5f, 20.0f ), getRandom( seed, 0.5f, 20.0f ) };
+
+                for ( int axis = 0; axis < 3; axis++ )
+                {
+                    box[axis].add( center[axis] - extents[axis] );
+                    box[axis + 3].add( center[axis] + extents[axis] );
+                }
+            }
+        }
+    };
+
+    static void getTestFrustum( ViewFrustum& frustum )
+    {
+        frustum.setProjection( 60.0f, 4.0f / 3.0f, 1.0f, 1000.0f );
+        frustum.setView( Vector<float>( 0.0f, -600.0f, 50.0f ), Vector<float>( 0.0f, 0.0f, 0.0f ), Vector<float>( 0.0f, 0.0f, 1.0f ) );
+    }
+
+    // The middle halves of the boxes that aren't outside, with their parents' plane masks
+    static void getChildBoxes( const List<float> boxes[6], const uint8_t* results, const uint8_t* planeMasks, List<float> children[6], List<uint8_t>& childMasks )
+    {
+        for ( size_t i = 0; i < boxes[0].getLength(); i++ )
+        {
+            if ( results[i] == ViewFrustum::outside )
+                continue;
+
+            for ( int axis = 0; axis < 3; axis++ )
+            {
+                const float quarter = ( boxes[axis + 3][i] - boxes[axis][i] ) * 0.25f;
+
+                children[axis].add( boxes[axis][i] + quarter );
+                children[axis + 3].add( boxes[axis + 3][i] - quarter );
+            }
+
+            childMasks.add( planeMasks[i] );
+        }
+    }
+
+    SgTest( ViewFrustum, batchCulling )
+    {
+        // Not a multiple of four, so that the scalar tails are covered too
+        static const size_t count = 10001;
+
+        CullingVolumes volumes( count );
+
+        ViewFrustum frustum;
+        getTestFrustum( frustum );
+
+        Array<uint8_t> results( count ), planeMasks( count );
+        size_t numVisible;
+
+        // Spheres
+        numVisible = 0;
+
+        for ( size_t i = 0; i < count; i++ )
+            if ( frustum.sphereInFrustum( Vector<float>( volumes.x[i], volumes.y[i], volumes.z[i] ), volumes.radius[i] ) != ViewFrustum::outside )
+                numVisible++;
+
+        SgCheck( numVisible > 0 && numVisible < count );
+        SgCheck( frustum.spheresInFrustum( volumes.x.getPtrUnsafe(), volumes.y.getPtrUnsafe(), volumes.z.getPtrUnsafe(), volumes.radius.getPtrUnsafe(), count,
+                results.getPtr() ) == numVisible );
+
+        for ( size_t i = 0; i < count; i++ )
+            SgCheck( results[i] == frustum.sphereInFrustum( Vector<float>( volumes.x[i], volumes.y[i], volumes.z[i] ), volumes.radius[i] ) );
+
+        // Boxes, with and without plane masks
+        for ( int masked = 0; masked < 2; masked++ )
+        {
+            for ( size_t i = 0; i < count; i++ )
+                planeMasks[i] = ViewFrustum::allPlanes;
+
+            frustum.boxesInFrustum( volumes.box[0].getPtrUnsafe(), volumes.box[1].getPtrUnsafe(), volumes.box[2].getPtrUnsafe(), volumes.box[3].getPtrUnsafe(),
+                    volumes.box[4].getPtrUnsafe(), volumes.box[5].getPtrUnsafe(), count, results.getPtr(), masked ? planeMasks.getPtr() : nullptr );
+
+            for ( size_t i = 0; i < count; i++ )
+            {
+                const Vector<float> min( volumes.box[0][i], volumes.box[1][i], volumes.box[2][i] ), max( volumes.box[3][i], volumes.box[4][i], volumes.box[5][i] );
+
+                SgCheck( results[i] == frustum.boxInFrustum( min, max ) );
+
+                // Only intersected volumes pass planes on to their children
+                if ( masked )
+                    SgCheck( ( planeMasks[i] != 0 ) == ( results[i] == ViewFrustum::intersect ) );
+            }
+        }
+
+        // Boxes nested in the previous ones, culled hierarchically
+        List<float> children[6];
+        List<uint8_t> childMasks;
+
+        getChildBoxes( volumes.box, results.getPtr(), planeMasks.getPtr(), children, childMasks );
+
+        const size_t numChildren = childMasks.getLength();
+        Array<uint8_t> childResults( numChildren );
+
+        numVisible = frustum.boxesInFrustum( children[0].getPtrUnsafe(), children[1].getPtrUnsafe(), children[2].getPtrUnsafe(), children[3].getPtrUnsafe(),
+                children[4].getPtrUnsafe(), children[5].getPtrUnsafe(), numChildren, childResults.getPtr(), childMasks.getPtrUnsafe() );
+
+        size_t numChildrenVisible = 0;
+
+        for ( size_t i = 0; i < numChildren; i++ )
+        {
+            const Vector<float> min( children[0][i], children[1][i], children[2][i] ), max( children[3][i], children[4][i], children[5][i] );
+            const ViewFrustum::TestResult result = frustum.boxInFrustum( min, max );
+
+            // Planes that the parent is inside of are skipped for the child, which must not change the result
+            SgCheck( childResults[i] == result );
+
+            if ( result != ViewFrustum::outside )
+                numChildrenVisible++;
+        }
+
+        SgCheck( numVisible == numChildrenVisible );
+    }
+
+    SgBenchmark( ViewFrustum, cullBench )
+    {
+        const size_t count = maximum( getParameter( "count", 1000000 ), 1 );
+        const unsigned iterations = maximum( getParameter( "iterations", 10 ), 1 );
+
+        CullingVolumes volumes( count );
+
+        ViewFrustum frustum;
+        getTestFrustum( frustum );
+
+        Array<uint8_t> results( count ), planeMasks( count );
+
+        for ( size_t i = 0; i < count; i++ )
+            planeMasks[i] = ViewFrustum::allPlanes;
+
+        frustum.boxesInFrustum( volumes.box[0].getPtrUnsafe(), volumes.box[1].getPtrUnsafe(), volumes.box[2].getPtrUnsafe(), volumes.box[3].getPtrUnsafe(),
+                volumes.box[4].getPtrUnsafe(), volumes.box[5].getPtrUnsafe(), count, results.getPtr(), planeMasks.getPtr() );
+
+        List<float> children[6];
+        List<uint8_t> childMasks, masks;
+
+        getChildBoxes( volumes.box, results.getPtr(), planeMasks.getPtr(), children, childMasks );
+
+        const size_t numChildren = childMasks.getLength();
+
+        for ( size_t i = 0; i < numChildren; i++ )
+            masks.add( 0 );
+
+        static const char* passes[] = { "spheres", "boxes", "nested boxes" };
+
+        for ( int pass = 0; pass < 3; pass++ )
+        {
+            const size_t numVolumes = ( pass == 2 ) ? numChildren : count;
+            List<float>* boxes = ( pass == 2 ) ? children : volumes.box;
+
+            uint64_t times[2];
+            size_t numVisible = 0;
+
+            for ( int batch = 0; batch < 2; batch++ )
+            {
+                const uint64_t start = Timer::getRelativeMicroseconds();
+
+                for ( unsigned iteration = 0; iteration < iterations; iteration++ )
+                {
+                    if ( pass == 0 && batch )
+                        numVisible = frustum.spheresInFrustum( volumes.x.getPtrUnsafe(), volumes.y.getPtrUnsafe(), volumes.z.getPtrUnsafe(),
+                                volumes.radius.getPtrUnsafe(), count, results.getPtr() );
+                    else if ( pass == 0 )
+                    {
+                        for ( size_t i = 0; i < count; i++ )
+                            results[i] = frustum.sphereInFrustum( Vector<float>( volumes.x[i], volumes.y[i], volumes.z[i] ), volumes.radius[i] );
+                    }
+                    else if ( batch )
+                    {
+                        // The plane masks are consumed by the test, so the children get a fresh copy every time
+                        if ( pass == 2 )
+                            memcpy( masks.getPtrUnsafe(), childMasks.getPtrUnsafe(), numVolumes );
+
+                        numVisible = frustum.boxesInFrustum( boxes[0].getPtrUnsafe(), boxes[1].getPtrUnsafe(), boxes[2].getPtrUnsafe(), boxes[3].getPtrUnsafe(),
+                                boxes[4].getPtrUnsafe(), boxes[5].getPtrUnsafe(), numVolumes, results.getPtr(), ( pass == 2 ) ? masks.getPtrUnsafe() : nullptr );
+                    }
+                    else
+                    {
+                        for ( size_t i = 0; i < numVolumes; i++ )
+                            results[i] = frustum.boxInFrustum( Vector<float>( boxes[0][i], boxes[1][i], boxes[2][i] ), Vector<float>( boxes[3][i], boxes[4][i], boxes[5][i] ) );
+                    }
+                }
+
+                times[batch] = ( Timer::getRelativeMicroseconds() - start ) / iterations;
+            }
+
+            printf( "ViewFrustum.cullBench: %s, %u of %u visible: single %u us, batch %u us\n", passes[pass], ( unsigned ) numVisible, ( unsigned ) numVolumes,
+                    ( unsigned ) times[0], ( unsigned ) times[1] );
+        }
+    }
+}